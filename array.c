@@ -0,0 +1,314 @@
+#include "array.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define ARRAY_SIMD
+#include <immintrin.h>
+#endif
+
+#pragma region Storage
+
+// Integers are kept unboxed as long as the conversion to double is exact
+static bool unboxed_value(LiteralExpr value, double* out){
+    if (value.type == NUM_T){
+        *out = value.as.number;
+        return true;
+    }
+    if (value.type == INT_T && value.as.integer >= -(1LL << 53) && value.as.integer <= (1LL << 53)){
+        *out = (double)value.as.integer;
+        return true;
+    }
+    return false;
+}
+
+// the unboxed storage holds one kind of number, an empty array takes whichever comes first
+static bool fits_unboxed(Array* array, LiteralExpr value, double* out){
+    if (!unboxed_value(value, out)) return false;
+    if (array->count == 0) array->integral = value.type == INT_T;
+    return array->integral == (value.type == INT_T);
+}
+
+Array* create_array(size_t capacity){
+    Array* array = (Array*)mem_alloc(MEM_ARRAYS, sizeof(Array));
+    if (capacity < INITIAL_ARRAY_SIZE) capacity = INITIAL_ARRAY_SIZE;
+    if (array != NULL) array->as.numbers = (double*)mem_alloc(MEM_ARRAYS, sizeof(double) * capacity);
+    if (array == NULL || array->as.numbers == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for array");
+        exit(1);
+    }
+    array->count = 0;
+    array->capacity = capacity;
+    array->boxed = false;
+    array->integral = true;
+    return array;
+}
+
+Array* copy_array(Array* array){
+    Array* copy = (Array*)mem_alloc(MEM_ARRAYS, sizeof(Array));
+    size_t elem = array->boxed ? sizeof(LiteralExpr) : sizeof(double);
+    size_t capacity = array->count < INITIAL_ARRAY_SIZE ? INITIAL_ARRAY_SIZE : array->count;
+    if (copy != NULL) copy->as.numbers = (double*)mem_alloc(MEM_ARRAYS, elem * capacity);
+    if (copy == NULL || copy->as.numbers == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for array");
+        exit(1);
+    }
+    memcpy(copy->as.numbers, array->as.numbers, elem * array->count);
+    copy->count = array->count;
+    copy->capacity = capacity;
+    copy->boxed = array->boxed;
+    copy->integral = array->integral;
+    return copy;
+}
+
+void free_array(Array* array){
+    mem_free(MEM_ARRAYS, array->as.numbers);
+    mem_free(MEM_ARRAYS, array);
+}
+
+static void box(Array* array){
+    // array_get still reads the unboxed storage while the values are built
+    LiteralExpr* values = (LiteralExpr*)mem_alloc(MEM_ARRAYS, sizeof(LiteralExpr) * array->capacity);
+    if (values == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for array");
+        exit(1);
+    }
+    for (size_t i = 0; i < array->count; i++){
+        values[i] = array_get(array, i);
+    }
+    mem_free(MEM_ARRAYS, array->as.numbers);
+    array->as.values = values;
+    array->boxed = true;
+    array->integral = false;
+}
+
+bool array_unbox(Array* array){
+    if (!array->boxed) return true;
+    double number = 0;
+    bool integral = array->count == 0 || array->as.values[0].type == INT_T;
+    for (size_t i = 0; i < array->count; i++){
+        if (!unboxed_value(array->as.values[i], &number)) return false;
+        if ((array->as.values[i].type == INT_T) != integral) return false;
+    }
+    double* numbers = (double*)mem_alloc(MEM_ARRAYS, sizeof(double) * array->capacity);
+    if (numbers == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for array");
+        exit(1);
+    }
+    for (size_t i = 0; i < array->count; i++) unboxed_value(array->as.values[i], &numbers[i]);
+    mem_free(MEM_ARRAYS, array->as.values);
+    array->as.numbers = numbers;
+    array->boxed = false;
+    array->integral = integral;
+    return true;
+}
+
+void array_push(Array* array, LiteralExpr value){
+    double number = 0;
+    if (!array->boxed && !fits_unboxed(array, value, &number)) box(array);
+    if (array->count == array->capacity){
+        array->capacity *= 2;
+        size_t elem = array->boxed ? sizeof(LiteralExpr) : sizeof(double);
+        array->as.numbers = mem_realloc(MEM_ARRAYS, array->as.numbers, elem * array->capacity);
+        if (array->as.numbers == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't reallocate memory for array");
+            exit(1);
+        }
+    }
+    if (array->boxed) array->as.values[array->count++] = value;
+    else array->as.numbers[array->count++] = number;
+}
+
+LiteralExpr array_get(Array* array, size_t i){
+    if (array->boxed) return array->as.values[i];
+    if (array->integral) return (LiteralExpr){ .type = INT_T, .as.integer = (int64_t)array->as.numbers[i] };
+    return (LiteralExpr){ .type = NUM_T, .as.number = array->as.numbers[i] };
+}
+
+void array_set(Array* array, size_t i, LiteralExpr value){
+    double number = 0;
+    if (!array->boxed && !fits_unboxed(array, value, &number)) box(array);
+    if (array->boxed) array->as.values[i] = value;
+    else array->as.numbers[i] = number;
+}
+
+#pragma endregion Storage
+
+#pragma region Kernels
+
+static double sum_scalar(const double* a, size_t n){
+    double s = 0;
+    for (size_t i = 0; i < n; i++) s += a[i];
+    return s;
+}
+
+static double dot_scalar(const double* a, const double* b, size_t n){
+    double s = 0;
+    for (size_t i = 0; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+static double min_scalar(const double* a, size_t n, double m){
+    for (size_t i = 0; i < n; i++) m = a[i] < m ? a[i] : m;
+    return m;
+}
+
+static double max_scalar(const double* a, size_t n, double m){
+    for (size_t i = 0; i < n; i++) m = a[i] > m ? a[i] : m;
+    return m;
+}
+
+#ifdef ARRAY_SIMD
+
+static double hsum2(__m128d v){
+    double lanes[2];
+    _mm_storeu_pd(lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+__attribute__((target("avx2")))
+static double hsum4(__m256d v){
+    return hsum2(_mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1)));
+}
+
+static double sum_sse2(const double* a, size_t n){
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    }
+    return hsum2(_mm_add_pd(s0, s1)) + sum_scalar(a + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double sum_avx2(const double* a, size_t n){
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+    }
+    return hsum4(_mm256_add_pd(s0, s1)) + sum_scalar(a + i, n - i);
+}
+
+static double dot_sse2(const double* a, const double* b, size_t n){
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    return hsum2(_mm_add_pd(s0, s1)) + dot_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double dot_avx2(const double* a, const double* b, size_t n){
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    return hsum4(_mm256_add_pd(s0, s1)) + dot_scalar(a + i, b + i, n - i);
+}
+
+static double min_sse2(const double* a, size_t n){
+    __m128d m = _mm_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) m = _mm_min_pd(m, _mm_loadu_pd(a + i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, m);
+    return min_scalar(a + i, n - i, lanes[0] < lanes[1] ? lanes[0] : lanes[1]);
+}
+
+__attribute__((target("avx2")))
+static double min_avx2(const double* a, size_t n){
+    __m256d m = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) m = _mm256_min_pd(m, _mm256_loadu_pd(a + i));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    return min_scalar(a + i, n - i, min_scalar(lanes, 4, lanes[0]));
+}
+
+static double max_sse2(const double* a, size_t n){
+    __m128d m = _mm_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) m = _mm_max_pd(m, _mm_loadu_pd(a + i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, m);
+    return max_scalar(a + i, n - i, lanes[0] > lanes[1] ? lanes[0] : lanes[1]);
+}
+
+__attribute__((target("avx2")))
+static double max_avx2(const double* a, size_t n){
+    __m256d m = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) m = _mm256_max_pd(m, _mm256_loadu_pd(a + i));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    return max_scalar(a + i, n - i, max_scalar(lanes, 4, lanes[0]));
+}
+
+static void scale_sse2(double* dst, const double* a, double k, size_t n){
+    __m128d kk = _mm_set1_pd(k);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), kk));
+    for (; i < n; i++) dst[i] = a[i] * k;
+}
+
+__attribute__((target("avx2")))
+static void scale_avx2(double* dst, const double* a, double k, size_t n){
+    __m256d kk = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), kk));
+    for (; i < n; i++) dst[i] = a[i] * k;
+}
+
+static void add_sse2(double* dst, const double* a, const double* b, size_t n){
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    for (; i < n; i++) dst[i] = a[i] + b[i];
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(double* dst, const double* a, const double* b, size_t n){
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    for (; i < n; i++) dst[i] = a[i] + b[i];
+}
+
+#define HAS_AVX2 __builtin_cpu_supports("avx2")
+
+double vec_sum(const double* a, size_t n){ return HAS_AVX2 ? sum_avx2(a, n) : sum_sse2(a, n); }
+double vec_dot(const double* a, const double* b, size_t n){ return HAS_AVX2 ? dot_avx2(a, b, n) : dot_sse2(a, b, n); }
+double vec_min(const double* a, size_t n){ return HAS_AVX2 ? min_avx2(a, n) : min_sse2(a, n); }
+double vec_max(const double* a, size_t n){ return HAS_AVX2 ? max_avx2(a, n) : max_sse2(a, n); }
+
+void vec_scale(double* dst, const double* a, double k, size_t n){
+    if (HAS_AVX2) scale_avx2(dst, a, k, n);
+    else scale_sse2(dst, a, k, n);
+}
+
+void vec_add(double* dst, const double* a, const double* b, size_t n){
+    if (HAS_AVX2) add_avx2(dst, a, b, n);
+    else add_sse2(dst, a, b, n);
+}
+
+#else
+
+double vec_sum(const double* a, size_t n){ return sum_scalar(a, n); }
+double vec_dot(const double* a, const double* b, size_t n){ return dot_scalar(a, b, n); }
+double vec_min(const double* a, size_t n){ return min_scalar(a, n, a[0]); }
+double vec_max(const double* a, size_t n){ return max_scalar(a, n, a[0]); }
+
+void vec_scale(double* dst, const double* a, double k, size_t n){
+    for (size_t i = 0; i < n; i++) dst[i] = a[i] * k;
+}
+
+void vec_add(double* dst, const double* a, const double* b, size_t n){
+    for (size_t i = 0; i < n; i++) dst[i] = a[i] + b[i];
+}
+
+#endif
+
+#pragma endregion Kernels
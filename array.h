@@ -0,0 +1,43 @@
+#ifndef _ARRAY_H
+#define _ARRAY_H
+
+#include "parser.h"
+
+#define INITIAL_ARRAY_SIZE 8
+
+// Growable array value. As long as every element is a number of the same kind they are
+// kept unboxed in 'numbers', which is what the vectorised numeric builtins run over.
+// Integers are stored there as doubles too, 'integral' remembers to hand them back as
+// integers. Mixing integers with floats, or integers beyond 2^53, boxes the array, so
+// every element reads back with its own type.
+struct Array {
+    size_t count;
+    size_t capacity;
+    bool boxed;
+    bool integral;      // unboxed and every element is an integer, not a float
+    union {
+        double* numbers;
+        LiteralExpr* values;
+    } as;
+};
+
+Array* create_array(size_t capacity);
+void free_array(Array* array);
+// the same elements in new storage, arrays and maps among them are shared
+Array* copy_array(Array* array);
+
+void array_push(Array* array, LiteralExpr value);
+LiteralExpr array_get(Array* array, size_t i);
+void array_set(Array* array, size_t i, LiteralExpr value);
+// true if the elements are all integers or all floats, the array is stored unboxed afterwards
+bool array_unbox(Array* array);
+
+// kernels over unboxed storage, SSE2/AVX2 on x86 with a scalar fallback
+double vec_sum(const double* a, size_t n);
+double vec_min(const double* a, size_t n);
+double vec_max(const double* a, size_t n);
+double vec_dot(const double* a, const double* b, size_t n);
+void vec_scale(double* dst, const double* a, double k, size_t n);
+void vec_add(double* dst, const double* a, const double* b, size_t n);
+
+#endif // _ARRAY_H
@@ -0,0 +1,84 @@
+// Streams a generated CSV log through the file builtins and reports MB/s next to
+// `wc -l` over the same file. The file is written first, so it is read from the page cache.
+// usage: io_bench [megabytes]   (default 256)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../plang.h"
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    const char* name;
+    const char* source;     // reads or writes the file named by PATH, leaves a count in 'result'
+} Job;
+
+static const Job jobs[] = {
+    { "count lines", "var result = 0; for (var l in lines(PATH)) result = result + 1;" },
+    { "filter lines", "var result = 0; for (var l in lines(PATH)) if (indexOf(l, \"ERROR\") >= 0) result = result + 1;" },
+    { "group by field", "var levels = {}; var result = 0;"
+                        "for (var l in lines(PATH)) { var level = substr(l, 20, 5);"
+                        "  if (!has(levels, level)) { levels[level] = 0; result = result + 1; }"
+                        "  levels[level] = levels[level] + 1; }" },
+    { "4 KiB records", "var result = 0; for (var r in records(PATH, 4096)) result = result + 1;" },
+    { "copy lines", "var w = writer(OUT); var result = 0;"
+                    "for (var l in lines(PATH)) { write(w, l); result = result + 1; } close(w);" },
+};
+
+static double run(const Job* job, const char* path, const char* out, double* result){
+    PlangProgram* program = plang_compile(job->source, NULL, NULL);
+    if (program == NULL) exit(1);
+    PlangEnv* env = plang_env_new();
+    plang_set_string(env, "PATH", path);
+    plang_set_string(env, "OUT", out);
+    double t0 = now();
+    if (plang_run(program, env) != 0) exit(1);
+    double elapsed = now() - t0;
+    PlangValue value;
+    *result = plang_get(env, "result", &value) && value.type == PLANG_NUMBER ? value.as.number : 0;
+    plang_env_free(env);
+    plang_free_program(program);
+    return elapsed;
+}
+
+int main(int argc, char** argv){
+    double megabytes = argc > 1 ? strtod(argv[1], NULL) : 256;
+    char path[] = "/tmp/io_bench_XXXXXX";
+    char out[] = "/tmp/io_bench_out_XXXXXX";
+    int fd = mkstemp(path), out_fd = mkstemp(out);
+    if (fd < 0 || out_fd < 0) return 1;
+    close(out_fd);
+    FILE* f = fdopen(fd, "w");
+    static const char* levels[] = { "INFO ", "DEBUG", "WARN ", "ERROR" };
+    size_t size = 0;
+    srand(1);
+    for (size_t i = 0; size < megabytes * 1e6; i++){
+        int n = fprintf(f, "2024-01-01T00:%02zu:%02zu %s,request %zu,user%d,%d ms\n",
+            i / 60 % 60, i % 60, levels[rand() % 4], i, rand() % 1000, rand() % 5000);
+        size += (size_t)n;
+    }
+    fclose(f);
+    double mb = size / 1e6;
+
+    char command[128];
+    snprintf(command, sizeof(command), "wc -l < %s > /dev/null", path);
+    double t0 = now();
+    if (system(command) != 0) return 1;
+    double base = now() - t0;
+    printf("%-16s %8.3fs  %8.1f MB/s\n", "wc -l", base, mb / base);
+    for (size_t i = 0; i < sizeof(jobs) / sizeof(jobs[0]); i++){
+        double result;
+        double elapsed = run(&jobs[i], path, out, &result);
+        printf("%-16s %8.3fs  %8.1f MB/s  %5.2fx wc -l  result %.0f\n", jobs[i].name, elapsed, mb / elapsed, base / elapsed, result);
+    }
+    unlink(path);
+    unlink(out);
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Numeric loop kernels run with the loop JIT enabled and disabled.
+// usage: jit_bench [iterations]   (default 5000000)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../plang.h"
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    const char* name;
+    const char* source;     // runs N iterations and leaves its result in 'result'
+} Kernel;
+
+static const Kernel kernels[] = {
+    { "int sum", "var result = 0; var i = 0;"
+        "while (i < N) { result = result + i * i % 7; i = i + 1; }" },
+    { "leibniz", "var result = 0.0; var sign = 1.0; var k = 0;"
+        "while (k < N) { result = result + sign / (2 * k + 1); sign = -sign; k = k + 1; }" },
+    { "nested", "var result = 0; var side = 1; var a = 0; var b = 0;"
+        "while (side * side < N) side = side + 1;"
+        "while (a < side) { b = 0; while (b < side) { result = result + (a > b ? a - b : b - a); b = b + 1; } a = a + 1; }" },
+    { "collatz", "var result = 0; var n = 1; var x = 0;"
+        "while (n < N / 100) { x = n; while (x != 1) { if (x % 2 == 0) x = x / 2; else x = 3 * x + 1; result = result + 1; } n = n + 1; }" },
+};
+
+static double run(const PlangProgram* program, double n, bool jit, double* result){
+    PlangEnv* env = plang_env_new();
+    plang_env_set_jit(env, jit);
+    plang_set_number(env, "N", n);
+    double t0 = now();
+    if (plang_run(program, env) != 0) exit(1);
+    double elapsed = now() - t0;
+    PlangValue value;
+    *result = plang_get(env, "result", &value) && value.type == PLANG_NUMBER ? value.as.number : 0;
+    plang_env_free(env);
+    return elapsed;
+}
+
+int main(int argc, char** argv){
+    double n = argc > 1 ? strtod(argv[1], NULL) : 5000000;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++){
+        PlangProgram* program = plang_compile(kernels[i].source, NULL, NULL);
+        if (program == NULL) return 1;
+        double off_result, on_result;
+        double off = run(program, n, false, &off_result);
+        double on = run(program, n, true, &on_result);
+        printf("%-8s interpreter %8.3fs  jit %8.3fs  %6.1fx%s\n", kernels[i].name, off, on, off / on,
+            off_result == on_result ? "" : "  (RESULTS DIFFER)");
+        plang_free_program(program);
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Insert and lookup throughput of the map value type.
+// usage: map_bench [max_entries]   (default 10000000)
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "../map.h"
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(size_t n, LiteralExpr* keys, const char* kind){
+    // small maps are rebuilt until roughly ten million operations have run
+    size_t rounds = n >= 10000000 ? 1 : 10000000 / n;
+    double insert = 0, lookup = 0;
+    size_t found = 0;
+    for (size_t r = 0; r < rounds; r++){
+        Map* map = create_map(0);
+        double t0 = now();
+        for (size_t i = 0; i < n; i++) map_set(map, keys[i], keys[i]);
+        double t1 = now();
+        LiteralExpr value;
+        for (size_t i = 0; i < n; i++) found += map_get(map, keys[(i * 7919) % n], &value);
+        double t2 = now();
+        insert += t1 - t0;
+        lookup += t2 - t1;
+        free_map(map);
+    }
+    double ops = (double)n * rounds;
+    printf("%-8s %9zu entries  insert %7.2f Mops/s  lookup %7.2f Mops/s%s\n", kind, n,
+        ops / insert / 1e6, ops / lookup / 1e6, found == n * rounds ? "" : "  (MISSING KEYS)");
+}
+
+int main(int argc, char** argv){
+    size_t max = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    size_t sizes[] = { 1000, 1000000, 10000000 };
+
+    LiteralExpr* keys = (LiteralExpr*)malloc(sizeof(LiteralExpr) * max);
+    char* text = (char*)malloc(max * 24);
+    if (keys == NULL || text == NULL) return 1;
+
+    for (size_t i = 0; i < max; i++) keys[i] = (LiteralExpr){ .type = INT_T, .as.integer = (int64_t)i };
+    for (size_t s = 0; s < 3 && sizes[s] <= max; s++) run(sizes[s], keys, "integer");
+
+    for (size_t i = 0; i < max; i++){
+        snprintf(text + i * 24, 24, "key%zu", i);
+        keys[i] = (LiteralExpr){ .type = STR_T, .as.string = text + i * 24 };
+    }
+    for (size_t s = 0; s < 3 && sizes[s] <= max; s++) run(sizes[s], keys, "string");
+
+    free(keys);
+    free(text);
+    return 0;
+}
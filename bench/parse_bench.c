@@ -0,0 +1,102 @@
+// Parse throughput on a large generated file of expression-heavy statements.
+// usage: parse_bench [megabytes] [--stack-parse]   (default 8)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../tokenizer.h"
+#include "../parser.h"
+
+#define ROUNDS 5
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long state = 88172645463325252ULL;
+
+static unsigned next(unsigned n){
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (unsigned)(state % n);
+}
+
+static const char* binary_ops[] = { "+", "-", "*", "/", "%", "<", "<=", ">", ">=", "==", "!=", "and", "or" };
+
+static size_t operand(char* out, int depth){
+    static const char* leaves[] = { "a", "b", "count", "1", "42", "2.5", "\"text\"", "true", "nil", "x[i]", "f(a)" };
+    if (depth > 3 || next(3) == 0) return sprintf(out, "%s", leaves[next(sizeof(leaves) / sizeof(leaves[0]))]);
+    size_t n = 0;
+    switch (next(7))
+    {
+    case 0: n += sprintf(out, "-"); n += operand(out + n, depth + 1); break;
+    case 1: n += sprintf(out, "("); n += operand(out + n, depth + 1); n += sprintf(out + n, ")"); break;
+    case 2: n += sprintf(out, "f("); n += operand(out + n, depth + 1); n += sprintf(out + n, ", ");
+            n += operand(out + n, depth + 1); n += sprintf(out + n, ")"); break;
+    case 3: n += sprintf(out, "["); n += operand(out + n, depth + 1); n += sprintf(out + n, ", ");
+            n += operand(out + n, depth + 1); n += sprintf(out + n, "]"); break;
+    case 4: n += operand(out, depth + 1); n += sprintf(out + n, " ? "); n += operand(out + n, depth + 1);
+            n += sprintf(out + n, " : "); n += operand(out + n, depth + 1); break;
+    default:
+        n += operand(out, depth + 1);
+        for (unsigned k = next(4); k < 4; k++){
+            n += sprintf(out + n, " %s ", binary_ops[next(sizeof(binary_ops) / sizeof(binary_ops[0]))]);
+            n += operand(out + n, depth + 1);
+        }
+    }
+    return n;
+}
+
+// one statement per line, every one of them an assignment of a generated expression
+static char* generate(size_t size){
+    char* text = (char*)malloc(size + 4096);
+    size_t len = 0;
+    while (len < size){
+        len += sprintf(text + len, "v%u = ", next(100));
+        len += operand(text + len, 0);
+        len += sprintf(text + len, ";\n");
+    }
+    text[len] = '\0';
+    return text;
+}
+
+int main(int argc, char** argv){
+    size_t megabytes = 8;
+    bool stack_parse = false;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--stack-parse") == 0) stack_parse = true;
+        else megabytes = strtoull(argv[i], NULL, 10);
+    }
+    char* text = generate(megabytes << 20);
+    size_t bytes = strlen(text);
+
+    Context ctx = create_context(stdout, stderr);
+    ctx.stack_parse = stack_parse;
+    Tokenizer* tokenizer = create_tokenizer(&ctx, text);
+    tokenize(tokenizer);
+    Parser* parser = create_parser(tokenizer);
+
+    double best = 0;
+    size_t statements = 0;
+    for (int r = 0; r < ROUNDS; r++){
+        double t0 = now();
+        parse(parser);
+        double elapsed = now() - t0;
+        if (r == 0 || elapsed < best) best = elapsed;
+        statements = parser->stmt_list->index;
+        free_stmt_list(parser->stmt_list);
+        reset_parser(parser);
+    }
+    printf("%s parser  %6.1f MB  %9zu tokens  %8zu statements  %8.3fs  %7.1f MB/s  %6.1f Mtokens/s%s\n",
+        stack_parse ? "stack" : "pratt", bytes / 1048576.0, tokenizer->list_index, statements, best,
+        bytes / best / 1048576.0, tokenizer->list_index / best / 1e6, ctx.hadError ? "  (PARSE ERRORS)" : "");
+
+    free_parser(parser);
+    free_tokenizer(tokenizer);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Splits one loop into spawned tasks and joins them, with 1 up to all cores as workers.
+// The pool is sized once per process, so every worker count runs in a forked child.
+// The joining thread runs tasks too, so 1 worker means two threads at work.
+// usage: spawn_bench [iterations] [tasks]   (default 20000000, 64)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../plang.h"
+#include "../task.h"
+
+static const char* source =
+    "var tasks = []; var k = 0;"
+    "while (k < K) {"
+    "  push(tasks, spawn { var s = 0; var i = k * (N / K); var end = i + N / K;"
+    "    while (i < end) { s = s + i * 0.5; i = i + 1; } s; });"
+    "  k = k + 1;"
+    "}"
+    "var result = 0; k = 0;"
+    "while (k < K) { result = result + join tasks[k]; k = k + 1; }";
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the loops are interpreted, with the JIT the tasks end before they are stolen
+static double run(int workers, double n, double k, double* result){
+    task_workers(workers);
+    PlangProgram* program = plang_compile(source, NULL, NULL);
+    if (program == NULL) exit(1);
+    PlangEnv* env = plang_env_new();
+    plang_env_set_jit(env, false);
+    plang_set_number(env, "N", n);
+    plang_set_number(env, "K", k);
+    double t0 = now();
+    if (plang_run(program, env) != 0) exit(1);
+    double elapsed = now() - t0;
+    PlangValue value;
+    *result = plang_get(env, "result", &value) && value.type == PLANG_NUMBER ? value.as.number : 0;
+    plang_env_free(env);
+    plang_free_program(program);
+    return elapsed;
+}
+
+int main(int argc, char** argv){
+    double n = argc > 1 ? strtod(argv[1], NULL) : 20000000;
+    double k = argc > 2 ? strtod(argv[2], NULL) : 64;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    double base = 0;
+    for (int workers = 1;; workers = workers * 2 < cores ? workers * 2 : (int)cores){
+        int fds[2];
+        if (pipe(fds) != 0) return 1;
+        pid_t child = fork();
+        if (child < 0) return 1;
+        if (child == 0){
+            double times[2];
+            times[0] = run(workers, n, k, &times[1]);
+            if (write(fds[1], times, sizeof(times)) != sizeof(times)) _exit(1);
+            _exit(0);
+        }
+        close(fds[1]);
+        double times[2];
+        bool ok = read(fds[0], times, sizeof(times)) == sizeof(times);
+        close(fds[0]);
+        int status;
+        waitpid(child, &status, 0);
+        if (!ok) return 1;
+        if (base == 0) base = times[0];
+        printf("%3d workers %8.3fs  %5.2fx  result %.0f\n", workers, times[0], base / times[0], times[1]);
+        if (workers == cores) break;
+    }
+    return 0;
+}
@@ -0,0 +1,485 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "builtins.h"
+#include "array.h"
+#include "map.h"
+#include "io.h"
+
+static LiteralExpr nil_obj(){
+    return (LiteralExpr){ .type = NIL_T };
+}
+
+static LiteralExpr num_obj(double num){
+    return (LiteralExpr){ .type = NUM_T, .as.number = num };
+}
+
+static LiteralExpr int_obj(int64_t num){
+    return (LiteralExpr){ .type = INT_T, .as.integer = num };
+}
+
+// results of kernels over integer arrays go back to integers when they are still whole
+static LiteralExpr result_obj(Array* array, double num){
+    int64_t whole;
+    if (array->integral && integral_value(num, &whole)) return int_obj(whole);
+    return num_obj(num);
+}
+
+static LiteralExpr array_obj(Array* array){
+    return (LiteralExpr){ .type = ARR_T, .as.array = array };
+}
+
+static double number_of(LiteralExpr value){
+    return value.type == INT_T ? (double)value.as.integer : value.as.number;
+}
+
+// '+', '*' and '<' on two numbers, integers only turn into floats on overflow
+static LiteralExpr add_numbers(LiteralExpr a, LiteralExpr b){
+    int64_t res;
+    if (a.type == INT_T && b.type == INT_T && !__builtin_add_overflow(a.as.integer, b.as.integer, &res)) return int_obj(res);
+    return num_obj(number_of(a) + number_of(b));
+}
+
+static LiteralExpr mul_numbers(LiteralExpr a, LiteralExpr b){
+    int64_t res;
+    if (a.type == INT_T && b.type == INT_T && !__builtin_mul_overflow(a.as.integer, b.as.integer, &res)) return int_obj(res);
+    return num_obj(number_of(a) * number_of(b));
+}
+
+static bool less_numbers(LiteralExpr a, LiteralExpr b){
+    if (a.type == INT_T && b.type == INT_T) return a.as.integer < b.as.integer;
+    return number_of(a) < number_of(b);
+}
+
+// Checks that the argument is an array holding only numbers. Arrays of one kind of number
+// are left unboxed for the kernels, the others stay boxed.
+static bool expect_numbers(Context* ctx, Token* paren, const char* name, LiteralExpr arg){
+    bool numbers = arg.type == ARR_T;
+    if (numbers && !array_unbox(arg.as.array)){
+        Array* array = arg.as.array;
+        for (size_t i = 0; i < array->count && numbers; i++){
+            numbers = array->as.values[i].type == INT_T || array->as.values[i].type == NUM_T;
+        }
+    }
+    if (!numbers){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin '%s' expects an array of numbers", name);
+        return false;
+    }
+    return true;
+}
+
+static bool expect_same_length(Context* ctx, Token* paren, const char* name, Array* a, Array* b){
+    if (a->count != b->count){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin '%s' expects arrays of equal length, but got %zu and %zu", name, a->count, b->count);
+        return false;
+    }
+    return true;
+}
+
+static LiteralExpr builtin_len(Context* ctx, Token* paren, LiteralExpr* args){
+    if (args[0].type == ARR_T) return int_obj((int64_t)args[0].as.array->count);
+    if (args[0].type == MAP_T) return int_obj((int64_t)args[0].as.map->count);
+    if (args[0].type == STR_T) return int_obj((int64_t)string_length(&args[0]));
+    plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin 'len' expects an array, map or string");
+    return nil_obj();
+}
+
+static LiteralExpr builtin_push(Context* ctx, Token* paren, LiteralExpr* args){
+    if (args[0].type != ARR_T){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin 'push' expects an array");
+        return nil_obj();
+    }
+    array_push(args[0].as.array, keep_value(args[1]));
+    return args[0];
+}
+
+static LiteralExpr builtin_fill(Context* ctx, Token* paren, LiteralExpr* args){
+    int64_t count = args[0].as.integer;
+    if ((args[0].type != INT_T && !(args[0].type == NUM_T && integral_value(args[0].as.number, &count))) || count < 0){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin 'fill' expects a non-negative integer count");
+        return nil_obj();
+    }
+    size_t n = (size_t)count;
+    Array* array = create_array(n);
+    LiteralExpr value = keep_value(args[1]);
+    for (size_t i = 0; i < n; i++) array_push(array, value);
+    return array_obj(array);
+}
+
+// The kernels add integers as doubles, which is exact as long as no partial result can
+// pass 2^53. Beyond that, and for boxed arrays, the builtins go element by element.
+#define EXACT_LIMIT 9007199254740992.0
+
+// largest magnitude in unboxed storage
+static double magnitude(Array* a){
+    if (a->count == 0) return 0;
+    return fmax(fabs(vec_min(a->as.numbers, a->count)), fabs(vec_max(a->as.numbers, a->count)));
+}
+
+static LiteralExpr builtin_sum(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_numbers(ctx, paren, "sum", args[0])) return nil_obj();
+    Array* a = args[0].as.array;
+    if (!a->boxed && (!a->integral || magnitude(a) * a->count <= EXACT_LIMIT)) return result_obj(a, vec_sum(a->as.numbers, a->count));
+    LiteralExpr sum = int_obj(0);
+    for (size_t i = 0; i < a->count; i++) sum = add_numbers(sum, array_get(a, i));
+    return sum;
+}
+
+static LiteralExpr builtin_min(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_numbers(ctx, paren, "min", args[0])) return nil_obj();
+    Array* a = args[0].as.array;
+    if (a->count == 0) return nil_obj();
+    if (!a->boxed) return result_obj(a, vec_min(a->as.numbers, a->count));
+    LiteralExpr min = a->as.values[0];
+    for (size_t i = 1; i < a->count; i++) if (less_numbers(a->as.values[i], min)) min = a->as.values[i];
+    return min;
+}
+
+static LiteralExpr builtin_max(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_numbers(ctx, paren, "max", args[0])) return nil_obj();
+    Array* a = args[0].as.array;
+    if (a->count == 0) return nil_obj();
+    if (!a->boxed) return result_obj(a, vec_max(a->as.numbers, a->count));
+    LiteralExpr max = a->as.values[0];
+    for (size_t i = 1; i < a->count; i++) if (less_numbers(max, a->as.values[i])) max = a->as.values[i];
+    return max;
+}
+
+static LiteralExpr builtin_dot(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_numbers(ctx, paren, "dot", args[0]) || !expect_numbers(ctx, paren, "dot", args[1])) return nil_obj();
+    Array* a = args[0].as.array;
+    Array* b = args[1].as.array;
+    if (!expect_same_length(ctx, paren, "dot", a, b)) return nil_obj();
+    if (!a->boxed && !b->boxed && (!a->integral || !b->integral || magnitude(a) * magnitude(b) * a->count <= EXACT_LIMIT)){
+        double dot = vec_dot(a->as.numbers, b->as.numbers, a->count);
+        return b->integral ? result_obj(a, dot) : num_obj(dot);
+    }
+    LiteralExpr dot = int_obj(0);
+    for (size_t i = 0; i < a->count; i++) dot = add_numbers(dot, mul_numbers(array_get(a, i), array_get(b, i)));
+    return dot;
+}
+
+static LiteralExpr builtin_scale(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_numbers(ctx, paren, "scale", args[0])) return nil_obj();
+    if (args[1].type != NUM_T && args[1].type != INT_T){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin 'scale' expects a number as factor");
+        return nil_obj();
+    }
+    double k = number_of(args[1]);
+    Array* a = args[0].as.array;
+    Array* res = create_array(a->count);
+    if (a->boxed){
+        for (size_t i = 0; i < a->count; i++) array_push(res, num_obj(number_of(a->as.values[i]) * k));
+        return array_obj(res);
+    }
+    vec_scale(res->as.numbers, a->as.numbers, k, a->count);
+    res->count = a->count;
+    res->integral = false;
+    return array_obj(res);
+}
+
+static LiteralExpr builtin_add(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_numbers(ctx, paren, "add", args[0]) || !expect_numbers(ctx, paren, "add", args[1])) return nil_obj();
+    Array* a = args[0].as.array;
+    Array* b = args[1].as.array;
+    if (!expect_same_length(ctx, paren, "add", a, b)) return nil_obj();
+    Array* res = create_array(a->count);
+    if (a->boxed || b->boxed || (a->integral && b->integral && magnitude(a) + magnitude(b) > EXACT_LIMIT)){
+        for (size_t i = 0; i < a->count; i++) array_push(res, add_numbers(array_get(a, i), array_get(b, i)));
+        return array_obj(res);
+    }
+    vec_add(res->as.numbers, a->as.numbers, b->as.numbers, a->count);
+    res->count = a->count;
+    res->integral = a->integral && b->integral;
+    return array_obj(res);
+}
+
+static bool expect_map(Context* ctx, Token* paren, const char* name, LiteralExpr* args, size_t key){
+    if (args[0].type != MAP_T){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin '%s' expects a map", name);
+        return false;
+    }
+    if (key > 0 && !valid_map_key(args[key])){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Map key must be a string or number");
+        return false;
+    }
+    return true;
+}
+
+// keys() and values() snapshot the map in slot order, so a script can modify the map while looping
+static LiteralExpr map_entries(Context* ctx, Token* paren, LiteralExpr* args, bool keys){
+    if (!expect_map(ctx, paren, keys ? "keys" : "values", args, 0)) return nil_obj();
+    Map* map = args[0].as.map;
+    Array* array = create_array(map->count);
+    size_t it = 0;
+    MapEntry* entry;
+    while (map_next(map, &it, &entry)) array_push(array, keys ? entry->key : entry->value);
+    return array_obj(array);
+}
+
+static LiteralExpr builtin_keys(Context* ctx, Token* paren, LiteralExpr* args){
+    return map_entries(ctx, paren, args, true);
+}
+
+static LiteralExpr builtin_values(Context* ctx, Token* paren, LiteralExpr* args){
+    return map_entries(ctx, paren, args, false);
+}
+
+static LiteralExpr builtin_has(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_map(ctx, paren, "has", args, 1)) return nil_obj();
+    LiteralExpr value;
+    return (LiteralExpr){ .type = BOOL_T, .as.boolean = map_get(args[0].as.map, args[1], &value) };
+}
+
+static LiteralExpr builtin_remove(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_map(ctx, paren, "remove", args, 1)) return nil_obj();
+    return (LiteralExpr){ .type = BOOL_T, .as.boolean = map_remove(args[0].as.map, args[1]) };
+}
+
+// seconds on a monotonic clock, only differences between two calls mean anything
+static LiteralExpr builtin_clock(Context* ctx, Token* paren, LiteralExpr* args){
+    (void)ctx;
+    (void)paren;
+    (void)args;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return num_obj((double)now.tv_sec + (double)now.tv_nsec / 1e9);
+}
+
+static bool expect_number(Context* ctx, Token* paren, const char* name, LiteralExpr arg, double* out){
+    if (arg.type == INT_T) *out = (double)arg.as.integer;
+    else if (arg.type == NUM_T) *out = arg.as.number;
+    else {
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin '%s' expects a number", name);
+        return false;
+    }
+    return true;
+}
+
+static LiteralExpr math_op(Context* ctx, Token* paren, LiteralExpr* args, const char* name, double (*op)(double)){
+    double x;
+    if (!expect_number(ctx, paren, name, args[0], &x)) return nil_obj();
+    return num_obj(op(x));
+}
+
+// rounding keeps integers, and gives one back when the result fits
+static LiteralExpr round_op(Context* ctx, Token* paren, LiteralExpr* args, const char* name, double (*op)(double)){
+    if (args[0].type == INT_T) return args[0];
+    double x;
+    if (!expect_number(ctx, paren, name, args[0], &x)) return nil_obj();
+    int64_t whole;
+    double rounded = op(x);
+    if (integral_value(rounded, &whole)) return int_obj(whole);
+    return num_obj(rounded);
+}
+
+static LiteralExpr builtin_sqrt(Context* ctx, Token* paren, LiteralExpr* args){
+    return math_op(ctx, paren, args, "sqrt", sqrt);
+}
+
+static LiteralExpr builtin_exp(Context* ctx, Token* paren, LiteralExpr* args){
+    return math_op(ctx, paren, args, "exp", exp);
+}
+
+static LiteralExpr builtin_log(Context* ctx, Token* paren, LiteralExpr* args){
+    return math_op(ctx, paren, args, "log", log);
+}
+
+static LiteralExpr builtin_sin(Context* ctx, Token* paren, LiteralExpr* args){
+    return math_op(ctx, paren, args, "sin", sin);
+}
+
+static LiteralExpr builtin_cos(Context* ctx, Token* paren, LiteralExpr* args){
+    return math_op(ctx, paren, args, "cos", cos);
+}
+
+static LiteralExpr builtin_floor(Context* ctx, Token* paren, LiteralExpr* args){
+    return round_op(ctx, paren, args, "floor", floor);
+}
+
+static LiteralExpr builtin_ceil(Context* ctx, Token* paren, LiteralExpr* args){
+    return round_op(ctx, paren, args, "ceil", ceil);
+}
+
+static LiteralExpr builtin_round(Context* ctx, Token* paren, LiteralExpr* args){
+    return round_op(ctx, paren, args, "round", round);
+}
+
+static LiteralExpr builtin_abs(Context* ctx, Token* paren, LiteralExpr* args){
+    if (args[0].type == INT_T && args[0].as.integer != INT64_MIN){
+        return int_obj(args[0].as.integer < 0 ? -args[0].as.integer : args[0].as.integer);
+    }
+    return math_op(ctx, paren, args, "abs", fabs);
+}
+
+// integer powers stay integers like the other operators, until they overflow
+static LiteralExpr builtin_pow(Context* ctx, Token* paren, LiteralExpr* args){
+    if (args[0].type == INT_T && args[1].type == INT_T && args[1].as.integer >= 0){
+        int64_t base = args[0].as.integer, result = 1;
+        bool overflow = false;
+        for (int64_t e = args[1].as.integer; e > 0 && !overflow; e >>= 1){
+            if (e & 1) overflow = __builtin_mul_overflow(result, base, &result);
+            if (e > 1 && !overflow) overflow = __builtin_mul_overflow(base, base, &base);
+        }
+        if (!overflow) return int_obj(result);
+    }
+    double x, y;
+    if (!expect_number(ctx, paren, "pow", args[0], &x) || !expect_number(ctx, paren, "pow", args[1], &y)) return nil_obj();
+    return num_obj(pow(x, y));
+}
+
+static bool expect_string(Context* ctx, Token* paren, const char* name, LiteralExpr arg){
+    if (arg.type != STR_T){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin '%s' expects a string", name);
+        return false;
+    }
+    return true;
+}
+
+static bool expect_count(Context* ctx, Token* paren, const char* name, LiteralExpr arg, size_t* out){
+    int64_t count = arg.as.integer;
+    if ((arg.type != INT_T && !(arg.type == NUM_T && integral_value(arg.as.number, &count))) || count < 0){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin '%s' expects a non-negative integer", name);
+        return false;
+    }
+    *out = (size_t)count;
+    return true;
+}
+
+// substr(s, start, count), both clamped to the end of s
+static LiteralExpr builtin_substr(Context* ctx, Token* paren, LiteralExpr* args){
+    size_t start, count;
+    if (!expect_string(ctx, paren, "substr", args[0]) || !expect_count(ctx, paren, "substr", args[1], &start) ||
+        !expect_count(ctx, paren, "substr", args[2], &count)) return nil_obj();
+    size_t length = string_length(&args[0]);
+    if (start > length) start = length;
+    if (count > length - start) count = length - start;
+    const char* chars = string_chars(&args[0]) + start;
+    // a slice of a slice is as lasting as the slice
+    if (args[0].sso == SSO_SLICE || count <= SSO_MAX) return slice_string(chars, count);
+    char* res = (char*)mem_alloc(MEM_STRINGS, count + 1);
+    if (res == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for substring");
+        exit(1);
+    }
+    memcpy(res, chars, count);
+    res[count] = '\0';
+    return (LiteralExpr){ .type = STR_T, .as.string = res };
+}
+
+// the byte offset of the first occurrence of the second string in the first, -1 if there is none
+static LiteralExpr builtin_indexOf(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_string(ctx, paren, "indexOf", args[0]) || !expect_string(ctx, paren, "indexOf", args[1])) return nil_obj();
+    const char* chars = string_chars(&args[0]);
+    const char* found = (const char*)memmem(chars, string_length(&args[0]), string_chars(&args[1]), string_length(&args[1]));
+    return int_obj(found != NULL ? (int64_t)(found - chars) : -1);
+}
+
+static LiteralExpr file_obj(File* file){
+    return (LiteralExpr){ .type = FILE_T, .as.file = file };
+}
+
+// opens the file named by the string argument, nil after reporting why it couldn't
+static LiteralExpr open_file(Context* ctx, Token* paren, const char* name, LiteralExpr arg, size_t record){
+    if (!expect_string(ctx, paren, name, arg)) return nil_obj();
+    size_t n = string_length(&arg);
+    char* path = (char*)malloc(n + 1);
+    if (path == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for path");
+        exit(1);
+    }
+    memcpy(path, string_chars(&arg), n);
+    path[n] = '\0';
+    File* file = strcmp(name, "writer") == 0 ? open_writer(path) : open_reader(path, record);
+    if (file == NULL) plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Couldn't open '%s': %s", path, strerror(errno));
+    free(path);
+    return file != NULL ? file_obj(file) : nil_obj();
+}
+
+static LiteralExpr builtin_lines(Context* ctx, Token* paren, LiteralExpr* args){
+    return open_file(ctx, paren, "lines", args[0], 0);
+}
+
+static LiteralExpr builtin_records(Context* ctx, Token* paren, LiteralExpr* args){
+    size_t size;
+    if (!expect_count(ctx, paren, "records", args[1], &size)) return nil_obj();
+    if (size == 0){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin 'records' expects a record size above 0");
+        return nil_obj();
+    }
+    return open_file(ctx, paren, "records", args[0], size);
+}
+
+static LiteralExpr builtin_writer(Context* ctx, Token* paren, LiteralExpr* args){
+    return open_file(ctx, paren, "writer", args[0], 0);
+}
+
+static bool expect_writer(Context* ctx, Token* paren, const char* name, LiteralExpr arg){
+    if (arg.type != FILE_T || arg.as.file->out == NULL){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Builtin '%s' expects an open writer", name);
+        return false;
+    }
+    return true;
+}
+
+static LiteralExpr builtin_write(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_writer(ctx, paren, "write", args[0])) return nil_obj();
+    if (!file_write(args[0].as.file, args[1])){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Couldn't write: %s", strerror(errno));
+        return nil_obj();
+    }
+    return args[0];
+}
+
+static LiteralExpr builtin_close(Context* ctx, Token* paren, LiteralExpr* args){
+    if (!expect_writer(ctx, paren, "close", args[0])) return nil_obj();
+    if (!file_close(args[0].as.file)){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Couldn't close: %s", strerror(errno));
+    }
+    return nil_obj();
+}
+
+const Builtin builtins[] = {
+    { "len",     1, builtin_len,     NULL },
+    { "push",    2, builtin_push,    NULL },
+    { "fill",    2, builtin_fill,    NULL },
+    { "sum",     1, builtin_sum,     NULL },
+    { "min",     1, builtin_min,     NULL },
+    { "max",     1, builtin_max,     NULL },
+    { "dot",     2, builtin_dot,     NULL },
+    { "scale",   2, builtin_scale,   NULL },
+    { "add",     2, builtin_add,     NULL },
+    { "keys",    1, builtin_keys,    NULL },
+    { "values",  1, builtin_values,  NULL },
+    { "has",     2, builtin_has,     NULL },
+    { "remove",  2, builtin_remove,  NULL },
+    { "clock",   0, builtin_clock,   NULL },
+    { "sqrt",    1, builtin_sqrt,    NULL },
+    { "exp",     1, builtin_exp,     NULL },
+    { "log",     1, builtin_log,     NULL },
+    { "sin",     1, builtin_sin,     NULL },
+    { "cos",     1, builtin_cos,     NULL },
+    { "floor",   1, builtin_floor,   NULL },
+    { "ceil",    1, builtin_ceil,    NULL },
+    { "round",   1, builtin_round,   NULL },
+    { "abs",     1, builtin_abs,     NULL },
+    { "pow",     2, builtin_pow,     NULL },
+    { "substr",  3, builtin_substr,  NULL },
+    { "indexOf", 2, builtin_indexOf, NULL },
+    { "lines",   1, builtin_lines,   NULL },
+    { "records", 2, builtin_records, NULL },
+    { "writer",  1, builtin_writer,  NULL },
+    { "write",   2, builtin_write,   NULL },
+    { "close",   1, builtin_close,   NULL },
+};
+const size_t builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+
+const Builtin* find_builtin(const char* name, size_t length){
+    for (size_t i = 0; i < builtin_count; i++){
+        if (strlen(builtins[i].name) == length && strncmp(builtins[i].name, name, length) == 0){
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef _BUILTINS_H
+#define _BUILTINS_H
+
+#include "parser.h"
+
+#define MAX_BUILTIN_ARITY 4
+
+typedef LiteralExpr (*BuiltinFn)(Context* ctx, Token* paren, LiteralExpr* args);
+// functions defined by an embedder are handed their own entry, see plang_define_function
+typedef LiteralExpr (*HostFn)(const Builtin* self, Context* ctx, Token* paren, LiteralExpr* args);
+
+struct Builtin {
+    const char* name;
+    size_t arity;
+    BuiltinFn fn;
+    HostFn host;        // called instead of fn when that is NULL
+};
+
+// compiled scripts call builtins through this table by index
+extern const Builtin builtins[];
+extern const size_t builtin_count;
+
+const Builtin* find_builtin(const char* name, size_t length);
+
+static inline LiteralExpr call_builtin(const Builtin* builtin, Context* ctx, Token* paren, LiteralExpr* args){
+    return builtin->fn != NULL ? builtin->fn(ctx, paren, args) : builtin->host(builtin, ctx, paren, args);
+}
+
+#endif // _BUILTINS_H
@@ -0,0 +1,638 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cache.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+uint64_t hash_source(const char* source, size_t len){
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++){
+        hash ^= (unsigned char)source[i];
+        hash *= 1099511628211ULL; /* FNV-1a */
+    }
+    return hash;
+}
+
+char* cache_path(const char* script_path, uint64_t hash){
+    const char* dir = getenv("PLANG_CACHE_DIR");
+    size_t n = (dir != NULL ? strlen(dir) + 32 : strlen(script_path) + 8);
+    char* path = (char*)malloc(n);
+    if (path == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cache path");
+        exit(1);
+    }
+    if (dir != NULL){
+        snprintf(path, n, "%s/%016llx.plangc", dir, (unsigned long long)hash);
+        return path;
+    }
+    const char* ext = strrchr(script_path, '.');
+    if (ext != NULL && strcmp(ext, ".plang") == 0){
+        snprintf(path, n, "%sc", script_path);
+    } else {
+        snprintf(path, n, "%s.plangc", script_path);
+    }
+    return path;
+}
+
+#pragma region Writer
+
+typedef struct {
+    Tokenizer* tokenizer;
+    Token** string_tokens;  // STRING tokens sorted by literal address
+    size_t string_count;
+
+    CacheExpr* exprs;
+    size_t expr_index;
+    size_t expr_size;
+
+    CacheStmt* stmts;
+    size_t stmt_index;
+    size_t stmt_size;
+
+    uint32_t* lists;
+    size_t list_index;
+    size_t list_size;
+
+    char* strings;          // inline string literals, stored after the token strings
+    size_t string_base;
+    size_t string_index;
+    size_t string_size;
+} CacheWriter;
+
+static void* grow(void* buf, size_t* size, size_t elem){
+    *size = *size == 0 ? 64 : *size * 2;
+    buf = realloc(buf, elem * *size);
+    if (buf == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cache writer");
+        exit(1);
+    }
+    return buf;
+}
+
+static int compare_literal(const void* a, const void* b){
+    const char* x = (*(Token* const*)a)->lit.string;
+    const char* y = (*(Token* const*)b)->lit.string;
+    return (x > y) - (x < y);
+}
+
+static uint32_t token_index(CacheWriter* w, Token* tok){
+    if (tok == NULL) return PLANGC_NONE;
+    return (uint32_t)(tok - w->tokenizer->tokens);
+}
+
+static uint32_t string_token(CacheWriter* w, char* string){
+    size_t lo = 0, hi = w->string_count;
+    while (lo < hi){
+        size_t mid = (lo + hi) / 2;
+        char* s = w->string_tokens[mid]->lit.string;
+        if (s == string) return token_index(w, w->string_tokens[mid]);
+        if (s < string) lo = mid + 1;
+        else hi = mid;
+    }
+    return PLANGC_NONE;
+}
+
+static void push_list(CacheWriter* w, uint32_t value);
+static uint32_t write_expr(CacheWriter* w, Expr* expr);
+
+static uint32_t write_expr_list(CacheWriter* w, ExprList* list){
+    // same layout as statement lists, children first so the run stays contiguous
+    uint32_t* kids = (uint32_t*)malloc(sizeof(uint32_t) * (list->index + 1));
+    if (kids == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cache writer");
+        exit(1);
+    }
+    for (size_t i = 0; i < list->index; i++) kids[i] = write_expr(w, list->exprs[i]);
+    uint32_t offset = (uint32_t)w->list_index;
+    push_list(w, (uint32_t)list->index);
+    for (size_t i = 0; i < list->index; i++) push_list(w, kids[i]);
+    free(kids);
+    return offset;
+}
+
+static uint32_t write_expr(CacheWriter* w, Expr* expr){
+    if (expr == NULL) return PLANGC_NONE;
+    CacheExpr rec = { .type = expr->type, .token = PLANGC_NONE,
+        .kids = {PLANGC_NONE, PLANGC_NONE, PLANGC_NONE}, .list = PLANGC_NONE };
+    switch (expr->type)
+    {
+    case BINARY: {
+        rec.token = token_index(w, expr->as.binary.op);
+        rec.kids[0] = write_expr(w, expr->as.binary.left);
+        rec.kids[1] = write_expr(w, expr->as.binary.right);
+    } break;
+    case TERNARY: {
+        rec.kids[0] = write_expr(w, expr->as.ternary.cond);
+        rec.kids[1] = write_expr(w, expr->as.ternary.trueBranch);
+        rec.kids[2] = write_expr(w, expr->as.ternary.falseBranch);
+    } break;
+    case UNARY: {
+        rec.token = token_index(w, expr->as.unary.op);
+        rec.kids[0] = write_expr(w, expr->as.unary.right);
+    } break;
+    case LITERAL: {
+        rec.value_type = expr->as.literal.type;
+        switch (expr->as.literal.type){
+            case NUM_T: memcpy(&rec.value, &expr->as.literal.as.number, sizeof(double)); break;
+            case INT_T: memcpy(&rec.value, &expr->as.literal.as.integer, sizeof(int64_t)); break;
+            case BOOL_T: rec.value = expr->as.literal.as.boolean; break;
+            case STR_T: {
+                if (expr->as.literal.sso == 0){
+                    rec.token = string_token(w, expr->as.literal.as.string);
+                    break;
+                }
+                size_t n = expr->as.literal.sso;
+                while (w->string_index + n > w->string_size) w->strings = grow(w->strings, &w->string_size, 1);
+                memcpy(w->strings + w->string_index, expr->as.literal.as.small, n);
+                rec.value = w->string_base + w->string_index;
+                w->string_index += n;
+            } break;
+            default: break;
+        }
+    } break;
+    case GROUPING: rec.kids[0] = write_expr(w, expr->as.group.expression); break;
+    case VAREXPR: rec.token = token_index(w, expr->as.var.name); break;
+    case ASSIGN: {
+        rec.token = token_index(w, expr->as.assign.name);
+        rec.kids[0] = write_expr(w, expr->as.assign.value);
+    } break;
+    case CALL: {
+        rec.token = token_index(w, expr->as.call.paren);
+        rec.kids[0] = write_expr(w, expr->as.call.callee);
+        rec.list = write_expr_list(w, expr->as.call.args);
+    } break;
+    case ARRAY: {
+        rec.token = token_index(w, expr->as.array.bracket);
+        rec.list = write_expr_list(w, expr->as.array.elements);
+    } break;
+    case INDEX: {
+        rec.token = token_index(w, expr->as.index.bracket);
+        rec.kids[0] = write_expr(w, expr->as.index.object);
+        rec.kids[1] = write_expr(w, expr->as.index.index);
+    } break;
+    case SET_INDEX: {
+        rec.token = token_index(w, expr->as.set_index.bracket);
+        rec.kids[0] = write_expr(w, expr->as.set_index.object);
+        rec.kids[1] = write_expr(w, expr->as.set_index.index);
+        rec.kids[2] = write_expr(w, expr->as.set_index.value);
+    } break;
+    case MAP: {
+        rec.token = token_index(w, expr->as.map.brace);
+        rec.list = write_expr_list(w, expr->as.map.entries);
+    } break;
+    default: break;
+    }
+    if (w->expr_index == w->expr_size) w->exprs = grow(w->exprs, &w->expr_size, sizeof(CacheExpr));
+    w->exprs[w->expr_index] = rec;
+    return (uint32_t)w->expr_index++;
+}
+
+static void push_list(CacheWriter* w, uint32_t value){
+    if (w->list_index == w->list_size) w->lists = grow(w->lists, &w->list_size, sizeof(uint32_t));
+    w->lists[w->list_index++] = value;
+}
+
+static uint32_t write_stmt(CacheWriter* w, Stmt* stmt);
+
+static uint32_t write_list(CacheWriter* w, StmtList* list){
+    // children are written first so the list run stays contiguous
+    uint32_t* kids = (uint32_t*)malloc(sizeof(uint32_t) * (list->index + 1));
+    if (kids == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cache writer");
+        exit(1);
+    }
+    for (size_t i = 0; i < list->index; i++) kids[i] = write_stmt(w, &list->statements[i]);
+    uint32_t offset = (uint32_t)w->list_index;
+    push_list(w, (uint32_t)list->index);
+    for (size_t i = 0; i < list->index; i++) push_list(w, kids[i]);
+    free(kids);
+    return offset;
+}
+
+static uint32_t write_stmt(CacheWriter* w, Stmt* stmt){
+    if (stmt == NULL) return PLANGC_NONE;
+    CacheStmt rec = { .type = stmt->type, .line = stmt->line, .token = PLANGC_NONE, .expr = PLANGC_NONE,
+        .stmts = {PLANGC_NONE, PLANGC_NONE}, .list = PLANGC_NONE };
+    switch (stmt->type)
+    {
+    case EXPR_STMT: rec.expr = write_expr(w, stmt->as.expr.expression); break;
+    case PRINT_STMT: rec.expr = write_expr(w, stmt->as.print.expression); break;
+    case VAR_DECL_STMT: {
+        rec.token = token_index(w, stmt->as.var.name);
+        rec.expr = write_expr(w, stmt->as.var.initializer);
+    } break;
+    case BLOCK_STMT: rec.list = write_list(w, stmt->as.block.list); break;
+    case IF_STMT: {
+        rec.expr = write_expr(w, stmt->as.if_stmt.cond);
+        rec.stmts[0] = write_stmt(w, stmt->as.if_stmt.trueBranch);
+        rec.stmts[1] = write_stmt(w, stmt->as.if_stmt.falseBranch);
+    } break;
+    case WHILE_STMT: {
+        rec.expr = write_expr(w, stmt->as.while_stmt.cond);
+        rec.stmts[0] = write_stmt(w, stmt->as.while_stmt.body);
+    } break;
+    default: break;
+    }
+    if (w->stmt_index == w->stmt_size) w->stmts = grow(w->stmts, &w->stmt_size, sizeof(CacheStmt));
+    w->stmts[w->stmt_index] = rec;
+    return (uint32_t)w->stmt_index++;
+}
+
+void write_cache(const char* path, uint64_t hash, Parser* parser){
+    // the writer recurses on expressions, such programs are parsed every time instead
+    if (ast_depth(parser->stmt_list) > MAX_RECURSIVE_DEPTH) return;
+    Tokenizer* tokenizer = parser->tokenizer;
+    // spawned and generator bodies are statements inside expressions, parallel loops carry
+    // their reductions and the names they read and for-in loops their variable, which the
+    // records have no room for
+    for (size_t i = 0; i < tokenizer->list_index; i++){
+        TokenType type = tokenizer->tokens[i].type;
+        if (type == SPAWN || type == PARALLEL || type == GENERATOR || type == IN) return;
+    }
+    CacheWriter w = { .tokenizer = tokenizer };
+
+    w.string_tokens = (Token**)malloc(sizeof(Token*) * (tokenizer->list_index + 1));
+    CacheToken* tokens = (CacheToken*)malloc(sizeof(CacheToken) * (tokenizer->list_index + 1));
+    if (w.string_tokens == NULL || tokens == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cache writer");
+        exit(1);
+    }
+
+    uint64_t string_bytes = 0;
+    for (size_t i = 0; i < tokenizer->list_index; i++){
+        Token* tok = &tokenizer->tokens[i];
+        tokens[i] = (CacheToken){ .type = tok->type, .line = (uint32_t)tok->line,
+            .start = tok->start, .count = tok->count };
+        if (tok->type == NUMBER) memcpy(&tokens[i].lit, &tok->lit.number, sizeof(double));
+        if (tok->type == INTEGER) memcpy(&tokens[i].lit, &tok->lit.integer, sizeof(int64_t));
+        if (tok->type == STRING && tok->lit.string == NULL) tokens[i].lit = PLANGC_NO_STRING;
+        else if (tok->type == STRING){
+            tokens[i].lit = string_bytes;
+            string_bytes += strlen(tok->lit.string) + 1;
+            w.string_tokens[w.string_count++] = tok;
+        }
+    }
+    qsort(w.string_tokens, w.string_count, sizeof(Token*), compare_literal);
+
+    w.string_base = string_bytes;
+    uint32_t top_list = write_list(&w, parser->stmt_list);
+    string_bytes += w.string_index;
+
+    CacheHeader header = {
+        .magic = {PLANGC_MAGIC[0], PLANGC_MAGIC[1], PLANGC_MAGIC[2], PLANGC_MAGIC[3]},
+        .version = PLANGC_VERSION,
+        .source_hash = hash,
+        .source_len = tokenizer->source_len,
+        .token_count = (uint32_t)tokenizer->list_index,
+        .expr_count = (uint32_t)w.expr_index,
+        .stmt_count = (uint32_t)w.stmt_index,
+        .list_count = (uint32_t)w.list_index,
+        .top_list = top_list,
+        .string_bytes = string_bytes,
+    };
+
+    // write to a private file first so concurrent runs never map a half written cache
+    size_t n = strlen(path) + 32;
+    char* tmp_path = (char*)malloc(n);
+    if (tmp_path == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cache path");
+        exit(1);
+    }
+    snprintf(tmp_path, n, "%s.%ld.tmp", path, (long)getpid());
+    FILE* f = fopen(tmp_path, "wb");
+    if (f != NULL){
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = ok && fwrite(tokens, sizeof(CacheToken), tokenizer->list_index, f) == tokenizer->list_index;
+        ok = ok && fwrite(w.exprs, sizeof(CacheExpr), w.expr_index, f) == w.expr_index;
+        ok = ok && fwrite(w.stmts, sizeof(CacheStmt), w.stmt_index, f) == w.stmt_index;
+        ok = ok && fwrite(w.lists, sizeof(uint32_t), w.list_index, f) == w.list_index;
+        for (size_t i = 0; ok && i < tokenizer->list_index; i++){
+            if (tokenizer->tokens[i].type != STRING || tokenizer->tokens[i].lit.string == NULL) continue;
+            char* s = tokenizer->tokens[i].lit.string;
+            ok = fwrite(s, 1, strlen(s) + 1, f) == strlen(s) + 1;
+        }
+        ok = ok && (w.string_index == 0 || fwrite(w.strings, 1, w.string_index, f) == w.string_index);
+        ok = (fclose(f) == 0) && ok;
+        if (!ok || rename(tmp_path, path) != 0) remove(tmp_path);
+    }
+    // failing to write a cache is not an error, the next run just parses again
+
+    free(tmp_path);
+    free(tokens);
+    free(w.string_tokens);
+    free(w.exprs);
+    free(w.stmts);
+    free(w.lists);
+    free(w.strings);
+}
+
+#pragma endregion Writer
+
+#pragma region Loader
+
+static bool valid_cache(const CacheHeader* h, size_t size, uint64_t hash, size_t source_len){
+    if (size < sizeof(CacheHeader)) return false;
+    if (memcmp(h->magic, PLANGC_MAGIC, 4) != 0) return false;
+    if (h->version != PLANGC_VERSION) return false;
+    if (h->source_hash != hash || h->source_len != source_len) return false;
+    uint64_t expected = sizeof(CacheHeader)
+        + (uint64_t)h->token_count * sizeof(CacheToken)
+        + (uint64_t)h->expr_count * sizeof(CacheExpr)
+        + (uint64_t)h->stmt_count * sizeof(CacheStmt)
+        + (uint64_t)h->list_count * sizeof(uint32_t)
+        + h->string_bytes;
+    return expected == size && h->token_count > 0 && h->top_list < h->list_count;
+}
+
+// every expression and statement is loaded into one parent, a shared one would be freed twice
+static bool use_once(uint8_t* used, uint32_t index){
+    if (index == PLANGC_NONE) return true;
+    if (used[index]) return false;
+    used[index] = 1;
+    return true;
+}
+
+static bool valid_list(const uint32_t* lists, uint32_t count, uint32_t offset, uint32_t below, uint8_t* used){
+    if (offset >= count || (uint64_t)offset + lists[offset] >= count) return false;
+    for (uint32_t i = 1; i <= lists[offset]; i++){
+        if (lists[offset + i] >= below || !use_once(used, lists[offset + i])) return false;
+    }
+    return true;
+}
+
+// the operands the interpreter expects an expression to have
+static bool complete_expr(const CacheExpr* e){
+    bool token = e->token != PLANGC_NONE;
+    bool first = e->kids[0] != PLANGC_NONE, second = e->kids[1] != PLANGC_NONE, third = e->kids[2] != PLANGC_NONE;
+    switch (e->type)
+    {
+    case BINARY: return token && first && second;
+    case TERNARY: return first && second && third;
+    case UNARY: return token && first;
+    case GROUPING: return first;
+    case VAREXPR: return token;
+    case ASSIGN: return token && first;
+    case CALL: return token && first;
+    case ARRAY: return true;
+    case INDEX: return token && first && second;
+    case SET_INDEX: return token && first && second && third;
+    case MAP: return token;
+    default: return true;
+    }
+}
+
+// children are stored before their parents, so every reference must point backwards
+static bool check_records(const CacheHeader* h, const CacheToken* tokens, const CacheExpr* exprs,
+                          const CacheStmt* stmts, const uint32_t* lists, const char* strings,
+                          uint8_t* used_exprs, uint8_t* used_stmts){
+    for (uint32_t i = 0; i < h->token_count; i++){
+        if (tokens[i].type > ENDFILE || tokens[i].start > tokens[i].count || tokens[i].count > h->source_len) return false;
+        if (tokens[i].type == STRING && tokens[i].lit != PLANGC_NO_STRING && (tokens[i].lit >= h->string_bytes ||
+            memchr(strings + tokens[i].lit, '\0', h->string_bytes - tokens[i].lit) == NULL)) return false;
+    }
+    for (uint32_t i = 0; i < h->expr_count; i++){
+        const CacheExpr* e = &exprs[i];
+        if (e->type > MAP || !complete_expr(e)) return false;
+        if (e->token != PLANGC_NONE && e->token >= h->token_count) return false;
+        for (int k = 0; k < 3; k++){
+            if (e->kids[k] != PLANGC_NONE && (e->kids[k] >= i || !use_once(used_exprs, e->kids[k]))) return false;
+        }
+        if ((e->type == CALL || e->type == ARRAY || e->type == MAP) && !valid_list(lists, h->list_count, e->list, i, used_exprs)) return false;
+        if (e->type == MAP && lists[e->list] % 2 != 0) return false;
+        if (e->type == LITERAL && e->value_type == STR_T){
+            if (e->token != PLANGC_NONE){
+                if (tokens[e->token].type != STRING || tokens[e->token].lit == PLANGC_NO_STRING) return false;
+            } else {
+                if (e->value >= h->string_bytes) return false;
+                size_t n = h->string_bytes - e->value < SSO_CAPACITY ? h->string_bytes - e->value : SSO_CAPACITY;
+                if (memchr(strings + e->value, '\0', n) == NULL) return false;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < h->stmt_count; i++){
+        const CacheStmt* s = &stmts[i];
+        // the kinds write_stmt() records, the writer skips programs with any other
+        if (s->type < EXPR_STMT || s->type > WHILE_STMT) return false;
+        if (s->token != PLANGC_NONE && s->token >= h->token_count) return false;
+        if (s->expr != PLANGC_NONE && (s->expr >= h->expr_count || !use_once(used_exprs, s->expr))) return false;
+        for (int k = 0; k < 2; k++){
+            if (s->stmts[k] != PLANGC_NONE && (s->stmts[k] >= i || !use_once(used_stmts, s->stmts[k]))) return false;
+        }
+        if ((s->type == EXPR_STMT || s->type == PRINT_STMT || s->type == IF_STMT || s->type == WHILE_STMT) &&
+            s->expr == PLANGC_NONE) return false;
+        if (s->type == VAR_DECL_STMT && s->token == PLANGC_NONE) return false;
+        if ((s->type == IF_STMT || s->type == WHILE_STMT) && s->stmts[0] == PLANGC_NONE) return false;
+        if (s->type == BLOCK_STMT && !valid_list(lists, h->list_count, s->list, i, used_stmts)) return false;
+    }
+    return valid_list(lists, h->list_count, h->top_list, h->stmt_count, used_stmts);
+}
+
+static bool valid_records(const CacheHeader* h, const CacheToken* tokens, const CacheExpr* exprs,
+                          const CacheStmt* stmts, const uint32_t* lists, const char* strings){
+    uint8_t* used = (uint8_t*)calloc((size_t)h->expr_count + h->stmt_count + 1, 1);
+    if (used == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cached program");
+        exit(1);
+    }
+    bool valid = check_records(h, tokens, exprs, stmts, lists, strings, used, used + h->expr_count);
+    free(used);
+    return valid;
+}
+
+static ExprList* load_expr_list(const uint32_t* lists, uint32_t offset, Expr** exprs){
+    ExprList* list = init_expr_list();
+    for (uint32_t i = 1; i <= lists[offset]; i++) add_expr(list, exprs[lists[offset + i]]);
+    return list;
+}
+
+static Stmt* copy_stmt(Stmt stmt){
+    Stmt* s = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
+    if (s == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cached statement");
+        exit(1);
+    }
+    *s = stmt;
+    return s;
+}
+
+static StmtList* load_list(const uint32_t* lists, uint32_t offset, Stmt* stmts){
+    StmtList* list = init_stmt_list();
+    for (uint32_t i = 1; i <= lists[offset]; i++) add_statement(list, stmts[lists[offset + i]]);
+    return list;
+}
+
+bool load_cache(const char* path, uint64_t hash, Tokenizer* tokenizer, Parser* parser){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheHeader)){
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    const char* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+
+    const CacheHeader* h = (const CacheHeader*)base;
+    const CacheToken* ctokens = (const CacheToken*)(base + sizeof(CacheHeader));
+    const CacheExpr* cexprs = (const CacheExpr*)(ctokens + h->token_count);
+    const CacheStmt* cstmts = (const CacheStmt*)(cexprs + h->expr_count);
+    const uint32_t* lists = (const uint32_t*)(cstmts + h->stmt_count);
+    const char* strings = (const char*)(lists + h->list_count);
+    if (!valid_cache(h, size, hash, tokenizer->source_len) ||
+        !valid_records(h, ctokens, cexprs, cstmts, lists, strings)){
+        munmap((void*)base, size);
+        return false;
+    }
+
+    Token* tokens = (Token*)mem_realloc(MEM_TOKENS, tokenizer->tokens, sizeof(Token) * h->token_count);
+    Expr** exprs = (Expr**)malloc(sizeof(Expr*) * (h->expr_count + 1));
+    Stmt* stmts = (Stmt*)malloc(sizeof(Stmt) * (h->stmt_count + 1));
+    if (tokens == NULL || exprs == NULL || stmts == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cached program");
+        exit(1);
+    }
+    tokenizer->tokens = tokens;
+    tokenizer->list_index = h->token_count;
+    tokenizer->max_size = h->token_count;
+
+    for (uint32_t i = 0; i < h->token_count; i++){
+        const CacheToken* c = &ctokens[i];
+        tokens[i] = (Token){ .type = c->type, .line = c->line, .start = c->start,
+            .count = c->count, .source = tokenizer->source };
+        if (c->type == NUMBER) memcpy(&tokens[i].lit.number, &c->lit, sizeof(double));
+        if (c->type == INTEGER) memcpy(&tokens[i].lit.integer, &c->lit, sizeof(int64_t));
+        if (c->type == STRING && c->lit == PLANGC_NO_STRING) tokens[i].lit.string = NULL;
+        else if (c->type == STRING){
+            const char* s = strings + c->lit;
+            size_t n = strlen(s);
+            tokens[i].lit.string = (char*)mem_alloc(MEM_LITERALS, n + 1);
+            if (tokens[i].lit.string == NULL){
+                plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for string literal");
+                exit(1);
+            }
+            memcpy(tokens[i].lit.string, s, n + 1);
+        }
+    }
+
+    #define TOKEN(idx) ((idx) == PLANGC_NONE ? NULL : &tokens[(idx)])
+    #define EXPR(idx) ((idx) == PLANGC_NONE ? NULL : exprs[(idx)])
+    for (uint32_t i = 0; i < h->expr_count; i++){
+        const CacheExpr* c = &cexprs[i];
+        Expr* e = (Expr*)mem_alloc(MEM_EXPR, sizeof(Expr));
+        if (e == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for cached expression");
+            exit(1);
+        }
+        e->type = c->type;
+        switch (c->type)
+        {
+        case BINARY: {
+            e->as.binary.op = TOKEN(c->token);
+            e->as.binary.left = EXPR(c->kids[0]);
+            e->as.binary.right = EXPR(c->kids[1]);
+            e->as.binary.proof = UNPROVEN;
+        } break;
+        case TERNARY: {
+            e->as.ternary.cond = EXPR(c->kids[0]);
+            e->as.ternary.trueBranch = EXPR(c->kids[1]);
+            e->as.ternary.falseBranch = EXPR(c->kids[2]);
+        } break;
+        case UNARY: {
+            e->as.unary.op = TOKEN(c->token);
+            e->as.unary.right = EXPR(c->kids[0]);
+        } break;
+        case LITERAL: {
+            e->as.literal = (LiteralExpr){ .type = c->value_type };
+            switch (c->value_type){
+                case NUM_T: memcpy(&e->as.literal.as.number, &c->value, sizeof(double)); break;
+                case INT_T: memcpy(&e->as.literal.as.integer, &c->value, sizeof(int64_t)); break;
+                case BOOL_T: e->as.literal.as.boolean = c->value != 0; break;
+                case STR_T: {
+                    if (c->token != PLANGC_NONE){
+                        e->as.literal.as.string = tokens[c->token].lit.string;
+                        break;
+                    }
+                    const char* small = strings + c->value;
+                    e->as.literal = small_string(small, strlen(small));
+                } break;
+                default: break;
+            }
+        } break;
+        case GROUPING: e->as.group.expression = EXPR(c->kids[0]); break;
+        case VAREXPR: e->as.var.name = TOKEN(c->token); break;
+        case ASSIGN: {
+            e->as.assign.name = TOKEN(c->token);
+            e->as.assign.value = EXPR(c->kids[0]);
+        } break;
+        case CALL: {
+            e->as.call.paren = TOKEN(c->token);
+            e->as.call.callee = EXPR(c->kids[0]);
+            e->as.call.args = load_expr_list(lists, c->list, exprs);
+            e->as.call.builtin = NULL;
+        } break;
+        case ARRAY: {
+            e->as.array.bracket = TOKEN(c->token);
+            e->as.array.elements = load_expr_list(lists, c->list, exprs);
+        } break;
+        case INDEX: {
+            e->as.index.bracket = TOKEN(c->token);
+            e->as.index.object = EXPR(c->kids[0]);
+            e->as.index.index = EXPR(c->kids[1]);
+        } break;
+        case SET_INDEX: {
+            e->as.set_index.bracket = TOKEN(c->token);
+            e->as.set_index.object = EXPR(c->kids[0]);
+            e->as.set_index.index = EXPR(c->kids[1]);
+            e->as.set_index.value = EXPR(c->kids[2]);
+        } break;
+        case MAP: {
+            e->as.map.brace = TOKEN(c->token);
+            e->as.map.entries = load_expr_list(lists, c->list, exprs);
+        } break;
+        default: break;
+        }
+        exprs[i] = e;
+    }
+
+    for (uint32_t i = 0; i < h->stmt_count; i++){
+        const CacheStmt* c = &cstmts[i];
+        Stmt s = { .type = c->type, .line = c->line };
+        switch (c->type)
+        {
+        case EXPR_STMT: s.as.expr.expression = EXPR(c->expr); break;
+        case PRINT_STMT: s.as.print.expression = EXPR(c->expr); break;
+        case VAR_DECL_STMT: {
+            s.as.var.name = TOKEN(c->token);
+            s.as.var.initializer = EXPR(c->expr);
+        } break;
+        case BLOCK_STMT: s.as.block.list = load_list(lists, c->list, stmts); break;
+        case IF_STMT: {
+            s.as.if_stmt.cond = EXPR(c->expr);
+            s.as.if_stmt.trueBranch = copy_stmt(stmts[c->stmts[0]]);
+            s.as.if_stmt.falseBranch = c->stmts[1] == PLANGC_NONE ? NULL : copy_stmt(stmts[c->stmts[1]]);
+        } break;
+        case WHILE_STMT: {
+            s.as.while_stmt.cond = EXPR(c->expr);
+            s.as.while_stmt.body = copy_stmt(stmts[c->stmts[0]]);
+        } break;
+        default: break;
+        }
+        stmts[i] = s;
+    }
+    #undef TOKEN
+    #undef EXPR
+
+    if (parser->stmt_list != NULL) free_stmt_list(parser->stmt_list);
+    parser->stmt_list = load_list(lists, h->top_list, stmts);
+    parser->current_token = h->token_count - 1;
+
+    free(exprs);
+    free(stmts);
+    munmap((void*)base, size);
+    return true;
+}
+
+#pragma endregion Loader
@@ -0,0 +1,64 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdint.h>
+#include "tokenizer.h"
+#include "parser.h"
+
+// On-disk cache of a tokenized and parsed program (.plangc).
+// All references inside the file are indices into its own tables, so it can be
+// mapped anywhere and turned back into a Token list and AST without tokenizing or parsing.
+// Bump PLANGC_VERSION whenever Token, Expr or Stmt (or their meaning) changes.
+
+#define PLANGC_MAGIC "PLGC"
+#define PLANGC_VERSION 9
+#define PLANGC_NONE UINT32_MAX
+#define PLANGC_NO_STRING UINT64_MAX   // lit of a STRING token whose value is stored inline
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_len;
+    uint32_t flags;
+    uint32_t token_count;
+    uint32_t expr_count;
+    uint32_t stmt_count;
+    uint32_t list_count;
+    uint32_t top_list;
+    uint64_t string_bytes;
+} CacheHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t line;
+    uint64_t start;
+    uint64_t count;
+    uint64_t lit;           // number or integer bits, or offset into the string table
+} CacheToken;
+
+typedef struct {
+    uint32_t type;
+    uint32_t token;         // for heap string literals, the STRING token owning the text
+    uint32_t kids[3];       // children always precede their parent
+    uint32_t list;          // offset of a [count, expr...] run for arguments and elements
+    uint32_t value_type;
+    uint64_t value;         // number or integer bits, boolean or string table offset of an inline string
+} CacheExpr;
+
+typedef struct {
+    uint32_t type;
+    uint32_t line;
+    uint32_t token;
+    uint32_t expr;
+    uint32_t stmts[2];
+    uint32_t list;          // offset of a [count, stmt...] run in the list table
+} CacheStmt;
+
+uint64_t hash_source(const char* source, size_t len);
+char* cache_path(const char* script_path, uint64_t hash);
+
+bool load_cache(const char* path, uint64_t hash, Tokenizer* tokenizer, Parser* parser);
+void write_cache(const char* path, uint64_t hash, Parser* parser);
+
+#endif // _CACHE_H
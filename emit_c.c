@@ -0,0 +1,742 @@
+#include <stdarg.h>
+#include <math.h>
+#include "emit_c.h"
+#include "builtins.h"
+
+// Every expression becomes one C expression. Operands that must be evaluated before the
+// rest of an expression are held in GNU statement expressions, so the emitted code keeps
+// the interpreter's left to right order. Variables are resolved while emitting: a 'var'
+// declares a fresh C local, which also gives shadowing the interpreter's semantics.
+//
+// A variable whose initializer and every assignment are float arithmetic is a plain
+// double. Whether an assignment is float arithmetic depends on the other variables, so
+// the program is emitted until a pass no longer demotes a variable to a boxed value.
+
+typedef struct {
+    const char* name;
+    size_t length;
+    bool number;
+} Binding;
+
+typedef struct {
+    char* text;
+    size_t index;
+    size_t size;
+
+    Binding* bindings;      // in declaration order, ids are the same in every pass
+    size_t binding_count;
+    size_t binding_size;
+    bool* demoted;          // per binding, assigned something that isn't known to be a float
+    bool* read;             // per binding, read in an earlier pass
+    bool changed;
+
+    size_t* scope;          // ids of the visible bindings, innermost last
+    size_t scope_index;
+    size_t scope_size;
+
+    Tokenizer* tokenizer;
+    int* token_slots;       // per token, its index in the emitted token table or -1
+    Token** tokens;
+    size_t token_count;
+    size_t token_size;
+
+    int indent;
+} Emitter;
+
+#pragma region Output
+static void* grow(void* items, size_t* size, size_t elem){
+    *size = *size == 0 ? INITIAL_BINDINGS : *size * 2;
+    void* grown = realloc(items, *size * elem);
+    if (grown == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "realloc failed");
+        exit(1);
+    }
+    return grown;
+}
+
+static void put(Emitter* e, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (e->index + n + 1 > e->size){
+        size_t size = e->size == 0 ? INITIAL_EMIT_SIZE : e->size;
+        while (e->index + n + 1 > size) size *= 2;
+        char* text = realloc(e->text, size);
+        if (text == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "realloc failed");
+            exit(1);
+        }
+        e->text = text;
+        e->size = size;
+    }
+    va_start(args, format);
+    vsnprintf(e->text + e->index, n + 1, format, args);
+    va_end(args);
+    e->index += n;
+}
+
+static void put_line(Emitter* e){
+    put(e, "\n%*s", e->indent * 4, "");
+}
+
+static void put_string(Emitter* e, const char* chars, size_t length){
+    put(e, "\"");
+    for (size_t i = 0; i < length; i++){
+        unsigned char c = (unsigned char)chars[i];
+        if (c == '"' || c == '\\' || c == '?') put(e, "\\%c", c);
+        else if (c == '\n') put(e, "\\n");
+        else if (c == '\t') put(e, "\\t");
+        else if (c < 32 || c >= 127) put(e, "\\%03o", c);
+        else put(e, "%c", c);
+    }
+    put(e, "\"");
+}
+
+static void put_double(Emitter* e, double d){
+    if (isinf(d)) {
+        put(e, d > 0 ? "__builtin_inf()" : "(-__builtin_inf())");
+        return;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", d);
+    put(e, "%s%s", buffer, strpbrk(buffer, ".e") != NULL ? "" : ".0");
+}
+
+static void put_token(Emitter* e, Token* token){
+    size_t i = (size_t)(token - e->tokenizer->tokens);
+    if (e->token_slots[i] < 0){
+        if (e->token_count == e->token_size) e->tokens = grow(e->tokens, &e->token_size, sizeof(Token*));
+        e->token_slots[i] = (int)e->token_count;
+        e->tokens[e->token_count++] = token;
+    }
+    put(e, "&tokens[%d]", e->token_slots[i]);
+}
+
+static void put_var(Emitter* e, int id){
+    Binding* binding = &e->bindings[id];
+    put(e, "v%d_%.*s", id, (int)binding->length, binding->name);
+}
+
+// variables no pass has read yet are declared with a (void) cast, so that C compilers don't
+// warn about the ones a redeclaration shadows before they are read
+static void put_read(Emitter* e, int id){
+    if (!e->read[id]){
+        e->read[id] = true;
+        e->changed = true;
+    }
+    put_var(e, id);
+}
+
+// the only token types the runtime looks at
+static const char* token_name(TokenType type){
+    switch (type){
+        case PLUS: return "PLUS";
+        case MINUS: return "MINUS";
+        case STAR: return "STAR";
+        case SLASH: return "SLASH";
+        case PERCENT: return "PERCENT";
+        case GREATER: return "GREATER";
+        case GREATER_EQUAL: return "GREATER_EQUAL";
+        case LESS: return "LESS";
+        case LESS_EQUAL: return "LESS_EQUAL";
+        case EQUAL_EQUAL: return "EQUAL_EQUAL";
+        case BANG_EQUAL: return "BANG_EQUAL";
+        case BANG: return "BANG";
+        default: return NULL;
+    }
+}
+
+static const char* c_operator(TokenType type){
+    switch (type){
+        case PLUS: return "+";
+        case MINUS: return "-";
+        case STAR: return "*";
+        case SLASH: return "/";
+        case GREATER: return ">";
+        case GREATER_EQUAL: return ">=";
+        case LESS: return "<";
+        case LESS_EQUAL: return "<=";
+        case EQUAL_EQUAL: return "==";
+        case BANG_EQUAL: return "!=";
+        default: return "?";
+    }
+}
+#pragma endregion Output
+
+#pragma region Scopes
+static int declare(Emitter* e, Token* name, bool number){
+    if (e->binding_count == e->binding_size){
+        size_t old = e->binding_size;
+        e->bindings = grow(e->bindings, &e->binding_size, sizeof(Binding));
+        e->demoted = realloc(e->demoted, e->binding_size * sizeof(bool));
+        e->read = realloc(e->read, e->binding_size * sizeof(bool));
+        if (e->demoted == NULL || e->read == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "realloc failed");
+            exit(1);
+        }
+        memset(e->demoted + old, 0, (e->binding_size - old) * sizeof(bool));
+        memset(e->read + old, 0, (e->binding_size - old) * sizeof(bool));
+    }
+    size_t id = e->binding_count++;
+    e->bindings[id] = (Binding){
+        .name = name->source + name->start,
+        .length = name->count - name->start,
+        .number = number && !e->demoted[id]
+    };
+    return (int)id;
+}
+
+// the declaration only becomes visible after its initializer was emitted
+static void enter(Emitter* e, int id){
+    if (e->scope_index == e->scope_size) e->scope = grow(e->scope, &e->scope_size, sizeof(size_t));
+    e->scope[e->scope_index++] = (size_t)id;
+}
+
+static int resolve(Emitter* e, Token* name){
+    const char* key = name->source + name->start;
+    size_t length = name->count - name->start;
+    for (size_t i = e->scope_index; i-- > 0;){
+        Binding* binding = &e->bindings[e->scope[i]];
+        if (binding->length == length && memcmp(binding->name, key, length) == 0) return (int)e->scope[i];
+    }
+    return -1;
+}
+#pragma endregion Scopes
+
+#pragma region Expressions
+static Expr* unwrap(Expr* expr){
+    while (expr->type == GROUPING) expr = expr->as.group.expression;
+    return expr;
+}
+
+static bool int_literal(Expr* expr){
+    expr = unwrap(expr);
+    return expr->type == LITERAL && expr->as.literal.type == INT_T;
+}
+
+static bool nonzero_literal(Expr* expr){
+    expr = unwrap(expr);
+    if (expr->type != LITERAL) return false;
+    if (expr->as.literal.type == INT_T) return expr->as.literal.as.integer != 0;
+    if (expr->as.literal.type == NUM_T) return expr->as.literal.as.number != 0;
+    return false;
+}
+
+static bool has_assign(Expr* expr);
+
+static bool list_has_assign(ExprList* list){
+    for (size_t i = 0; i < list->index; i++){
+        if (has_assign(list->exprs[i])) return true;
+    }
+    return false;
+}
+
+static bool has_assign(Expr* expr){
+    switch (expr->type){
+        case GROUPING: return has_assign(expr->as.group.expression);
+        case UNARY: return has_assign(expr->as.unary.right);
+        case BINARY: return has_assign(expr->as.binary.left) || has_assign(expr->as.binary.right);
+        case TERNARY: return has_assign(expr->as.ternary.cond) || has_assign(expr->as.ternary.trueBranch)
+            || has_assign(expr->as.ternary.falseBranch);
+        case CALL: return list_has_assign(expr->as.call.args);
+        case ARRAY: return list_has_assign(expr->as.array.elements);
+        case MAP: return list_has_assign(expr->as.map.entries);
+        case INDEX: return has_assign(expr->as.index.object) || has_assign(expr->as.index.index);
+        case SET_INDEX: return has_assign(expr->as.set_index.object) || has_assign(expr->as.set_index.index)
+            || has_assign(expr->as.set_index.value);
+        case ASSIGN: return true;
+        default: return false;
+    }
+}
+
+static bool is_number(Emitter* e, Expr* expr);
+
+// Operands of float arithmetic or comparisons. They can't fail or have side effects, so
+// C may evaluate them in any order, and integer literals convert like as_double() does.
+static bool number_operands(Emitter* e, BinaryExpr* binary){
+    if (int_literal(binary->left) && int_literal(binary->right)) return false;
+    if (has_assign(binary->left) || has_assign(binary->right)) return false;
+    return (int_literal(binary->left) || is_number(e, binary->left))
+        && (int_literal(binary->right) || is_number(e, binary->right));
+}
+
+// true if expr always produces a float and can be emitted as a C double
+static bool is_number(Emitter* e, Expr* expr){
+    switch (expr->type){
+    case GROUPING: return is_number(e, expr->as.group.expression);
+    case LITERAL: return expr->as.literal.type == NUM_T;
+    case VAREXPR: {
+        int id = resolve(e, expr->as.var.name);
+        return id >= 0 && e->bindings[id].number;
+    }
+    case ASSIGN: {
+        int id = resolve(e, expr->as.assign.name);
+        return id >= 0 && e->bindings[id].number && is_number(e, expr->as.assign.value);
+    }
+    case UNARY: return expr->as.unary.op->type == MINUS && is_number(e, expr->as.unary.right);
+    case BINARY:
+        switch (expr->as.binary.op->type){
+            case PLUS:
+            case MINUS:
+            case STAR: return number_operands(e, &expr->as.binary);
+            // division by zero is an error that yields nil
+            case SLASH: return number_operands(e, &expr->as.binary) && nonzero_literal(expr->as.binary.right);
+            default: return false;
+        }
+    default: return false;
+    }
+}
+
+static bool number_comparison(Emitter* e, Expr* expr){
+    expr = unwrap(expr);
+    if (expr->type != BINARY) return false;
+    switch (expr->as.binary.op->type){
+        case GREATER:
+        case GREATER_EQUAL:
+        case LESS:
+        case LESS_EQUAL:
+        case EQUAL_EQUAL:
+        case BANG_EQUAL: return number_operands(e, &expr->as.binary);
+        default: return false;
+    }
+}
+
+static void emit_number(Emitter* e, Expr* expr){
+    switch (expr->type){
+    case GROUPING: emit_number(e, expr->as.group.expression); break;
+    case LITERAL:
+        if (expr->as.literal.type == INT_T) put(e, "((double)INT64_C(%lld))", (long long)expr->as.literal.as.integer);
+        else put_double(e, expr->as.literal.as.number);
+        break;
+    case VAREXPR: put_read(e, resolve(e, expr->as.var.name)); break;
+    case ASSIGN:
+        put(e, "(");
+        put_var(e, resolve(e, expr->as.assign.name));
+        put(e, " = ");
+        emit_number(e, expr->as.assign.value);
+        put(e, ")");
+        break;
+    case UNARY:
+        put(e, "(-");
+        emit_number(e, expr->as.unary.right);
+        put(e, ")");
+        break;
+    case BINARY:
+        put(e, "(");
+        emit_number(e, expr->as.binary.left);
+        put(e, " %s ", c_operator(expr->as.binary.op->type));
+        emit_number(e, expr->as.binary.right);
+        put(e, ")");
+        break;
+    default: break;
+    }
+}
+
+static void emit_error(Emitter* e, Token* token, const char* format, ...){
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    put(e, "runtime_error(ctx, ");
+    put_token(e, token);
+    put(e, ", ");
+    put_string(e, message, strlen(message));
+    put(e, ")");
+}
+
+static void emit_value(Emitter* e, Expr* expr);
+
+static void emit_literal(Emitter* e, LiteralExpr* literal){
+    switch (literal->type){
+        case NIL_T: put(e, "nil_obj()"); break;
+        case BOOL_T: put(e, "bool_obj(%s)", literal->as.boolean ? "true" : "false"); break;
+        case INT_T: put(e, "int_obj(INT64_C(%lld))", (long long)literal->as.integer); break;
+        case NUM_T:
+            put(e, "num_obj(");
+            put_double(e, literal->as.number);
+            put(e, ")");
+            break;
+        case STR_T:
+            put(e, literal->sso ? "small_string(" : "string_obj(");
+            put_string(e, string_chars(literal), string_length(literal));
+            if (literal->sso) put(e, ", %zu", string_length(literal));
+            put(e, ")");
+            break;
+        default: put(e, "nil_obj()"); break;
+    }
+}
+
+static void emit_call(Emitter* e, CallExpr* call){
+    if (call->callee->type != VAREXPR){
+        emit_error(e, call->paren, "Can only call named builtins");
+        return;
+    }
+    Token* name = call->callee->as.var.name;
+    int length = (int)(name->count - name->start);
+    const Builtin* builtin = find_builtin(name->source + name->start, length);
+    if (builtin == NULL){
+        emit_error(e, name, "Undefined function '%.*s'", length, name->source + name->start);
+        return;
+    }
+    if (call->args->index != builtin->arity){
+        emit_error(e, call->paren, "Builtin '%s' expects %zu arguments, but got %zu", builtin->name, builtin->arity, call->args->index);
+        return;
+    }
+    put(e, "({ LiteralExpr _args[MAX_BUILTIN_ARITY]; ");
+    for (size_t i = 0; i < call->args->index; i++){
+        put(e, "_args[%zu] = ", i);
+        emit_value(e, call->args->exprs[i]);
+        put(e, "; ");
+    }
+    put(e, "builtins[%zu].fn(ctx, ", (size_t)(builtin - builtins));
+    put_token(e, call->paren);
+    put(e, ", _args); })");
+}
+
+static void emit_binary(Emitter* e, BinaryExpr* binary){
+    TokenType op = binary->op->type;
+    if (op == AND || op == OR){
+        put(e, "(isTruthy(");
+        emit_value(e, binary->left);
+        put(e, op == AND ? ") ? " : ") ? bool_obj(true) : ");
+        emit_value(e, binary->right);
+        put(e, op == AND ? " : bool_obj(false))" : ")");
+        return;
+    }
+    // reading a variable or a literal first only needs a temporary if the right side assigns
+    Expr* left = unwrap(binary->left);
+    bool simple = (left->type == LITERAL || (left->type == VAREXPR && resolve(e, left->as.var.name) >= 0))
+        && !has_assign(binary->right);
+    if (simple){
+        put(e, "binary_op(ctx, ");
+        put_token(e, binary->op);
+        put(e, ", ");
+        emit_value(e, binary->left);
+    } else {
+        put(e, "({ LiteralExpr _left = ");
+        emit_value(e, binary->left);
+        put(e, "; binary_op(ctx, ");
+        put_token(e, binary->op);
+        put(e, ", _left");
+    }
+    put(e, ", ");
+    emit_value(e, binary->right);
+    put(e, simple ? ")" : "); })");
+}
+
+static void emit_value(Emitter* e, Expr* expr){
+    if (expr->type != LITERAL && expr->type != GROUPING && is_number(e, expr)){
+        put(e, "num_obj(");
+        emit_number(e, expr);
+        put(e, ")");
+        return;
+    }
+    if (number_comparison(e, expr)){
+        BinaryExpr* binary = &unwrap(expr)->as.binary;
+        put(e, "bool_obj(");
+        emit_number(e, binary->left);
+        put(e, " %s ", c_operator(binary->op->type));
+        emit_number(e, binary->right);
+        put(e, ")");
+        return;
+    }
+    switch (expr->type){
+    case LITERAL: emit_literal(e, &expr->as.literal); break;
+    case GROUPING: emit_value(e, expr->as.group.expression); break;
+    case VAREXPR: {
+        Token* name = expr->as.var.name;
+        int id = resolve(e, name);
+        if (id < 0){
+            emit_error(e, name, "Undefined variable '%.*s'", (int)(name->count - name->start), name->source + name->start);
+        } else if (e->bindings[id].number){
+            put(e, "num_obj(");
+            put_read(e, id);
+            put(e, ")");
+        } else {
+            put_read(e, id);
+        }
+    } break;
+    case ASSIGN: {
+        Token* name = expr->as.assign.name;
+        int id = resolve(e, name);
+        if (id < 0){
+            put(e, "({ LiteralExpr _value = ");
+            emit_value(e, expr->as.assign.value);
+            put(e, "; ");
+            emit_error(e, name, "Undefined variable '%.*s'", (int)(name->count - name->start), name->source + name->start);
+            put(e, "; _value; })");
+            break;
+        }
+        if (e->bindings[id].number){
+            // is_number() failed for the value, the variable has to hold any value
+            e->demoted[id] = true;
+            e->changed = true;
+        }
+        put(e, "(");
+        put_var(e, id);
+        put(e, " = ");
+        emit_value(e, expr->as.assign.value);
+        put(e, ")");
+    } break;
+    case BINARY: emit_binary(e, &expr->as.binary); break;
+    case TERNARY:
+        put(e, "(isTruthy(");
+        emit_value(e, expr->as.ternary.cond);
+        put(e, ") ? ");
+        emit_value(e, expr->as.ternary.trueBranch);
+        put(e, " : ");
+        emit_value(e, expr->as.ternary.falseBranch);
+        put(e, ")");
+        break;
+    case UNARY:
+        // there is no scheduler in the runtime library
+        if (expr->as.unary.op->type == JOIN){
+            emit_error(e, expr->as.unary.op, "Tasks aren't supported in compiled scripts");
+            break;
+        }
+        put(e, "unary_op(ctx, ");
+        put_token(e, expr->as.unary.op);
+        put(e, ", ");
+        emit_value(e, expr->as.unary.right);
+        put(e, ")");
+        break;
+    case CALL: emit_call(e, &expr->as.call); break;
+    case ARRAY: {
+        ExprList* elements = expr->as.array.elements;
+        put(e, "({ Array* _array = create_array(%zu); ", elements->index);
+        for (size_t i = 0; i < elements->index; i++){
+            put(e, "array_push(_array, ");
+            emit_value(e, elements->exprs[i]);
+            put(e, "); ");
+        }
+        put(e, "array_obj(_array); })");
+    } break;
+    case MAP: {
+        ExprList* entries = expr->as.map.entries;
+        put(e, "({ Map* _map = create_map(%zu); ", entries->index / 2);
+        for (size_t i = 0; i + 1 < entries->index; i += 2){
+            put(e, "{ LiteralExpr _key = ");
+            emit_value(e, entries->exprs[i]);
+            put(e, "; map_literal_set(ctx, ");
+            put_token(e, expr->as.map.brace);
+            put(e, ", _map, _key, ");
+            emit_value(e, entries->exprs[i+1]);
+            put(e, "); } ");
+        }
+        put(e, "map_obj(_map); })");
+    } break;
+    case INDEX:
+        put(e, "({ LiteralExpr _object = ");
+        emit_value(e, expr->as.index.object);
+        put(e, "; index_get(ctx, ");
+        put_token(e, expr->as.index.bracket);
+        put(e, ", _object, ");
+        emit_value(e, expr->as.index.index);
+        put(e, "); })");
+        break;
+    case SET_INDEX:
+        put(e, "({ LiteralExpr _object = ");
+        emit_value(e, expr->as.set_index.object);
+        put(e, "; LiteralExpr _index = ");
+        emit_value(e, expr->as.set_index.index);
+        put(e, "; LiteralExpr _value = nil_obj(); if (index_target(ctx, ");
+        put_token(e, expr->as.set_index.bracket);
+        put(e, ", _object, &_index)) { _value = ");
+        emit_value(e, expr->as.set_index.value);
+        put(e, "; index_set(_object, _index, _value); } _value; })");
+        break;
+    case SPAWN_EXPR: emit_error(e, expr->as.spawn.keyword, "Tasks aren't supported in compiled scripts"); break;
+    case GENERATOR_EXPR: emit_error(e, expr->as.generator.keyword, "Generators aren't supported in compiled scripts"); break;
+    default: put(e, "nil_obj()"); break;
+    }
+}
+
+static void emit_condition(Emitter* e, Expr* expr){
+    if (number_comparison(e, expr)){
+        BinaryExpr* binary = &unwrap(expr)->as.binary;
+        put(e, "(");
+        emit_number(e, binary->left);
+        put(e, " %s ", c_operator(binary->op->type));
+        emit_number(e, binary->right);
+        put(e, ")");
+        return;
+    }
+    put(e, "isTruthy(");
+    emit_value(e, expr);
+    put(e, ")");
+}
+#pragma endregion Expressions
+
+#pragma region Statements
+static void emit_stmt(Emitter* e, Stmt* stmt);
+
+static void emit_block(Emitter* e, StmtList* list){
+    size_t scope = e->scope_index;
+    put(e, "{");
+    e->indent++;
+    for (size_t i = 0; i < list->index; i++) emit_stmt(e, &list->statements[i]);
+    e->indent--;
+    put_line(e);
+    put(e, "}");
+    e->scope_index = scope;
+}
+
+// bodies of if and while are always braced
+static void emit_body(Emitter* e, Stmt* stmt){
+    if (stmt->type == BLOCK_STMT){
+        put(e, " ");
+        emit_block(e, stmt->as.block.list);
+        return;
+    }
+    put(e, " {");
+    e->indent++;
+    emit_stmt(e, stmt);
+    e->indent--;
+    put_line(e);
+    put(e, "}");
+}
+
+static void emit_stmt(Emitter* e, Stmt* stmt){
+    switch (stmt->type){
+    case EXPR_STMT:
+        put_line(e);
+        if (is_number(e, stmt->as.expr.expression)) emit_number(e, stmt->as.expr.expression);
+        else emit_value(e, stmt->as.expr.expression);
+        put(e, ";");
+        break;
+    case PRINT_STMT:
+        put_line(e);
+        put(e, "print_value(ctx->out, ");
+        emit_value(e, stmt->as.print.expression);
+        put(e, ", 0);");
+        put_line(e);
+        put(e, "fprintf(ctx->out, \"\\n\");");
+        break;
+    case VAR_DECL_STMT: {
+        Expr* initializer = stmt->as.var.initializer;
+        int id = declare(e, stmt->as.var.name, initializer != NULL && is_number(e, initializer));
+        put_line(e);
+        if (e->bindings[id].number){
+            put(e, "double ");
+            put_var(e, id);
+            put(e, " = ");
+            emit_number(e, initializer);
+        } else {
+            put(e, "LiteralExpr ");
+            put_var(e, id);
+            put(e, " = ");
+            if (initializer != NULL) emit_value(e, initializer);
+            else put(e, "nil_obj()");
+        }
+        put(e, ";");
+        if (!e->read[id]){
+            put(e, " (void)");
+            put_var(e, id);
+            put(e, ";");
+        }
+        enter(e, id);
+    } break;
+    case BLOCK_STMT:
+        put_line(e);
+        emit_block(e, stmt->as.block.list);
+        break;
+    case IF_STMT:
+        put_line(e);
+        put(e, "if (");
+        emit_condition(e, stmt->as.if_stmt.cond);
+        put(e, ")");
+        emit_body(e, stmt->as.if_stmt.trueBranch);
+        if (stmt->as.if_stmt.falseBranch != NULL){
+            put(e, " else ");
+            emit_body(e, stmt->as.if_stmt.falseBranch);
+        }
+        break;
+    case WHILE_STMT:
+        put_line(e);
+        put(e, "while (");
+        emit_condition(e, stmt->as.while_stmt.cond);
+        put(e, ")");
+        emit_body(e, stmt->as.while_stmt.body);
+        break;
+    case PARALLEL_STMT:
+        put_line(e);
+        emit_error(e, stmt->as.parallel.keyword, "Parallel loops aren't supported in compiled scripts");
+        put(e, ";");
+        break;
+    case FOR_IN_STMT:
+        put_line(e);
+        emit_error(e, stmt->as.for_in.keyword, "For-in loops aren't supported in compiled scripts");
+        put(e, ";");
+        break;
+    default: break;
+    }
+}
+#pragma endregion Statements
+
+void emit_c(FILE* out, Parser* parser, const char* path){
+    if (ast_depth(parser->stmt_list) > MAX_RECURSIVE_DEPTH){
+        plerror(parser->tokenizer->ctx, -1, -1, PARSE_ERR, "Expressions nested deeper than %d levels can't be emitted as C", MAX_RECURSIVE_DEPTH);
+        return;
+    }
+    Emitter e = { .tokenizer = parser->tokenizer };
+    size_t token_total = parser->tokenizer->list_index + 1;
+    e.token_slots = (int*)malloc(sizeof(int) * token_total);
+    if (e.token_slots == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for the C emitter");
+        exit(1);
+    }
+    StmtList* list = parser->stmt_list;
+    do {
+        e.changed = false;
+        e.index = 0;
+        e.binding_count = 0;
+        e.scope_index = 0;
+        e.token_count = 0;
+        e.indent = 1;
+        memset(e.token_slots, 0xFF, sizeof(int) * token_total);
+        for (size_t i = 0; i < list->index; i++) emit_stmt(&e, &list->statements[i]);
+    } while (e.changed);
+
+    fprintf(out, "// Generated by plang --emit-c from %s\n", path != NULL ? path : "<stdin>");
+    fprintf(out, "#include \"runtime.h\"\n\n");
+
+    // tokens point into the source so that errors report the same line and column
+    Emitter header = { 0 };
+    put(&header, "static char source[] =");
+    Tokenizer* tokenizer = parser->tokenizer;
+    size_t start = 0;
+    for (size_t i = 0; i < tokenizer->source_len; i++){
+        if (tokenizer->source[i] != '\n' && i + 1 < tokenizer->source_len) continue;
+        put(&header, "\n    ");
+        put_string(&header, tokenizer->source + start, i + 1 - start);
+        start = i + 1;
+    }
+    put(&header, tokenizer->source_len == 0 ? " \"\";\n\n" : ";\n\n");
+    put(&header, "static Token tokens[] = {\n");
+    for (size_t i = 0; i < e.token_count; i++){
+        Token* token = e.tokens[i];
+        const char* type = token_name(token->type);
+        put(&header, "    { %s%s%s.line = %zu, .start = %zu, .source = source },\n",
+            type != NULL ? ".type = " : "", type != NULL ? type : "", type != NULL ? ", " : "", token->line, token->start);
+    }
+    if (e.token_count == 0) put(&header, "    { .source = source },\n");
+    put(&header, "};\n\n");
+    fwrite(header.text, 1, header.index, out);
+
+    fprintf(out, "int main(void){\n");
+    fprintf(out, "    Context context = create_context(stdout, stderr);\n");
+    fprintf(out, "    Context* ctx = &context;");
+    if (e.index > 0) fwrite(e.text, 1, e.index, out);
+    fprintf(out, "\n    return ctx->hadError ? 1 : 0;\n}\n");
+
+    free(header.text);
+    free(e.text);
+    free(e.bindings);
+    free(e.demoted);
+    free(e.read);
+    free(e.scope);
+    free(e.token_slots);
+    free(e.tokens);
+}
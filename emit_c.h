@@ -0,0 +1,15 @@
+#ifndef _EMIT_C_H
+#define _EMIT_C_H
+
+#include "parser.h"
+
+#define INITIAL_EMIT_SIZE 4096
+#define INITIAL_BINDINGS 16
+
+// Writes the parsed program as a standalone C translation unit with the same value
+// semantics as the interpreter. It only needs runtime.h and libplangrt.a (make runtime):
+//   gcc -O2 script.c -I<plang> <plang>/libplangrt.a -o script
+// Variables become C locals, those that only ever hold floats are plain doubles.
+void emit_c(FILE* out, Parser* parser, const char* path);
+
+#endif // _EMIT_C_H
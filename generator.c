@@ -0,0 +1,146 @@
+#include "generator.h"
+#include "runtime.h"
+#include "task.h"
+#include "io.h"
+
+// a block, while or for-in loop the body is in the middle of
+typedef struct {
+    Stmt* stmt;
+    Env* scope;             // where the statements of the frame run
+    Env env;                // the scope of a block, or the one of a loop's variable
+    LiteralExpr* var;       // the variable of a for-in loop, in env
+    LiteralExpr iterable;
+    size_t index;           // next statement of a block, next element of an array
+} Frame;
+
+struct Generator {
+    GeneratorExpr* expr;
+    Env root;               // the copied variables
+    bool started;
+    bool running;
+    bool done;
+    size_t count;           // frames in use
+    Frame frames[];
+};
+
+LiteralExpr make_generator(GeneratorExpr* expr, Env* env){
+    Generator* gen = (Generator*)mem_calloc(MEM_GENERATORS, 1, sizeof(Generator) + sizeof(Frame) * expr->depth);
+    if (gen == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for generator");
+        exit(1);
+    }
+    gen->expr = expr;
+    init_env(&gen->root, NULL);
+    SpawnCaptures* captures = body_captures(expr->body, &expr->captures);
+    for (size_t i = 0; i < captures->count; i++){
+        Token* name = captures->names[i];
+        const char* key = name->source + name->start;
+        size_t length = name->count - name->start;
+        LiteralExpr* value = lookup_value(env, key, length);
+        if (value != NULL) define(&gen->root, key, length, *value);
+    }
+    return (LiteralExpr){ .type = GEN_T, .as.generator = gen };
+}
+
+static bool yields(GeneratorExpr* expr, Stmt* stmt){
+    size_t low = 0, high = expr->yielding_count;
+    while (low < high){
+        size_t mid = low + (high - low) / 2;
+        if (expr->yielding[mid] == stmt) return true;
+        if ((uintptr_t)expr->yielding[mid] < (uintptr_t)stmt) low = mid + 1;
+        else high = mid;
+    }
+    return false;
+}
+
+static void push_frame(Context* ctx, Generator* gen, Stmt* stmt, Env* scope){
+    Frame* frame = &gen->frames[gen->count++];
+    *frame = (Frame){ .stmt = stmt, .scope = scope };
+    if (stmt->type == BLOCK_STMT){
+        init_env(&frame->env, scope);
+        frame->scope = &frame->env;
+    } else if (stmt->type == FOR_IN_STMT){
+        // bodies aren't declarations, nothing else is ever defined in this scope
+        Token* var = stmt->as.for_in.var;
+        frame->iterable = evaluate(ctx, stmt->as.for_in.iterable, scope);
+        init_env(&frame->env, scope);
+        define(&frame->env, var->source + var->start, var->count - var->start, nil_obj());
+        frame->var = lookup_value(&frame->env, var->source + var->start, var->count - var->start);
+        frame->scope = &frame->env;
+    }
+}
+
+static void pop_frame(Generator* gen){
+    Frame* frame = &gen->frames[--gen->count];
+    if (frame->scope == &frame->env) release_env(&frame->env);
+}
+
+// runs stmt, true if it yielded into *value. Statements with a yield in them become
+// frames and the ifs among them pick their branch here.
+static bool step(Context* ctx, Generator* gen, Stmt* stmt, Env* scope, LiteralExpr* value){
+    while (stmt != NULL && stmt->type == IF_STMT && yields(gen->expr, stmt)){
+        IfStmt* branch = &stmt->as.if_stmt;
+        stmt = isTruthy(evaluate(ctx, branch->cond, scope)) ? branch->trueBranch : branch->falseBranch;
+    }
+    if (stmt == NULL) return false;
+    if (stmt->type == YIELD_STMT){
+        *value = evaluate(ctx, stmt->as.yield.value, scope);
+        return true;
+    }
+    if (yields(gen->expr, stmt)) push_frame(ctx, gen, stmt, scope);
+    else execute(ctx, stmt, scope);
+    return false;
+}
+
+bool resume_generator(Context* ctx, Token* at, Generator* gen, LiteralExpr* value){
+    // a body that loops over its own generator, or two threads sharing one
+    if (__atomic_exchange_n(&gen->running, true, __ATOMIC_ACQUIRE)){
+        runtime_error(ctx, at, "A generator can't be resumed while it is running");
+        return false;
+    }
+    bool yielded = false;
+    if (!gen->started){
+        gen->started = true;
+        yielded = step(ctx, gen, gen->expr->body, &gen->root, value);
+    }
+    while (!yielded && gen->count > 0){
+        Frame* frame = &gen->frames[gen->count - 1];
+        Stmt* stmt = frame->stmt;
+        Stmt* next = NULL;
+        switch (stmt->type)
+        {
+        case BLOCK_STMT:
+            if (frame->index < stmt->as.block.list->index) next = &stmt->as.block.list->statements[frame->index++];
+            break;
+        case WHILE_STMT:
+            if (isTruthy(evaluate(ctx, stmt->as.while_stmt.cond, frame->scope))) next = stmt->as.while_stmt.body;
+            break;
+        case FOR_IN_STMT:
+            if (next_item(ctx, &stmt->as.for_in, frame->iterable, &frame->index, frame->var)) next = stmt->as.for_in.body;
+            break;
+        default: break;
+        }
+        if (next == NULL) pop_frame(gen);
+        else yielded = step(ctx, gen, next, frame->scope, value);
+    }
+    if (!yielded && !gen->done){
+        gen->done = true;
+        release_env(&gen->root);
+    }
+    __atomic_store_n(&gen->running, false, __ATOMIC_RELEASE);
+    return yielded;
+}
+
+bool next_item(Context* ctx, ForInStmt* loop, LiteralExpr iterable, size_t* index, LiteralExpr* item){
+    if (iterable.type == GEN_T) return resume_generator(ctx, loop->keyword, iterable.as.generator, item);
+    // the loop's index is its byte offset in a mapped file
+    if (iterable.type == FILE_T) return file_next(iterable.as.file, index, item);
+    if (iterable.type != ARR_T){
+        runtime_error(ctx, loop->keyword, "Can only loop over arrays, generators and files");
+        return false;
+    }
+    // the body may push or remove, the count is looked at again every time
+    if (*index >= iterable.as.array->count) return false;
+    *item = array_get(iterable.as.array, (*index)++);
+    return true;
+}
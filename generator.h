@@ -0,0 +1,24 @@
+#ifndef _GENERATOR_H
+#define _GENERATOR_H
+
+#include "interpreter.h"
+
+// 'generator { ... }' yields a generator without running anything. Each step of a
+// 'for (var x in g)' loop runs its body on to the next 'yield' and takes the value, the
+// loop ends once the body has finished.
+//
+// Generators don't have a stack of their own. The blocks and loops the body is in the
+// middle of are kept as frames in the generator's one heap allocation, sized by the parser
+// (GeneratorExpr.depth), and resuming steps through them again from the innermost.
+// Statements without a yield run as usual, so only where the body can stop costs frames.
+//
+// A generator starts with the values its body's variables had where it was made; arrays
+// and maps are shared as everywhere else.
+
+LiteralExpr make_generator(GeneratorExpr* expr, Env* env);
+// runs the generator on to its next yield into *value, false once its body has finished
+bool resume_generator(Context* ctx, Token* at, Generator* gen, LiteralExpr* value);
+// the next element of an array, value of a generator or item of a file for a for-in loop, false at the end
+bool next_item(Context* ctx, ForInStmt* loop, LiteralExpr iterable, size_t* index, LiteralExpr* item);
+
+#endif // _GENERATOR_H
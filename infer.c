@@ -0,0 +1,597 @@
+#include "infer.h"
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// the value types an expression or variable may have, one bit per ValueType
+typedef uint16_t Types;
+#define TYPE(t) ((Types)(1u << (t)))
+#define ANY_TYPE ((Types)0xFFFF)
+#define NUMBER_TYPES (TYPE(INT_T) | TYPE(NUM_T))
+
+// The model is a run without runtime errors. Once one is reported, operations may have
+// been left half done (a call whose arguments were never evaluated, an expression over
+// the depth budget) and the interpreter stops trusting the proofs for the rest of the run.
+typedef struct {
+    Token* name;
+    uint32_t hash;
+    Types types;
+    size_t shadows;         // index + 1 of the fact with the same name it hides, 0 if none
+} Fact;
+
+// the innermost fact of every name seen so far
+typedef struct {
+    Token* name;            // NULL if the slot is free
+    uint32_t hash;
+    size_t fact;            // index + 1, 0 while no fact of the name is in scope
+} NameSlot;
+
+// Where a loop nested in another one settled, so the next round of the outer loop doesn't
+// have to find it again from the start. The types are of all facts at the loop.
+typedef struct {
+    Stmt* body;             // NULL if the slot is free
+    Types* head;
+    size_t count;
+} LoopHead;
+
+typedef struct {
+    Fact* facts;            // the variables in scope, innermost last
+    size_t count;
+    size_t size;
+    NameSlot* names;
+    size_t name_count;
+    size_t name_size;
+    LoopHead* loops;
+    size_t loop_count;
+    size_t loop_size;
+    size_t scope;           // where the facts of the innermost scope begin
+    size_t base;            // facts below base belong to code a spawned body was copied from
+    bool marking;           // false while loop bodies are repeated towards their fixpoint
+    size_t visits;
+    size_t budget;
+    bool exhausted;
+    InferStats stats;
+} Inference;
+
+static bool same_name(Token* a, Token* b){
+    size_t length = a->count - a->start;
+    return b->count - b->start == length && memcmp(a->source + a->start, b->source + b->start, length) == 0;
+}
+
+static uint32_t hash_name(Token* name){
+    uint32_t hash = 2166136261u;
+    for (size_t i = name->start; i < name->count; i++){
+        hash ^= (uint8_t)name->source[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static bool is_typed_op(TokenType op){
+    switch (op)
+    {
+    case PLUS: case MINUS: case STAR: case SLASH:
+    case GREATER: case GREATER_EQUAL: case LESS: case LESS_EQUAL: return true;
+    default: return false;
+    }
+}
+
+#pragma region Facts
+static NameSlot* probe(NameSlot* names, size_t size, Token* name, uint32_t hash){
+    size_t i = hash & (size - 1);
+    while (names[i].name != NULL && !(names[i].hash == hash && same_name(names[i].name, name))) i = (i + 1) & (size - 1);
+    return &names[i];
+}
+
+static NameSlot* find_name(Inference* inf, Token* name, uint32_t hash){
+    if (2 * (inf->name_count + 1) > inf->name_size){
+        size_t size = inf->name_size == 0 ? INITIAL_FACTS_SIZE : inf->name_size * 2;
+        NameSlot* names = (NameSlot*)calloc(size, sizeof(NameSlot));
+        if (names == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for type inference");
+            exit(1);
+        }
+        for (size_t i = 0; i < inf->name_size; i++){
+            NameSlot* old = &inf->names[i];
+            if (old->name != NULL) *probe(names, size, old->name, old->hash) = *old;
+        }
+        free(inf->names);
+        inf->names = names;
+        inf->name_size = size;
+    }
+    NameSlot* slot = probe(inf->names, inf->name_size, name, hash);
+    if (slot->name == NULL){
+        *slot = (NameSlot){ .name = name, .hash = hash };
+        inf->name_count++;
+    }
+    return slot;
+}
+
+// declaring a name twice in one scope replaces it, as define() does
+static void declare(Inference* inf, Token* name, Types types){
+    uint32_t hash = hash_name(name);
+    NameSlot* slot = find_name(inf, name, hash);
+    if (slot->fact > inf->scope){
+        inf->facts[slot->fact - 1].types = types;
+        return;
+    }
+    if (inf->count == inf->size){
+        size_t size = inf->size == 0 ? INITIAL_FACTS_SIZE : inf->size * 2;
+        Fact* facts = (Fact*)realloc(inf->facts, sizeof(Fact) * size);
+        if (facts == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for type inference");
+            exit(1);
+        }
+        inf->facts = facts;
+        inf->size = size;
+    }
+    inf->facts[inf->count++] = (Fact){ .name = name, .hash = hash, .types = types, .shadows = slot->fact };
+    slot->fact = inf->count;
+}
+
+typedef struct {
+    size_t count, scope, base;
+} Scope;
+
+// detached scopes see none of the facts outside of them
+static Scope enter_scope(Inference* inf, bool detached){
+    Scope outer = { .count = inf->count, .scope = inf->scope, .base = inf->base };
+    inf->scope = inf->count;
+    if (detached) inf->base = inf->count;
+    return outer;
+}
+
+static void leave_scope(Inference* inf, Scope outer){
+    while (inf->count > outer.count){
+        Fact* fact = &inf->facts[--inf->count];
+        find_name(inf, fact->name, fact->hash)->fact = fact->shadows;
+    }
+    inf->scope = outer.scope;
+    inf->base = outer.base;
+}
+
+// NULL for names the program uses without declaring them first
+static Fact* find_fact(Inference* inf, Token* name){
+    NameSlot* slot = find_name(inf, name, hash_name(name));
+    return slot->fact > inf->base ? &inf->facts[slot->fact - 1] : NULL;
+}
+
+// Copying the types of every fact is cheap next to visiting a node, but a branch in
+// the scope of thousands of variables still counts towards the budget
+static void charge(Inference* inf){
+    inf->visits += inf->count / INFER_BUDGET;
+}
+
+// a function defined by the embedder may change any variable through plang.h
+static void forget_all(Inference* inf){
+    charge(inf);
+    for (size_t i = 0; i < inf->count; i++) inf->facts[i].types = ANY_TYPE;
+}
+
+// the types of every fact in scope, to come back to after a branch
+static Types* save(Inference* inf){
+    charge(inf);
+    Types* saved = (Types*)malloc(sizeof(Types) * (inf->count + 1));
+    if (saved == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for type inference");
+        exit(1);
+    }
+    for (size_t i = 0; i < inf->count; i++) saved[i] = inf->facts[i].types;
+    return saved;
+}
+
+static void restore(Inference* inf, Types* saved){
+    for (size_t i = 0; i < inf->count; i++) inf->facts[i].types = saved[i];
+}
+
+// adds the current types into saved, true if that changed it. Branches and loop bodies
+// can't declare anything outside of their blocks, so both cover the same facts.
+static bool join_into(Inference* inf, Types* saved){
+    charge(inf);
+    bool changed = false;
+    for (size_t i = 0; i < inf->count; i++){
+        Types joined = saved[i] | inf->facts[i].types;
+        changed |= joined != saved[i];
+        saved[i] = joined;
+    }
+    return changed;
+}
+#pragma endregion Facts
+
+#pragma region Inference
+static void infer_stmt(Inference* inf, Stmt* stmt);
+
+static bool visit(Inference* inf){
+    if (inf->exhausted) return false;
+    if (++inf->visits > inf->budget) inf->exhausted = true;
+    return !inf->exhausted;
+}
+
+static void prove(Inference* inf, BinaryExpr* binary, Types left, Types right){
+    if (!inf->marking || !is_typed_op(binary->op->type)) return;
+    Proof proof = UNPROVEN;
+    if ((left & ~NUMBER_TYPES) == 0 && (right & ~NUMBER_TYPES) == 0) proof = PROVEN_NUMBERS;
+    else if (binary->op->type == PLUS && left == TYPE(STR_T) && right == TYPE(STR_T)) proof = PROVEN_STRINGS;
+    binary->proof = proof;
+    if (proof == PROVEN_NUMBERS) inf->stats.numbers++;
+    else if (proof == PROVEN_STRINGS) inf->stats.strings++;
+}
+
+// spawned and generator bodies start from nothing known, they see copies of the variables
+static void infer_detached(Inference* inf, Stmt* body){
+    Scope outer = enter_scope(inf, true);
+    infer_stmt(inf, body);
+    leave_scope(inf, outer);
+}
+
+static Types infer_expr(Inference* inf, Expr* expr){
+    if (expr == NULL) return TYPE(NIL_T);
+    if (!visit(inf)) return ANY_TYPE;
+    switch (expr->type)
+    {
+    case LITERAL: return TYPE(expr->as.literal.type);
+    case VAREXPR: {
+        Fact* fact = find_fact(inf, expr->as.var.name);
+        return fact != NULL ? fact->types : ANY_TYPE;
+    }
+    case GROUPING: return infer_expr(inf, expr->as.group.expression);
+    case INVARIANT: return infer_expr(inf, expr->as.invariant.expr);
+    case BINARY: {
+        BinaryExpr* binary = &expr->as.binary;
+        Types left = infer_expr(inf, binary->left);
+        switch (binary->op->type)
+        {
+        case AND:
+        case OR: {
+            // the right side may not run
+            Types* before = save(inf);
+            Types right = infer_expr(inf, binary->right);
+            join_into(inf, before);
+            restore(inf, before);
+            free(before);
+            return TYPE(BOOL_T) | right;
+        }
+        default: break;
+        }
+        Types right = infer_expr(inf, binary->right);
+        prove(inf, binary, left, right);
+        switch (binary->op->type)
+        {
+        case PLUS: {
+            Types result = 0;
+            if ((left & NUMBER_TYPES) && (right & NUMBER_TYPES)) result |= NUMBER_TYPES;
+            if ((left & TYPE(STR_T)) && (right & TYPE(STR_T))) result |= TYPE(STR_T);
+            return result;
+        }
+        case MINUS: case STAR: case SLASH: return NUMBER_TYPES;
+        case PERCENT: return TYPE(INT_T);
+        default: return TYPE(BOOL_T);
+        }
+    }
+    case UNARY: {
+        infer_expr(inf, expr->as.unary.right);
+        switch (expr->as.unary.op->type)
+        {
+        case MINUS: return NUMBER_TYPES;
+        case BANG: return TYPE(BOOL_T);
+        default: return ANY_TYPE;
+        }
+    }
+    case TERNARY: {
+        infer_expr(inf, expr->as.ternary.cond);
+        Types* before = save(inf);
+        Types result = infer_expr(inf, expr->as.ternary.trueBranch);
+        Types* after = save(inf);
+        restore(inf, before);
+        result |= infer_expr(inf, expr->as.ternary.falseBranch);
+        join_into(inf, after);
+        restore(inf, after);
+        free(before);
+        free(after);
+        return result;
+    }
+    case ASSIGN: {
+        Types value = infer_expr(inf, expr->as.assign.value);
+        Fact* fact = find_fact(inf, expr->as.assign.name);
+        if (fact != NULL) fact->types = value;
+        return value;
+    }
+    case CALL: {
+        ExprList* args = expr->as.call.args;
+        for (size_t i = 0; i < args->index; i++) infer_expr(inf, args->exprs[i]);
+        Expr* callee = expr->as.call.callee;
+        if (callee->type == VAREXPR){
+            Token* name = callee->as.var.name;
+            if (find_builtin(name->source + name->start, name->count - name->start) != NULL) return ANY_TYPE;
+        }
+        forget_all(inf);
+        return ANY_TYPE;
+    }
+    case ARRAY: {
+        ExprList* elements = expr->as.array.elements;
+        for (size_t i = 0; i < elements->index; i++) infer_expr(inf, elements->exprs[i]);
+        return TYPE(ARR_T);
+    }
+    case MAP: {
+        ExprList* entries = expr->as.map.entries;
+        for (size_t i = 0; i < entries->index; i++) infer_expr(inf, entries->exprs[i]);
+        return TYPE(MAP_T);
+    }
+    case INDEX:
+        infer_expr(inf, expr->as.index.object);
+        infer_expr(inf, expr->as.index.index);
+        return ANY_TYPE;
+    case SET_INDEX:
+        infer_expr(inf, expr->as.set_index.object);
+        infer_expr(inf, expr->as.set_index.index);
+        return infer_expr(inf, expr->as.set_index.value);
+    case SPAWN_EXPR:
+        infer_detached(inf, expr->as.spawn.body);
+        return TYPE(TASK_T);
+    case GENERATOR_EXPR:
+        infer_detached(inf, expr->as.generator.body);
+        return TYPE(GEN_T);
+    default: return ANY_TYPE;
+    }
+}
+
+static LoopHead* probe_loop(LoopHead* loops, size_t size, Stmt* body){
+    size_t i = ((uintptr_t)body >> 4) & (size - 1);
+    while (loops[i].body != NULL && loops[i].body != body) i = (i + 1) & (size - 1);
+    return &loops[i];
+}
+
+// NULL if the loop settled nowhere yet and add is false
+static LoopHead* find_loop(Inference* inf, Stmt* body, bool add){
+    if (inf->loop_size > 0){
+        LoopHead* known = probe_loop(inf->loops, inf->loop_size, body);
+        if (known->body != NULL || !add) return known->body != NULL ? known : NULL;
+    } else if (!add) return NULL;
+    if (2 * (inf->loop_count + 1) > inf->loop_size){
+        size_t size = inf->loop_size == 0 ? INITIAL_FACTS_SIZE : inf->loop_size * 2;
+        LoopHead* loops = (LoopHead*)calloc(size, sizeof(LoopHead));
+        if (loops == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for type inference");
+            exit(1);
+        }
+        for (size_t i = 0; i < inf->loop_size; i++){
+            if (inf->loops[i].body != NULL) *probe_loop(loops, size, inf->loops[i].body) = inf->loops[i];
+        }
+        free(inf->loops);
+        inf->loops = loops;
+        inf->loop_size = size;
+    }
+    LoopHead* known = probe_loop(inf->loops, inf->loop_size, body);
+    *known = (LoopHead){ .body = body };
+    inf->loop_count++;
+    return known;
+}
+
+// Repeats cond and body from the types at the head of the loop, joined with those at
+// the end of the body, until they stop changing. Only then are the operations inside
+// proven, in one more pass from the final head.
+static void infer_loop(Inference* inf, Expr* cond, Stmt* body){
+    bool marking = inf->marking;
+    inf->marking = false;
+    Types* head = save(inf);
+    // where the loop settled before holds from here as well if it covers the types here
+    LoopHead* known = find_loop(inf, body, !marking);
+    bool settled = false;
+    if (known != NULL && known->head != NULL && known->count == inf->count){
+        settled = true;
+        for (size_t i = 0; i < inf->count; i++){
+            settled &= (head[i] & ~known->head[i]) == 0;
+            head[i] |= known->head[i];
+        }
+        restore(inf, head);
+    }
+    while (!settled){
+        infer_expr(inf, cond);
+        infer_stmt(inf, body);
+        settled = !join_into(inf, head) || inf->exhausted;
+        restore(inf, head);
+    }
+    // loops in the body may have moved the table
+    known = known != NULL ? find_loop(inf, body, true) : NULL;
+    if (known != NULL && !inf->exhausted){
+        if (known->count != inf->count || known->head == NULL){
+            free(known->head);
+            known->head = save(inf);
+            known->count = inf->count;
+        } else memcpy(known->head, head, sizeof(Types) * inf->count);
+    }
+    inf->marking = marking;
+    // the loop ends after its condition
+    infer_expr(inf, cond);
+    if (marking){
+        Types* exit = save(inf);
+        infer_stmt(inf, body);
+        restore(inf, exit);
+        free(exit);
+    }
+    free(head);
+}
+
+static void infer_stmt(Inference* inf, Stmt* stmt){
+    if (stmt == NULL || !visit(inf)) return;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: infer_expr(inf, stmt->as.expr.expression); break;
+    case PRINT_STMT: infer_expr(inf, stmt->as.print.expression); break;
+    case YIELD_STMT: infer_expr(inf, stmt->as.yield.value); break;
+    case VAR_DECL_STMT: {
+        Types types = infer_expr(inf, stmt->as.var.initializer);
+        declare(inf, stmt->as.var.name, types);
+    } break;
+    case BLOCK_STMT: {
+        Scope outer = enter_scope(inf, false);
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++) infer_stmt(inf, &list->statements[i]);
+        leave_scope(inf, outer);
+    } break;
+    case IF_STMT: {
+        infer_expr(inf, stmt->as.if_stmt.cond);
+        Types* before = save(inf);
+        infer_stmt(inf, stmt->as.if_stmt.trueBranch);
+        Types* after = save(inf);
+        restore(inf, before);
+        infer_stmt(inf, stmt->as.if_stmt.falseBranch);
+        join_into(inf, after);
+        restore(inf, after);
+        free(before);
+        free(after);
+    } break;
+    case WHILE_STMT: infer_loop(inf, stmt->as.while_stmt.cond, stmt->as.while_stmt.body); break;
+    case FOR_IN_STMT: {
+        infer_expr(inf, stmt->as.for_in.iterable);
+        Scope outer = enter_scope(inf, false);
+        declare(inf, stmt->as.for_in.var, ANY_TYPE);
+        infer_loop(inf, NULL, stmt->as.for_in.body);
+        leave_scope(inf, outer);
+    } break;
+    case PARALLEL_STMT: {
+        ParallelStmt* loop = &stmt->as.parallel;
+        infer_expr(inf, loop->start);
+        infer_expr(inf, loop->end);
+        // chunks run like spawned bodies, with the targets starting from their identities
+        Scope outer = enter_scope(inf, true);
+        for (size_t i = 0; i < loop->reduction_count; i++){
+            Token* op = loop->reductions[i].op;
+            declare(inf, loop->reductions[i].name, op->type == PLUS || op->type == STAR ? TYPE(INT_T) : TYPE(NUM_T));
+        }
+        declare(inf, loop->var, TYPE(INT_T));
+        infer_loop(inf, NULL, loop->body);
+        leave_scope(inf, outer);
+        for (size_t i = 0; i < loop->reduction_count; i++){
+            Fact* fact = find_fact(inf, loop->reductions[i].name);
+            if (fact != NULL) fact->types = ANY_TYPE;
+        }
+    } break;
+    default: break;
+    }
+}
+#pragma endregion Inference
+
+#pragma region Reset
+static void reset_stmt(Inference* inf, Stmt* stmt);
+
+// clears what an earlier run of the pass proved and counts the nodes for the budget
+static void reset_expr(Inference* inf, Expr* expr){
+    if (expr == NULL) return;
+    inf->budget += INFER_BUDGET;
+    switch (expr->type)
+    {
+    case BINARY:
+        expr->as.binary.proof = UNPROVEN;
+        if (is_typed_op(expr->as.binary.op->type)) inf->stats.operations++;
+        reset_expr(inf, expr->as.binary.left);
+        reset_expr(inf, expr->as.binary.right);
+        break;
+    case TERNARY:
+        reset_expr(inf, expr->as.ternary.cond);
+        reset_expr(inf, expr->as.ternary.trueBranch);
+        reset_expr(inf, expr->as.ternary.falseBranch);
+        break;
+    case UNARY: reset_expr(inf, expr->as.unary.right); break;
+    case GROUPING: reset_expr(inf, expr->as.group.expression); break;
+    case ASSIGN: reset_expr(inf, expr->as.assign.value); break;
+    case CALL:
+        for (size_t i = 0; i < expr->as.call.args->index; i++) reset_expr(inf, expr->as.call.args->exprs[i]);
+        break;
+    case ARRAY:
+        for (size_t i = 0; i < expr->as.array.elements->index; i++) reset_expr(inf, expr->as.array.elements->exprs[i]);
+        break;
+    case MAP:
+        for (size_t i = 0; i < expr->as.map.entries->index; i++) reset_expr(inf, expr->as.map.entries->exprs[i]);
+        break;
+    case INDEX:
+        reset_expr(inf, expr->as.index.object);
+        reset_expr(inf, expr->as.index.index);
+        break;
+    case SET_INDEX:
+        reset_expr(inf, expr->as.set_index.object);
+        reset_expr(inf, expr->as.set_index.index);
+        reset_expr(inf, expr->as.set_index.value);
+        break;
+    case INVARIANT: reset_expr(inf, expr->as.invariant.expr); break;
+    case SPAWN_EXPR: reset_stmt(inf, expr->as.spawn.body); break;
+    case GENERATOR_EXPR: reset_stmt(inf, expr->as.generator.body); break;
+    default: break;
+    }
+}
+
+static void reset_stmt(Inference* inf, Stmt* stmt){
+    if (stmt == NULL) return;
+    inf->budget += INFER_BUDGET;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: reset_expr(inf, stmt->as.expr.expression); break;
+    case PRINT_STMT: reset_expr(inf, stmt->as.print.expression); break;
+    case YIELD_STMT: reset_expr(inf, stmt->as.yield.value); break;
+    case VAR_DECL_STMT: reset_expr(inf, stmt->as.var.initializer); break;
+    case BLOCK_STMT: {
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++) reset_stmt(inf, &list->statements[i]);
+    } break;
+    case IF_STMT:
+        reset_expr(inf, stmt->as.if_stmt.cond);
+        reset_stmt(inf, stmt->as.if_stmt.trueBranch);
+        reset_stmt(inf, stmt->as.if_stmt.falseBranch);
+        break;
+    case WHILE_STMT:
+        reset_expr(inf, stmt->as.while_stmt.cond);
+        reset_stmt(inf, stmt->as.while_stmt.body);
+        break;
+    case PARALLEL_STMT:
+        reset_expr(inf, stmt->as.parallel.start);
+        reset_expr(inf, stmt->as.parallel.end);
+        reset_stmt(inf, stmt->as.parallel.body);
+        break;
+    case FOR_IN_STMT:
+        reset_expr(inf, stmt->as.for_in.iterable);
+        reset_stmt(inf, stmt->as.for_in.body);
+        break;
+    default: break;
+    }
+}
+#pragma endregion Reset
+
+InferStats infer_types(StmtList* list){
+    Inference inf = { .marking = true };
+    // the budget of every top-level statement, 0 for those nested too deep for passes that
+    // recurse on expressions; they are left unproven (they never were) and may change anything
+    size_t* budgets = (size_t*)malloc(sizeof(size_t) * (list->index + 1));
+    if (budgets == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for type inference");
+        exit(1);
+    }
+    for (size_t i = 0; i < list->index; i++){
+        budgets[i] = 0;
+        if (stmt_depth(&list->statements[i]) > MAX_RECURSIVE_DEPTH) continue;
+        reset_stmt(&inf, &list->statements[i]);
+        budgets[i] = inf.budget;
+        inf.budget = 0;
+    }
+    for (size_t i = 0; i < list->index; i++){
+        Stmt* stmt = &list->statements[i];
+        if (budgets[i] > 0){
+            InferStats before = inf.stats;
+            inf.visits = 0;
+            inf.budget = budgets[i];
+            infer_stmt(&inf, stmt);
+            if (!inf.exhausted) continue;
+            // loops that take too long to settle, nothing in the statement is proven rather than part of it
+            reset_stmt(&inf, stmt);
+            inf.stats = before;
+            inf.exhausted = false;
+        }
+        forget_all(&inf);
+        if (stmt->type == VAR_DECL_STMT) declare(&inf, stmt->as.var.name, ANY_TYPE);
+    }
+    for (size_t i = 0; i < inf.loop_size; i++) free(inf.loops[i].head);
+    free(inf.loops);
+    free(budgets);
+    free(inf.facts);
+    free(inf.names);
+    return inf.stats;
+}
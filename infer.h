@@ -0,0 +1,30 @@
+#ifndef _INFER_H
+#define _INFER_H
+
+#include "parser.h"
+
+#define INFER_BUDGET 32     // visits per node before a program is given up on
+#define INITIAL_FACTS_SIZE 16
+
+// Flow-sensitive type inference. The pass follows which types every variable in scope
+// can hold through declarations, assignments and branches, and repeats loop bodies
+// until that stops changing. Arithmetic and comparisons whose operands are then known
+// to be numbers, and '+' of two strings, get a Proof that lets the interpreter skip
+// the type checks.
+//
+// Names the program doesn't declare before using them, such as globals from earlier
+// runs or set through plang.h, can hold anything, as can results of calls, indexing
+// and joins. Spawned, generator and parallel bodies run on copies and are inferred on
+// their own. The proofs hold for runs without runtime errors, the interpreter checks
+// types again after the first one. Runs on a parsed program before optimize(), and
+// again on the whole program whenever part of it is replaced.
+
+typedef struct {
+    size_t operations;      // arithmetic operators and comparisons
+    size_t numbers;         // of them proven to be on numbers
+    size_t strings;         // '+' proven to be on strings
+} InferStats;
+
+InferStats infer_types(StmtList* list);
+
+#endif // _INFER_H
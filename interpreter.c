@@ -1,379 +1,736 @@
+#define _POSIX_C_SOURCE 200809L
 #include "interpreter.h"
-#define UTILS_IMPLEMENT
-#include "utils.h"
-
-static char* source;
-
-static LiteralExpr nil_obj();
-static LiteralExpr num_obj(double num);
-static LiteralExpr string_obj(char* string);
-static LiteralExpr bool_obj(bool b);
+#include <math.h>
+#include "runtime.h"
+#include "jit.h"
+#include "io.h"
+#include "profile.h"
+#include "trace.h"
+#include "task.h"
+#include "generator.h"
 
 #pragma region Environment
-static unsigned int hash(char* s){
-    unsigned int hashval;
-    for (hashval = 0; *s != '\0'; s++){
-        hashval = *s + 31 * hashval;
+static uint32_t hash(const char* key, size_t length){
+    uint32_t hashval = 2166136261u;
+    for (size_t i = 0; i < length; i++){
+        hashval ^= (unsigned char)key[i];
+        hashval *= 16777619u; /* FNV-1a */
     }
+    return hashval == 0 ? 1 : hashval;
+}
+
+void init_env(Env* env, Env* enclosing){
+    *env = (Env){ .enclosing = enclosing };
+}
 
-    return hashval % ENV_SIZE;
+void release_env(Env* env){
+    mem_free(MEM_ENV, env->slots);
+    env->slots = NULL;
 }
 
 Env* create_env(Env* enclosing){
-    Env* e = (Env*)malloc(sizeof(Env));
+    Env* e = (Env*)mem_alloc(MEM_ENV, sizeof(Env));
     if (e == NULL){
-        plerror(-1, -1, MEMORY_ERR, "Malloc failed at environment initialisation");
+        plerror(NULL, -1, -1, MEMORY_ERR, "Malloc failed at environment initialisation");
         exit(1);
     }
-    e->map = (EnvMap**)malloc(sizeof(EnvMap*) * ENV_SIZE);
-    if (e == NULL){
-        plerror(-1, -1, MEMORY_ERR, "Malloc failed at environment initialisation");
-        exit(1);
-    }
-    memset(e->map, 0, sizeof(EnvMap*) * ENV_SIZE);
-    e->enclosing = enclosing;
+    init_env(e, enclosing);
     return e;
 }
 
-void free_env_map(EnvMap** env){
-    for (size_t i = 0; i < ENV_SIZE; i++){
-        EnvMap* e = env[i];
-        EnvMap* tmp;
-        while(e != NULL){
-            tmp = e;
-            e = e->next;
-            free(tmp->key);
-            free(tmp);
+void free_env(Env* env){
+    release_env(env);
+    mem_free(MEM_ENV, env);
+}
+
+static EnvSlot* find_slot(Env* env, const char* key, size_t length, uint32_t hashval){
+    size_t mask = env->capacity - 1;
+    for (size_t i = hashval & mask; ; i = (i + 1) & mask){
+        EnvSlot* slot = &env->slots[i];
+        if (slot->hash == 0) return slot;
+        if (slot->hash == hashval && slot->length == length && memcmp(env->keys + slot->key, key, length) == 0){
+            return slot;
         }
     }
-    free(env);
-    env = NULL;
 }
 
-void free_env(Env* env){
-    free_env_map(env->map);
-    env->map = NULL;
-    free(env);
-    env = NULL;
+// moves the table into a new allocation with room for at least one more name of the given length
+static void grow_env(Env* env, size_t length){
+    size_t capacity = env->capacity == 0 ? INITIAL_ENV_SIZE : env->capacity;
+    while ((env->count + 1) * 4 > capacity * 3) capacity *= 2;
+    size_t key_size = env->key_size == 0 ? INITIAL_ENV_KEYS : env->key_size;
+    while (env->key_index + length > key_size) key_size *= 2;
+
+    EnvSlot* slots = (EnvSlot*)mem_calloc(MEM_ENV, 1, sizeof(EnvSlot) * capacity + key_size);
+    if (slots == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for environment");
+        exit(1);
+    }
+    char* keys = (char*)(slots + capacity);
+    if (env->key_index > 0) memcpy(keys, env->keys, env->key_index);
+    for (size_t i = 0; i < env->capacity; i++){
+        EnvSlot* old = &env->slots[i];
+        if (old->hash == 0) continue;
+        size_t j = old->hash & (capacity - 1);
+        while (slots[j].hash != 0) j = (j + 1) & (capacity - 1);
+        slots[j] = *old;
+    }
+    mem_free(MEM_ENV, env->slots);
+    env->slots = slots;
+    env->keys = keys;
+    env->capacity = capacity;
+    env->key_size = key_size;
 }
 
-static EnvMap* lookup(EnvMap** env, char* s){
-    EnvMap* e;
-    for (e = env[hash(s)]; e != NULL; e = e->next){
-        if (strcmp(s, e->key) == 0){
-            return e;
+void define(Env* env, const char* key, size_t length, LiteralExpr value){
+    value = keep_value(value);
+    uint32_t hashval = hash(key, length);
+    if (env->capacity > 0){
+        EnvSlot* slot = find_slot(env, key, length, hashval);
+        if (slot->hash != 0){
+            slot->value = value;
+            return;
         }
     }
+    if ((env->count + 1) * 4 > env->capacity * 3 || env->key_index + length > env->key_size){
+        grow_env(env, length);
+    }
+    EnvSlot* slot = find_slot(env, key, length, hashval);
+    memcpy(env->keys + env->key_index, key, length);
+    *slot = (EnvSlot){ .hash = hashval, .length = (uint32_t)length, .key = (uint32_t)env->key_index, .value = value };
+    env->key_index += length;
+    env->count++;
+}
+
+// the hash is the same in every scope, so it is computed once for the whole chain
+LiteralExpr* lookup_value(Env* env, const char* key, size_t length){
+    uint32_t hashval = hash(key, length);
+    for (; env != NULL; env = env->enclosing){
+        if (env->count == 0) continue;
+        EnvSlot* slot = find_slot(env, key, length, hashval);
+        if (slot->hash != 0) return &slot->value;
+    }
     return NULL;
 }
 
-void define(Env* env, char* key, LiteralExpr value){
-    EnvMap* e;
-    if ((e = lookup(env->map, key)) == NULL){
-        e = (EnvMap*)malloc(sizeof(*e));
-        if (e == NULL) {
-            plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for Environment node: %s", key);
-            exit(1);
-        }
-        e->key = malloc(sizeof(char) * strlen(key) + 1);
-        if (e->key == NULL) {
-            plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for Environment node key");
-            exit(1);
-        } 
-        strcpy(e->key, key);
-        unsigned int hashval = hash(key);
-        e->next = env->map[hashval];
-        env->map[hashval] = e;
-    }
-    e->value = value;
-}
-
-static char* get_lexeme(Token* tok){
-    size_t n = tok->count - tok->start;
-    char* buf = (char*)malloc(n * sizeof(char) + 1);
-    for (size_t i = 0; i < n; i++) buf[i] = source[tok->start+i];
-    buf[n] = '\0';
-    return buf; 
-}
-
-void assign(Env* env, Token* name, LiteralExpr value){
-    EnvMap* e;
-    char* lexeme = get_lexeme(name);
-    if ((e = lookup(env->map, lexeme)) == NULL){
-        if (env->enclosing != NULL){
-            free(lexeme);
-            assign(env->enclosing, name, value);
-            return;
-        }
-        plerror(name->line, get_column(name), RUNTIME_ERR, "Undefined variable '%s'", lexeme);
-        free(lexeme);
+void assign(Context* ctx, Env* env, Token* name, LiteralExpr value){
+    const char* key = name->source + name->start;
+    size_t length = name->count - name->start;
+    LiteralExpr* slot = lookup_value(env, key, length);
+    if (slot == NULL){
+        plerror(ctx, name->line, get_column(name), RUNTIME_ERR, "Undefined variable '%.*s'", (int)length, key);
         return;
     }
-    e->value = value;
-    free(lexeme);
+    *slot = keep_value(value);
 }
 
-LiteralExpr get(Env* env, Token* name){
-    EnvMap* e;
-    char* lexeme = get_lexeme(name);
-    if ((e = lookup(env->map, lexeme)) == NULL){
-        if (env->enclosing != NULL){
-            free(lexeme);
-            return get(env->enclosing, name);
-        }
-        plerror(name->line, get_column(name), RUNTIME_ERR, "Undefined variable '%s'", lexeme);
-        free(lexeme);
+LiteralExpr get(Context* ctx, Env* env, Token* name){
+    const char* key = name->source + name->start;
+    size_t length = name->count - name->start;
+    LiteralExpr* slot = lookup_value(env, key, length);
+    if (slot == NULL){
+        plerror(ctx, name->line, get_column(name), RUNTIME_ERR, "Undefined variable '%.*s'", (int)length, key);
         return nil_obj();
     }
-    return e->value;
+    return *slot;
 }
 #pragma endregion Environment
 
 #pragma region Interpreter
 
-static char* valueTypes[] = { "nil", "number", "string", "boolean" };
+// eval_stack() keeps its work on explicit stacks instead of the C stack: a frame for each
+// compound expression in progress and the values of the children it has finished.
+// Leaves are read without a frame, and both stacks start out in eval_stack's own frame
+// and only move to the heap for deeply nested expressions.
+typedef struct {
+    Expr* expr;
+    size_t step;                // children evaluated so far
+    const Builtin* builtin;     // resolved callee of a CALL
+} EvalFrame;
 
-LiteralExpr nil_obj(){
-    return (LiteralExpr){
-        .type = NIL_T
-    };
+typedef struct {
+    EvalFrame* frames;
+    size_t frame_count, frame_size;
+    LiteralExpr* values;
+    size_t value_count, value_size;
+    bool heap;                  // the stacks have left evaluate's frame
+    size_t budget;
+} EvalStack;
+
+// the builtin a call goes to, NULL after reporting why there is none
+// Builtins take precedence over variables, so the first call caches the one it found for
+// the call site. Other names are looked up as functions defined by the embedder every time.
+static const Builtin* resolve_call(Context* ctx, CallExpr* call, Env* env){
+    const Builtin* builtin = __atomic_load_n(&call->builtin, __ATOMIC_RELAXED);
+    if (builtin != NULL) return builtin;
+    Token* paren = call->paren;
+    if (call->callee->type != VAREXPR){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Can only call named functions");
+        return NULL;
+    }
+    Token* name = call->callee->as.var.name;
+    const char* key = name->source + name->start;
+    size_t length = name->count - name->start;
+    builtin = find_builtin(key, length);
+    if (builtin == NULL){
+        LiteralExpr* value = lookup_value(env, key, length);
+        if (value != NULL && value->type == FUNC_T) builtin = value->as.function;
+    }
+    if (builtin == NULL){
+        plerror(ctx, name->line, get_column(name), RUNTIME_ERR, "Undefined function '%.*s'", (int)length, key);
+        return NULL;
+    }
+    if (call->args->index != builtin->arity){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "%s '%s' expects %zu arguments, but got %zu",
+            builtin->fn != NULL ? "Builtin" : "Function", builtin->name, builtin->arity, call->args->index);
+        return NULL;
+    }
+    if (builtin->fn != NULL) __atomic_store_n(&call->builtin, builtin, __ATOMIC_RELAXED);
+    return builtin;
 }
 
-LiteralExpr num_obj(double num){
-    return (LiteralExpr){
-        .type = NUM_T,
-        .as.number = num
-    };
+// 'join' is a prefix operator, but it waits on the scheduler rather than computing a value
+static inline LiteralExpr apply_unary(Context* ctx, Token* op, LiteralExpr right){
+    if (op->type == JOIN) return join_task(ctx, op, right);
+    return unary_op(ctx, op, right);
 }
 
-LiteralExpr string_obj(char* string){
-    return (LiteralExpr){
-        .type = STR_T,
-        .as.string = string
-    };
+// operands infer_types() proved skip the type checks, until a runtime error may have left
+// the run somewhere the proofs don't cover. Strings are still told apart from other
+// values, concatenating anything else would read it as a pointer.
+static inline LiteralExpr apply_binary(Context* ctx, BinaryExpr* binary, LiteralExpr left, LiteralExpr right){
+    if (binary->proof == PROVEN_NUMBERS && !ctx->hadError) return numeric_op(ctx, binary->op, left, right);
+    if (binary->proof == PROVEN_STRINGS && left.type == STR_T && right.type == STR_T) return concat_strings(left, right);
+    return binary_op(ctx, binary->op, left, right);
 }
 
-LiteralExpr bool_obj(bool b){
-    return (LiteralExpr){
-        .type = BOOL_T,
-        .as.boolean = b
-    };
+static void grow_eval_stack(EvalStack* s){
+    size_t frame_size = s->frame_size * 2, value_size = s->value_size * 2;
+    EvalFrame* frames = (EvalFrame*)mem_alloc(MEM_STACKS, sizeof(EvalFrame) * frame_size);
+    LiteralExpr* values = (LiteralExpr*)mem_alloc(MEM_STACKS, sizeof(LiteralExpr) * value_size);
+    if (frames == NULL || values == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for evaluation stack");
+        exit(1);
+    }
+    memcpy(frames, s->frames, sizeof(EvalFrame) * s->frame_count);
+    memcpy(values, s->values, sizeof(LiteralExpr) * s->value_count);
+    if (s->heap){
+        mem_free(MEM_STACKS, s->frames);
+        mem_free(MEM_STACKS, s->values);
+    }
+    s->frames = frames;
+    s->values = values;
+    s->frame_size = frame_size;
+    s->value_size = value_size;
+    s->heap = true;
 }
 
-int isTruthy(LiteralExpr obj){
-    if (obj.type == NIL_T) return false;
-    if (obj.type == BOOL_T) return obj.as.boolean;
-    return true;
+static inline void push_value(EvalStack* s, LiteralExpr value){
+    if (s->value_count == s->value_size) grow_eval_stack(s);
+    s->values[s->value_count++] = value;
+}
+
+static inline LiteralExpr pop_value(EvalStack* s){
+    return s->values[--s->value_count];
+}
+
+// ends the top frame with its value
+static inline void finish(EvalStack* s, LiteralExpr value){
+    s->frame_count--;
+    push_value(s, value);
 }
 
-LiteralExpr evaluate(Expr* expr, Env* env){
+// the value of a leaf goes straight onto the value stack, anything else gets a frame;
+// false once the budget is used up
+static inline bool enter(Context* ctx, EvalStack* s, Expr* expr, Env* env){
     switch (expr->type)
     {
-    case BINARY: {
-        if (expr->as.binary.op->type == AND){
-            LiteralExpr left = evaluate(expr->as.binary.left, env);
-            if (!isTruthy(left)) return bool_obj(false);
-            return evaluate(expr->as.binary.right, env);
-        } else if (expr->as.binary.op->type == OR){
-            LiteralExpr left = evaluate(expr->as.binary.left, env);
-            if (isTruthy(left)) return bool_obj(true);
-            return evaluate(expr->as.binary.right, env);
+    case LITERAL: push_value(s, expr->as.literal); return true;
+    case VAREXPR: push_value(s, get(ctx, env, expr->as.var.name)); return true;
+    case INVARIANT: {
+        // not defined when it failed before the loop, then it reports its error in place
+        const char* name = expr->as.invariant.name;
+        LiteralExpr* value = lookup_value(env, name, strlen(name));
+        if (value != NULL){
+            push_value(s, *value);
+            return true;
         }
-        
-        LiteralExpr left = evaluate(expr->as.binary.left, env);
-        LiteralExpr right = evaluate(expr->as.binary.right, env);
+        expr = expr->as.invariant.expr;
+    } break;
+    case SPAWN_EXPR: push_value(s, spawn_task(ctx, &expr->as.spawn, env)); return true;
+    case GENERATOR_EXPR: push_value(s, make_generator(&expr->as.generator, env)); return true;
+    default: break;
+    }
+    if (s->frame_count == s->budget) return false;
+    if (s->frame_count == s->frame_size) grow_eval_stack(s);
+    s->frames[s->frame_count++] = (EvalFrame){ .expr = expr };
+    return true;
+}
 
-        switch (expr->as.binary.op->type)
+static LiteralExpr eval_stack(Context* ctx, Expr* expr, Env* env){
+    EvalFrame local_frames[EVAL_LOCAL_STACK];
+    LiteralExpr local_values[EVAL_LOCAL_STACK];
+    EvalStack s = {
+        .frames = local_frames, .frame_size = EVAL_LOCAL_STACK,
+        .values = local_values, .value_size = EVAL_LOCAL_STACK,
+        .budget = ctx->max_depth
+    };
+    bool within = enter(ctx, &s, expr, env);
+    // every branch either finishes its frame, replaces its expression (tail position) or
+    // enters the next child after counting it in step; f is stale after an enter
+    while (within && s.frame_count > 0){
+        EvalFrame* f = &s.frames[s.frame_count - 1];
+        Expr* e = f->expr;
+        switch (e->type)
         {
-        case EQUAL_EQUAL: {
-            if (left.type == NIL_T && right.type == NIL_T) return bool_obj(true);
-            if (left.type == NIL_T) return bool_obj(false);
-            return bool_obj(left.as.number == right.as.number);
-        }
-        case BANG_EQUAL: {
-            if (left.type == NIL_T && right.type == NIL_T) return bool_obj(false);
-            if (left.type == NIL_T) return bool_obj(true);
-            return bool_obj(left.as.number != right.as.number);
-        }
-        case GREATER: {
-            if (left.type != NUM_T || right.type != NUM_T) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'greater than' operator is not defined for %s and %s", 
-                    valueTypes[left.type], valueTypes[right.type]);
-                return nil_obj();
-            }
-            return bool_obj(left.as.number > right.as.number);
-        }
-        case GREATER_EQUAL: {
-            if (left.type != NUM_T || right.type != NUM_T) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'greater than or equal to' operator is not defined for %s and %s", 
-                    valueTypes[left.type], valueTypes[right.type]);
-                return nil_obj();
+        case BINARY: {
+            TokenType op = e->as.binary.op->type;
+            if (f->step == 0){
+                f->step = 1;
+                within = enter(ctx, &s, e->as.binary.left, env);
+            } else if (op == AND || op == OR){
+                bool left = isTruthy(pop_value(&s));
+                if (op == AND && !left) finish(&s, bool_obj(false));
+                else if (op == OR && left) finish(&s, bool_obj(true));
+                else {
+                    f->expr = e->as.binary.right;
+                    f->step = 0;
+                }
+            } else if (f->step == 1){
+                f->step = 2;
+                within = enter(ctx, &s, e->as.binary.right, env);
+            } else {
+                LiteralExpr right = pop_value(&s);
+                LiteralExpr left = pop_value(&s);
+                finish(&s, apply_binary(ctx, &e->as.binary, left, right));
             }
-            return bool_obj(left.as.number >= right.as.number);
-        }
-        case LESS: {
-            if (left.type != NUM_T || right.type != NUM_T) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'less than' operator is not defined for %s and %s", 
-                    valueTypes[left.type], valueTypes[right.type]);
-                return nil_obj();
+        } break;
+        case TERNARY: {
+            if (f->step == 0){
+                f->step = 1;
+                within = enter(ctx, &s, e->as.ternary.cond, env);
+            } else {
+                f->expr = isTruthy(pop_value(&s)) ? e->as.ternary.trueBranch : e->as.ternary.falseBranch;
+                f->step = 0;
             }
-            return bool_obj(left.as.number < right.as.number);
-        }
-        case LESS_EQUAL: {
-            if (left.type != NUM_T || right.type != NUM_T) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'less than or equal to' operator is not defined for %s and %s", 
-                    valueTypes[left.type], valueTypes[right.type]);
-                return nil_obj();
+        } break;
+        case UNARY: {
+            if (f->step == 0){
+                f->step = 1;
+                within = enter(ctx, &s, e->as.unary.right, env);
+            } else finish(&s, apply_unary(ctx, e->as.unary.op, pop_value(&s)));
+        } break;
+        case LITERAL: finish(&s, e->as.literal); break;
+        case GROUPING: f->expr = e->as.group.expression; break;
+        case VAREXPR: finish(&s, get(ctx, env, e->as.var.name)); break;
+        case INVARIANT: {
+            s.frame_count--;
+            within = enter(ctx, &s, e, env);
+        } break;
+        case ASSIGN: {
+            if (f->step == 0){
+                f->step = 1;
+                within = enter(ctx, &s, e->as.assign.value, env);
+            } else {
+                LiteralExpr val = pop_value(&s);
+                assign(ctx, env, e->as.assign.name, val);
+                finish(&s, val);
             }
-            return bool_obj(left.as.number <= right.as.number);
-        }
-        case STAR: {
-            if (left.type != NUM_T || right.type != NUM_T) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'times' operator is not defined for %s and %s", 
-                    valueTypes[left.type], valueTypes[right.type]);
-                return nil_obj();
+        } break;
+        case CALL: {
+            ExprList* args = e->as.call.args;
+            Token* paren = e->as.call.paren;
+            if (f->step == 0){
+                f->builtin = resolve_call(ctx, &e->as.call, env);
+                if (f->builtin == NULL){
+                    finish(&s, nil_obj());
+                    break;
+                }
             }
-            return num_obj(left.as.number * right.as.number);
-        }
-        case SLASH: {
-            if (left.type != NUM_T || right.type != NUM_T) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'division' operator is not defined for %s and %s", 
-                    valueTypes[left.type], valueTypes[right.type]);
-                return nil_obj();
+            if (f->step < args->index){
+                within = enter(ctx, &s, args->exprs[f->step++], env);
+            } else {
+                s.value_count -= args->index;
+                finish(&s, call_builtin(f->builtin, ctx, paren, s.values + s.value_count));
             }
-            if (right.as.number == 0) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Division by zero error");
-                return nil_obj();
+        } break;
+        case ARRAY: {
+            // the array waits on the value stack, every element is added once it is done
+            ExprList* elements = e->as.array.elements;
+            if (f->step == 0) push_value(&s, array_obj(create_array(elements->index)));
+            else {
+                LiteralExpr element = pop_value(&s);
+                array_push(s.values[s.value_count - 1].as.array, keep_value(element));
             }
-            return num_obj(left.as.number / right.as.number);
-        }
-        case MINUS: {
-            if (left.type != NUM_T || right.type != NUM_T) {
-                plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'minus' operator is not defined for %s and %s", 
-                    valueTypes[left.type], valueTypes[right.type]);
-                return nil_obj();
+            if (f->step < elements->index) within = enter(ctx, &s, elements->exprs[f->step++], env);
+            else s.frame_count--;
+        } break;
+        case MAP: {
+            ExprList* entries = e->as.map.entries;
+            size_t count = entries->index & ~(size_t)1;
+            if (f->step == 0) push_value(&s, map_obj(create_map(entries->index / 2)));
+            else if (f->step % 2 == 0){
+                LiteralExpr value = pop_value(&s);
+                LiteralExpr key = pop_value(&s);
+                map_literal_set(ctx, e->as.map.brace, s.values[s.value_count - 1].as.map, key, value);
             }
-            return num_obj(left.as.number - right.as.number);
-        }
-        case PLUS: {
-            if (left.type == NUM_T && right.type == NUM_T){
-                return num_obj(left.as.number + right.as.number);
+            if (f->step < count) within = enter(ctx, &s, entries->exprs[f->step++], env);
+            else s.frame_count--;
+        } break;
+        case INDEX: {
+            if (f->step == 0){
+                f->step = 1;
+                within = enter(ctx, &s, e->as.index.object, env);
+            } else if (f->step == 1){
+                f->step = 2;
+                within = enter(ctx, &s, e->as.index.index, env);
+            } else {
+                LiteralExpr index = pop_value(&s);
+                LiteralExpr object = pop_value(&s);
+                finish(&s, index_get(ctx, e->as.index.bracket, object, index));
             }
-            if (left.type == STR_T && right.type == STR_T){
-                size_t len_left = strlen(left.as.string);
-                size_t len_right = strlen(right.as.string);
-                char* res = malloc(len_left + len_right + 1);
-                for (size_t i = 0; i < len_left; i++) res[i] = left.as.string[i];
-                for (size_t i = len_left; i < len_left + len_right; i++) res[i] = right.as.string[i-len_left];
-                res[len_left+len_right] = '\0';
-                return string_obj(res);
+        } break;
+        case SET_INDEX: {
+            if (f->step == 0){
+                f->step = 1;
+                within = enter(ctx, &s, e->as.set_index.object, env);
+            } else if (f->step == 1){
+                f->step = 2;
+                within = enter(ctx, &s, e->as.set_index.index, env);
+            } else if (f->step == 2){
+                LiteralExpr* index = &s.values[s.value_count - 1];
+                if (!index_target(ctx, e->as.set_index.bracket, s.values[s.value_count - 2], index)){
+                    s.value_count -= 2;
+                    finish(&s, nil_obj());
+                } else {
+                    f->step = 3;
+                    within = enter(ctx, &s, e->as.set_index.value, env);
+                }
+            } else {
+                LiteralExpr value = pop_value(&s);
+                LiteralExpr index = pop_value(&s);
+                LiteralExpr object = pop_value(&s);
+                index_set(object, index, value);
+                finish(&s, value);
             }
-            plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Type mismatch, binary 'plus' operation is not defined for %s and %s", 
-                valueTypes[left.type], valueTypes[right.type]);
-            return nil_obj();
-        }
+        } break;
         default:
-            plerror(expr->as.binary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Unreachable binary operator");
-            return nil_obj();
+            plerror(ctx, -1, -1, RUNTIME_ERR, "Unreachable state");
+            finish(&s, nil_obj());
         }
-    } break;
+    }
+    LiteralExpr result = nil_obj();
+    if (within) result = s.values[0];
+    else plerror(ctx, -1, -1, RUNTIME_ERR, "Expression nested deeper than the budget of %zu levels", s.budget);
+    if (s.heap){
+        mem_free(MEM_STACKS, s.frames);
+        mem_free(MEM_STACKS, s.values);
+    }
+    return result;
+}
+
+// Arithmetic a few levels deep, which is most of what ordinary code evaluates, is cheaper
+// by direct recursion than through the stacks. The recursion stops at
+// EVAL_RECURSION_DEPTH, deeper subtrees and all other expressions go to eval_stack.
+static LiteralExpr eval_shallow(Context* ctx, Expr* expr, Env* env, int depth){
+    if (depth == EVAL_RECURSION_DEPTH) return eval_stack(ctx, expr, env);
+    switch (expr->type)
+    {
+    case LITERAL: return expr->as.literal;
+    case VAREXPR: return get(ctx, env, expr->as.var.name);
+    case GROUPING: return eval_shallow(ctx, expr->as.group.expression, env, depth + 1);
+    case BINARY: {
+        TokenType op = expr->as.binary.op->type;
+        LiteralExpr left = eval_shallow(ctx, expr->as.binary.left, env, depth + 1);
+        if (op == AND && !isTruthy(left)) return bool_obj(false);
+        if (op == OR && isTruthy(left)) return bool_obj(true);
+        LiteralExpr right = eval_shallow(ctx, expr->as.binary.right, env, depth + 1);
+        if (op == AND || op == OR) return right;
+        return apply_binary(ctx, &expr->as.binary, left, right);
+    }
+    case UNARY: return apply_unary(ctx, expr->as.unary.op, eval_shallow(ctx, expr->as.unary.right, env, depth + 1));
     case TERNARY: {
-        LiteralExpr res = evaluate(expr->as.ternary.cond, env);
-        if (isTruthy(res)) {
-            return evaluate(expr->as.ternary.trueBranch, env);
-        } else {
-            return evaluate(expr->as.ternary.falseBranch, env);
-        }
-    } break;
-    case UNARY: {
-        LiteralExpr right = evaluate(expr->as.unary.right, env);
-        switch(expr->as.unary.op->type){
-            case MINUS: {
-                if (right.type != NUM_T) {
-                    plerror(expr->as.unary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Expected type '%s', but got '%s'", valueTypes[NUM_T], valueTypes[right.type]);
-                    return nil_obj();
-                }
-                right.as.number = -right.as.number;
-                return right;
-            };
-            case BANG: {
-                right.as.boolean = !isTruthy(right);
-                right.type = BOOL_T;
-                return right;
-            }
-            default: 
-                plerror(expr->as.unary.op->line, get_column(expr->as.binary.op), RUNTIME_ERR, "Unreachable state");
-                return nil_obj();
-        }
-    } break;
-    case LITERAL: {
-        return expr->as.literal;
-    } break;
-    case GROUPING: return evaluate(expr->as.group.expression, env); break;
-    case VAREXPR: return get(env, expr->as.var.name); break;
+        LiteralExpr cond = eval_shallow(ctx, expr->as.ternary.cond, env, depth + 1);
+        return eval_shallow(ctx, isTruthy(cond) ? expr->as.ternary.trueBranch : expr->as.ternary.falseBranch, env, depth + 1);
+    }
     case ASSIGN: {
-        LiteralExpr val = evaluate(expr->as.assign.value, env);
-        assign(env, expr->as.assign.name, val);
+        LiteralExpr val = eval_shallow(ctx, expr->as.assign.value, env, depth + 1);
+        assign(ctx, env, expr->as.assign.name, val);
         return val;
-    } break;
-    default:
-        plerror(-1, -1, RUNTIME_ERR, "Unreachable state");
-        return nil_obj();
     }
+    case INDEX: {
+        LiteralExpr object = eval_shallow(ctx, expr->as.index.object, env, depth + 1);
+        LiteralExpr index = eval_shallow(ctx, expr->as.index.index, env, depth + 1);
+        return index_get(ctx, expr->as.index.bracket, object, index);
+    }
+    case SET_INDEX: {
+        LiteralExpr object = eval_shallow(ctx, expr->as.set_index.object, env, depth + 1);
+        LiteralExpr index = eval_shallow(ctx, expr->as.set_index.index, env, depth + 1);
+        if (!index_target(ctx, expr->as.set_index.bracket, object, &index)) return nil_obj();
+        LiteralExpr value = eval_shallow(ctx, expr->as.set_index.value, env, depth + 1);
+        index_set(object, index, value);
+        return value;
+    }
+    case CALL: {
+        const Builtin* builtin = resolve_call(ctx, &expr->as.call, env);
+        if (builtin == NULL) return nil_obj();
+        ExprList* args = expr->as.call.args;
+        LiteralExpr values[MAX_BUILTIN_ARITY];
+        for (size_t i = 0; i < args->index; i++) values[i] = eval_shallow(ctx, args->exprs[i], env, depth + 1);
+        return call_builtin(builtin, ctx, expr->as.call.paren, values);
+    }
+    case INVARIANT: {
+        const char* name = expr->as.invariant.name;
+        LiteralExpr* value = lookup_value(env, name, strlen(name));
+        if (value != NULL) return *value;
+        return eval_shallow(ctx, expr->as.invariant.expr, env, depth + 1);
+    }
+    case SPAWN_EXPR: return spawn_task(ctx, &expr->as.spawn, env);
+    case GENERATOR_EXPR: return make_generator(&expr->as.generator, env);
+    default: return eval_stack(ctx, expr, env);
+    }
+}
+
+LiteralExpr evaluate(Context* ctx, Expr* expr, Env* env){
+    return eval_shallow(ctx, expr, env, 0);
+}
+
+// evaluates the invariants of a loop once into their hidden variables; the ones that
+// fail are left undefined, so their errors come up where the loop would have hit them
+static void hoist_invariants(Context* ctx, ExprList* invariants, Env* hoisted){
+    // after an error the proofs no longer hold, the invariants are then evaluated in place
+    if (ctx->hadError) return;
+    Context probe = *ctx;
+    probe.quiet = true;
+    for (size_t i = 0; i < invariants->index; i++){
+        InvariantExpr* invariant = &invariants->exprs[i]->as.invariant;
+        probe.hadError = false;
+        LiteralExpr value = evaluate(&probe, invariant->expr, hoisted);
+        if (!probe.hadError) define(hoisted, invariant->name, strlen(invariant->name), value);
+    }
+}
+
+// The chunks of a parallel loop only depend on its number of iterations, and their partial
+// results are combined in order, so a run gives the same result with any number of threads.
+typedef struct {
+    Context* ctx;
+    ParallelStmt* loop;
+    Env* env;
+    int64_t first;
+    size_t count;           // iterations
+    size_t chunk_size;
+    LiteralExpr* partials;  // reduction_count per chunk
+    bool failed;
+} ParallelRun;
+
+static bool is_min(Token* op){
+    return op->type == IDENTIFIER && memcmp(op->source + op->start, "min", 3) == 0;
+}
+
+static LiteralExpr reduction_identity(Token* op){
+    if (op->type == PLUS) return int_obj(0);
+    if (op->type == STAR) return int_obj(1);
+    return num_obj(is_min(op) ? INFINITY : -INFINITY);
+}
+
+static LiteralExpr combine(Context* ctx, Token* op, LiteralExpr total, LiteralExpr partial){
+    if (op->type == PLUS || op->type == STAR) return binary_op(ctx, op, total, partial);
+    // a chunk that never assigned its target, total may not be a number yet
+    if (values_equal(partial, reduction_identity(op))) return total;
+    Token compare = *op;
+    compare.type = is_min(op) ? LESS : GREATER;
+    return isTruthy(binary_op(ctx, &compare, partial, total)) ? partial : total;
+}
+
+static void run_chunk(void* arg, size_t chunk){
+    ParallelRun* run = (ParallelRun*)arg;
+    ParallelStmt* loop = run->loop;
+    Context ctx = *run->ctx;
+    ctx.hadError = false;
+    // like tasks, the profiler and the trace only follow the thread of the run
+    ctx.profiler = NULL;
+    ctx.trace = NULL;
+    Env local;
+    init_env(&local, run->env);
+    for (size_t r = 0; r < loop->reduction_count; r++){
+        Token* name = loop->reductions[r].name;
+        define(&local, name->source + name->start, name->count - name->start, reduction_identity(loop->reductions[r].op));
+    }
+    Token* var = loop->var;
+    define(&local, var->source + var->start, var->count - var->start, nil_obj());
+    // the body declares into scopes of its own, so the slot stays put
+    LiteralExpr* slot = lookup_value(&local, var->source + var->start, var->count - var->start);
+    size_t first = chunk * run->chunk_size;
+    size_t last = first + run->chunk_size < run->count ? first + run->chunk_size : run->count;
+    for (size_t i = first; i < last; i++){
+        *slot = int_obj((int64_t)((uint64_t)run->first + (uint64_t)i * (uint64_t)loop->step));
+        execute(&ctx, loop->body, &local);
+    }
+    for (size_t r = 0; r < loop->reduction_count; r++){
+        Token* name = loop->reductions[r].name;
+        run->partials[chunk * loop->reduction_count + r] = *lookup_value(&local, name->source + name->start, name->count - name->start);
+    }
+    release_env(&local);
+    if (ctx.hadError) __atomic_store_n(&run->failed, true, __ATOMIC_RELAXED);
+}
+
+static bool loop_bound(LiteralExpr value, int64_t* bound){
+    if (value.type == INT_T) *bound = value.as.integer;
+    else return value.type == NUM_T && integral_value(value.as.number, bound);
+    return true;
+}
+
+static void execute_parallel(Context* ctx, ParallelStmt* loop, Env* env){
+    int64_t first, limit;
+    if (!loop_bound(evaluate(ctx, loop->start, env), &first) || !loop_bound(evaluate(ctx, loop->end, env), &limit)){
+        plerror(ctx, loop->keyword->line, get_column(loop->keyword), RUNTIME_ERR, "Parallel loop bounds must be integers");
+        return;
+    }
+    for (size_t r = 0; r < loop->reduction_count; r++){
+        Token* name = loop->reductions[r].name;
+        if (lookup_value(env, name->source + name->start, name->count - name->start) == NULL){
+            get(ctx, env, name);
+            return;
+        }
+    }
+    size_t count = 0;
+    if (limit > first || (loop->inclusive && limit == first)){
+        uint64_t span = (uint64_t)limit - (uint64_t)first - (loop->inclusive ? 0 : 1);
+        count = (size_t)(span / (uint64_t)loop->step) + 1;
+    }
+    if (count == 0) return;
+    size_t chunk_size = (count + PARALLEL_CHUNKS - 1) / PARALLEL_CHUNKS;
+    if (chunk_size < PARALLEL_MIN_CHUNK) chunk_size = PARALLEL_MIN_CHUNK;
+    size_t chunks = (count + chunk_size - 1) / chunk_size;
+
+    // the chunks read these together, nothing may change how they are stored meanwhile
+    for (size_t i = 0; i < loop->reads->count; i++){
+        Token* name = loop->reads->names[i];
+        LiteralExpr* value = lookup_value(env, name->source + name->start, name->count - name->start);
+        if (value != NULL) settle_value(*value);
+    }
+    ParallelRun run = { .ctx = ctx, .loop = loop, .env = env, .first = first, .count = count, .chunk_size = chunk_size };
+    run.partials = (LiteralExpr*)mem_alloc(MEM_TASKS, sizeof(LiteralExpr) * (chunks * loop->reduction_count + 1));
+    if (run.partials == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for reductions");
+        exit(1);
+    }
+    parallel_chunks(ctx, chunks, run_chunk, &run);
+    if (run.failed) ctx->hadError = true;
+
+    for (size_t r = 0; r < loop->reduction_count; r++){
+        Reduction* reduction = &loop->reductions[r];
+        LiteralExpr total = get(ctx, env, reduction->name);
+        for (size_t c = 0; c < chunks; c++) total = combine(ctx, reduction->op, total, run.partials[c * loop->reduction_count + r]);
+        assign(ctx, env, reduction->name, total);
+    }
+    mem_free(MEM_TASKS, run.partials);
 }
 
-void execute(Stmt stmt, Env* env){
-    switch (stmt.type)
+static void execute_for_in(Context* ctx, ForInStmt* loop, Env* env){
+    LiteralExpr iterable = evaluate(ctx, loop->iterable, env);
+    Env scope;
+    init_env(&scope, env);
+    Token* var = loop->var;
+    define(&scope, var->source + var->start, var->count - var->start, nil_obj());
+    // the body isn't a declaration, nothing else is defined in this scope
+    LiteralExpr* slot = lookup_value(&scope, var->source + var->start, var->count - var->start);
+    size_t index = 0;
+    while (next_item(ctx, loop, iterable, &index, slot)) execute(ctx, loop->body, &scope);
+    release_env(&scope);
+}
+
+void execute(Context* ctx, Stmt* stmt, Env* env){
+    // blocks only scope, their statements are the frames
+    bool profiled = ctx->profiler != NULL && stmt->type != BLOCK_STMT;
+    if (profiled) profile_enter(ctx->profiler, stmt->type, stmt->line);
+    switch (stmt->type)
     {
-    case EXPR_STMT: evaluate(stmt.as.expr.expression, env); break;
+    case EXPR_STMT: evaluate(ctx, stmt->as.expr.expression, env); break;
     case PRINT_STMT: {
-        LiteralExpr val = evaluate(stmt.as.print.expression, env);
-        switch (val.type)
-        {
-        case NUM_T:  printf("%f\n", val.as.number); break;
-        case NIL_T:  printf("nil\n"); break;
-        case BOOL_T: printf(val.as.boolean ? "true\n" : "false\n"); break;
-        case STR_T:  printf("%s\n", val.as.string); break;
-        default: break;
-        }
+        LiteralExpr val = evaluate(ctx, stmt->as.print.expression, env);
+        // tasks print too, a value and its newline stay together
+        flockfile(ctx->out);
+        print_value(ctx->out, val, 0);
+        fprintf(ctx->out, "\n");
+        funlockfile(ctx->out);
     } break;
     case BLOCK_STMT: {
-        Env* local = create_env(env);
-        for (size_t i = 0; i < stmt.as.block.list->index; i++){
-            execute(stmt.as.block.list->statements[i], local);
+        Env local;
+        init_env(&local, env);
+        for (size_t i = 0; i < stmt->as.block.list->index; i++){
+            execute(ctx, &stmt->as.block.list->statements[i], &local);
         }
-        free_env(local);
+        release_env(&local);
     } break;
     case VAR_DECL_STMT:{
-        char* lexeme = get_lexeme(stmt.as.var.name);
-        if (stmt.as.var.initializer != NULL){
-            LiteralExpr init = evaluate(stmt.as.var.initializer, env);
-            define(env, lexeme, init);
-        } else define(env, lexeme, nil_obj());
-        free(lexeme);
+        Token* name = stmt->as.var.name;
+        LiteralExpr init = nil_obj();
+        if (stmt->as.var.initializer != NULL) init = evaluate(ctx, stmt->as.var.initializer, env);
+        define(env, name->source + name->start, name->count - name->start, init);
     } break;
     case IF_STMT: {
-        LiteralExpr cond = evaluate(stmt.as.if_stmt.cond, env);
+        LiteralExpr cond = evaluate(ctx, stmt->as.if_stmt.cond, env);
         if (isTruthy(cond)){
-            execute(*stmt.as.if_stmt.trueBranch, env);
-        } else if (stmt.as.if_stmt.falseBranch != NULL){
-            execute(*stmt.as.if_stmt.falseBranch, env);
+            execute(ctx, stmt->as.if_stmt.trueBranch, env);
+        } else if (stmt->as.if_stmt.falseBranch != NULL){
+            execute(ctx, stmt->as.if_stmt.falseBranch, env);
         }
     } break;
     case WHILE_STMT: {
-        while (isTruthy(evaluate(stmt.as.while_stmt.cond, env))){
-            execute(*stmt.as.while_stmt.body, env);
+        ExprList* invariants = stmt->as.while_stmt.invariants;
+        Env hoisted;
+        if (invariants != NULL){
+            init_env(&hoisted, env);
+            hoist_invariants(ctx, invariants, &hoisted);
+            env = &hoisted;
         }
+        // a loop that was hot before starts out on its compiled code
+        bool cached = ctx->jit && __atomic_load_n(&stmt->as.while_stmt.jit, __ATOMIC_RELAXED) != NULL;
+        JitResult native = cached ? jit_run_loop(stmt, env) : JIT_UNSUPPORTED;
+        size_t iterations = 0;
+        while (native != JIT_DONE && isTruthy(evaluate(ctx, stmt->as.while_stmt.cond, env))){
+            execute(ctx, stmt->as.while_stmt.body, env);
+            // hot loops continue natively from the next condition, after a deopt the rest
+            // of this run stays in the interpreter
+            if (++iterations == JIT_THRESHOLD && ctx->jit && native != JIT_DEOPT && jit_run_loop(stmt, env) == JIT_DONE) break;
+        }
+        if (invariants != NULL) release_env(&hoisted);
     } break;
+    case PARALLEL_STMT: execute_parallel(ctx, &stmt->as.parallel, env); break;
+    case FOR_IN_STMT: execute_for_in(ctx, &stmt->as.for_in, env); break;
     default: break;
     }
+    if (profiled) profile_leave(ctx->profiler);
+}
+
+// --trace records every top-level statement, then how many Envs and runtime strings it
+// allocated. The counts come from memory accounting and cover all runs of a batch.
+static void traced_execute(Context* ctx, Stmt* stmt, Env* env){
+    size_t envs, env_bytes, strings, string_bytes;
+    mem_usage(MEM_ENV, &envs, &env_bytes);
+    mem_usage(MEM_STRINGS, &strings, &string_bytes);
+    char args[96];
+    snprintf(args, sizeof(args), "{\"line\":%u}", stmt->line);
+    trace_event(ctx->trace, 'B', ctx->trace_tid, "statement", stmt_kind_name(stmt->type), args);
+    execute(ctx, stmt, env);
+    trace_event(ctx->trace, 'E', ctx->trace_tid, "statement", stmt_kind_name(stmt->type), NULL);
+
+    size_t envs_after, strings_after;
+    mem_usage(MEM_ENV, &envs_after, &env_bytes);
+    mem_usage(MEM_STRINGS, &strings_after, &string_bytes);
+    snprintf(args, sizeof(args), "{\"allocations\":%zu,\"bytes\":%zu}", envs_after - envs, env_bytes);
+    trace_event(ctx->trace, 'C', ctx->trace_tid, "memory", "Env", args);
+    snprintf(args, sizeof(args), "{\"allocations\":%zu,\"bytes\":%zu}", strings_after - strings, string_bytes);
+    trace_event(ctx->trace, 'C', ctx->trace_tid, "memory", "runtime strings", args);
 }
 
-void interpret(StmtList* list, Env* env, char* code_source){
-    source = code_source;
+void interpret(Context* ctx, StmtList* list, Env* env){
     for (size_t i = 0; i < list->index; i++){
-        execute(list->statements[i], env);
+        if (ctx->trace != NULL) traced_execute(ctx, &list->statements[i], env);
+        else execute(ctx, &list->statements[i], env);
     }
+    wait_tasks(ctx);
 }
 
-#pragma endregion Environment
\ No newline at end of file
+#pragma endregion Interpreter
\ No newline at end of file
@@ -4,28 +4,48 @@
 #include "tokenizer.h"
 #include "parser.h"
 
-#define ENV_SIZE 100
-
-typedef struct envList EnvMap;
-struct envList {
-    struct envList* next;
-    char* key;
+#define INITIAL_ENV_SIZE 8
+#define INITIAL_ENV_KEYS 64
+#define EVAL_LOCAL_STACK 32
+#define EVAL_RECURSION_DEPTH 32
+#define PARALLEL_CHUNKS 64      // a parallel loop is split into at most this many chunks
+#define PARALLEL_MIN_CHUNK 16   // of at least this many iterations
+
+typedef struct {
+    uint32_t hash;      // 0 marks an empty slot
+    uint32_t length;
+    uint32_t key;       // offset of the name in the key area
     LiteralExpr value;
-};
+} EnvSlot;
 
+// Scope as an open addressing table with linear probing. The slots and the bytes of
+// all names live in one allocation (slots first, then the key area), made on the
+// first define so that scopes without variables cost nothing.
 typedef struct Env_t Env;
 struct Env_t {
-    EnvMap** map;
+    EnvSlot* slots;
+    char* keys;
+    size_t capacity;    // power of two, 0 until the first define
+    size_t count;
+    size_t key_index;
+    size_t key_size;
     struct Env_t* enclosing;
 };
 
 Env* create_env(Env* enclosing);
 void free_env(Env* env);
-
-void define(Env* env, char* key, LiteralExpr value);
-void assign(Env* env, Token* name, LiteralExpr value);
-LiteralExpr get(Env* env, Token* name);
-
-void interpret(StmtList* list, Env* env, char* code_source);
+// for scopes that live on the stack
+void init_env(Env* env, Env* enclosing);
+void release_env(Env* env);
+
+void define(Env* env, const char* key, size_t length, LiteralExpr value);
+// points into the environment, valid until a variable is defined in it or it is freed
+LiteralExpr* lookup_value(Env* env, const char* key, size_t length);
+void assign(Context* ctx, Env* env, Token* name, LiteralExpr value);
+LiteralExpr get(Context* ctx, Env* env, Token* name);
+
+LiteralExpr evaluate(Context* ctx, Expr* expr, Env* env);
+void execute(Context* ctx, Stmt* stmt, Env* env);
+void interpret(Context* ctx, StmtList* list, Env* env);
 
 #endif // _INTERPRETER_H
\ No newline at end of file
@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "io.h"
+#include "runtime.h"
+
+static File* new_file(void){
+    File* file = (File*)mem_calloc(MEM_FILES, 1, sizeof(File));
+    if (file == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for file");
+        exit(1);
+    }
+    file->fd = -1;
+    return file;
+}
+
+// false if fd is not a regular file or can't be mapped, an empty file maps to nothing
+static bool map_file(File* file, int fd){
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    file->size = (size_t)st.st_size;
+    if (file->size == 0) return true;
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return false;
+    posix_madvise(data, file->size, POSIX_MADV_SEQUENTIAL);
+    file->data = (const char*)data;
+    return true;
+}
+
+File* open_reader(const char* path, size_t record){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    File* file = new_file();
+    file->record = record;
+    if (map_file(file, fd)){
+        close(fd);
+        size_t length = strlen(path);
+        file->path = (char*)mem_alloc(MEM_FILES, length + 1);
+        if (file->path == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for file path");
+            exit(1);
+        }
+        memcpy(file->path, path, length + 1);
+        pthread_mutex_init(&file->lock, NULL);
+        return file;
+    }
+    file->fd = fd;
+    file->capacity = record > IO_BUFFER_SIZE ? record : IO_BUFFER_SIZE;
+    file->buffer = (char*)mem_alloc(MEM_FILES, file->capacity);
+    if (file->buffer == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for file buffer");
+        exit(1);
+    }
+    return file;
+}
+
+File* open_writer(const char* path){
+    FILE* out = fopen(path, "w");
+    if (out == NULL) return NULL;
+    setvbuf(out, NULL, _IOFBF, IO_BUFFER_SIZE);
+    File* file = new_file();
+    file->out = out;
+    return file;
+}
+
+// the length of the next item in n bytes, and how many bytes it uses up
+static bool next_span(File* file, const char* chars, size_t n, bool last, size_t* length, size_t* used){
+    if (file->record > 0){
+        if (n < file->record && !last) return false;
+        *length = *used = n < file->record ? n : file->record;
+        return true;
+    }
+    const char* newline = (const char*)memchr(chars, '\n', n);
+    if (newline == NULL){
+        if (!last) return false;
+        *length = *used = n;
+    } else {
+        *length = (size_t)(newline - chars);
+        *used = *length + 1;
+    }
+    if (*length > 0 && chars[*length - 1] == '\r') (*length)--;
+    return true;
+}
+
+// moves the unread bytes to the front and reads more behind them, false at the end
+static bool refill(File* file){
+    size_t unread = file->end - file->start;
+    memmove(file->buffer, file->buffer + file->start, unread);
+    file->start = 0;
+    file->end = unread;
+    if (file->end == file->capacity){
+        // a line longer than the buffer
+        file->capacity *= 2;
+        file->buffer = (char*)mem_realloc(MEM_FILES, file->buffer, file->capacity);
+        if (file->buffer == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for file buffer");
+            exit(1);
+        }
+    }
+    ssize_t n;
+    do n = read(file->fd, file->buffer + file->end, file->capacity - file->end);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0){
+        close(file->fd);
+        file->fd = -1;
+        return false;
+    }
+    file->end += (size_t)n;
+    return true;
+}
+
+static LiteralExpr copy_string(const char* chars, size_t length){
+    if (length <= SSO_MAX) return small_string(chars, length);
+    char* copy = (char*)mem_alloc(MEM_STRINGS, length + 1);
+    if (copy == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for string");
+        exit(1);
+    }
+    memcpy(copy, chars, length);
+    copy[length] = '\0';
+    return string_obj(copy);
+}
+
+// false if there is nothing to read, the file may have changed since the last loop
+static bool start_loop(File* file){
+    pthread_mutex_lock(&file->lock);
+    if (file->loops == 0 && file->data == NULL){
+        int fd = open(file->path, O_RDONLY);
+        if (fd >= 0){
+            map_file(file, fd);
+            close(fd);
+        }
+    }
+    bool mapped = file->data != NULL;
+    if (mapped) file->loops++;
+    pthread_mutex_unlock(&file->lock);
+    return mapped;
+}
+
+// the slices the loop handed out were copied wherever they were kept
+static void end_loop(File* file){
+    pthread_mutex_lock(&file->lock);
+    if (--file->loops == 0){
+        munmap((void*)file->data, file->size);
+        file->data = NULL;
+    }
+    pthread_mutex_unlock(&file->lock);
+}
+
+LiteralExpr copy_slice(LiteralExpr slice){
+    return copy_string(slice.as.slice.chars, slice.as.slice.length);
+}
+
+bool file_next(File* file, size_t* offset, LiteralExpr* item){
+    size_t length, used;
+    if (file->buffer == NULL){
+        if (*offset == 0 && !start_loop(file)) return false;
+        if (*offset >= file->size){
+            end_loop(file);
+            return false;
+        }
+        const char* chars = file->data + *offset;
+        next_span(file, chars, file->size - *offset, true, &length, &used);
+        *offset += used;
+        *item = slice_string(chars, length);
+        return true;
+    }
+    for (;;){
+        const char* chars = file->buffer + file->start;
+        size_t n = file->end - file->start;
+        bool last = file->fd < 0;
+        if (n > 0 && next_span(file, chars, n, last, &length, &used)){
+            file->start += used;
+            *item = copy_string(chars, length);
+            return true;
+        }
+        if (last || !refill(file)){
+            if (file->end == file->start) return false;
+        }
+    }
+}
+
+bool file_write(File* file, LiteralExpr value){
+    if (file->out == NULL) return false;
+    print_value(file->out, value, 0);
+    return fputc('\n', file->out) != EOF;
+}
+
+bool file_close(File* file){
+    if (file->out == NULL) return false;
+    bool ok = fclose(file->out) == 0;
+    file->out = NULL;
+    return ok;
+}
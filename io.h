@@ -0,0 +1,52 @@
+#ifndef _IO_H
+#define _IO_H
+
+#include <pthread.h>
+#include "parser.h"
+
+#define IO_BUFFER_SIZE (1 << 20)
+
+// File value of the I/O builtins. lines(path) and records(path, size) open a file to loop
+// over with for-in, writer(path) one that write() appends lines to through a buffer.
+//
+// Regular files are mapped read-only and every loop over them starts at the beginning.
+// The strings it hands out are slices of the mapping rather than copies, anything that
+// keeps one copies it (see keep_value()). The mapping is unmapped when the last loop
+// reading it ends and mapped again from the path for the next one. Its pages are clean
+// and the kernel drops them again, so files larger than memory stream through.
+// Pipes and other files that can't be mapped are read through a buffer, each item is
+// copied out of it, and they can only be looped over once.
+struct File {
+    size_t record;          // bytes per item, 0 to split at newlines
+    const char* data;       // the mapping, NULL for a stream or between loops
+    size_t size;
+    char* path;             // of a mapped file
+    size_t loops;           // reading the mapping
+    pthread_mutex_t lock;   // loops may run on several threads
+    int fd;                 // a stream being read, -1 once it is at its end
+    char* buffer;
+    size_t start;           // unread bytes of the buffer are [start, end)
+    size_t end;
+    size_t capacity;
+    FILE* out;              // a writer, NULL once closed
+};
+
+// NULL with errno set if the file can't be opened
+File* open_reader(const char* path, size_t record);
+File* open_writer(const char* path);
+// the next line or record into *item, false at the end. offset is where a loop is in a mapped file,
+// it starts at 0 and a loop that stops before the end keeps the mapping.
+bool file_next(File* file, size_t* offset, LiteralExpr* item);
+// writes the value as print does, followed by a newline
+bool file_write(File* file, LiteralExpr value);
+// flushes and closes a writer, false if that failed
+bool file_close(File* file);
+
+// A slice is only valid while a loop reads its file, so variables and containers keep
+// values through this, which copies slices.
+LiteralExpr copy_slice(LiteralExpr slice);
+static inline LiteralExpr keep_value(LiteralExpr value){
+    return value.type == STR_T && value.sso == SSO_SLICE ? copy_slice(value) : value;
+}
+
+#endif // _IO_H
@@ -0,0 +1,605 @@
+#define _DEFAULT_SOURCE
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+// Baseline template JIT: every expression leaves its value in rax (ints and bools) or
+// xmm0 (numbers), binary operators spill the left operand with push/pop. Variables live
+// in a frame of int64_t slots, rdi points at the live frame and rsi at a snapshot taken
+// at the top of every iteration of the outer loop. A failed guard returns 1, and the
+// interpreter resumes from the snapshot as if the iteration had never started.
+
+#define INITIAL_JIT_CODE 256
+#define INITIAL_JIT_GUARDS 16
+
+typedef enum {
+    J_INT,
+    J_NUM,
+    J_BOOL,
+} JitType;
+
+typedef struct {
+    uint8_t* code;
+    size_t index;
+    size_t size;
+
+    size_t* guards;         // rel32 fields that jump to the deopt exit
+    size_t guard_index;
+    size_t guard_size;
+
+    LiteralExpr* slots[JIT_MAX_VARS];
+    const char* keys[JIT_MAX_VARS];     // names the slots were found under
+    size_t lengths[JIT_MAX_VARS];
+    JitType types[JIT_MAX_VARS];
+    bool written[JIT_MAX_VARS];     // only these are written back, the chunks of a parallel loop share the rest
+    size_t var_count;
+
+    Env* env;
+    size_t depth;           // of the expression being compiled
+    bool failed;
+} Jit;
+
+typedef int (*JitFn)(int64_t* frame, int64_t* snapshot);
+
+#pragma region Emitter
+static void emit(Jit* jit, const uint8_t* bytes, size_t n){
+    if (jit->index + n > jit->size){
+        size_t size = jit->size == 0 ? INITIAL_JIT_CODE : jit->size;
+        while (jit->index + n > size) size *= 2;
+        uint8_t* code = realloc(jit->code, size);
+        if (code == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "realloc failed");
+            exit(1);
+        }
+        jit->code = code;
+        jit->size = size;
+    }
+    memcpy(jit->code + jit->index, bytes, n);
+    jit->index += n;
+}
+
+#define EMIT(jit, ...) emit((jit), (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+static void emit_u32(Jit* jit, uint32_t value){
+    uint8_t bytes[4];
+    memcpy(bytes, &value, 4);
+    emit(jit, bytes, 4);
+}
+
+static void emit_u64(Jit* jit, uint64_t value){
+    uint8_t bytes[8];
+    memcpy(bytes, &value, 8);
+    emit(jit, bytes, 8);
+}
+
+// returns the offset of the rel32 to patch
+static size_t emit_jmp(Jit* jit){
+    EMIT(jit, 0xE9);
+    emit_u32(jit, 0);
+    return jit->index - 4;
+}
+
+static size_t emit_jcc(Jit* jit, uint8_t cc){
+    EMIT(jit, 0x0F, cc);
+    emit_u32(jit, 0);
+    return jit->index - 4;
+}
+
+static void patch(Jit* jit, size_t at, size_t target){
+    int32_t rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+    memcpy(jit->code + at, &rel, 4);
+}
+
+#define JO 0x80
+#define JE 0x84
+#define JNE 0x85
+
+static void guard(Jit* jit, uint8_t cc){
+    if (jit->guard_index == jit->guard_size){
+        jit->guard_size = jit->guard_size == 0 ? INITIAL_JIT_GUARDS : jit->guard_size * 2;
+        size_t* guards = realloc(jit->guards, jit->guard_size * sizeof(size_t));
+        if (guards == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "realloc failed");
+            exit(1);
+        }
+        jit->guards = guards;
+    }
+    jit->guards[jit->guard_index++] = emit_jcc(jit, cc);
+}
+
+static void load_var(Jit* jit, size_t index){
+    uint32_t disp = (uint32_t)(index * sizeof(int64_t));
+    if (jit->types[index] == J_NUM) EMIT(jit, 0xF2, 0x0F, 0x10, 0x87);    // movsd xmm0, [rdi+disp]
+    else EMIT(jit, 0x48, 0x8B, 0x87);                                       // mov rax, [rdi+disp]
+    emit_u32(jit, disp);
+}
+
+static void store_var(Jit* jit, size_t index){
+    uint32_t disp = (uint32_t)(index * sizeof(int64_t));
+    if (jit->types[index] == J_NUM) EMIT(jit, 0xF2, 0x0F, 0x11, 0x87);    // movsd [rdi+disp], xmm0
+    else EMIT(jit, 0x48, 0x89, 0x87);                                       // mov [rdi+disp], rax
+    emit_u32(jit, disp);
+    jit->written[index] = true;
+}
+
+static void to_double(Jit* jit, JitType type){
+    if (type == J_INT) EMIT(jit, 0xF2, 0x48, 0x0F, 0x2A, 0xC0);             // cvtsi2sd xmm0, rax
+}
+
+// setcc al; movzx eax, al
+static void set_bool(Jit* jit, uint8_t cc){
+    EMIT(jit, 0x0F, cc, 0xC0, 0x0F, 0xB6, 0xC0);
+}
+#pragma endregion Emitter
+
+#pragma region Compiler
+static int slot_index(Jit* jit, const char* key, size_t length){
+    LiteralExpr* slot = lookup_value(jit->env, key, length);
+    if (slot == NULL){
+        jit->failed = true;
+        return -1;
+    }
+    for (size_t i = 0; i < jit->var_count; i++){
+        if (jit->slots[i] == slot) return (int)i;
+    }
+    if (jit->var_count == JIT_MAX_VARS){
+        jit->failed = true;
+        return -1;
+    }
+    switch (slot->type){
+        case INT_T: jit->types[jit->var_count] = J_INT; break;
+        case NUM_T: jit->types[jit->var_count] = J_NUM; break;
+        case BOOL_T: jit->types[jit->var_count] = J_BOOL; break;
+        default:
+            jit->failed = true;
+            return -1;
+    }
+    jit->slots[jit->var_count] = slot;
+    jit->keys[jit->var_count] = key;
+    jit->lengths[jit->var_count] = length;
+    return (int)jit->var_count++;
+}
+
+static int var_index(Jit* jit, Token* name){
+    return slot_index(jit, name->source + name->start, name->count - name->start);
+}
+
+static JitType compile_expr(Jit* jit, Expr* expr);
+
+static JitType compile_logical(Jit* jit, BinaryExpr* binary){
+    if (compile_expr(jit, binary->left) != J_BOOL) jit->failed = true;
+    EMIT(jit, 0x48, 0x85, 0xC0);                                            // test rax, rax
+    size_t skip = emit_jcc(jit, binary->op->type == AND ? JE : JNE);
+    if (compile_expr(jit, binary->right) != J_BOOL) jit->failed = true;
+    patch(jit, skip, jit->index);
+    return J_BOOL;
+}
+
+static JitType compile_int_binary(Jit* jit, TokenType op){
+    EMIT(jit, 0x48, 0x89, 0xC1);                                            // mov rcx, rax
+    EMIT(jit, 0x58);                                                        // pop rax
+    switch (op){
+        case PLUS:
+            EMIT(jit, 0x48, 0x01, 0xC8);                                    // add rax, rcx
+            guard(jit, JO);
+            return J_INT;
+        case MINUS:
+            EMIT(jit, 0x48, 0x29, 0xC8);                                    // sub rax, rcx
+            guard(jit, JO);
+            return J_INT;
+        case STAR:
+            EMIT(jit, 0x48, 0x0F, 0xAF, 0xC1);                              // imul rax, rcx
+            guard(jit, JO);
+            return J_INT;
+        case SLASH:
+        case PERCENT:
+            // zero is an error and -1 can overflow, both are left to the interpreter
+            EMIT(jit, 0x48, 0x85, 0xC9);                                    // test rcx, rcx
+            guard(jit, JE);
+            EMIT(jit, 0x48, 0x83, 0xF9, 0xFF);                              // cmp rcx, -1
+            guard(jit, JE);
+            EMIT(jit, 0x48, 0x99, 0x48, 0xF7, 0xF9);                        // cqo; idiv rcx
+            if (op == SLASH){
+                // inexact division produces a number
+                EMIT(jit, 0x48, 0x85, 0xD2);                                // test rdx, rdx
+                guard(jit, JNE);
+            } else {
+                EMIT(jit, 0x48, 0x89, 0xD0);                                // mov rax, rdx
+            }
+            return J_INT;
+        default: break;
+    }
+    EMIT(jit, 0x48, 0x39, 0xC8);                                            // cmp rax, rcx
+    switch (op){
+        case GREATER: set_bool(jit, 0x9F); break;
+        case GREATER_EQUAL: set_bool(jit, 0x9D); break;
+        case LESS: set_bool(jit, 0x9C); break;
+        case LESS_EQUAL: set_bool(jit, 0x9E); break;
+        case EQUAL_EQUAL: set_bool(jit, 0x94); break;
+        case BANG_EQUAL: set_bool(jit, 0x95); break;
+        default: jit->failed = true; break;
+    }
+    return J_BOOL;
+}
+
+static JitType compile_num_binary(Jit* jit, TokenType op, JitType left, JitType right){
+    to_double(jit, right);
+    EMIT(jit, 0x66, 0x0F, 0x28, 0xC8);                                      // movapd xmm1, xmm0
+    EMIT(jit, 0x58);                                                        // pop rax
+    if (left == J_NUM) EMIT(jit, 0x66, 0x48, 0x0F, 0x6E, 0xC0);             // movq xmm0, rax
+    else to_double(jit, left);
+    switch (op){
+        case PLUS: EMIT(jit, 0xF2, 0x0F, 0x58, 0xC1); return J_NUM;         // addsd xmm0, xmm1
+        case MINUS: EMIT(jit, 0xF2, 0x0F, 0x5C, 0xC1); return J_NUM;        // subsd xmm0, xmm1
+        case STAR: EMIT(jit, 0xF2, 0x0F, 0x59, 0xC1); return J_NUM;         // mulsd xmm0, xmm1
+        case SLASH:
+            // division by zero is reported by the interpreter, NaN takes the same exit
+            EMIT(jit, 0x66, 0x0F, 0x57, 0xD2);                              // xorpd xmm2, xmm2
+            EMIT(jit, 0x66, 0x0F, 0x2E, 0xCA);                              // ucomisd xmm1, xmm2
+            guard(jit, JE);
+            EMIT(jit, 0xF2, 0x0F, 0x5E, 0xC1);                              // divsd xmm0, xmm1
+            return J_NUM;
+        // unordered compares set CF and ZF, seta/setae are false for them
+        case GREATER:
+            EMIT(jit, 0x66, 0x0F, 0x2E, 0xC1);                              // ucomisd xmm0, xmm1
+            set_bool(jit, 0x97);
+            return J_BOOL;
+        case GREATER_EQUAL:
+            EMIT(jit, 0x66, 0x0F, 0x2E, 0xC1);
+            set_bool(jit, 0x93);
+            return J_BOOL;
+        case LESS:
+            EMIT(jit, 0x66, 0x0F, 0x2E, 0xC8);                              // ucomisd xmm1, xmm0
+            set_bool(jit, 0x97);
+            return J_BOOL;
+        case LESS_EQUAL:
+            EMIT(jit, 0x66, 0x0F, 0x2E, 0xC8);
+            set_bool(jit, 0x93);
+            return J_BOOL;
+        case EQUAL_EQUAL:
+            EMIT(jit, 0x66, 0x0F, 0x2E, 0xC1);
+            EMIT(jit, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8);      // sete al; setnp cl; and al, cl
+            EMIT(jit, 0x0F, 0xB6, 0xC0);                                    // movzx eax, al
+            return J_BOOL;
+        case BANG_EQUAL:
+            EMIT(jit, 0x66, 0x0F, 0x2E, 0xC1);
+            EMIT(jit, 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8);      // setne al; setp cl; or al, cl
+            EMIT(jit, 0x0F, 0xB6, 0xC0);
+            return J_BOOL;
+        default:
+            // '%' is only defined for ints
+            jit->failed = true;
+            return J_NUM;
+    }
+}
+
+static JitType compile_binary(Jit* jit, BinaryExpr* binary){
+    TokenType op = binary->op->type;
+    if (op == AND || op == OR) return compile_logical(jit, binary);
+
+    JitType left = compile_expr(jit, binary->left);
+    if (left == J_NUM) EMIT(jit, 0x66, 0x48, 0x0F, 0x7E, 0xC0);             // movq rax, xmm0
+    EMIT(jit, 0x50);                                                        // push rax
+    JitType right = compile_expr(jit, binary->right);
+
+    if (left == J_BOOL || right == J_BOOL){
+        if (left != right || (op != EQUAL_EQUAL && op != BANG_EQUAL)){
+            jit->failed = true;
+            return J_BOOL;
+        }
+        return compile_int_binary(jit, op);
+    }
+    if (left == J_INT && right == J_INT) return compile_int_binary(jit, op);
+    return compile_num_binary(jit, op, left, right);
+}
+
+static JitType compile_node(Jit* jit, Expr* expr){
+    if (jit->failed) return J_INT;
+    switch (expr->type){
+    case LITERAL: {
+        LiteralExpr* value = &expr->as.literal;
+        switch (value->type){
+            case INT_T:
+                EMIT(jit, 0x48, 0xB8);                                      // mov rax, imm64
+                emit_u64(jit, (uint64_t)value->as.integer);
+                return J_INT;
+            case NUM_T: {
+                uint64_t bits;
+                memcpy(&bits, &value->as.number, sizeof(bits));
+                EMIT(jit, 0x48, 0xB8);
+                emit_u64(jit, bits);
+                EMIT(jit, 0x66, 0x48, 0x0F, 0x6E, 0xC0);                    // movq xmm0, rax
+                return J_NUM;
+            }
+            case BOOL_T:
+                EMIT(jit, 0xB8);                                            // mov eax, imm32
+                emit_u32(jit, value->as.boolean ? 1 : 0);
+                return J_BOOL;
+            default: break;
+        }
+        jit->failed = true;
+        return J_INT;
+    }
+    case GROUPING: return compile_expr(jit, expr->as.group.expression);
+    case VAREXPR: {
+        int index = var_index(jit, expr->as.var.name);
+        if (index < 0) return J_INT;
+        load_var(jit, index);
+        return jit->types[index];
+    }
+    case INVARIANT: {
+        // hoisted values are read like variables, the loop never writes them
+        const char* name = expr->as.invariant.name;
+        if (lookup_value(jit->env, name, strlen(name)) == NULL) return compile_expr(jit, expr->as.invariant.expr);
+        int index = slot_index(jit, name, strlen(name));
+        if (index < 0) return J_INT;
+        load_var(jit, index);
+        return jit->types[index];
+    }
+    case ASSIGN: {
+        int index = var_index(jit, expr->as.assign.name);
+        if (index < 0) return J_INT;
+        // a variable that would change its type can't stay in its slot
+        if (compile_expr(jit, expr->as.assign.value) != jit->types[index]) jit->failed = true;
+        store_var(jit, index);
+        return jit->types[index];
+    }
+    case UNARY: {
+        if (expr->as.unary.op->type == JOIN){
+            jit->failed = true;
+            return J_INT;
+        }
+        JitType type = compile_expr(jit, expr->as.unary.right);
+        if (expr->as.unary.op->type == BANG){
+            if (type == J_BOOL) EMIT(jit, 0x83, 0xF0, 0x01);                // xor eax, 1
+            else EMIT(jit, 0xB8, 0x00, 0x00, 0x00, 0x00);                   // numbers are always truthy
+            return J_BOOL;
+        }
+        if (type == J_INT){
+            EMIT(jit, 0x48, 0xF7, 0xD8);                                    // neg rax
+            guard(jit, JO);
+        } else if (type == J_NUM){
+            EMIT(jit, 0x48, 0xB9);                                          // mov rcx, imm64
+            emit_u64(jit, 0x8000000000000000ull);
+            EMIT(jit, 0x66, 0x48, 0x0F, 0x6E, 0xC9);                        // movq xmm1, rcx
+            EMIT(jit, 0x66, 0x0F, 0x57, 0xC1);                              // xorpd xmm0, xmm1
+        } else {
+            jit->failed = true;
+        }
+        return type;
+    }
+    case TERNARY: {
+        JitType cond = compile_expr(jit, expr->as.ternary.cond);
+        size_t otherwise = 0;
+        if (cond == J_BOOL){
+            EMIT(jit, 0x48, 0x85, 0xC0);                                    // test rax, rax
+            otherwise = emit_jcc(jit, JE);
+        }
+        JitType type = compile_expr(jit, expr->as.ternary.trueBranch);
+        size_t end = emit_jmp(jit);
+        if (cond == J_BOOL) patch(jit, otherwise, jit->index);
+        if (compile_expr(jit, expr->as.ternary.falseBranch) != type) jit->failed = true;
+        patch(jit, end, jit->index);
+        return type;
+    }
+    case BINARY: return compile_binary(jit, &expr->as.binary);
+    default:
+        jit->failed = true;
+        return J_INT;
+    }
+}
+
+// compilation recurses, so it gives up on deep expressions
+static JitType compile_expr(Jit* jit, Expr* expr){
+    if (jit->depth == JIT_MAX_DEPTH){
+        jit->failed = true;
+        return J_INT;
+    }
+    jit->depth++;
+    JitType type = compile_node(jit, expr);
+    jit->depth--;
+    return type;
+}
+
+static void compile_loop(Jit* jit, Stmt* loop, bool outer);
+
+static void compile_stmt(Jit* jit, Stmt* stmt){
+    if (jit->failed) return;
+    switch (stmt->type){
+    case NULL_STMT: break;
+    case EXPR_STMT: compile_expr(jit, stmt->as.expr.expression); break;
+    case BLOCK_STMT: {
+        // declarations would need a scope of their own
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++) compile_stmt(jit, &list->statements[i]);
+    } break;
+    case IF_STMT: {
+        JitType cond = compile_expr(jit, stmt->as.if_stmt.cond);
+        if (cond != J_BOOL){
+            compile_stmt(jit, stmt->as.if_stmt.trueBranch);
+            break;
+        }
+        EMIT(jit, 0x48, 0x85, 0xC0);                                        // test rax, rax
+        size_t otherwise = emit_jcc(jit, JE);
+        compile_stmt(jit, stmt->as.if_stmt.trueBranch);
+        if (stmt->as.if_stmt.falseBranch != NULL){
+            size_t end = emit_jmp(jit);
+            patch(jit, otherwise, jit->index);
+            compile_stmt(jit, stmt->as.if_stmt.falseBranch);
+            patch(jit, end, jit->index);
+        } else {
+            patch(jit, otherwise, jit->index);
+        }
+    } break;
+    case WHILE_STMT: compile_loop(jit, stmt, false); break;
+    default:
+        jit->failed = true;
+        break;
+    }
+}
+
+// the outer loop snapshots every variable at its head, so var_count must already be final
+static void compile_loop(Jit* jit, Stmt* loop, bool outer){
+    size_t head = jit->index;
+    if (outer){
+        for (size_t i = 0; i < jit->var_count; i++){
+            uint32_t disp = (uint32_t)(i * sizeof(int64_t));
+            EMIT(jit, 0x48, 0x8B, 0x87);                                    // mov rax, [rdi+disp]
+            emit_u32(jit, disp);
+            EMIT(jit, 0x48, 0x89, 0x86);                                    // mov [rsi+disp], rax
+            emit_u32(jit, disp);
+        }
+    }
+    JitType cond = compile_expr(jit, loop->as.while_stmt.cond);
+    size_t exit_loop = 0;
+    if (cond == J_BOOL){
+        EMIT(jit, 0x48, 0x85, 0xC0);                                        // test rax, rax
+        exit_loop = emit_jcc(jit, JE);
+    }
+    compile_stmt(jit, loop->as.while_stmt.body);
+    patch(jit, emit_jmp(jit), head);
+    if (cond == J_BOOL) patch(jit, exit_loop, jit->index);
+}
+
+static void compile(Jit* jit, Stmt* loop){
+    jit->index = 0;
+    jit->guard_index = 0;
+    // guards can fire with operands still pushed, rbx keeps the stack pointer to return with
+    EMIT(jit, 0x53, 0x48, 0x89, 0xE3);                                      // push rbx; mov rbx, rsp
+    compile_loop(jit, loop, true);
+    EMIT(jit, 0x5B, 0x31, 0xC0, 0xC3);                                      // pop rbx; xor eax, eax; ret
+    size_t deopt = jit->index;
+    EMIT(jit, 0x48, 0x89, 0xDC, 0x5B);                                      // mov rsp, rbx; pop rbx
+    EMIT(jit, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3);                          // mov eax, 1; ret
+    for (size_t i = 0; i < jit->guard_index; i++) patch(jit, jit->guards[i], deopt);
+}
+#pragma endregion Compiler
+
+#pragma region Cache
+// A loop's code only depends on the variables it uses and their types, so it is kept on the
+// WhileStmt and reused whenever those names resolve to variables of the same types. A run
+// takes the code off the statement and puts it back afterwards, concurrent runs of the
+// program compile their own meanwhile.
+
+typedef struct {
+    JitCode base;
+    void* memory;
+    size_t size;
+    size_t var_count;
+    const char* keys[JIT_MAX_VARS];
+    size_t lengths[JIT_MAX_VARS];
+    JitType types[JIT_MAX_VARS];
+    bool written[JIT_MAX_VARS];
+} CompiledLoop;
+
+static void release_loop(JitCode* code){
+    CompiledLoop* compiled = (CompiledLoop*)code;
+    munmap(compiled->memory, compiled->size);
+    free(compiled);
+}
+
+static const ValueType value_types[] = { [J_INT] = INT_T, [J_NUM] = NUM_T, [J_BOOL] = BOOL_T };
+
+// the slots of the compiled loop's variables in env, false if one is missing or changed its type
+static bool resolve(CompiledLoop* compiled, Env* env, LiteralExpr** slots){
+    for (size_t i = 0; i < compiled->var_count; i++){
+        slots[i] = lookup_value(env, compiled->keys[i], compiled->lengths[i]);
+        if (slots[i] == NULL || slots[i]->type != value_types[compiled->types[i]]) return false;
+    }
+    return true;
+}
+
+static CompiledLoop* compile_loop_code(Stmt* loop, Env* env, LiteralExpr** slots){
+    Jit jit = { .env = env };
+    // the first pass finds the variables, the second knows how many to snapshot
+    compile(&jit, loop);
+    if (!jit.failed) compile(&jit, loop);
+    void* memory = jit.failed ? MAP_FAILED : mmap(NULL, jit.index, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED){
+        memcpy(memory, jit.code, jit.index);
+        if (mprotect(memory, jit.index, PROT_READ | PROT_EXEC) != 0){
+            munmap(memory, jit.index);
+            memory = MAP_FAILED;
+        }
+    }
+    free(jit.code);
+    free(jit.guards);
+    if (memory == MAP_FAILED) return NULL;
+
+    CompiledLoop* compiled = malloc(sizeof(CompiledLoop));
+    if (compiled == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for compiled loop");
+        exit(1);
+    }
+    compiled->base.release = release_loop;
+    compiled->memory = memory;
+    compiled->size = jit.index;
+    compiled->var_count = jit.var_count;
+    memcpy(compiled->keys, jit.keys, sizeof(jit.keys));
+    memcpy(compiled->lengths, jit.lengths, sizeof(jit.lengths));
+    memcpy(compiled->types, jit.types, sizeof(jit.types));
+    memcpy(compiled->written, jit.written, sizeof(jit.written));
+    memcpy(slots, jit.slots, sizeof(jit.slots));
+    return compiled;
+}
+#pragma endregion Cache
+
+JitResult jit_run_loop(Stmt* loop, Env* env){
+    LiteralExpr* slots[JIT_MAX_VARS];
+    JitCode** cache = &loop->as.while_stmt.jit;
+    CompiledLoop* compiled = (CompiledLoop*)__atomic_exchange_n(cache, NULL, __ATOMIC_ACQUIRE);
+    if (compiled != NULL && !resolve(compiled, env, slots)){
+        release_loop(&compiled->base);
+        compiled = NULL;
+    }
+    if (compiled == NULL) compiled = compile_loop_code(loop, env, slots);
+    if (compiled == NULL) return JIT_UNSUPPORTED;
+
+    int64_t frame[JIT_MAX_VARS];
+    int64_t snapshot[JIT_MAX_VARS];
+    for (size_t i = 0; i < compiled->var_count; i++){
+        LiteralExpr* slot = slots[i];
+        switch (compiled->types[i]){
+            case J_INT: frame[i] = slot->as.integer; break;
+            case J_NUM: memcpy(&frame[i], &slot->as.number, sizeof(double)); break;
+            case J_BOOL: frame[i] = slot->as.boolean; break;
+        }
+    }
+
+    JitFn fn;
+    memcpy(&fn, &compiled->memory, sizeof(fn));
+    int deopt = fn(frame, snapshot);
+
+    int64_t* values = deopt ? snapshot : frame;
+    for (size_t i = 0; i < compiled->var_count; i++){
+        if (!compiled->written[i]) continue;
+        LiteralExpr* slot = slots[i];
+        switch (compiled->types[i]){
+            case J_INT: *slot = (LiteralExpr){ .type = INT_T, .as.integer = values[i] }; break;
+            case J_NUM:
+                *slot = (LiteralExpr){ .type = NUM_T };
+                memcpy(&slot->as.number, &values[i], sizeof(double));
+                break;
+            case J_BOOL: *slot = (LiteralExpr){ .type = BOOL_T, .as.boolean = values[i] != 0 }; break;
+        }
+    }
+
+    // code whose guard failed would likely fail again, the next entry compiles for the new types
+    JitCode* empty = NULL;
+    if (deopt || !__atomic_compare_exchange_n(cache, &empty, &compiled->base, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+        release_loop(&compiled->base);
+    }
+    return deopt ? JIT_DEOPT : JIT_DONE;
+}
+
+#else
+
+JitResult jit_run_loop(Stmt* loop, Env* env){
+    (void)loop;
+    (void)env;
+    return JIT_UNSUPPORTED;
+}
+
+#endif
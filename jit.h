@@ -0,0 +1,24 @@
+#ifndef _JIT_H
+#define _JIT_H
+
+#include "interpreter.h"
+
+// a while loop is handed to the JIT once it has run this many iterations in the interpreter
+#define JIT_THRESHOLD 100
+#define JIT_MAX_VARS 64
+#define JIT_MAX_DEPTH 256     // deeper expressions stay interpreted
+
+typedef enum {
+    JIT_DONE,           // the loop ran to completion natively
+    JIT_DEOPT,          // a guard failed, the variables hold their values from the start of that iteration
+    JIT_UNSUPPORTED     // the loop can't be compiled (or this isn't x86-64 Linux), nothing was changed
+} JitResult;
+
+// Compiles a WHILE_STMT for the current types of the variables it uses and runs it from
+// its condition. Only loops over int, number and bool variables that already exist in env
+// and that keep their types are compiled. The code stays on the statement for the next
+// time the loop is entered while its variables have the same types, and is dropped
+// when a guard fails.
+JitResult jit_run_loop(Stmt* loop, Env* env);
+
+#endif //_JIT_H
@@ -1,63 +1,410 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
 #include "tokenizer.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "infer.h"
+#include "optimize.h"
+#include "session.h"
+#include "cache.h"
+#include "emit_c.h"
+#include "profile.h"
+#include "trace.h"
+#include "watch.h"
+#include "task.h"
 #include "utils.h"
 
-bool hadError = false;
+typedef struct {
+    bool cache;
+    bool no_jit;
+    bool emit_c;
+    bool stack_parse;
+    bool mem_report;
+    bool infer_report;
+    bool watch;
+    const char* profile;    // where --profile writes folded stacks
+    int profile_hz;
+    const char* trace;      // where --trace writes trace events
+    size_t max_depth;
+    int jobs;
+    int workers;            // threads running spawned tasks
+} Options;
 
-void run(char* source, Env* env){
+static Options options = { .max_depth = DEFAULT_MAX_DEPTH, .profile_hz = DEFAULT_PROFILE_HZ };
+static Trace* trace = NULL;
 
-    Tokenizer* tokenizer = create_tokenizer(source);
-    tokenize(tokenizer);
-    // if (!hadError) print_tokens(tokenizer);
+// tid is the row of the trace the run's events go to
+static Context options_context(FILE* out, FILE* err, int tid){
+    Context ctx = create_context(out, err);
+    ctx.jit = !options.no_jit;
+    ctx.stack_parse = options.stack_parse;
+    ctx.max_depth = options.max_depth;
+    ctx.trace = trace;
+    ctx.trace_tid = tid;
+    return ctx;
+}
+
+// begins ('B') or ends ('E') a phase of the run in the trace
+static void phase(Context* ctx, char edge, const char* name){
+    if (ctx->trace != NULL) trace_event(ctx->trace, edge, ctx->trace_tid, "phase", name, NULL);
+}
+
+void run(Context* ctx, char* source, Env* env, const char* path){
 
+    Tokenizer* tokenizer = create_tokenizer(ctx, source);
     Parser* parser = create_parser(tokenizer);
-    parse(parser);
-    if (!hadError) print_statements(parser);
 
-    if (!hadError) interpret(parser->stmt_list, env, source);
+    char* cached = NULL;
+    uint64_t hash = 0;
+    bool loaded = false;
+    if (options.cache && path != NULL){
+        phase(ctx, 'B', "load cache");
+        hash = hash_source(source, tokenizer->source_len);
+        cached = cache_path(path, hash);
+        loaded = cached != NULL && load_cache(cached, hash, tokenizer, parser);
+        phase(ctx, 'E', "load cache");
+    }
+    if (!loaded){
+        phase(ctx, 'B', "tokenize");
+        tokenize(tokenizer);
+        phase(ctx, 'E', "tokenize");
+        // if (!ctx->hadError) print_tokens(tokenizer);
+        phase(ctx, 'B', "parse");
+        parse(parser);
+        phase(ctx, 'E', "parse");
+        if (!ctx->hadError && cached != NULL){
+            phase(ctx, 'B', "write cache");
+            write_cache(cached, hash, parser);
+            phase(ctx, 'E', "write cache");
+        }
+    }
+    free(cached);
+    if (!ctx->hadError && options.emit_c){
+        phase(ctx, 'B', "emit C");
+        emit_c(ctx->out, parser, path);
+        phase(ctx, 'E', "emit C");
+    } else {
+        if (!ctx->hadError){
+            phase(ctx, 'B', "print statements");
+            print_statements(parser);
+            phase(ctx, 'E', "print statements");
+        }
+        if (!ctx->hadError){
+            phase(ctx, 'B', "infer types");
+            InferStats stats = infer_types(parser->stmt_list);
+            phase(ctx, 'E', "infer types");
+            if (options.infer_report){
+                fprintf(ctx->err, "%s: %zu of %zu operations proven (%zu on numbers, %zu on strings)\n", path != NULL ? path : "script",
+                    stats.numbers + stats.strings, stats.operations, stats.numbers, stats.strings);
+            }
+            phase(ctx, 'B', "optimize");
+            optimize(parser->stmt_list);
+            phase(ctx, 'E', "optimize");
+        }
+
+        if (!ctx->hadError){
+            phase(ctx, 'B', "interpret");
+            interpret(ctx, parser->stmt_list, env);
+            phase(ctx, 'E', "interpret");
+        }
+    }
 
     free_parser(parser);
     free_tokenizer(tokenizer);
 }
 
+// names the run's row of the trace after the script and times reading it
+static char* read_traced(Context* ctx, const char* path){
+    if (ctx->trace != NULL) trace_thread_name(ctx->trace, ctx->trace_tid, path);
+    phase(ctx, 'B', "read source");
+    char* source = read_source_file(ctx, path);
+    phase(ctx, 'E', "read source");
+    return source;
+}
+
 void runFile(const char* path){
-    char* source = read_source_file(path);
+    Context ctx = options_context(stdout, stderr, 1);
+    char* source = read_traced(&ctx, path);
+    if (source == NULL) exit(1);
     Env* env = create_env(NULL);
-    run(source, env);
+    if (options.profile != NULL){
+        ctx.profiler = profiler_start(path, options.profile_hz);
+        if (ctx.profiler == NULL) fprintf(stderr, "Couldn't start the profiler, running without it\n");
+    }
+    run(&ctx, source, env, path);
+    if (ctx.profiler != NULL && !profiler_stop(ctx.profiler, options.profile)){
+        fprintf(stderr, "Couldn't write profile to %s\n", options.profile);
+    }
     free_env(env);
-    free(source);
-    if (hadError) exit(1);
+    mem_free(MEM_SOURCE, source);
+    if (ctx.hadError) exit(1);
+}
+
+#pragma region Batch
+
+// Every script runs on a worker with its own Context, its output is buffered and
+// written out in command line order once the script (and all before it) finished.
+typedef struct {
+    const char* path;
+    char* out;
+    size_t out_len;
+    char* err;
+    size_t err_len;
+    bool hadError;
+    bool done;
+} BatchJob;
+
+typedef struct {
+    BatchJob* jobs;
+    size_t job_count;
+    size_t next;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} Batch;
+
+static void run_job(BatchJob* job, int tid){
+    FILE* out = open_memstream(&job->out, &job->out_len);
+    FILE* err = open_memstream(&job->err, &job->err_len);
+    if (out == NULL || err == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate output buffers for %s", job->path);
+        exit(1);
+    }
+    Context ctx = options_context(out, err, tid);
+    char* source = read_traced(&ctx, job->path);
+    if (source != NULL){
+        Env* env = create_env(NULL);
+        run(&ctx, source, env, job->path);
+        free_env(env);
+        mem_free(MEM_SOURCE, source);
+    }
+    fclose(out);
+    fclose(err);
+    job->hadError = ctx.hadError;
+}
+
+static void* batch_worker(void* arg){
+    Batch* batch = (Batch*)arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->job_count){
+        run_job(&batch->jobs[i], (int)i + 1);
+        pthread_mutex_lock(&batch->lock);
+        batch->jobs[i].done = true;
+        pthread_cond_broadcast(&batch->finished);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+void runBatch(const char** paths, size_t count, int jobs){
+    Batch batch = { .job_count = count, .next = 0 };
+    batch.jobs = (BatchJob*)calloc(count, sizeof(BatchJob));
+    pthread_t* workers = (pthread_t*)malloc(sizeof(pthread_t) * jobs);
+    if (batch.jobs == NULL || workers == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for batch run");
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) batch.jobs[i].path = paths[i];
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.finished, NULL);
+
+    int started = 0;
+    for (; started < jobs && (size_t)started < count; started++){
+        if (pthread_create(&workers[started], NULL, batch_worker, &batch) != 0) break;
+    }
+    if (started == 0) batch_worker(&batch);
+
+    bool failed = false;
+    for (size_t i = 0; i < count; i++){
+        BatchJob* job = &batch.jobs[i];
+        pthread_mutex_lock(&batch.lock);
+        while (!job->done) pthread_cond_wait(&batch.finished, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+        fwrite(job->out, 1, job->out_len, stdout);
+        fflush(stdout);
+        fwrite(job->err, 1, job->err_len, stderr);
+        free(job->out);
+        free(job->err);
+        failed = failed || job->hadError;
+    }
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.finished);
+    free(workers);
+    free(batch.jobs);
+    if (failed) exit(1);
+}
+
+#pragma endregion Batch
+
+#pragma region Watch
+
+static double now_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Runs the script, then again after every save. Editors often save by writing a new file
+// and renaming it over the old one, so the directory is watched for the script's name.
+void runWatch(const char* path){
+    Context ctx = options_context(stdout, stderr, 0);
+    Watch* watch = create_watch(&ctx);
+    char* dir_path = strdup(path);
+    char* file_path = strdup(path);
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (dir_path == NULL || file_path == NULL || fd < 0 ||
+        inotify_add_watch(fd, dirname(dir_path), IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+        fprintf(stderr, "Couldn't watch %s\n", path);
+        exit(1);
+    }
+    const char* name = basename(file_path);
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = true;
+    while (true){
+        if (changed){
+            ctx.hadError = false;
+            char* source = read_source_file(&ctx, path);
+            if (source != NULL){
+                double start = now_ms();
+                watch_update(watch, source);
+                fprintf(stderr, "[watch] %s: parsed %zu of %zu statements in %.2f ms\n",
+                    path, watch->reparsed, watch->unit_count, now_ms() - start);
+                watch_run(watch);
+            }
+        }
+        ssize_t n = read(fd, events, sizeof(events));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        changed = false;
+        for (char* at = events; at < events + n;){
+            struct inotify_event* event = (struct inotify_event*)at;
+            if (event->len > 0 && strcmp(event->name, name) == 0) changed = true;
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    close(fd);
+    free(dir_path);
+    free(file_path);
+    free_watch(watch);
 }
 
+#pragma endregion Watch
+
 void runREPL(){
-    char c;
-    size_t size, index;
-    char* line = malloc(100);
-    Env* env = create_env(NULL);
+    int c;
+    size_t size = 100, index;
+    char* line = malloc(size);
+    Context ctx = options_context(stdout, stderr, 0);
+    Session* session = create_session(&ctx);
     printf("Welcome to the REPL (Read, Evaluate, Print, Loop) environment\n");
     while (true){
-        size = 100;
         index = 0;
         printf("> ");
         while ((c = fgetc(stdin)) != EOF){
             if (c == '\n') break;
-            if (index == size) {
+            if (index + 1 == size) {
                 size *= 2;
                 line = realloc(line, size);
             }
             line[index++] = c;
         }
         line[index] = '\0';
-        
-        run(line, env);
-        hadError = false;
+        if (c == EOF && index == 0) break;
+
+        session_run(session, line);
+        ctx.hadError = false;
     }
-    free_env(env);
+    printf("\n");
+    free_session(session);
+    free(line);
+}
+
+static void close_trace(void){
+    if (!trace_close(trace)) fprintf(stderr, "Couldn't write the trace to %s\n", options.trace);
+}
+
+static void usage(const char* program){
+    fprintf(stderr, "Usage: %s [options] [script...]\n", program);
+    fprintf(stderr, "  --cache        reuse/write a parsed .plangc next to the script (or in $PLANG_CACHE_DIR)\n");
+    fprintf(stderr, "  --jobs=N       run several scripts concurrently on N worker threads (default: all cores)\n");
+    fprintf(stderr, "  --workers=N    run spawned tasks on N worker threads (default: all cores)\n");
+    fprintf(stderr, "  --emit-c       write the script as a C program to stdout instead of running it\n");
+    fprintf(stderr, "  --no-jit       interpret hot loops instead of compiling them to native code\n");
+    fprintf(stderr, "  --stack-parse  parse expressions without recursion, for deeply nested generated code\n");
+    fprintf(stderr, "  --max-depth=N  deepest expression nesting parsed with --stack-parse and evaluated (default: %d)\n", DEFAULT_MAX_DEPTH);
+    fprintf(stderr, "  --watch        run the script again whenever it is saved, only parsing the edited statements\n");
+    fprintf(stderr, "  --mem-report   print memory use per subsystem to stderr at exit and on SIGUSR1\n");
+    fprintf(stderr, "  --infer-report print how many arithmetic operations and comparisons skip their type checks to stderr\n");
+    fprintf(stderr, "  --profile=FILE sample the running statements and write folded stacks to FILE\n");
+    fprintf(stderr, "  --profile-hz=N samples per second of CPU time for --profile (default: %d)\n", DEFAULT_PROFILE_HZ);
+    fprintf(stderr, "  --trace=FILE   write the phases and top-level statements of every run as Chrome trace events\n");
 }
 
 int main(int argc, char** argv){
-    if (argc == 2) runFile(argv[1]);
+    const char** paths = (const char**)malloc(sizeof(char*) * argc);
+    size_t path_count = 0;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--cache") == 0) options.cache = true;
+        else if (strcmp(argv[i], "--no-jit") == 0) options.no_jit = true;
+        else if (strcmp(argv[i], "--emit-c") == 0) options.emit_c = true;
+        else if (strcmp(argv[i], "--stack-parse") == 0) options.stack_parse = true;
+        else if (strcmp(argv[i], "--mem-report") == 0) options.mem_report = true;
+        else if (strcmp(argv[i], "--infer-report") == 0) options.infer_report = true;
+        else if (strcmp(argv[i], "--watch") == 0) options.watch = true;
+        else if (strncmp(argv[i], "--max-depth=", 12) == 0 && atol(argv[i] + 12) > 0) options.max_depth = (size_t)atol(argv[i] + 12);
+        else if (strncmp(argv[i], "--profile=", 10) == 0 && argv[i][10] != '\0') options.profile = argv[i] + 10;
+        else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0') options.trace = argv[i] + 8;
+        else if (strncmp(argv[i], "--profile-hz=", 13) == 0 && atoi(argv[i] + 13) > 0) options.profile_hz = atoi(argv[i] + 13);
+        else if (strncmp(argv[i], "--jobs=", 7) == 0 && atoi(argv[i] + 7) > 0) options.jobs = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--workers=", 10) == 0 && atoi(argv[i] + 10) > 0) options.workers = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--", 2) == 0) {
+            usage(argv[0]);
+            return 1;
+        } else paths[path_count++] = argv[i];
+    }
+    // the interval timer is per process, so only a single script can be sampled
+    if (options.profile != NULL && path_count != 1){
+        fprintf(stderr, "--profile needs exactly one script\n");
+        return 1;
+    }
+    task_workers(options.workers);
+    if (options.watch && path_count != 1){
+        fprintf(stderr, "--watch needs exactly one script\n");
+        return 1;
+    }
+    if (options.trace != NULL && path_count == 0){
+        fprintf(stderr, "--trace needs a script\n");
+        return 1;
+    }
+    // before anything is allocated, accounting only knows blocks it saw being allocated.
+    // --trace takes its Env and string counts from it.
+    if (options.mem_report || options.trace != NULL) mem_track();
+    if (options.mem_report) mem_report_at_exit();
+    if (options.trace != NULL){
+        trace = trace_open(options.trace);
+        if (trace == NULL){
+            fprintf(stderr, "Couldn't open %s for the trace\n", options.trace);
+            return 1;
+        }
+        // runs that fail exit from deep inside, the trace is finished on the way out
+        atexit(close_trace);
+    }
+    if (options.jobs == 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        options.jobs = cores > 0 ? (int)cores : 1;
+    }
+
+    if (options.watch) runWatch(paths[0]);
+    else if (path_count > 1) runBatch(paths, path_count, options.jobs);
+    else if (path_count == 1) runFile(paths[0]);
     else runREPL();
+    free(paths);
     return 0;
 }
\ No newline at end of file
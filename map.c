@@ -0,0 +1,176 @@
+#include "map.h"
+
+Map* create_map(size_t capacity){
+    size_t n = INITIAL_MAP_SIZE;
+    while (n * MAP_LOAD_NUM / MAP_LOAD_DEN < capacity) n *= 2;
+    Map* map = (Map*)mem_alloc(MEM_MAPS, sizeof(Map));
+    if (map != NULL) map->entries = (MapEntry*)mem_calloc(MEM_MAPS, n, sizeof(MapEntry));
+    if (map == NULL || map->entries == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for map");
+        exit(1);
+    }
+    map->count = 0;
+    map->capacity = n;
+    return map;
+}
+
+Map* copy_map(Map* map){
+    Map* copy = (Map*)mem_alloc(MEM_MAPS, sizeof(Map));
+    if (copy != NULL) copy->entries = (MapEntry*)mem_alloc(MEM_MAPS, sizeof(MapEntry) * map->capacity);
+    if (copy == NULL || copy->entries == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for map");
+        exit(1);
+    }
+    memcpy(copy->entries, map->entries, sizeof(MapEntry) * map->capacity);
+    copy->count = map->count;
+    copy->capacity = map->capacity;
+    return copy;
+}
+
+void free_map(Map* map){
+    mem_free(MEM_MAPS, map->entries);
+    mem_free(MEM_MAPS, map);
+}
+
+bool valid_map_key(LiteralExpr key){
+    return key.type == STR_T || key.type == NUM_T || key.type == INT_T;
+}
+
+// whole numbers are stored as integers so that m[1] and m[1.0] are the same entry
+static LiteralExpr normalize_key(LiteralExpr key){
+    int64_t whole;
+    if (key.type == NUM_T && integral_value(key.as.number, &whole)){
+        return (LiteralExpr){ .type = INT_T, .as.integer = whole };
+    }
+    return key;
+}
+
+static uint32_t hash_key(LiteralExpr key){
+    uint64_t h;
+    if (key.type == STR_T){
+        h = 14695981039346656037ULL;
+        const char* s = string_chars(&key);
+        for (const char* end = s + string_length(&key); s < end; s++){
+            h ^= (unsigned char)*s;
+            h *= 1099511628211ULL; /* FNV-1a */
+        }
+    } else {
+        if (key.type == INT_T) h = (uint64_t)key.as.integer;
+        else memcpy(&h, &key.as.number, sizeof(h));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static bool key_equal(LiteralExpr a, LiteralExpr b){
+    if (a.type != b.type) return false;
+    if (a.type == NUM_T) return a.as.number == b.as.number;
+    if (a.type == INT_T) return a.as.integer == b.as.integer;
+    if (a.sso == 0 && b.sso == 0) return a.as.string == b.as.string || strcmp(a.as.string, b.as.string) == 0;
+    // a slice is as long as a heap string, but an inline string never is
+    size_t n = string_length(&a);
+    return n == string_length(&b) && memcmp(string_chars(&a), string_chars(&b), n) == 0;
+}
+
+// 'fresh' skips the key comparison when the key is known to be absent, as during a resize
+static void insert_entry(Map* map, MapEntry entry, bool fresh){
+    size_t mask = map->capacity - 1;
+    size_t i = entry.hash & mask;
+    entry.dist = 1;
+    for (;;){
+        MapEntry* slot = &map->entries[i];
+        if (slot->dist == 0){
+            *slot = entry;
+            map->count++;
+            return;
+        }
+        if (!fresh && slot->hash == entry.hash && key_equal(slot->key, entry.key)){
+            slot->value = entry.value;
+            return;
+        }
+        // take the slot from an entry that is closer to its home
+        if (slot->dist < entry.dist){
+            MapEntry tmp = *slot;
+            *slot = entry;
+            entry = tmp;
+        }
+        i = (i + 1) & mask;
+        entry.dist++;
+    }
+}
+
+static void resize(Map* map){
+    MapEntry* old = map->entries;
+    size_t old_capacity = map->capacity;
+    map->capacity *= 2;
+    map->entries = (MapEntry*)mem_calloc(MEM_MAPS, map->capacity, sizeof(MapEntry));
+    if (map->entries == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't reallocate memory for map");
+        exit(1);
+    }
+    map->count = 0;
+    for (size_t i = 0; i < old_capacity; i++){
+        if (old[i].dist != 0) insert_entry(map, old[i], true);
+    }
+    mem_free(MEM_MAPS, old);
+}
+
+void map_set(Map* map, LiteralExpr key, LiteralExpr value){
+    key = normalize_key(key);
+    if ((map->count + 1) * MAP_LOAD_DEN > map->capacity * MAP_LOAD_NUM) resize(map);
+    insert_entry(map, (MapEntry){ .key = key, .value = value, .hash = hash_key(key) }, false);
+}
+
+static MapEntry* find(Map* map, LiteralExpr key){
+    key = normalize_key(key);
+    uint32_t hash = hash_key(key);
+    size_t mask = map->capacity - 1;
+    size_t i = hash & mask;
+    for (uint32_t dist = 1; ; dist++){
+        MapEntry* slot = &map->entries[i];
+        // an entry further from home than us would have been displaced by the key
+        if (slot->dist < dist) return NULL;
+        if (slot->hash == hash && key_equal(slot->key, key)) return slot;
+        i = (i + 1) & mask;
+    }
+}
+
+bool map_get(Map* map, LiteralExpr key, LiteralExpr* value){
+    MapEntry* slot = find(map, key);
+    if (slot == NULL) return false;
+    *value = slot->value;
+    return true;
+}
+
+bool map_remove(Map* map, LiteralExpr key){
+    MapEntry* slot = find(map, key);
+    if (slot == NULL) return false;
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)(slot - map->entries);
+    size_t next = (i + 1) & mask;
+    // shift the following run back by one until an empty slot or an entry at its home
+    while (map->entries[next].dist > 1){
+        map->entries[i] = map->entries[next];
+        map->entries[i].dist--;
+        i = next;
+        next = (next + 1) & mask;
+    }
+    map->entries[i].dist = 0;
+    map->count--;
+    return true;
+}
+
+bool map_next(Map* map, size_t* it, MapEntry** entry){
+    while (*it < map->capacity){
+        MapEntry* slot = &map->entries[(*it)++];
+        if (slot->dist != 0){
+            *entry = slot;
+            return true;
+        }
+    }
+    return false;
+}
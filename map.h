@@ -0,0 +1,41 @@
+#ifndef _MAP_H
+#define _MAP_H
+
+#include <stdint.h>
+#include "parser.h"
+
+#define INITIAL_MAP_SIZE 8
+// grow once count exceeds capacity * MAP_LOAD_NUM / MAP_LOAD_DEN
+#define MAP_LOAD_NUM 7
+#define MAP_LOAD_DEN 8
+
+typedef struct {
+    LiteralExpr key;
+    LiteralExpr value;
+    uint32_t hash;      // cached so probing and resizing never rehash a string
+    uint32_t dist;      // probe distance + 1, 0 marks an empty slot
+} MapEntry;
+
+// Open addressing hash map with Robin Hood probing and backward shift deletion,
+// so there are no tombstones. Keys are strings or numbers.
+struct Map {
+    size_t count;
+    size_t capacity;    // always a power of two
+    MapEntry* entries;
+};
+
+Map* create_map(size_t capacity);
+void free_map(Map* map);
+// the same entries in a new table, arrays and maps among the values are shared
+Map* copy_map(Map* map);
+
+bool valid_map_key(LiteralExpr key);
+
+void map_set(Map* map, LiteralExpr key, LiteralExpr value);
+bool map_get(Map* map, LiteralExpr key, LiteralExpr* value);
+bool map_remove(Map* map, LiteralExpr key);
+
+// iterate with: size_t it = 0; while (map_next(map, &it, &entry)) ...
+bool map_next(Map* map, size_t* it, MapEntry** entry);
+
+#endif // _MAP_H
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include "memory.h"
+#include <malloc.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    size_t current;
+    size_t peak;
+    size_t allocations;
+    size_t frees;
+} MemCounter;
+
+static const char* category_names[MEM_CATEGORIES] = {
+    "source", "token list", "literals", "keyword table", "Expr", "StmtList",
+    "Env", "stacks", "runtime strings", "arrays", "maps", "profiler", "tasks", "generators", "files"
+};
+
+bool mem_tracking = false;
+
+// one more for the total, counters are shared by every thread of a --jobs run
+static MemCounter counters[MEM_CATEGORIES + 1];
+
+void mem_track(void){
+    mem_tracking = true;
+}
+
+static void raise_peak(MemCounter* counter, size_t current){
+    size_t peak = __atomic_load_n(&counter->peak, __ATOMIC_RELAXED);
+    while (current > peak &&
+        !__atomic_compare_exchange_n(&counter->peak, &peak, current, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void account(MemCategory category, size_t added, size_t removed, int allocations, int frees){
+    MemCounter* targets[2] = { &counters[category], &counters[MEM_CATEGORIES] };
+    for (int i = 0; i < 2; i++){
+        MemCounter* c = targets[i];
+        if (allocations) __atomic_add_fetch(&c->allocations, allocations, __ATOMIC_RELAXED);
+        if (frees) __atomic_add_fetch(&c->frees, frees, __ATOMIC_RELAXED);
+        size_t current = __atomic_add_fetch(&c->current, added - removed, __ATOMIC_RELAXED);
+        if (added > removed) raise_peak(c, current);
+    }
+}
+
+void* mem_tracked_alloc(MemCategory category, size_t size){
+    void* ptr = malloc(size);
+    if (ptr != NULL) account(category, malloc_usable_size(ptr), 0, 1, 0);
+    return ptr;
+}
+
+void* mem_tracked_calloc(MemCategory category, size_t count, size_t size){
+    void* ptr = calloc(count, size);
+    if (ptr != NULL) account(category, malloc_usable_size(ptr), 0, 1, 0);
+    return ptr;
+}
+
+void* mem_tracked_realloc(MemCategory category, void* ptr, size_t size){
+    size_t before = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    void* grown = realloc(ptr, size);
+    // a failed realloc leaves the block as it was
+    if (grown != NULL) account(category, malloc_usable_size(grown), before, ptr == NULL, 0);
+    return grown;
+}
+
+void mem_tracked_free(MemCategory category, void* ptr){
+    if (ptr == NULL) return;
+    account(category, 0, malloc_usable_size(ptr), 0, 1);
+    free(ptr);
+}
+
+void mem_usage(MemCategory category, size_t* allocations, size_t* current){
+    *allocations = __atomic_load_n(&counters[category].allocations, __ATOMIC_RELAXED);
+    *current = __atomic_load_n(&counters[category].current, __ATOMIC_RELAXED);
+}
+
+#pragma region Report
+
+// snprintf isn't async-signal-safe, rows are formatted by hand
+static size_t put_text(char* buf, size_t at, const char* text, size_t width){
+    size_t n = strlen(text);
+    memcpy(buf + at, text, n);
+    for (; n < width; n++) buf[at + n] = ' ';
+    return at + n;
+}
+
+static size_t put_number(char* buf, size_t at, size_t value, size_t width){
+    char digits[24];
+    size_t n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    for (size_t pad = n; pad < width; pad++) buf[at++] = ' ';
+    while (n > 0) buf[at++] = digits[--n];
+    return at;
+}
+
+static void put_row(int fd, const char* name, size_t current, size_t peak, size_t allocations, size_t live){
+    char row[128];
+    size_t at = put_text(row, 0, name, 16);
+    at = put_number(row, at, current, 16);
+    at = put_number(row, at, peak, 16);
+    at = put_number(row, at, allocations, 14);
+    at = put_number(row, at, live, 12);
+    row[at++] = '\n';
+    ssize_t written = write(fd, row, at);
+    (void)written;
+}
+
+void mem_report(int fd){
+    static const char header[] =
+        "category             current (B)        peak (B)   allocations        live\n";
+    ssize_t written = write(fd, header, sizeof(header) - 1);
+    (void)written;
+    for (int i = 0; i <= MEM_CATEGORIES; i++){
+        MemCounter c;
+        c.current = __atomic_load_n(&counters[i].current, __ATOMIC_RELAXED);
+        c.peak = __atomic_load_n(&counters[i].peak, __ATOMIC_RELAXED);
+        c.allocations = __atomic_load_n(&counters[i].allocations, __ATOMIC_RELAXED);
+        c.frees = __atomic_load_n(&counters[i].frees, __ATOMIC_RELAXED);
+        // the total's peak is the most ever live at once, not the sum of the peaks above
+        put_row(fd, i == MEM_CATEGORIES ? "total" : category_names[i], c.current, c.peak,
+            c.allocations, c.allocations - c.frees);
+    }
+}
+
+static void report_at_exit(void){
+    mem_report(STDERR_FILENO);
+}
+
+static void report_on_signal(int sig){
+    mem_report(STDERR_FILENO);
+    if (sig == SIGUSR1) return;
+    // SA_RESETHAND restored the default action, which ends the process as before
+    raise(sig);
+}
+
+void mem_report_at_exit(void){
+    atexit(report_at_exit);
+    struct sigaction action = { .sa_handler = report_on_signal, .sa_flags = SA_RESTART };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    action.sa_flags = SA_RESETHAND;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+#pragma endregion Report
@@ -0,0 +1,67 @@
+#ifndef _MEMORY_H
+#define _MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// What an allocation is for, --mem-report breaks memory use down by these
+typedef enum {
+    MEM_SOURCE,     // script text
+    MEM_TOKENS,     // tokenizers and their token lists
+    MEM_LITERALS,   // text of string and number literals
+    MEM_KEYWORDS,   // the keyword table
+    MEM_EXPR,       // Expr nodes and expression lists
+    MEM_STMT,       // parsers, statement lists and boxed statements
+    MEM_ENV,        // Env scopes and their slot tables
+    MEM_STACKS,     // heap stacks of the parser, printer and evaluator
+    MEM_STRINGS,    // strings created at runtime
+    MEM_ARRAYS,
+    MEM_MAPS,
+    MEM_PROFILE,    // --profile sample tables
+    MEM_TASKS,      // spawned tasks and the scheduler's deques
+    MEM_GENERATORS, // generators and their frames
+    MEM_FILES,      // open files and their read buffers
+    MEM_CATEGORIES
+} MemCategory;
+
+// Accounting is off unless mem_track() was called before anything was allocated, the
+// wrappers are plain malloc and free then. Tracked blocks are measured with
+// malloc_usable_size, so whatever the wrappers allocated must be freed by mem_free.
+extern bool mem_tracking;
+
+void mem_track(void);
+void* mem_tracked_alloc(MemCategory category, size_t size);
+void* mem_tracked_calloc(MemCategory category, size_t count, size_t size);
+void* mem_tracked_realloc(MemCategory category, void* ptr, size_t size);
+void mem_tracked_free(MemCategory category, void* ptr);
+
+// writes a table of current bytes, peak bytes, allocations and live blocks per
+// category to fd, only using calls that are safe inside a signal handler
+void mem_report(int fd);
+// allocations made so far and bytes held now in a category, both 0 unless tracking
+void mem_usage(MemCategory category, size_t* allocations, size_t* current);
+// reports when the process exits and on SIGUSR1 (which keeps running), SIGINT and SIGTERM
+void mem_report_at_exit(void);
+
+static inline void* mem_alloc(MemCategory category, size_t size){
+    if (!mem_tracking) return malloc(size);
+    return mem_tracked_alloc(category, size);
+}
+
+static inline void* mem_calloc(MemCategory category, size_t count, size_t size){
+    if (!mem_tracking) return calloc(count, size);
+    return mem_tracked_calloc(category, count, size);
+}
+
+static inline void* mem_realloc(MemCategory category, void* ptr, size_t size){
+    if (!mem_tracking) return realloc(ptr, size);
+    return mem_tracked_realloc(category, ptr, size);
+}
+
+static inline void mem_free(MemCategory category, void* ptr){
+    if (!mem_tracking) free(ptr);
+    else mem_tracked_free(category, ptr);
+}
+
+#endif // _MEMORY_H
@@ -0,0 +1,346 @@
+#include "optimize.h"
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// names written by a loop
+typedef struct {
+    size_t index;
+    size_t size;
+    Token** names;
+    bool all;               // a host function may set any global through the embedding API
+} NameSet;
+
+static void add_name(NameSet* set, Token* name){
+    if (set->index == set->size){
+        size_t size = set->size == 0 ? INITIAL_NAME_SET_SIZE : set->size * 2;
+        Token** names = (Token**)realloc(set->names, sizeof(Token*) * size);
+        if (names == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for loop variables");
+            exit(1);
+        }
+        set->names = names;
+        set->size = size;
+    }
+    set->names[set->index++] = name;
+}
+
+static bool has_name(NameSet* set, Token* name){
+    if (set->all) return true;
+    size_t length = name->count - name->start;
+    for (size_t i = 0; i < set->index; i++){
+        Token* other = set->names[i];
+        if (other->count - other->start == length &&
+            memcmp(other->source + other->start, name->source + name->start, length) == 0) return true;
+    }
+    return false;
+}
+
+#pragma region Written_names
+static void collect_stmt(NameSet* set, Stmt* stmt);
+
+static void collect_expr(NameSet* set, Expr* expr){
+    if (expr == NULL) return;
+    switch (expr->type)
+    {
+    case BINARY:
+        collect_expr(set, expr->as.binary.left);
+        collect_expr(set, expr->as.binary.right);
+        break;
+    case TERNARY:
+        collect_expr(set, expr->as.ternary.cond);
+        collect_expr(set, expr->as.ternary.trueBranch);
+        collect_expr(set, expr->as.ternary.falseBranch);
+        break;
+    case UNARY: collect_expr(set, expr->as.unary.right); break;
+    case GROUPING: collect_expr(set, expr->as.group.expression); break;
+    case ASSIGN:
+        add_name(set, expr->as.assign.name);
+        collect_expr(set, expr->as.assign.value);
+        break;
+    case CALL: {
+        Expr* callee = expr->as.call.callee;
+        if (callee->type != VAREXPR ||
+            find_builtin(callee->as.var.name->source + callee->as.var.name->start,
+                callee->as.var.name->count - callee->as.var.name->start) == NULL) set->all = true;
+        collect_expr(set, callee);
+        for (size_t i = 0; i < expr->as.call.args->index; i++) collect_expr(set, expr->as.call.args->exprs[i]);
+    } break;
+    case ARRAY:
+        for (size_t i = 0; i < expr->as.array.elements->index; i++) collect_expr(set, expr->as.array.elements->exprs[i]);
+        break;
+    case MAP:
+        for (size_t i = 0; i < expr->as.map.entries->index; i++) collect_expr(set, expr->as.map.entries->exprs[i]);
+        break;
+    case INDEX:
+        collect_expr(set, expr->as.index.object);
+        collect_expr(set, expr->as.index.index);
+        break;
+    case SET_INDEX:
+        collect_expr(set, expr->as.set_index.object);
+        collect_expr(set, expr->as.set_index.index);
+        collect_expr(set, expr->as.set_index.value);
+        break;
+    case INVARIANT: collect_expr(set, expr->as.invariant.expr); break;
+    default: break;
+    }
+}
+
+static void collect_stmt(NameSet* set, Stmt* stmt){
+    if (stmt == NULL) return;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: collect_expr(set, stmt->as.expr.expression); break;
+    case PRINT_STMT: collect_expr(set, stmt->as.print.expression); break;
+    case VAR_DECL_STMT:
+        add_name(set, stmt->as.var.name);
+        collect_expr(set, stmt->as.var.initializer);
+        break;
+    case BLOCK_STMT: {
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++) collect_stmt(set, &list->statements[i]);
+    } break;
+    case IF_STMT:
+        collect_expr(set, stmt->as.if_stmt.cond);
+        collect_stmt(set, stmt->as.if_stmt.trueBranch);
+        collect_stmt(set, stmt->as.if_stmt.falseBranch);
+        break;
+    case WHILE_STMT:
+        collect_expr(set, stmt->as.while_stmt.cond);
+        collect_stmt(set, stmt->as.while_stmt.body);
+        break;
+    case PARALLEL_STMT:
+        add_name(set, stmt->as.parallel.var);
+        for (size_t i = 0; i < stmt->as.parallel.reduction_count; i++) add_name(set, stmt->as.parallel.reductions[i].name);
+        collect_stmt(set, stmt->as.parallel.body);
+        break;
+    case FOR_IN_STMT:
+        add_name(set, stmt->as.for_in.var);
+        collect_expr(set, stmt->as.for_in.iterable);
+        collect_stmt(set, stmt->as.for_in.body);
+        break;
+    default: break;
+    }
+}
+#pragma endregion Written_names
+
+#pragma region Hoisting
+typedef struct {
+    NameSet* written;
+    ExprList* invariants;
+    size_t* next;           // numbers the hidden variables of one optimize() run
+} Loop;
+
+static bool is_invariant(Loop* loop, Expr* expr){
+    switch (expr->type)
+    {
+    case LITERAL: return true;
+    case VAREXPR: return !has_name(loop->written, expr->as.var.name);
+    case GROUPING: return is_invariant(loop, expr->as.group.expression);
+    // a join waits where it is
+    case UNARY: return expr->as.unary.op->type != JOIN && is_invariant(loop, expr->as.unary.right);
+    case BINARY: return is_invariant(loop, expr->as.binary.left) && is_invariant(loop, expr->as.binary.right);
+    case TERNARY:
+        return is_invariant(loop, expr->as.ternary.cond) && is_invariant(loop, expr->as.ternary.trueBranch) &&
+            is_invariant(loop, expr->as.ternary.falseBranch);
+    case INVARIANT: return true;
+    default: return false;
+    }
+}
+
+// only operations are worth a variable, a literal or a single read already costs one lookup
+static bool worth_hoisting(Expr* expr){
+    while (expr->type == GROUPING) expr = expr->as.group.expression;
+    switch (expr->type)
+    {
+    case BINARY:
+    case TERNARY: return true;
+    case UNARY: return worth_hoisting(expr->as.unary.right) || expr->as.unary.right->type == VAREXPR;
+    default: return false;
+    }
+}
+
+static void hoist_expr(Loop* loop, Expr** slot);
+
+static void hoist_list(Loop* loop, ExprList* list){
+    for (size_t i = 0; i < list->index; i++) hoist_expr(loop, &list->exprs[i]);
+}
+
+// replaces the largest invariant subexpressions below slot
+static void hoist_expr(Loop* loop, Expr** slot){
+    Expr* expr = *slot;
+    if (expr == NULL || expr->type == INVARIANT) return;
+    if (is_invariant(loop, expr) && worth_hoisting(expr)){
+        Expr* node = (Expr*)mem_alloc(MEM_EXPR, sizeof(Expr));
+        if (node == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for loop invariant");
+            exit(1);
+        }
+        node->type = INVARIANT;
+        node->as.invariant.expr = expr;
+        snprintf(node->as.invariant.name, sizeof(node->as.invariant.name), "$%zu", (*loop->next)++);
+        add_expr(loop->invariants, node);
+        *slot = node;
+        return;
+    }
+    switch (expr->type)
+    {
+    case BINARY:
+        hoist_expr(loop, &expr->as.binary.left);
+        hoist_expr(loop, &expr->as.binary.right);
+        break;
+    case TERNARY:
+        hoist_expr(loop, &expr->as.ternary.cond);
+        hoist_expr(loop, &expr->as.ternary.trueBranch);
+        hoist_expr(loop, &expr->as.ternary.falseBranch);
+        break;
+    case UNARY: hoist_expr(loop, &expr->as.unary.right); break;
+    case GROUPING: hoist_expr(loop, &expr->as.group.expression); break;
+    case ASSIGN: hoist_expr(loop, &expr->as.assign.value); break;
+    case CALL: hoist_list(loop, expr->as.call.args); break;
+    case ARRAY: hoist_list(loop, expr->as.array.elements); break;
+    case MAP: hoist_list(loop, expr->as.map.entries); break;
+    case INDEX:
+        hoist_expr(loop, &expr->as.index.object);
+        hoist_expr(loop, &expr->as.index.index);
+        break;
+    case SET_INDEX:
+        hoist_expr(loop, &expr->as.set_index.object);
+        hoist_expr(loop, &expr->as.set_index.index);
+        hoist_expr(loop, &expr->as.set_index.value);
+        break;
+    default: break;
+    }
+}
+
+static void hoist_stmt(Loop* loop, Stmt* stmt){
+    if (stmt == NULL) return;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: hoist_expr(loop, &stmt->as.expr.expression); break;
+    case PRINT_STMT: hoist_expr(loop, &stmt->as.print.expression); break;
+    case VAR_DECL_STMT: hoist_expr(loop, &stmt->as.var.initializer); break;
+    case BLOCK_STMT: {
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++) hoist_stmt(loop, &list->statements[i]);
+    } break;
+    case IF_STMT:
+        hoist_expr(loop, &stmt->as.if_stmt.cond);
+        hoist_stmt(loop, stmt->as.if_stmt.trueBranch);
+        hoist_stmt(loop, stmt->as.if_stmt.falseBranch);
+        break;
+    case WHILE_STMT:
+        hoist_expr(loop, &stmt->as.while_stmt.cond);
+        hoist_stmt(loop, stmt->as.while_stmt.body);
+        break;
+    // the chunks share what is hoisted, only the bounds are evaluated outside of them
+    case PARALLEL_STMT:
+        hoist_expr(loop, &stmt->as.parallel.start);
+        hoist_expr(loop, &stmt->as.parallel.end);
+        break;
+    case FOR_IN_STMT:
+        hoist_expr(loop, &stmt->as.for_in.iterable);
+        hoist_stmt(loop, stmt->as.for_in.body);
+        break;
+    default: break;
+    }
+}
+#pragma endregion Hoisting
+
+static void optimize_stmt(Stmt* stmt, size_t* next);
+
+// Spawned bodies run in a scope of their own, hoisting never moves code into or out of
+// them, their loops are optimized on their own
+static void optimize_spawns(Expr* expr, size_t* next){
+    if (expr == NULL) return;
+    switch (expr->type)
+    {
+    case BINARY:
+        optimize_spawns(expr->as.binary.left, next);
+        optimize_spawns(expr->as.binary.right, next);
+        break;
+    case TERNARY:
+        optimize_spawns(expr->as.ternary.cond, next);
+        optimize_spawns(expr->as.ternary.trueBranch, next);
+        optimize_spawns(expr->as.ternary.falseBranch, next);
+        break;
+    case UNARY: optimize_spawns(expr->as.unary.right, next); break;
+    case GROUPING: optimize_spawns(expr->as.group.expression, next); break;
+    case ASSIGN: optimize_spawns(expr->as.assign.value, next); break;
+    case CALL:
+        for (size_t i = 0; i < expr->as.call.args->index; i++) optimize_spawns(expr->as.call.args->exprs[i], next);
+        break;
+    case ARRAY:
+        for (size_t i = 0; i < expr->as.array.elements->index; i++) optimize_spawns(expr->as.array.elements->exprs[i], next);
+        break;
+    case MAP:
+        for (size_t i = 0; i < expr->as.map.entries->index; i++) optimize_spawns(expr->as.map.entries->exprs[i], next);
+        break;
+    case INDEX:
+        optimize_spawns(expr->as.index.object, next);
+        optimize_spawns(expr->as.index.index, next);
+        break;
+    case SET_INDEX:
+        optimize_spawns(expr->as.set_index.object, next);
+        optimize_spawns(expr->as.set_index.index, next);
+        optimize_spawns(expr->as.set_index.value, next);
+        break;
+    case INVARIANT: optimize_spawns(expr->as.invariant.expr, next); break;
+    case SPAWN_EXPR: optimize_stmt(expr->as.spawn.body, next); break;
+    case GENERATOR_EXPR: optimize_stmt(expr->as.generator.body, next); break;
+    default: break;
+    }
+}
+
+// outer loops go first, so an expression that is invariant in several nested loops
+// is computed before the outermost of them
+static void optimize_stmt(Stmt* stmt, size_t* next){
+    if (stmt == NULL) return;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: optimize_spawns(stmt->as.expr.expression, next); break;
+    case PRINT_STMT: optimize_spawns(stmt->as.print.expression, next); break;
+    case VAR_DECL_STMT: optimize_spawns(stmt->as.var.initializer, next); break;
+    case BLOCK_STMT: {
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++) optimize_stmt(&list->statements[i], next);
+    } break;
+    case IF_STMT:
+        optimize_spawns(stmt->as.if_stmt.cond, next);
+        optimize_stmt(stmt->as.if_stmt.trueBranch, next);
+        optimize_stmt(stmt->as.if_stmt.falseBranch, next);
+        break;
+    case WHILE_STMT: {
+        NameSet written = {0};
+        collect_stmt(&written, stmt);
+        Loop loop = { .written = &written, .invariants = init_expr_list(), .next = next };
+        hoist_stmt(&loop, stmt);
+        free(written.names);
+        if (loop.invariants->index > 0) stmt->as.while_stmt.invariants = loop.invariants;
+        else {
+            mem_free(MEM_EXPR, loop.invariants->exprs);
+            mem_free(MEM_EXPR, loop.invariants);
+        }
+        optimize_spawns(stmt->as.while_stmt.cond, next);
+        optimize_stmt(stmt->as.while_stmt.body, next);
+    } break;
+    case PARALLEL_STMT:
+        optimize_spawns(stmt->as.parallel.start, next);
+        optimize_spawns(stmt->as.parallel.end, next);
+        optimize_stmt(stmt->as.parallel.body, next);
+        break;
+    case FOR_IN_STMT:
+        optimize_spawns(stmt->as.for_in.iterable, next);
+        optimize_stmt(stmt->as.for_in.body, next);
+        break;
+    case YIELD_STMT: optimize_spawns(stmt->as.yield.value, next); break;
+    default: break;
+    }
+}
+
+void optimize(StmtList* list){
+    // the pass recurses on expressions
+    if (ast_depth(list) > MAX_RECURSIVE_DEPTH) return;
+    size_t next = 0;
+    for (size_t i = 0; i < list->index; i++) optimize_stmt(&list->statements[i], &next);
+}
@@ -0,0 +1,14 @@
+#ifndef _OPTIMIZE_H
+#define _OPTIMIZE_H
+
+#include "parser.h"
+
+#define INITIAL_NAME_SET_SIZE 16
+
+// Loop invariant code motion. Pure subexpressions of a while loop (and so of a for
+// loop) that only read variables the loop never assigns or declares are replaced by
+// INVARIANT nodes and listed on the loop, which evaluates them once before it starts.
+// Runs on a parsed program before it is interpreted.
+void optimize(StmtList* list);
+
+#endif // _OPTIMIZE_H
@@ -1,35 +1,31 @@
 #include "parser.h"
 #include <stdio.h>
 #include <stdbool.h>
-#define UTILS_IMPLEMENT
-#include "utils.h"
 
 static Stmt declaration(Parser* parser);
 static Stmt var_decl(Parser* parser);
 static Stmt statement(Parser* parser);
+static Stmt parse_statement(Parser* parser);
+static Stmt parallel_for(Parser* parser);
+static Stmt for_in(Parser* parser);
 
 static Expr* expression(Parser* parser);
-static Expr* or(Parser* parser);
-static Expr* and(Parser* parser);
-static Expr* equality(Parser* parser);
-static Expr* comparison(Parser* parser);
-static Expr* term(Parser* parser);
-static Expr* factor(Parser* parser);
 static Expr* unary(Parser* parser);
+static Expr* call(Parser* parser, Expr* callee);
 static Expr* primary(Parser* parser);
 
 #pragma region List_utils
 
 StmtList* init_stmt_list(){
-    StmtList* list = (StmtList*)malloc(sizeof(StmtList));
+    StmtList* list = (StmtList*)mem_alloc(MEM_STMT, sizeof(StmtList));
     if (list == NULL){
-        plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for StmtList");
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for StmtList");
         exit(1);
     }
-    list->statements = (Stmt*)malloc(sizeof(Stmt) * INITIAL_STMTLIST_SIZE);
+    list->statements = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt) * INITIAL_STMTLIST_SIZE);
     if (list->statements == NULL){
-        plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for statements");
-        free(list);
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for statements");
+        mem_free(MEM_STMT, list);
         exit(1);
     }
     list->index = 0;
@@ -40,72 +36,117 @@ StmtList* init_stmt_list(){
 void add_statement(StmtList* list, Stmt stmt){
     if (list->index == list->size){
         list->size *= 2;
-        list->statements = realloc(list->statements, sizeof(Stmt) * list->size);
+        list->statements = mem_realloc(MEM_STMT, list->statements, sizeof(Stmt) * list->size);
         if (list->statements == NULL){
-            plerror(-1, -1, MEMORY_ERR, "Couldn't reallocate memory for statements");
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't reallocate memory for statements");
             exit(1);
         }
     }
     list->statements[list->index++] = stmt;
 }
 
+ExprList* init_expr_list(){
+    ExprList* list = (ExprList*)mem_alloc(MEM_EXPR, sizeof(ExprList));
+    if (list == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for ExprList");
+        exit(1);
+    }
+    list->exprs = (Expr**)mem_alloc(MEM_EXPR, sizeof(Expr*) * INITIAL_EXPRLIST_SIZE);
+    if (list->exprs == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for expressions");
+        mem_free(MEM_EXPR, list);
+        exit(1);
+    }
+    list->index = 0;
+    list->size = INITIAL_EXPRLIST_SIZE;
+    return list;
+}
+
+void add_expr(ExprList* list, Expr* expr){
+    if (list->index == list->size){
+        list->size *= 2;
+        list->exprs = mem_realloc(MEM_EXPR, list->exprs, sizeof(Expr*) * list->size);
+        if (list->exprs == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't reallocate memory for expressions");
+            exit(1);
+        }
+    }
+    list->exprs[list->index++] = expr;
+}
+
+static void free_expr_list(ExprList* list){
+    for (size_t i = 0; i < list->index; i++){
+        free_expr(list->exprs[i]);
+    }
+    mem_free(MEM_EXPR, list->exprs);
+    mem_free(MEM_EXPR, list);
+}
+
+static void push_child(ExprList* pending, Expr* expr){
+    if (expr != NULL) add_expr(pending, expr);
+}
+
+// moves the expressions of list onto pending and frees the list itself
+static void push_children(ExprList* pending, ExprList* list){
+    for (size_t i = 0; i < list->index; i++) push_child(pending, list->exprs[i]);
+    mem_free(MEM_EXPR, list->exprs);
+    mem_free(MEM_EXPR, list);
+}
+
+// children wait on an explicit stack, so trees of any depth can be freed
 void free_expr(Expr* expr){
     if (expr == NULL) return;
-    switch (expr->type)
-    {
-    case BINARY: {
-        free_expr(expr->as.binary.left);
-        free(expr->as.binary.left);
-        expr->as.binary.left = NULL;
-        free_expr(expr->as.binary.right);
-        free(expr->as.binary.right);
-        expr->as.binary.right = NULL;
-        free(expr);
-        expr = NULL;
-    } break;
-    case TERNARY: {
-        free_expr(expr->as.ternary.cond);
-        free(expr->as.ternary.cond);
-        expr->as.ternary.cond = NULL;
-        free_expr(expr->as.ternary.trueBranch);
-        free(expr->as.ternary.trueBranch);
-        expr->as.ternary.trueBranch = NULL;
-        free_expr(expr->as.ternary.falseBranch);
-        free(expr->as.ternary.falseBranch);
-        expr->as.ternary.falseBranch = NULL;
-        free(expr);
-        expr = NULL;
-    } break;
-    case UNARY: {
-        free_expr(expr->as.unary.right);
-        free(expr->as.unary.right);
-        expr->as.unary.right = NULL;
-        free(expr);
-        expr = NULL;
-    } break;
-    case LITERAL: {
-        free(expr);
-        expr = NULL;
-    } break;
-    case GROUPING: {
-        free_expr(expr->as.group.expression);
-        free(expr->as.group.expression);
-        expr->as.group.expression = NULL;
-        free(expr);
-        expr = NULL;
-    } break;
-    case VAREXPR: {
-        free(expr);
-        expr = NULL;
-    } break;
-    case ASSIGN: {
-        free_expr(expr->as.assign.value);
-        expr->as.assign.value = NULL;
-        free(expr);
-        expr = NULL;
-    } break;
-    default: break;
+    ExprList* pending = init_expr_list();
+    add_expr(pending, expr);
+    while (pending->index > 0){
+        expr = pending->exprs[--pending->index];
+        switch (expr->type)
+        {
+        case BINARY: {
+            push_child(pending, expr->as.binary.left);
+            push_child(pending, expr->as.binary.right);
+        } break;
+        case TERNARY: {
+            push_child(pending, expr->as.ternary.cond);
+            push_child(pending, expr->as.ternary.trueBranch);
+            push_child(pending, expr->as.ternary.falseBranch);
+        } break;
+        case UNARY: push_child(pending, expr->as.unary.right); break;
+        case GROUPING: push_child(pending, expr->as.group.expression); break;
+        case ASSIGN: push_child(pending, expr->as.assign.value); break;
+        case CALL: {
+            push_child(pending, expr->as.call.callee);
+            push_children(pending, expr->as.call.args);
+        } break;
+        case ARRAY: push_children(pending, expr->as.array.elements); break;
+        case MAP: push_children(pending, expr->as.map.entries); break;
+        case INDEX: {
+            push_child(pending, expr->as.index.object);
+            push_child(pending, expr->as.index.index);
+        } break;
+        case SET_INDEX: {
+            push_child(pending, expr->as.set_index.object);
+            push_child(pending, expr->as.set_index.index);
+            push_child(pending, expr->as.set_index.value);
+        } break;
+        case INVARIANT: push_child(pending, expr->as.invariant.expr); break;
+        case SPAWN_EXPR: {
+            free_stmt(*expr->as.spawn.body);
+            mem_free(MEM_STMT, expr->as.spawn.body);
+            mem_free(MEM_EXPR, expr->as.spawn.captures);
+        } break;
+        case GENERATOR_EXPR: {
+            free_stmt(*expr->as.generator.body);
+            mem_free(MEM_STMT, expr->as.generator.body);
+            mem_free(MEM_EXPR, expr->as.generator.captures);
+            mem_free(MEM_STMT, expr->as.generator.yielding);
+        } break;
+        default: break;
+        }
+        mem_free(MEM_EXPR, expr);
     }
+    mem_free(MEM_EXPR, pending->exprs);
+    mem_free(MEM_EXPR, pending);
 }
 
 void free_stmt(Stmt stmt){
@@ -117,24 +158,39 @@ void free_stmt(Stmt stmt){
     case IF_STMT: {
         free_expr(stmt.as.if_stmt.cond);
         free_stmt(*stmt.as.if_stmt.trueBranch);
-        free(stmt.as.if_stmt.trueBranch);
+        mem_free(MEM_STMT, stmt.as.if_stmt.trueBranch);
         if (stmt.as.if_stmt.falseBranch != NULL) free_stmt(*stmt.as.if_stmt.falseBranch);
-        free(stmt.as.if_stmt.falseBranch);
+        mem_free(MEM_STMT, stmt.as.if_stmt.falseBranch);
     } break;
     case WHILE_STMT: {
         free_expr(stmt.as.while_stmt.cond);
         free_stmt(*stmt.as.while_stmt.body);
-        free(stmt.as.while_stmt.body);
+        mem_free(MEM_STMT, stmt.as.while_stmt.body);
+        if (stmt.as.while_stmt.jit != NULL) stmt.as.while_stmt.jit->release(stmt.as.while_stmt.jit);
+        // the invariants themselves are freed with the expressions they replaced
+        if (stmt.as.while_stmt.invariants != NULL){
+            mem_free(MEM_EXPR, stmt.as.while_stmt.invariants->exprs);
+            mem_free(MEM_EXPR, stmt.as.while_stmt.invariants);
+        }
     } break;
     case BLOCK_STMT: {
-        for (size_t i = 0; i < stmt.as.block.list->index; i++){
-            free_stmt(stmt.as.block.list->statements[i]);
-        }
-        free(stmt.as.block.list->statements);
-        stmt.as.block.list->statements = NULL;
-        free(stmt.as.block.list);
+        free_stmt_list(stmt.as.block.list);
         stmt.as.block.list = NULL;
     } break;
+    case PARALLEL_STMT: {
+        free_expr(stmt.as.parallel.start);
+        free_expr(stmt.as.parallel.end);
+        free_stmt(*stmt.as.parallel.body);
+        mem_free(MEM_STMT, stmt.as.parallel.body);
+        mem_free(MEM_STMT, stmt.as.parallel.reductions);
+        mem_free(MEM_EXPR, stmt.as.parallel.reads);
+    } break;
+    case FOR_IN_STMT: {
+        free_expr(stmt.as.for_in.iterable);
+        free_stmt(*stmt.as.for_in.body);
+        mem_free(MEM_STMT, stmt.as.for_in.body);
+    } break;
+    case YIELD_STMT: free_expr(stmt.as.yield.value); break;
     default: break;
     }
 }
@@ -145,13 +201,14 @@ void free_stmt(Stmt stmt){
 
 // expression constructors
 static Expr* new_expr(ExprType type){
-    Expr* e = malloc(sizeof(*e));
+    Expr* e = mem_alloc(MEM_EXPR, sizeof(*e));
     e->type = type;
     return e;
 }
 
 static Expr* binary_expr(Token* op, Expr* left, Expr* right){
     Expr* e = new_expr(BINARY);
+    e->as.binary.proof = UNPROVEN;
     e->as.binary.left = left;
     e->as.binary.right = right;
     e->as.binary.op = op;
@@ -175,7 +232,7 @@ static Expr* unary_expr(Token* op, Expr* right){
 
 static Expr* literal_expr(ValueType type){
     Expr* e = new_expr(LITERAL);
-    e->as.literal.type = type;
+    e->as.literal = (LiteralExpr){ .type = type };
     return e;
 }
 
@@ -198,6 +255,60 @@ static Expr* assign_expr(Token* name, Expr* value){
     return e;
 }
 
+static Expr* call_expr(Expr* callee, Token* paren, ExprList* args){
+    Expr* e = new_expr(CALL);
+    e->as.call.callee = callee;
+    e->as.call.paren = paren;
+    e->as.call.args = args;
+    e->as.call.builtin = NULL;
+    return e;
+}
+
+static Expr* array_expr(Token* bracket, ExprList* elements){
+    Expr* e = new_expr(ARRAY);
+    e->as.array.bracket = bracket;
+    e->as.array.elements = elements;
+    return e;
+}
+
+static Expr* map_expr(Token* brace, ExprList* entries){
+    Expr* e = new_expr(MAP);
+    e->as.map.brace = brace;
+    e->as.map.entries = entries;
+    return e;
+}
+
+static Expr* index_expr(Expr* object, Token* bracket, Expr* index){
+    Expr* e = new_expr(INDEX);
+    e->as.index.object = object;
+    e->as.index.bracket = bracket;
+    e->as.index.index = index;
+    return e;
+}
+
+static Expr* set_index_expr(Expr* object, Token* bracket, Expr* index, Expr* value){
+    Expr* e = new_expr(SET_INDEX);
+    e->as.set_index.object = object;
+    e->as.set_index.bracket = bracket;
+    e->as.set_index.index = index;
+    e->as.set_index.value = value;
+    return e;
+}
+
+static Expr* spawn_expr(Token* keyword, Stmt* body){
+    Expr* e = new_expr(SPAWN_EXPR);
+    e->as.spawn.keyword = keyword;
+    e->as.spawn.body = body;
+    e->as.spawn.captures = NULL;
+    return e;
+}
+
+static Expr* generator_expr(Token* keyword, Stmt* body){
+    Expr* e = new_expr(GENERATOR_EXPR);
+    e->as.generator = (GeneratorExpr){ .keyword = keyword, .body = body };
+    return e;
+}
+
 // statement constructors
 // static Stmt* newStmt(enum StmtType type){
 //     Stmt* stmt = malloc(sizeof(Stmt));
@@ -256,10 +367,10 @@ static Stmt whileStmt(Expr* cond, Stmt* body){
 #pragma region Parse_utils
 // utils
 static const char* token_strings[] = {   
-    "(", ")", "{", "}", ",", ".", "-", "+", ";", "/", "*", "?", ":",
-    "!", "!=", "=", "==", ">", ">=", "<", "<=", "IDENTIFIER", "STRING", "NUMBER",
+    "(", ")", "{", "}", "[", "]", ",", ".", "-", "+", ";", "/", "*", "%", "?", ":",
+    "!", "!=", "=", "==", ">", ">=", "<", "<=", "IDENTIFIER", "STRING", "NUMBER", "INTEGER",
     "and", "or", "print", "if", "else", "true", "false", "nil", "for", "while", "fun", 
-    "return", "class", "super", "this", "var", "EOF"
+    "return", "class", "super", "this", "var", "spawn", "join", "parallel", "reduce", "generator", "yield", "in", "EOF"
 };
 
 static Token* peek(Parser* parser){
@@ -286,46 +397,49 @@ static Token* advance(Parser* parser){
 
 static void expect(Parser* parser, TokenType type){
     if (!check(parser, type)){
-        plerror(peek(parser)->line, get_column(peek(parser)), PARSE_ERR, "Expected '%s', but got '%s'", 
+        plerror(parser->tokenizer->ctx, peek(parser)->line, get_column(peek(parser)), PARSE_ERR, "Expected '%s', but got '%s'", 
             token_strings[type], token_strings[peek(parser)->type]);
     }
     advance(parser);
 }
 
-static bool match(Parser* parser, TokenType* types, int size){
-    for (int i = 0; i < size; i++){
-        if (check(parser, types[i])){
-            advance(parser);
-            return true;
-        }
-    }
-    return false;
-}
-
 #pragma endregion parse_utils
 
 #pragma region Grammar
 // parser
-void free_parser(Parser* parser){
-    for (size_t i = 0; i < parser->stmt_list->index; i++){
-        free_stmt(parser->stmt_list->statements[i]);
+void free_stmt_list(StmtList* list){
+    for (size_t i = 0; i < list->index; i++){
+        free_stmt(list->statements[i]);
     }
-    free(parser->stmt_list->statements);
-    parser->stmt_list->statements = NULL;
-    free(parser->stmt_list);
+    mem_free(MEM_STMT, list->statements);
+    list->statements = NULL;
+    mem_free(MEM_STMT, list);
+}
+
+void free_parser(Parser* parser){
+    if (parser->stmt_list != NULL) free_stmt_list(parser->stmt_list);
     parser->stmt_list = NULL;
-    free(parser);
+    mem_free(MEM_STMT, parser);
+}
+
+void reset_parser(Parser* parser){
+    parser->stmt_list = init_stmt_list();
+    parser->current_token = 0;
+    parser->in_generator = false;
+    parser->depth = 0;
 }
 
 Parser* create_parser(Tokenizer* tokenizer){
-    Parser* p = (Parser*)malloc(sizeof(Parser));
+    Parser* p = (Parser*)mem_alloc(MEM_STMT, sizeof(Parser));
     if (p == NULL){
-        plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for parser object");
+        plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for parser object");
         exit(1);
     }
     p->stmt_list = init_stmt_list();
     p->current_token = 0;
     p->tokenizer = tokenizer;
+    p->in_generator = false;
+    p->depth = 0;
     return p;
 }
 
@@ -335,6 +449,12 @@ void parse(Parser* parser){
     }
 }
 
+bool parse_declaration(Parser* parser){
+    if (peek(parser)->type == ENDFILE) return false;
+    add_statement(parser->stmt_list, declaration(parser));
+    return true;
+}
+
 static Stmt declaration(Parser* parser){
     if (check(parser, VAR)){
         advance(parser);
@@ -343,7 +463,9 @@ static Stmt declaration(Parser* parser){
     return statement(parser);
 }
 
+// called right after 'var'
 static Stmt var_decl(Parser* parser){
+    uint32_t line = (uint32_t)previous(parser)->line;
     expect(parser, IDENTIFIER);
     Token* id = previous(parser);
     Expr* initializer = NULL;
@@ -352,10 +474,44 @@ static Stmt var_decl(Parser* parser){
         initializer = expression(parser);
     }
     expect(parser, SEMICOLON);
-    return declStmt(id, initializer);
+    Stmt stmt = declStmt(id, initializer);
+    stmt.line = line;
+    return stmt;
 }
 
+// Skips a statement too deeply nested to parse: up to its ';' or the '}' closing its
+// block, together with any 'else' branches, but not the '}' of the block it is in
+static void skip_statement(Parser* parser){
+    size_t open = 0;
+    while (peek(parser)->type != ENDFILE && !(open == 0 && check(parser, RIGHT_BRACE))){
+        TokenType type = advance(parser)->type;
+        if (type == LEFT_BRACE || type == LEFT_PAREN || type == LEFT_BRACKET) open++;
+        else if ((type == RIGHT_BRACE || type == RIGHT_PAREN || type == RIGHT_BRACKET) && open > 0) open--;
+        if (open == 0 && (type == SEMICOLON || type == RIGHT_BRACE) && !check(parser, ELSE)) return;
+    }
+}
+
+// Every pass over statements, parsing and executing them too, recurses on their nesting,
+// so it is bounded here by MAX_RECURSIVE_DEPTH. ctx->max_depth can lower that bound but
+// not raise it, unlike the bound on expressions.
 static Stmt statement(Parser* parser){
+    uint32_t line = (uint32_t)peek(parser)->line;
+    size_t limit = parser->tokenizer->ctx->max_depth < MAX_RECURSIVE_DEPTH ? parser->tokenizer->ctx->max_depth : MAX_RECURSIVE_DEPTH;
+    Stmt stmt;
+    if (parser->depth >= limit){
+        plerror(parser->tokenizer->ctx, peek(parser)->line, get_column(peek(parser)), PARSE_ERR, "Statements nested deeper than %zu levels", limit);
+        skip_statement(parser);
+        stmt = exprStmt(literal_expr(NIL_T));
+    } else {
+        parser->depth++;
+        stmt = parse_statement(parser);
+        parser->depth--;
+    }
+    stmt.line = line;
+    return stmt;
+}
+
+static Stmt parse_statement(Parser* parser){
     if (check(parser, PRINT)){
         advance(parser);
         Expr* expr = expression(parser);
@@ -367,13 +523,13 @@ static Stmt statement(Parser* parser){
         expect(parser, LEFT_PAREN);
         Expr* cond = expression(parser);
         expect(parser, RIGHT_PAREN);
-        Stmt* trueBranch = (Stmt*)malloc(sizeof(Stmt));
+        Stmt* trueBranch = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
         Stmt* falseBranch = NULL;
         
         *trueBranch = statement(parser);
         if (check(parser, ELSE)){
             advance(parser);
-            falseBranch = (Stmt*)malloc(sizeof(Stmt));
+            falseBranch = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
             *falseBranch = statement(parser);
         }
         return ifStmt(cond, trueBranch, falseBranch);
@@ -383,13 +539,17 @@ static Stmt statement(Parser* parser){
         expect(parser, LEFT_PAREN);
         Expr* cond = expression(parser);
         expect(parser, RIGHT_PAREN);
-        Stmt* body = (Stmt*)malloc(sizeof(Stmt));
+        Stmt* body = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
         *body = statement(parser);
         return whileStmt(cond, body);
 
     } else if (check(parser, FOR)){
         advance(parser);
+        // the desugared block, loop and step all report the line of 'for'
+        uint32_t line = (uint32_t)previous(parser)->line;
         expect(parser, LEFT_PAREN);
+        Token* at = peek(parser);
+        if (at->type == VAR && at[1].type == IDENTIFIER && at[2].type == IN) return for_in(parser);
         Stmt decl = {.type=NULL_STMT};
         if (check(parser, VAR)){
             advance(parser);
@@ -420,8 +580,11 @@ static Stmt statement(Parser* parser){
         StmtList* body = init_stmt_list();
         add_statement(body, loop_body);
 
-        if (incr != NULL)
-            add_statement(body, exprStmt(incr));
+        if (incr != NULL){
+            Stmt step = exprStmt(incr);
+            step.line = line;
+            add_statement(body, step);
+        }
         StmtList* list = init_stmt_list();
         if (decl.type != NULL_STMT) 
             add_statement(list, decl);
@@ -430,12 +593,24 @@ static Stmt statement(Parser* parser){
             cond = literal_expr(BOOL_T);
             cond->as.literal.as.boolean = true;
         }
-        Stmt* body_block = (Stmt*)malloc(sizeof(Stmt));
+        Stmt* body_block = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
         *body_block = blockStmt(body);
+        body_block->line = line;
         Stmt loop = whileStmt(cond, body_block);
+        loop.line = line;
         add_statement(list, loop);
         return blockStmt(list);
 
+    } else if (check(parser, PARALLEL)){
+        return parallel_for(parser);
+
+    } else if (check(parser, YIELD)){
+        Token* keyword = advance(parser);
+        if (!parser->in_generator) plerror(parser->tokenizer->ctx, keyword->line, get_column(keyword), PARSE_ERR, "Can only yield inside a generator");
+        Expr* value = expression(parser);
+        expect(parser, SEMICOLON);
+        return (Stmt){ .type = YIELD_STMT, .as.yield = { .keyword = keyword, .value = value } };
+
     } else if (check(parser, LEFT_BRACE)) {
         advance(parser);
         StmtList* list = init_stmt_list();
@@ -452,120 +627,621 @@ static Stmt statement(Parser* parser){
     }
 }
 
-static Expr* expression(Parser* parser){
-    Expr* expr = or(parser);
-    if (check(parser, EQUAL)){
-        Token* equal = previous(parser);
-        advance(parser);
-        Expr* value = expression(parser);
-        if (expr->type == VAREXPR){
-            Token* name = expr->as.var.name;
-            return assign_expr(name, value);
+#pragma region Parallel_loops
+static bool same_name(Token* a, Token* b){
+    size_t length = a->count - a->start;
+    return b->count - b->start == length && memcmp(a->source + a->start, b->source + b->start, length) == 0;
+}
+
+static bool is_name(Token* token, const char* name){
+    size_t length = token->count - token->start;
+    return strlen(name) == length && memcmp(token->source + token->start, name, length) == 0;
+}
+
+// a variable declared in the body, visible to the end of its block
+typedef struct {
+    Token* name;
+    bool fresh;         // only ever holds nil or arrays and maps made in the body
+    Token* changed;     // its first index assignment, push or remove
+} LoopLocal;
+
+typedef struct {
+    Parser* parser;
+    ParallelStmt* loop;
+    LoopLocal* locals;
+    size_t local_count, local_size;
+    Token** reads;
+    size_t read_count, read_size;
+} LoopCheck;
+
+static void loop_error(LoopCheck* c, Token* at, const char* message){
+    plerror(c->parser->tokenizer->ctx, at->line, get_column(at), PARSE_ERR, "%s", message);
+}
+
+static LoopLocal* find_local(LoopCheck* c, Token* name){
+    for (size_t i = c->local_count; i > 0; i--){
+        if (same_name(c->locals[i - 1].name, name)) return &c->locals[i - 1];
+    }
+    return NULL;
+}
+
+static bool is_target(ParallelStmt* loop, Token* name){
+    for (size_t i = 0; i < loop->reduction_count; i++){
+        if (same_name(loop->reductions[i].name, name)) return true;
+    }
+    return false;
+}
+
+static void add_local(LoopCheck* c, Token* name, bool fresh){
+    if (c->local_count == c->local_size){
+        c->local_size = c->local_size == 0 ? INITIAL_EXPRLIST_SIZE : c->local_size * 2;
+        c->locals = (LoopLocal*)realloc(c->locals, sizeof(LoopLocal) * c->local_size);
+        if (c->locals == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for loop variables");
+            exit(1);
         }
-        plerror(equal->line, get_column(peek(parser)), PARSE_ERR, "Invalid assignment target");
-    } else {
-        while(check(parser, QMARK)){
-            advance(parser);
-            Expr* tbranch = expression(parser);
-            expect(parser, COLON);
-            Expr* fbranch = expression(parser);
-            expr = ternary_expr(expr, tbranch, fbranch);
+    }
+    c->locals[c->local_count++] = (LoopLocal){ .name = name, .fresh = fresh };
+}
+
+// names read from outside the loop, the loop variable and the targets live in each chunk
+static void add_read(LoopCheck* c, Token* name){
+    if (find_local(c, name) != NULL || same_name(name, c->loop->var) || is_target(c->loop, name)) return;
+    for (size_t i = 0; i < c->read_count; i++){
+        if (same_name(c->reads[i], name)) return;
+    }
+    if (c->read_count == c->read_size){
+        c->read_size = c->read_size == 0 ? INITIAL_EXPRLIST_SIZE : c->read_size * 2;
+        c->reads = (Token**)realloc(c->reads, sizeof(Token*) * c->read_size);
+        if (c->reads == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for loop variables");
+            exit(1);
         }
-    } 
+    }
+    c->reads[c->read_count++] = name;
+}
+
+static Expr* ungroup(Expr* expr){
+    while (expr != NULL && expr->type == GROUPING) expr = expr->as.group.expression;
     return expr;
 }
 
-static Expr* or(Parser* parser){
-    Expr* left = and(parser);
-    TokenType types[1] = {OR};
-    while(match(parser, types, 1)){
-        Token* op = previous(parser);
-        Expr* right = and(parser);
-        left = binary_expr(op, left, right);
+// a new array or map, which no other chunk can reach
+static bool fresh_value(Expr* expr){
+    expr = ungroup(expr);
+    if (expr->type == ARRAY || expr->type == MAP) return true;
+    if (expr->type != CALL || expr->as.call.callee->type != VAREXPR) return false;
+    Token* name = expr->as.call.callee->as.var.name;
+    return is_name(name, "fill") || is_name(name, "scale") || is_name(name, "add") ||
+        is_name(name, "keys") || is_name(name, "values");
+}
+
+// target is the variable an index assignment, push or remove changes
+static void change_local(LoopCheck* c, Expr* target, Token* at){
+    target = ungroup(target);
+    LoopLocal* local = target != NULL && target->type == VAREXPR ? find_local(c, target->as.var.name) : NULL;
+    if (local == NULL){
+        loop_error(c, at, "A parallel loop can only change arrays and maps it created");
+        return;
+    }
+    if (local->changed == NULL) local->changed = at;
+}
+
+static void assign_name(LoopCheck* c, Token* name, bool fresh){
+    LoopLocal* local = find_local(c, name);
+    if (local != NULL) local->fresh = local->fresh && fresh;
+    else if (!is_target(c->loop, name)) loop_error(c, name, "A parallel loop can only assign its own variables and reduction targets");
+}
+
+static void check_stmt(LoopCheck* c, Stmt* stmt);
+static void close_scope(LoopCheck* c, size_t mark);
+
+// spawned bodies work on copies, whatever they change stays in their task. Generators
+// only copy the values of their variables, so the arrays and maps they reach are shared.
+static void check_expr(LoopCheck* c, Expr* expr){
+    if (expr == NULL) return;
+    ExprList* pending = init_expr_list();
+    add_expr(pending, expr);
+    while (pending->index > 0){
+        Expr* e = pending->exprs[--pending->index];
+        if (e == NULL) continue;
+        switch (e->type)
+        {
+        case BINARY:
+            add_expr(pending, e->as.binary.left);
+            add_expr(pending, e->as.binary.right);
+            break;
+        case TERNARY:
+            add_expr(pending, e->as.ternary.cond);
+            add_expr(pending, e->as.ternary.trueBranch);
+            add_expr(pending, e->as.ternary.falseBranch);
+            break;
+        case UNARY: add_expr(pending, e->as.unary.right); break;
+        case GROUPING: add_expr(pending, e->as.group.expression); break;
+        case VAREXPR: add_read(c, e->as.var.name); break;
+        case ASSIGN:
+            assign_name(c, e->as.assign.name, fresh_value(e->as.assign.value));
+            add_expr(pending, e->as.assign.value);
+            break;
+        case CALL: {
+            ExprList* args = e->as.call.args;
+            Expr* callee = e->as.call.callee;
+            if (callee->type == VAREXPR && args->index > 0 &&
+                (is_name(callee->as.var.name, "push") || is_name(callee->as.var.name, "remove")))
+                change_local(c, args->exprs[0], e->as.call.paren);
+            for (size_t i = 0; i < args->index; i++) add_expr(pending, args->exprs[i]);
+        } break;
+        case ARRAY:
+            for (size_t i = 0; i < e->as.array.elements->index; i++) add_expr(pending, e->as.array.elements->exprs[i]);
+            break;
+        case MAP:
+            for (size_t i = 0; i < e->as.map.entries->index; i++) add_expr(pending, e->as.map.entries->exprs[i]);
+            break;
+        case INDEX:
+            add_expr(pending, e->as.index.object);
+            add_expr(pending, e->as.index.index);
+            break;
+        case SET_INDEX:
+            change_local(c, e->as.set_index.object, e->as.set_index.bracket);
+            add_expr(pending, e->as.set_index.object);
+            add_expr(pending, e->as.set_index.index);
+            add_expr(pending, e->as.set_index.value);
+            break;
+        case GENERATOR_EXPR: {
+            size_t mark = c->local_count;
+            check_stmt(c, e->as.generator.body);
+            close_scope(c, mark);
+        } break;
+        default: break;
+        }
+    }
+    mem_free(MEM_EXPR, pending->exprs);
+    mem_free(MEM_EXPR, pending);
+}
+
+// variables that were changed in place have to be fresh for their whole scope
+static void close_scope(LoopCheck* c, size_t mark){
+    for (size_t i = mark; i < c->local_count; i++){
+        LoopLocal* local = &c->locals[i];
+        if (local->changed != NULL && !local->fresh)
+            loop_error(c, local->changed, "A parallel loop can only change arrays and maps it created");
+    }
+    c->local_count = mark;
+}
+
+static void check_stmt(LoopCheck* c, Stmt* stmt){
+    if (stmt == NULL) return;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: check_expr(c, stmt->as.expr.expression); break;
+    case PRINT_STMT: check_expr(c, stmt->as.print.expression); break;
+    case VAR_DECL_STMT: {
+        Expr* initializer = stmt->as.var.initializer;
+        check_expr(c, initializer);
+        add_local(c, stmt->as.var.name, initializer == NULL || fresh_value(initializer));
+    } break;
+    case BLOCK_STMT: {
+        size_t mark = c->local_count;
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++) check_stmt(c, &list->statements[i]);
+        close_scope(c, mark);
+    } break;
+    case IF_STMT:
+        check_expr(c, stmt->as.if_stmt.cond);
+        check_stmt(c, stmt->as.if_stmt.trueBranch);
+        check_stmt(c, stmt->as.if_stmt.falseBranch);
+        break;
+    case WHILE_STMT:
+        check_expr(c, stmt->as.while_stmt.cond);
+        check_stmt(c, stmt->as.while_stmt.body);
+        break;
+    case PARALLEL_STMT: {
+        // checked on its own already, what it combines into is assigned here
+        ParallelStmt* inner = &stmt->as.parallel;
+        check_expr(c, inner->start);
+        check_expr(c, inner->end);
+        for (size_t i = 0; i < inner->reduction_count; i++) assign_name(c, inner->reductions[i].name, false);
+        if (inner->reads != NULL){
+            for (size_t i = 0; i < inner->reads->count; i++) add_read(c, inner->reads->names[i]);
+        }
+    } break;
+    case FOR_IN_STMT: {
+        check_expr(c, stmt->as.for_in.iterable);
+        size_t mark = c->local_count;
+        add_local(c, stmt->as.for_in.var, false);
+        check_stmt(c, stmt->as.for_in.body);
+        close_scope(c, mark);
+    } break;
+    default: break;
     }
-    return left;
 }
 
-static Expr* and(Parser* parser){
-    Expr* left = equality(parser);
-    TokenType types[1] = {AND};
-    while(match(parser, types, 1)){
-        Token* op = previous(parser);
-        Expr* right = equality(parser);
-        left = binary_expr(op, left, right);
+static void check_parallel(Parser* parser, ParallelStmt* loop){
+    LoopCheck c = { .parser = parser, .loop = loop };
+    check_stmt(&c, loop->body);
+    close_scope(&c, 0);
+    loop->reads = (SpawnCaptures*)mem_alloc(MEM_EXPR, sizeof(SpawnCaptures) + sizeof(Token*) * c.read_count);
+    if (loop->reads == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for loop variables");
+        exit(1);
     }
-    return left;
+    loop->reads->count = c.read_count;
+    if (c.read_count > 0) memcpy(loop->reads->names, c.reads, sizeof(Token*) * c.read_count);
+    free(c.locals);
+    free(c.reads);
 }
 
-static Expr* equality(Parser* parser){
+// called on 'parallel'. The range is fixed before the loop starts, so that it can be split.
+static Stmt parallel_for(Parser* parser){
+    Token* keyword = advance(parser);
+    ParallelStmt loop = { .keyword = keyword, .step = 1 };
+    expect(parser, FOR);
+    expect(parser, LEFT_PAREN);
+    expect(parser, VAR);
+    expect(parser, IDENTIFIER);
+    loop.var = previous(parser);
+    expect(parser, EQUAL);
+    loop.start = expression(parser);
+    expect(parser, SEMICOLON);
+    Token* at = peek(parser);
+    Expr* cond = expression(parser);
+    if (cond->type == BINARY && (cond->as.binary.op->type == LESS || cond->as.binary.op->type == LESS_EQUAL) &&
+        cond->as.binary.left->type == VAREXPR && same_name(cond->as.binary.left->as.var.name, loop.var)){
+        loop.inclusive = cond->as.binary.op->type == LESS_EQUAL;
+        loop.end = cond->as.binary.right;
+        cond->as.binary.right = NULL;
+    } else {
+        plerror(parser->tokenizer->ctx, at->line, get_column(at), PARSE_ERR, "Expected the condition of a parallel loop to be 'i < end' or 'i <= end'");
+        loop.end = literal_expr(NIL_T);
+    }
+    free_expr(cond);
+    expect(parser, SEMICOLON);
+
+    at = peek(parser);
+    Expr* incr = expression(parser);
+    Expr* step = incr->type == ASSIGN && same_name(incr->as.assign.name, loop.var) ? incr->as.assign.value : NULL;
+    if (step != NULL && step->type == BINARY && step->as.binary.op->type == PLUS && step->as.binary.left->type == VAREXPR &&
+        same_name(step->as.binary.left->as.var.name, loop.var) && step->as.binary.right->type == LITERAL &&
+        step->as.binary.right->as.literal.type == INT_T && step->as.binary.right->as.literal.as.integer > 0){
+        loop.step = step->as.binary.right->as.literal.as.integer;
+    } else {
+        plerror(parser->tokenizer->ctx, at->line, get_column(at), PARSE_ERR, "Expected the step of a parallel loop to be 'i = i + n' with a positive integer n");
+    }
+    free_expr(incr);
+    expect(parser, RIGHT_PAREN);
 
-    Expr* left = comparison(parser);
-    TokenType types[2] = {BANG_EQUAL, EQUAL_EQUAL};
-    while(match(parser, types, 2)){
-        Token* op = previous(parser);
-        Expr* right = comparison(parser);
-        left = binary_expr(op, left, right);
+    if (check(parser, REDUCE)){
+        advance(parser);
+        expect(parser, LEFT_PAREN);
+        do {
+            expect(parser, IDENTIFIER);
+            Token* name = previous(parser);
+            expect(parser, COLON);
+            Token* op = advance(parser);
+            if (op->type != PLUS && op->type != STAR && !(op->type == IDENTIFIER && (is_name(op, "min") || is_name(op, "max"))))
+                plerror(parser->tokenizer->ctx, op->line, get_column(op), PARSE_ERR, "Expected a reduction of '+', '*', 'min' or 'max'");
+            if (same_name(name, loop.var))
+                plerror(parser->tokenizer->ctx, name->line, get_column(name), PARSE_ERR, "The loop variable can't be a reduction target");
+            loop.reductions = (Reduction*)mem_realloc(MEM_STMT, loop.reductions, sizeof(Reduction) * (loop.reduction_count + 1));
+            if (loop.reductions == NULL){
+                plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for reductions");
+                exit(1);
+            }
+            loop.reductions[loop.reduction_count++] = (Reduction){ .name = name, .op = op };
+        } while (check(parser, COMMA) && advance(parser));
+        expect(parser, RIGHT_PAREN);
     }
-    return left;
+
+    loop.body = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
+    bool in_generator = parser->in_generator;
+    parser->in_generator = false;
+    *loop.body = statement(parser);
+    parser->in_generator = in_generator;
+    check_parallel(parser, &loop);
+    return (Stmt){ .type = PARALLEL_STMT, .as.parallel = loop };
 }
+#pragma endregion Parallel_loops
 
-static Expr* comparison(Parser* parser){
+#pragma region Generators
+// called right after 'for (', on 'var name in'
+static Stmt for_in(Parser* parser){
+    advance(parser);
+    ForInStmt loop;
+    loop.var = advance(parser);
+    loop.keyword = advance(parser);
+    loop.iterable = expression(parser);
+    expect(parser, RIGHT_PAREN);
+    loop.body = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
+    *loop.body = statement(parser);
+    return (Stmt){ .type = FOR_IN_STMT, .as.for_in = loop };
+}
 
-    Expr* left = term(parser);
-    TokenType types[4] = {GREATER, GREATER_EQUAL, LESS, LESS_EQUAL};
-    while(match(parser, types, 4)){
-        Token* op = previous(parser);
-        Expr* right = term(parser);
-        left = binary_expr(op, left, right);
+typedef struct {
+    Stmt** yielding;
+    size_t count, size;
+    size_t depth;
+} YieldScan;
+
+// whether stmt contains a yield of this generator. Blocks and loops that do become
+// frames, one above the frames that hold them; an if only picks what runs next.
+static bool scan_yields(YieldScan* scan, Stmt* stmt, size_t frames){
+    bool found = false;
+    switch (stmt->type)
+    {
+    case YIELD_STMT: return true;
+    case IF_STMT:
+        found = scan_yields(scan, stmt->as.if_stmt.trueBranch, frames);
+        if (stmt->as.if_stmt.falseBranch != NULL && scan_yields(scan, stmt->as.if_stmt.falseBranch, frames)) found = true;
+        break;
+    case BLOCK_STMT: {
+        StmtList* list = stmt->as.block.list;
+        for (size_t i = 0; i < list->index; i++){
+            if (scan_yields(scan, &list->statements[i], frames + 1)) found = true;
+        }
+    } break;
+    case WHILE_STMT: found = scan_yields(scan, stmt->as.while_stmt.body, frames + 1); break;
+    case FOR_IN_STMT: found = scan_yields(scan, stmt->as.for_in.body, frames + 1); break;
+    default: return false;
     }
-    return left;
+    if (!found) return false;
+    if (stmt->type != IF_STMT && frames + 1 > scan->depth) scan->depth = frames + 1;
+    if (scan->count == scan->size){
+        scan->size = scan->size == 0 ? INITIAL_EXPRLIST_SIZE : scan->size * 2;
+        scan->yielding = (Stmt**)mem_realloc(MEM_STMT, scan->yielding, sizeof(Stmt*) * scan->size);
+        if (scan->yielding == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for generator frames");
+            exit(1);
+        }
+    }
+    scan->yielding[scan->count++] = stmt;
+    return true;
 }
 
-static Expr* term(Parser* parser){
+static int compare_stmts(const void* a, const void* b){
+    uintptr_t left = (uintptr_t)*(Stmt* const*)a, right = (uintptr_t)*(Stmt* const*)b;
+    return left < right ? -1 : left > right;
+}
 
-    Expr* left = factor(parser);
-    TokenType types[2] = {PLUS, MINUS};
-    while(match(parser, types, 2)){
-        Token* op = previous(parser);
-        Expr* right = factor(parser);
-        left = binary_expr(op, left, right);
+// 'generator { ... }', its yields belong to it and not to the code around it
+static Expr* generator(Parser* parser){
+    Token* keyword = advance(parser);
+    if (!check(parser, LEFT_BRACE))
+        plerror(parser->tokenizer->ctx, peek(parser)->line, get_column(peek(parser)), PARSE_ERR, "Expected a block after 'generator'");
+    Stmt* body = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
+    bool in_generator = parser->in_generator;
+    parser->in_generator = true;
+    *body = statement(parser);
+    parser->in_generator = in_generator;
+
+    // the body is complete, its statements stay where they are from now on
+    YieldScan scan = {0};
+    scan_yields(&scan, body, 0);
+    qsort(scan.yielding, scan.count, sizeof(Stmt*), compare_stmts);
+    Expr* e = generator_expr(keyword, body);
+    e->as.generator.yielding = scan.yielding;
+    e->as.generator.yielding_count = scan.count;
+    e->as.generator.depth = scan.depth;
+    return e;
+}
+#pragma endregion Generators
+
+// target = value, where target has been parsed as an 'or' expression and equal is the token before '='
+static Expr* assignment(Parser* parser, Expr* target, Token* equal, Expr* value){
+    if (target->type == VAREXPR){
+        Token* name = target->as.var.name;
+        mem_free(MEM_EXPR, target);
+        return assign_expr(name, value);
+    } else if (target->type == INDEX){
+        Expr* set = set_index_expr(target->as.index.object, target->as.index.bracket, target->as.index.index, value);
+        mem_free(MEM_EXPR, target);
+        return set;
     }
-    return left;
+    plerror(parser->tokenizer->ctx, equal->line, get_column(peek(parser)), PARSE_ERR, "Invalid assignment target");
+    free_expr(value);
+    return target;
 }
 
-static Expr* factor(Parser* parser){
+static Expr* stack_expression(Parser* parser);
+
+// Expressions are parsed by precedence climbing over a table keyed on token type: a
+// token's prefix rule starts an operand, its infix rule extends the expression to its
+// left while the token binds at least as tightly as the caller asked for.
+typedef enum {
+    PREC_NONE,
+    PREC_ASSIGNMENT,    // =
+    PREC_TERNARY,       // ?:
+    PREC_OR,            // or
+    PREC_AND,           // and
+    PREC_EQUALITY,      // == !=
+    PREC_COMPARISON,    // < > <= >=
+    PREC_TERM,          // + -
+    PREC_FACTOR,        // * / %
+    PREC_UNARY,         // ! -
+    PREC_CALL           // () []
+} Precedence;
+
+typedef Expr* (*PrefixRule)(Parser* parser);
+typedef Expr* (*InfixRule)(Parser* parser, Expr* left);
+
+typedef struct {
+    PrefixRule prefix;
+    InfixRule infix;
+    Precedence precedence;
+} ParseRule;
+
+static Expr* grouping(Parser* parser);
+static Expr* array_literal(Parser* parser);
+static Expr* map_literal(Parser* parser);
+static Expr* spawn(Parser* parser);
+static Expr* generator(Parser* parser);
+static Expr* binary(Parser* parser, Expr* left);
+static Expr* ternary(Parser* parser, Expr* left);
+static Expr* assign(Parser* parser, Expr* left);
+static Expr* subscript(Parser* parser, Expr* object);
+
+// tokens without a prefix rule are handled by primary(), which also reports them
+static const ParseRule rules[] = {
+    [LEFT_PAREN]    = { grouping, call, PREC_CALL },
+    [LEFT_BRACE]    = { map_literal, NULL, PREC_NONE },
+    [LEFT_BRACKET]  = { array_literal, subscript, PREC_CALL },
+    [MINUS]         = { unary, binary, PREC_TERM },
+    [PLUS]          = { NULL, binary, PREC_TERM },
+    [SLASH]         = { NULL, binary, PREC_FACTOR },
+    [STAR]          = { NULL, binary, PREC_FACTOR },
+    [PERCENT]       = { NULL, binary, PREC_FACTOR },
+    [QMARK]         = { NULL, ternary, PREC_TERNARY },
+    [BANG]          = { unary, NULL, PREC_NONE },
+    [BANG_EQUAL]    = { NULL, binary, PREC_EQUALITY },
+    [EQUAL]         = { NULL, assign, PREC_ASSIGNMENT },
+    [EQUAL_EQUAL]   = { NULL, binary, PREC_EQUALITY },
+    [GREATER]       = { NULL, binary, PREC_COMPARISON },
+    [GREATER_EQUAL] = { NULL, binary, PREC_COMPARISON },
+    [LESS]          = { NULL, binary, PREC_COMPARISON },
+    [LESS_EQUAL]    = { NULL, binary, PREC_COMPARISON },
+    [AND]           = { NULL, binary, PREC_AND },
+    [OR]            = { NULL, binary, PREC_OR },
+    [SPAWN]         = { spawn, NULL, PREC_NONE },
+    [JOIN]          = { unary, NULL, PREC_NONE },
+    [GENERATOR]     = { generator, NULL, PREC_NONE },
+    [ENDFILE]       = { NULL, NULL, PREC_NONE },  // sizes the table to every token type
+};
 
-    Expr* left = unary(parser);
-    TokenType types[2] = {SLASH, STAR};
-    while(match(parser, types, 2)){
-        Token* op = previous(parser);
-        Expr* right = unary(parser);
-        left = binary_expr(op, left, right);
+// Every way to nest expressions comes back here for a whole expression, and from
+// MAX_RECURSIVE_DEPTH on those continue on the stack parser instead of the C stack
+static Expr* parse_precedence(Parser* parser, Precedence precedence){
+    if (precedence == PREC_ASSIGNMENT && parser->depth >= MAX_RECURSIVE_DEPTH) return stack_expression(parser);
+    parser->depth++;
+    PrefixRule prefix = rules[peek(parser)->type].prefix;
+    Expr* expr = prefix != NULL ? prefix(parser) : primary(parser);
+    while (precedence <= rules[peek(parser)->type].precedence){
+        expr = rules[peek(parser)->type].infix(parser, expr);
     }
-    return left;
+    parser->depth--;
+    return expr;
 }
 
+static Expr* expression(Parser* parser){
+    if (parser->tokenizer->ctx->stack_parse) return stack_expression(parser);
+    return parse_precedence(parser, PREC_ASSIGNMENT);
+}
+
+// binary operators are left associative, their right side binds one level tighter
+static Expr* binary(Parser* parser, Expr* left){
+    Token* op = advance(parser);
+    Expr* right = parse_precedence(parser, rules[op->type].precedence + 1);
+    return binary_expr(op, left, right);
+}
+
+// both branches are whole expressions, so 'a ? b : c ? d : e' nests to the right
+static Expr* ternary(Parser* parser, Expr* left){
+    advance(parser);
+    Expr* tbranch = parse_precedence(parser, PREC_ASSIGNMENT);
+    expect(parser, COLON);
+    Expr* fbranch = parse_precedence(parser, PREC_ASSIGNMENT);
+    return ternary_expr(left, tbranch, fbranch);
+}
+
+static Expr* assign(Parser* parser, Expr* left){
+    Token* equal = previous(parser);
+    advance(parser);
+    Expr* value = parse_precedence(parser, PREC_ASSIGNMENT);
+    return assignment(parser, left, equal, value);
+}
+
+// a run of prefix operators is consumed up front, so long chains of them don't recurse
 static Expr* unary(Parser* parser){
-    Expr* result;
-    TokenType types[2] = {BANG, MINUS};
-    if (match(parser, types, 2)){
-        Token* op = previous(parser);
-        Expr* right = unary(parser);
-        result = unary_expr(op, right);
-    } else {
-        result = primary(parser);
+    Token* first = peek(parser);
+    size_t count = 0;
+    while (check(parser, BANG) || check(parser, MINUS) || check(parser, JOIN)){
+        advance(parser);
+        count++;
     }
-    return result;
+    Expr* expr = parse_precedence(parser, PREC_UNARY);
+    while (count-- > 0) expr = unary_expr(&first[count], expr);
+    return expr;
+}
+
+static Expr* call(Parser* parser, Expr* callee){
+    Token* paren = advance(parser);
+    ExprList* args = init_expr_list();
+    if (!check(parser, RIGHT_PAREN)){
+        do {
+            add_expr(args, expression(parser));
+        } while (check(parser, COMMA) && advance(parser));
+    }
+    expect(parser, RIGHT_PAREN);
+    return call_expr(callee, paren, args);
+}
+
+static Expr* subscript(Parser* parser, Expr* object){
+    Token* bracket = advance(parser);
+    Expr* index = expression(parser);
+    expect(parser, RIGHT_BRACKET);
+    return index_expr(object, bracket, index);
+}
+
+static Expr* grouping(Parser* parser){
+    advance(parser);
+    Expr* e = expression(parser);
+    expect(parser, RIGHT_PAREN);
+    return group_expr(e);
+}
+
+static Expr* array_literal(Parser* parser){
+    Token* bracket = advance(parser);
+    ExprList* elements = init_expr_list();
+    if (!check(parser, RIGHT_BRACKET)){
+        do {
+            add_expr(elements, expression(parser));
+        } while (check(parser, COMMA) && advance(parser));
+    }
+    expect(parser, RIGHT_BRACKET);
+    return array_expr(bracket, elements);
+}
+
+static Expr* map_literal(Parser* parser){
+    Token* brace = advance(parser);
+    ExprList* entries = init_expr_list();
+    if (!check(parser, RIGHT_BRACE)){
+        do {
+            add_expr(entries, expression(parser));
+            expect(parser, COLON);
+            add_expr(entries, expression(parser));
+        } while (check(parser, COMMA) && advance(parser));
+    }
+    expect(parser, RIGHT_BRACE);
+    return map_expr(brace, entries);
+}
+
+// the task runs a block or, for anything else, the expression as an expression statement
+static Expr* spawn(Parser* parser){
+    Token* keyword = advance(parser);
+    Stmt* body = (Stmt*)mem_alloc(MEM_STMT, sizeof(Stmt));
+    bool in_generator = parser->in_generator;
+    parser->in_generator = false;
+    if (check(parser, LEFT_BRACE)) *body = statement(parser);
+    else {
+        *body = exprStmt(expression(parser));
+        body->line = (uint32_t)keyword->line;
+    }
+    parser->in_generator = in_generator;
+    return spawn_expr(keyword, body);
 }
 
+// literals and names, anything else that can't start an operand is reported here
 static Expr* primary(Parser* parser){
     Expr* result;
     if (check(parser, NUMBER)){
         result = literal_expr(NUM_T);
         result->as.literal.as.number = peek(parser)->lit.number;
+    } else if (check(parser, INTEGER)){
+        result = literal_expr(INT_T);
+        result->as.literal.as.integer = peek(parser)->lit.integer;
     } else if (check(parser, STRING)){
+        Token* tok = peek(parser);
         result = literal_expr(STR_T);
-        result->as.literal.as.string = peek(parser)->lit.string;
+        if (tok->lit.string == NULL) result->as.literal = small_string(tok->source + tok->start + 1, tok->count - tok->start - 2);
+        else result->as.literal.as.string = tok->lit.string;
     } else if (check(parser, IDENTIFIER)){
         result = var_expr(peek(parser));
     } else if (check(parser, FALSE)){
@@ -576,16 +1252,12 @@ static Expr* primary(Parser* parser){
         result->as.literal.as.boolean = true;
     } else if (check(parser, NIL)){
         result = literal_expr(NIL_T);
-    } else if (check(parser, LEFT_PAREN)){
-        advance(parser);
-        Expr* e = expression(parser);
-        expect(parser, RIGHT_PAREN);
-        result = group_expr(e);
     } else if (check(parser, SEMICOLON)){
         result = literal_expr(NIL_T);
         return result;
     } else {
-        plerror(peek(parser)->line, get_column(peek(parser)), PARSE_ERR, "unhandled value, got '%s'", token_strings[peek(parser)->type]);
+        plerror(parser->tokenizer->ctx, peek(parser)->line, get_column(peek(parser)), PARSE_ERR, "unhandled value, got '%s'", token_strings[peek(parser)->type]);
+        result = literal_expr(NIL_T);
     }
 
     advance(parser);
@@ -593,123 +1265,661 @@ static Expr* primary(Parser* parser){
 }
 #pragma endregion Grammar
 
+#pragma region Stack_parser
+// The grammar of the Pratt table driven by heap stacks, so that nesting is bounded by
+// ctx->max_depth instead of the C stack. Every nested expression (group,
+// element, map entry, argument, index, assigned value, ternary branch) is a frame that
+// records where its result goes; binary operators wait on an operator stack and are
+// reduced by precedence.
+
+typedef enum {
+    TO_TOP,
+    TO_GROUP,
+    TO_ELEMENT,
+    TO_MAP_KEY,
+    TO_MAP_VALUE,
+    TO_ARGUMENT,
+    TO_INDEX,
+    TO_ASSIGN,
+    TO_TRUE_BRANCH,
+    TO_FALSE_BRANCH
+} ParseTarget;
+
+typedef struct {
+    ParseTarget target;
+    size_t ops;         // heights of the operator and operand stacks when the frame started
+    size_t operands;
+    Expr* pending;      // callee, indexed object, assignment target or ternary condition
+    Expr* branch;       // true branch of a ternary
+    Token* token;       // paren, bracket, brace or the token before '='
+    ExprList* list;     // arguments, elements or map entries
+} ParseFrame;
+
+typedef struct {
+    Token* token;
+    bool unary;
+} ParseOp;
+
+typedef struct {
+    ParseFrame* frames;
+    size_t frame_count, frame_size;
+    ParseOp* ops;
+    size_t op_count, op_size;
+    Expr** operands;
+    size_t operand_count, operand_size;
+    size_t budget;
+} ParseStack;
+
+static void* grow_stack(void* items, size_t* size, size_t elem){
+    *size = *size == 0 ? INITIAL_PARSE_STACK : *size * 2;
+    void* grown = mem_realloc(MEM_STACKS, items, *size * elem);
+    if (grown == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for parser stack");
+        exit(1);
+    }
+    return grown;
+}
+
+static void free_frame(ParseFrame* frame){
+    free_expr(frame->pending);
+    free_expr(frame->branch);
+    if (frame->list != NULL) free_expr_list(frame->list);
+}
+
+// false when the budget is used up, the trees of the frame are freed then
+static bool push_frame(ParseStack* s, ParseFrame frame){
+    if (s->frame_count + s->op_count >= s->budget){
+        free_frame(&frame);
+        return false;
+    }
+    if (s->frame_count == s->frame_size) s->frames = grow_stack(s->frames, &s->frame_size, sizeof(ParseFrame));
+    frame.ops = s->op_count;
+    frame.operands = s->operand_count;
+    s->frames[s->frame_count++] = frame;
+    return true;
+}
+
+static bool push_op(ParseStack* s, Token* token, bool unary){
+    if (s->frame_count + s->op_count >= s->budget) return false;
+    if (s->op_count == s->op_size) s->ops = grow_stack(s->ops, &s->op_size, sizeof(ParseOp));
+    s->ops[s->op_count++] = (ParseOp){ .token = token, .unary = unary };
+    return true;
+}
+
+static void push_operand(ParseStack* s, Expr* expr){
+    if (s->operand_count == s->operand_size) s->operands = grow_stack(s->operands, &s->operand_size, sizeof(Expr*));
+    s->operands[s->operand_count++] = expr;
+}
+
+// the binding powers of the Pratt table, PREC_NONE for anything that isn't a binary operator
+static Precedence binary_precedence(TokenType type){
+    return rules[type].infix == binary ? rules[type].precedence : PREC_NONE;
+}
+
+// combines the binary operators above base that bind at least as tightly as precedence
+static void reduce(ParseStack* s, size_t base, Precedence precedence){
+    while (s->op_count > base && binary_precedence(s->ops[s->op_count - 1].token->type) >= precedence){
+        Token* op = s->ops[--s->op_count].token;
+        Expr* right = s->operands[--s->operand_count];
+        Expr* left = s->operands[s->operand_count - 1];
+        s->operands[s->operand_count - 1] = binary_expr(op, left, right);
+    }
+}
+
+static void free_parse_stack(ParseStack* s){
+    for (size_t i = 0; i < s->frame_count; i++) free_frame(&s->frames[i]);
+    for (size_t i = 0; i < s->operand_count; i++) free_expr(s->operands[i]);
+    mem_free(MEM_STACKS, s->frames);
+    mem_free(MEM_STACKS, s->ops);
+    mem_free(MEM_STACKS, s->operands);
+}
+
+static Expr* stack_expression(Parser* parser){
+    ParseStack s = { .budget = parser->tokenizer->ctx->max_depth };
+    enum { OPERAND, POSTFIX, OPERAND_DONE, OR_DONE, TERNARY_DONE, COMPLETE } state = OPERAND;
+    Expr* operand = NULL;   // the operand being built in the top frame, then its result
+    bool within = push_frame(&s, (ParseFrame){ .target = TO_TOP });
+    while (within){
+        ParseFrame* frame = &s.frames[s.frame_count - 1];
+        switch (state)
+        {
+        case OPERAND: {
+            if (check(parser, BANG) || check(parser, MINUS) || check(parser, JOIN)){
+                within = push_op(&s, advance(parser), true);
+            } else if (check(parser, LEFT_PAREN)){
+                advance(parser);
+                within = push_frame(&s, (ParseFrame){ .target = TO_GROUP });
+            } else if (check(parser, LEFT_BRACKET)){
+                Token* bracket = advance(parser);
+                ExprList* elements = init_expr_list();
+                if (check(parser, RIGHT_BRACKET)){
+                    expect(parser, RIGHT_BRACKET);
+                    operand = array_expr(bracket, elements);
+                    state = POSTFIX;
+                } else within = push_frame(&s, (ParseFrame){ .target = TO_ELEMENT, .token = bracket, .list = elements });
+            } else if (check(parser, LEFT_BRACE)){
+                Token* brace = advance(parser);
+                ExprList* entries = init_expr_list();
+                if (check(parser, RIGHT_BRACE)){
+                    expect(parser, RIGHT_BRACE);
+                    operand = map_expr(brace, entries);
+                    state = POSTFIX;
+                } else within = push_frame(&s, (ParseFrame){ .target = TO_MAP_KEY, .token = brace, .list = entries });
+            } else if (check(parser, SPAWN) || check(parser, GENERATOR)){
+                // the body is parsed on its own, like the statements of a block
+                operand = check(parser, SPAWN) ? spawn(parser) : generator(parser);
+                state = POSTFIX;
+            } else {
+                operand = primary(parser);
+                state = POSTFIX;
+            }
+        } break;
+        case POSTFIX: {
+            if (check(parser, LEFT_PAREN)){
+                Token* paren = advance(parser);
+                ExprList* args = init_expr_list();
+                if (check(parser, RIGHT_PAREN)){
+                    expect(parser, RIGHT_PAREN);
+                    operand = call_expr(operand, paren, args);
+                } else {
+                    within = push_frame(&s, (ParseFrame){ .target = TO_ARGUMENT, .pending = operand, .token = paren, .list = args });
+                    operand = NULL;
+                    state = OPERAND;
+                }
+            } else if (check(parser, LEFT_BRACKET)){
+                Token* bracket = advance(parser);
+                within = push_frame(&s, (ParseFrame){ .target = TO_INDEX, .pending = operand, .token = bracket });
+                operand = NULL;
+                state = OPERAND;
+            } else state = OPERAND_DONE;
+        } break;
+        case OPERAND_DONE: {
+            while (s.op_count > frame->ops && s.ops[s.op_count - 1].unary){
+                operand = unary_expr(s.ops[--s.op_count].token, operand);
+            }
+            push_operand(&s, operand);
+            operand = NULL;
+            Precedence precedence = binary_precedence(peek(parser)->type);
+            if (precedence != PREC_NONE){
+                reduce(&s, frame->ops, precedence);
+                within = push_op(&s, advance(parser), false);
+                state = OPERAND;
+            } else {
+                reduce(&s, frame->ops, PREC_OR);
+                operand = s.operands[--s.operand_count];
+                state = OR_DONE;
+            }
+        } break;
+        case OR_DONE: {
+            if (check(parser, EQUAL)){
+                Token* equal = previous(parser);
+                advance(parser);
+                within = push_frame(&s, (ParseFrame){ .target = TO_ASSIGN, .pending = operand, .token = equal });
+                operand = NULL;
+                state = OPERAND;
+            } else state = TERNARY_DONE;
+        } break;
+        case TERNARY_DONE: {
+            if (check(parser, QMARK)){
+                advance(parser);
+                within = push_frame(&s, (ParseFrame){ .target = TO_TRUE_BRANCH, .pending = operand });
+                operand = NULL;
+                state = OPERAND;
+            } else state = COMPLETE;
+        } break;
+        case COMPLETE: {
+            ParseFrame done = s.frames[--s.frame_count];
+            Expr* result = operand;
+            operand = NULL;
+            switch (done.target)
+            {
+            case TO_TOP: {
+                free_parse_stack(&s);
+                return result;
+            }
+            case TO_GROUP: {
+                expect(parser, RIGHT_PAREN);
+                operand = group_expr(result);
+                state = POSTFIX;
+            } break;
+            case TO_ELEMENT: {
+                add_expr(done.list, result);
+                if (check(parser, COMMA) && advance(parser)){
+                    within = push_frame(&s, done);
+                    state = OPERAND;
+                } else {
+                    expect(parser, RIGHT_BRACKET);
+                    operand = array_expr(done.token, done.list);
+                    state = POSTFIX;
+                }
+            } break;
+            case TO_MAP_KEY: {
+                add_expr(done.list, result);
+                expect(parser, COLON);
+                done.target = TO_MAP_VALUE;
+                within = push_frame(&s, done);
+                state = OPERAND;
+            } break;
+            case TO_MAP_VALUE: {
+                add_expr(done.list, result);
+                if (check(parser, COMMA) && advance(parser)){
+                    done.target = TO_MAP_KEY;
+                    within = push_frame(&s, done);
+                    state = OPERAND;
+                } else {
+                    expect(parser, RIGHT_BRACE);
+                    operand = map_expr(done.token, done.list);
+                    state = POSTFIX;
+                }
+            } break;
+            case TO_ARGUMENT: {
+                add_expr(done.list, result);
+                if (check(parser, COMMA) && advance(parser)){
+                    within = push_frame(&s, done);
+                    state = OPERAND;
+                } else {
+                    expect(parser, RIGHT_PAREN);
+                    operand = call_expr(done.pending, done.token, done.list);
+                    state = POSTFIX;
+                }
+            } break;
+            case TO_INDEX: {
+                expect(parser, RIGHT_BRACKET);
+                operand = index_expr(done.pending, done.token, result);
+                state = POSTFIX;
+            } break;
+            case TO_ASSIGN: {
+                // an assignment ends the expression it belongs to
+                operand = assignment(parser, done.pending, done.token, result);
+                state = COMPLETE;
+            } break;
+            case TO_TRUE_BRANCH: {
+                expect(parser, COLON);
+                done.target = TO_FALSE_BRANCH;
+                done.branch = result;
+                within = push_frame(&s, done);
+                state = OPERAND;
+            } break;
+            case TO_FALSE_BRANCH: {
+                operand = ternary_expr(done.pending, done.branch, result);
+                state = TERNARY_DONE;
+            } break;
+            }
+        } break;
+        }
+    }
+
+    plerror(parser->tokenizer->ctx, peek(parser)->line, get_column(peek(parser)), PARSE_ERR,
+        "Expression nested deeper than the budget of %zu levels", s.budget);
+    free_expr(operand);
+    free_parse_stack(&s);
+    // the rest of the expression can't be parsed, resume at the end of its statement
+    while (peek(parser)->type != ENDFILE && !check(parser, SEMICOLON)) advance(parser);
+    return literal_expr(NIL_T);
+}
+#pragma endregion Stack_parser
+
 #pragma region AST
 // AST methods
 
 void print_lexeme(Parser* parser, Token* token){
+    FILE* out = parser->tokenizer->ctx->out;
     for (size_t i = 0; i < token->count - token->start; i++){
-        printf("%c", parser->tokenizer->source[token->start+i]);
+        fprintf(out, "%c", parser->tokenizer->source[token->start+i]);
     }
 }
 
+// an expression still to print, or text that follows one
+typedef struct {
+    Expr* expr;
+    const char* text;
+} PrintItem;
+
+typedef struct {
+    PrintItem* items;
+    size_t count, size;
+} PrintStack;
+
+static void push_print(PrintStack* s, Expr* expr, const char* text){
+    if (s->count == s->size) s->items = grow_stack(s->items, &s->size, sizeof(PrintItem));
+    s->items[s->count++] = (PrintItem){ .expr = expr, .text = text };
+}
+
+// pushes " e0 e1 ... )" for the elements of list, last first
+static void push_print_list(PrintStack* s, ExprList* list){
+    push_print(s, NULL, " )");
+    for (size_t i = list->index; i > 0; i--){
+        push_print(s, list->exprs[i - 1], NULL);
+        push_print(s, NULL, " ");
+    }
+}
+
+// prints the opening of each node right away and stacks what follows it in reverse,
+// so the depth of the tree doesn't matter
 void expression_printer(Parser* parser, Expr* expr){
-    
-    switch (expr->type)
-    {
-    case BINARY: {
-        printf("( %s ", token_strings[expr->as.binary.op->type]);
-        expression_printer(parser, expr->as.binary.left);
-        expression_printer(parser, expr->as.binary.right);
-        printf(" )");
-    } break;
-    case TERNARY: {
-        printf("( ternary ");
-        expression_printer(parser, expr->as.ternary.cond);
-        printf(" ? ");
-        expression_printer(parser, expr->as.ternary.trueBranch);
-        printf(" : ");
-        expression_printer(parser, expr->as.ternary.falseBranch);
-        printf(" )");
-    } break;
-    case UNARY: {
-        printf("( %s ", token_strings[expr->as.unary.op->type]);
-        expression_printer(parser, expr->as.unary.right);
-        printf(" )");
-    } break;
-    case LITERAL: {
-        switch (expr->as.literal.type){
-            case NUM_T: printf(" %f", expr->as.literal.as.number); break;
-            case BOOL_T: printf(expr->as.literal.as.boolean ? " true" : " false"); break;
-            case NIL_T: printf(" nil"); break;
-            case STR_T: printf(" \"%s\"", expr->as.literal.as.string); break;
-            default: break;
+    FILE* out = parser->tokenizer->ctx->out;
+    PrintStack s = {0};
+    push_print(&s, expr, NULL);
+    while (s.count > 0){
+        PrintItem item = s.items[--s.count];
+        if (item.expr == NULL){
+            fprintf(out, "%s", item.text);
+            continue;
+        }
+        expr = item.expr;
+        switch (expr->type)
+        {
+        case BINARY: {
+            fprintf(out, "( %s ", token_strings[expr->as.binary.op->type]);
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.binary.right, NULL);
+            push_print(&s, expr->as.binary.left, NULL);
+        } break;
+        case TERNARY: {
+            fprintf(out, "( ternary ");
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.ternary.falseBranch, NULL);
+            push_print(&s, NULL, " : ");
+            push_print(&s, expr->as.ternary.trueBranch, NULL);
+            push_print(&s, NULL, " ? ");
+            push_print(&s, expr->as.ternary.cond, NULL);
+        } break;
+        case UNARY: {
+            fprintf(out, "( %s ", token_strings[expr->as.unary.op->type]);
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.unary.right, NULL);
+        } break;
+        case LITERAL: {
+            switch (expr->as.literal.type){
+                case NUM_T: fprintf(out, " %f", expr->as.literal.as.number); break;
+                case INT_T: fprintf(out, " %lld", (long long)expr->as.literal.as.integer); break;
+                case BOOL_T: fprintf(out, expr->as.literal.as.boolean ? " true" : " false"); break;
+                case NIL_T: fprintf(out, " nil"); break;
+                case STR_T: fprintf(out, " \"%s\"", string_chars(&expr->as.literal)); break;
+                default: break;
+            }
+        } break;
+        case GROUPING: {
+            fprintf(out, "( group ");
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.group.expression, NULL);
+        } break;
+        case VAREXPR: {
+            fprintf(out, "( id ");
+            print_lexeme(parser, expr->as.var.name);
+            fprintf(out, " )"); 
+        } break;
+        case ASSIGN: {
+            fprintf(out, "( assign ");
+            print_lexeme(parser, expr->as.assign.name);
+            fprintf(out, " ");
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.assign.value, NULL);
+        } break;
+        case CALL: {
+            fprintf(out, "( call ");
+            push_print_list(&s, expr->as.call.args);
+            push_print(&s, expr->as.call.callee, NULL);
+        } break;
+        case MAP: {
+            fprintf(out, "( map");
+            push_print_list(&s, expr->as.map.entries);
+        } break;
+        case ARRAY: {
+            fprintf(out, "( array");
+            push_print_list(&s, expr->as.array.elements);
+        } break;
+        case INDEX: {
+            fprintf(out, "( index ");
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.index.index, NULL);
+            push_print(&s, NULL, " ");
+            push_print(&s, expr->as.index.object, NULL);
+        } break;
+        case SET_INDEX: {
+            fprintf(out, "( set index ");
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.set_index.value, NULL);
+            push_print(&s, NULL, " ");
+            push_print(&s, expr->as.set_index.index, NULL);
+            push_print(&s, NULL, " ");
+            push_print(&s, expr->as.set_index.object, NULL);
+        } break;
+        case INVARIANT: {
+            fprintf(out, "( invariant %s ", expr->as.invariant.name);
+            push_print(&s, NULL, " )");
+            push_print(&s, expr->as.invariant.expr, NULL);
+        } break;
+        case SPAWN_EXPR: {
+            fprintf(out, "( spawn ");
+            statement_printer(parser, *expr->as.spawn.body);
+            fprintf(out, " )");
+        } break;
+        case GENERATOR_EXPR: {
+            fprintf(out, "( generator ");
+            statement_printer(parser, *expr->as.generator.body);
+            fprintf(out, " )");
+        } break;
+        default: break;
         }
-    } break;
-    case GROUPING: {
-        printf("( group ");
-        expression_printer(parser, expr->as.group.expression);
-        printf(" )");
-    } break;
-    case VAREXPR: {
-        printf("( id ");
-        print_lexeme(parser, expr->as.var.name);
-        printf(" )"); 
-    } break;
-    case ASSIGN: {
-        printf("( assign ");
-        print_lexeme(parser, expr->as.assign.name);
-        printf(" ");
-        expression_printer(parser, expr->as.assign.value);
-        printf(" )");
-    } break;
-    default: break;
     }
+    mem_free(MEM_STACKS, s.items);
 }
 
 void statement_printer(Parser* parser, Stmt stmt){
+    FILE* out = parser->tokenizer->ctx->out;
     switch(stmt.type)
     {
     case EXPR_STMT: {
-        printf("( expr ");
+        fprintf(out, "( expr ");
         expression_printer(parser, stmt.as.expr.expression);
-        printf(" )");
+        fprintf(out, " )");
     } break;
     case PRINT_STMT: {
-        printf("( print ");
+        fprintf(out, "( print ");
         expression_printer(parser, stmt.as.expr.expression);
-        printf(" )");
+        fprintf(out, " )");
     } break;
     case VAR_DECL_STMT: {
-        printf("( var decl ");
+        fprintf(out, "( var decl ");
         print_lexeme(parser, stmt.as.var.name);
         if (stmt.as.var.initializer != NULL)
             expression_printer(parser, stmt.as.var.initializer);
-        printf(" )");
+        fprintf(out, " )");
     } break;
     case IF_STMT: {
-        printf("( if ");
+        fprintf(out, "( if ");
         expression_printer(parser, stmt.as.if_stmt.cond);
-        printf(" then ");
+        fprintf(out, " then ");
         statement_printer(parser, *stmt.as.if_stmt.trueBranch);
         if (stmt.as.if_stmt.falseBranch != NULL){
-            printf(" else ");
+            fprintf(out, " else ");
             statement_printer(parser, *stmt.as.if_stmt.falseBranch);
         }
-        printf(" )");
+        fprintf(out, " )");
     } break;
     case WHILE_STMT: {
-        printf("( while ");
+        fprintf(out, "( while ");
         expression_printer(parser, stmt.as.while_stmt.cond);
-        printf(" then ");
+        fprintf(out, " then ");
         statement_printer(parser, *stmt.as.while_stmt.body);
-        printf(" )");
+        fprintf(out, " )");
+    } break;
+    case PARALLEL_STMT: {
+        ParallelStmt* loop = &stmt.as.parallel;
+        fprintf(out, "( parallel for ");
+        print_lexeme(parser, loop->var);
+        fprintf(out, " from ");
+        expression_printer(parser, loop->start);
+        fprintf(out, loop->inclusive ? " through " : " to ");
+        expression_printer(parser, loop->end);
+        fprintf(out, " step %lld", (long long)loop->step);
+        for (size_t i = 0; i < loop->reduction_count; i++){
+            fprintf(out, " reduce ");
+            print_lexeme(parser, loop->reductions[i].name);
+            fprintf(out, " ");
+            print_lexeme(parser, loop->reductions[i].op);
+        }
+        fprintf(out, " then ");
+        statement_printer(parser, *loop->body);
+        fprintf(out, " )");
+    } break;
+    case FOR_IN_STMT: {
+        fprintf(out, "( for ");
+        print_lexeme(parser, stmt.as.for_in.var);
+        fprintf(out, " in ");
+        expression_printer(parser, stmt.as.for_in.iterable);
+        fprintf(out, " then ");
+        statement_printer(parser, *stmt.as.for_in.body);
+        fprintf(out, " )");
+    } break;
+    case YIELD_STMT: {
+        fprintf(out, "( yield ");
+        expression_printer(parser, stmt.as.yield.value);
+        fprintf(out, " )");
     } break;
     case BLOCK_STMT: {
-        printf("( block [ \n");
+        fprintf(out, "( block [ \n");
         for (size_t i = 0; i < stmt.as.block.list->index; i++){
             statement_printer(parser, stmt.as.block.list->statements[i]);
         }
-        printf(" ] )\n");
+        fprintf(out, " ] )\n");
     } break;
     default: break;
     }
 }
 
+const char* stmt_kind_name(StmtType type){
+    static const char* names[] = {
+        [EXPR_STMT] = "expr",
+        [PRINT_STMT] = "print",
+        [VAR_DECL_STMT] = "var",
+        [BLOCK_STMT] = "block",
+        [IF_STMT] = "if",
+        [WHILE_STMT] = "while",
+        [PARALLEL_STMT] = "parallel",
+        [FOR_IN_STMT] = "for",
+        [YIELD_STMT] = "yield",
+    };
+    if ((size_t)type < sizeof(names) / sizeof(names[0]) && names[type] != NULL) return names[type];
+    return "stmt";
+}
+
 void print_statements(Parser* parser){
+    FILE* out = parser->tokenizer->ctx->out;
     for (size_t i = 0; i < parser->stmt_list->index; i++){
         statement_printer(parser, parser->stmt_list->statements[i]);
     }
-    printf("\n");
+    fprintf(out, "\n");
+}
+
+typedef struct {
+    Expr* expr;
+    size_t depth;
+} DepthItem;
+
+static void push_depth(DepthItem** items, size_t* count, size_t* size, Expr* expr, size_t depth){
+    if (expr == NULL) return;
+    if (*count == *size) *items = grow_stack(*items, size, sizeof(DepthItem));
+    (*items)[(*count)++] = (DepthItem){ .expr = expr, .depth = depth };
+}
+
+static size_t expr_depth(Expr* expr){
+    DepthItem* items = NULL;
+    size_t count = 0, size = 0, deepest = 0;
+    push_depth(&items, &count, &size, expr, 1);
+    while (count > 0){
+        DepthItem item = items[--count];
+        Expr* e = item.expr;
+        size_t d = item.depth + 1;
+        if (item.depth > deepest) deepest = item.depth;
+        switch (e->type)
+        {
+        case BINARY:
+            push_depth(&items, &count, &size, e->as.binary.left, d);
+            push_depth(&items, &count, &size, e->as.binary.right, d);
+            break;
+        case TERNARY:
+            push_depth(&items, &count, &size, e->as.ternary.cond, d);
+            push_depth(&items, &count, &size, e->as.ternary.trueBranch, d);
+            push_depth(&items, &count, &size, e->as.ternary.falseBranch, d);
+            break;
+        case UNARY: push_depth(&items, &count, &size, e->as.unary.right, d); break;
+        case GROUPING: push_depth(&items, &count, &size, e->as.group.expression, d); break;
+        case ASSIGN: push_depth(&items, &count, &size, e->as.assign.value, d); break;
+        case CALL:
+            push_depth(&items, &count, &size, e->as.call.callee, d);
+            for (size_t i = 0; i < e->as.call.args->index; i++) push_depth(&items, &count, &size, e->as.call.args->exprs[i], d);
+            break;
+        case ARRAY:
+            for (size_t i = 0; i < e->as.array.elements->index; i++) push_depth(&items, &count, &size, e->as.array.elements->exprs[i], d);
+            break;
+        case MAP:
+            for (size_t i = 0; i < e->as.map.entries->index; i++) push_depth(&items, &count, &size, e->as.map.entries->exprs[i], d);
+            break;
+        case INDEX:
+            push_depth(&items, &count, &size, e->as.index.object, d);
+            push_depth(&items, &count, &size, e->as.index.index, d);
+            break;
+        case SET_INDEX:
+            push_depth(&items, &count, &size, e->as.set_index.object, d);
+            push_depth(&items, &count, &size, e->as.set_index.index, d);
+            push_depth(&items, &count, &size, e->as.set_index.value, d);
+            break;
+        case INVARIANT: push_depth(&items, &count, &size, e->as.invariant.expr, d); break;
+        case SPAWN_EXPR: {
+            size_t body = item.depth + stmt_depth(e->as.spawn.body);
+            if (body > deepest) deepest = body;
+        } break;
+        case GENERATOR_EXPR: {
+            size_t body = item.depth + stmt_depth(e->as.generator.body);
+            if (body > deepest) deepest = body;
+        } break;
+        default: break;
+        }
+    }
+    mem_free(MEM_STACKS, items);
+    return deepest;
+}
+
+size_t stmt_depth(Stmt* stmt){
+    size_t deepest = 0, d = 0;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: return expr_depth(stmt->as.expr.expression);
+    case PRINT_STMT: return expr_depth(stmt->as.print.expression);
+    case VAR_DECL_STMT: return expr_depth(stmt->as.var.initializer);
+    case BLOCK_STMT: return ast_depth(stmt->as.block.list);
+    case IF_STMT:
+        deepest = expr_depth(stmt->as.if_stmt.cond);
+        if ((d = stmt_depth(stmt->as.if_stmt.trueBranch)) > deepest) deepest = d;
+        if (stmt->as.if_stmt.falseBranch != NULL && (d = stmt_depth(stmt->as.if_stmt.falseBranch)) > deepest) deepest = d;
+        return deepest;
+    case WHILE_STMT:
+        deepest = expr_depth(stmt->as.while_stmt.cond);
+        if ((d = stmt_depth(stmt->as.while_stmt.body)) > deepest) deepest = d;
+        return deepest;
+    case PARALLEL_STMT:
+        deepest = expr_depth(stmt->as.parallel.start);
+        if ((d = expr_depth(stmt->as.parallel.end)) > deepest) deepest = d;
+        if ((d = stmt_depth(stmt->as.parallel.body)) > deepest) deepest = d;
+        return deepest;
+    case FOR_IN_STMT:
+        deepest = expr_depth(stmt->as.for_in.iterable);
+        if ((d = stmt_depth(stmt->as.for_in.body)) > deepest) deepest = d;
+        return deepest;
+    case YIELD_STMT: return expr_depth(stmt->as.yield.value);
+    default: return 0;
+    }
+}
+
+size_t ast_depth(StmtList* list){
+    size_t deepest = 0;
+    for (size_t i = 0; i < list->index; i++){
+        size_t d = stmt_depth(&list->statements[i]);
+        if (d > deepest) deepest = d;
+    }
+    return deepest;
 }
 
 #pragma endregion AST
\ No newline at end of file
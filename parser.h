@@ -12,7 +12,14 @@ typedef enum {
     GROUPING,
     VAREXPR,
     ASSIGN,
-    CALL
+    CALL,
+    ARRAY,
+    INDEX,
+    SET_INDEX,
+    MAP,
+    INVARIANT,
+    SPAWN_EXPR,
+    GENERATOR_EXPR
 } ExprType;
 
 typedef enum {
@@ -23,15 +30,23 @@ typedef enum {
     BLOCK_STMT,
     IF_STMT,
     WHILE_STMT,
-    FOR_STMT,
-    FUN_STMT,
+    PARALLEL_STMT,
+    FOR_IN_STMT,
+    YIELD_STMT,
 } StmtType;
 
 typedef enum {
     NIL_T,
     NUM_T,
     STR_T,
-    BOOL_T
+    BOOL_T,
+    ARR_T,
+    MAP_T,
+    INT_T,
+    TASK_T,
+    GEN_T,
+    FUNC_T,
+    FILE_T
 } ValueType;
 
 // typedef struct {
@@ -40,11 +55,35 @@ typedef enum {
 
 // Expressions
 typedef struct Expr Expr;
+typedef struct Stmt Stmt;
+typedef struct Array Array;
+typedef struct Map Map;
+typedef struct Task Task;
+typedef struct Generator Generator;
+typedef struct Builtin Builtin;
+typedef struct File File;
+
+#define INITIAL_EXPRLIST_SIZE 4
+#define INITIAL_PARSE_STACK 32
+#define MAX_RECURSIVE_DEPTH 4096
+typedef struct {
+    size_t index;
+    size_t size;
+    Expr** exprs;
+} ExprList;
+
+// what infer_types() proved about the operands of an arithmetic operator or comparison
+typedef enum {
+    UNPROVEN,
+    PROVEN_NUMBERS,         // integers or floats
+    PROVEN_STRINGS          // '+' of two strings
+} Proof;
 
 typedef struct {
     Expr* left;
     Token* op;
     Expr* right;
+    Proof proof;
 } BinaryExpr;
 
 typedef struct {
@@ -60,13 +99,51 @@ typedef struct {
 
 typedef struct {
     ValueType type;
+    uint8_t sso;            // length + 1 of a string stored in as.small, 0 if it lives on the heap,
+                            // SSO_SLICE if it is as.slice; strings of up to SSO_MAX bytes are always stored inline
     union {
         double number;
+        int64_t integer;
         bool boolean;
         char* string;
+        char small[SSO_CAPACITY];
+        struct {
+            const char* chars;  // not NUL-terminated
+            size_t length;
+        } slice;
+        Array* array;
+        Map* map;
+        Task* task;
+        Generator* generator;
+        const Builtin* function;
+        File* file;
     } as;
 } LiteralExpr;
 
+static inline const char* string_chars(const LiteralExpr* value){
+    if (value->sso == SSO_SLICE) return value->as.slice.chars;
+    return value->sso ? value->as.small : value->as.string;
+}
+
+static inline size_t string_length(const LiteralExpr* value){
+    if (value->sso == SSO_SLICE) return value->as.slice.length;
+    return value->sso ? (size_t)value->sso - 1 : strlen(value->as.string);
+}
+
+// length must be at most SSO_MAX
+static inline LiteralExpr small_string(const char* chars, size_t length){
+    LiteralExpr value = { .type = STR_T, .sso = (uint8_t)(length + 1) };
+    memcpy(value.as.small, chars, length);
+    value.as.small[length] = '\0';
+    return value;
+}
+
+// the bytes at chars are never changed or freed
+static inline LiteralExpr slice_string(const char* chars, size_t length){
+    if (length <= SSO_MAX) return small_string(chars, length);
+    return (LiteralExpr){ .type = STR_T, .sso = SSO_SLICE, .as.slice = { .chars = chars, .length = length } };
+}
+
 typedef struct {
     Expr* expression;
 } GroupingExpr;
@@ -80,6 +157,69 @@ typedef struct {
     Expr* value;
 } AssignExpr;
 
+typedef struct {
+    Expr* callee;
+    Token* paren;
+    ExprList* args;
+    const Builtin* builtin;     // set by the first call when the callee is a builtin
+} CallExpr;
+
+typedef struct {
+    Token* bracket;
+    ExprList* elements;
+} ArrayExpr;
+
+typedef struct {
+    Expr* object;
+    Token* bracket;
+    Expr* index;
+} IndexExpr;
+
+typedef struct {
+    Expr* object;
+    Token* bracket;
+    Expr* index;
+    Expr* value;
+} SetIndexExpr;
+
+typedef struct {
+    Token* brace;
+    ExprList* entries;  // key, value, key, value, ...
+} MapExpr;
+
+// A loop invariant hoisted by optimize(). It is evaluated once before its loop into a
+// hidden variable; names start with '$' so they can't clash with identifiers.
+typedef struct {
+    Expr* expr;
+    char name[16];
+} InvariantExpr;
+
+// The names a spawned body reads or assigns, whose values are copied into the task
+typedef struct {
+    size_t count;
+    Token* names[];
+} SpawnCaptures;
+
+// 'spawn { ... }' or 'spawn expression', which becomes an EXPR_STMT body. captures
+// are collected by the first spawn and shared by the ones after it (see task.c).
+typedef struct {
+    Token* keyword;
+    Stmt* body;
+    SpawnCaptures* captures;
+} SpawnExpr;
+
+// 'generator { ... }'. Its body runs up to each 'yield' when it is looped over and then
+// waits in frames on the heap (see generator.c); only the statements in yielding, sorted
+// by address, contain a yield and need a frame, at most depth of them at a time.
+typedef struct {
+    Token* keyword;
+    Stmt* body;
+    SpawnCaptures* captures;
+    Stmt** yielding;
+    size_t yielding_count;
+    size_t depth;
+} GeneratorExpr;
+
 struct Expr {
     ExprType type;
     union {
@@ -90,13 +230,19 @@ struct Expr {
         GroupingExpr group;
         VarExpr var;
         AssignExpr assign;
+        CallExpr call;
+        ArrayExpr array;
+        IndexExpr index;
+        SetIndexExpr set_index;
+        MapExpr map;
+        InvariantExpr invariant;
+        SpawnExpr spawn;
+        GeneratorExpr generator;
     } as;
 };
 
 // statements
 
-typedef struct Stmt Stmt;
-
 #define INITIAL_STMTLIST_SIZE 100
 typedef struct {
     size_t index;
@@ -127,13 +273,57 @@ typedef struct {
     Stmt* falseBranch;
 } IfStmt;
 
+// Machine code jit.c compiled for a while loop. It is freed through release, so the
+// parser doesn't depend on the JIT.
+typedef struct JitCode {
+    void (*release)(struct JitCode* code);
+} JitCode;
+
 typedef struct {
     Expr* cond;
     Stmt* body;
+    ExprList* invariants;   // INVARIANT nodes of this loop, NULL if there are none
+    JitCode* jit;           // NULL until the loop gets hot, and while no run holds the code
 } WhileStmt;
 
+// 'reduce (name: op, ...)' of a parallel loop, op is '+', '*', 'min' or 'max'
+typedef struct {
+    Token* name;
+    Token* op;
+} Reduction;
+
+// 'parallel for (var i = start; i < end; i = i + step) reduce (...) body'. The parser
+// made sure that the body only assigns its own variables and the reduction targets,
+// and only changes arrays and maps it created itself.
+typedef struct {
+    Token* keyword;
+    Token* var;
+    Expr* start;
+    Expr* end;
+    bool inclusive;         // 'i <= end'
+    int64_t step;
+    Reduction* reductions;
+    size_t reduction_count;
+    SpawnCaptures* reads;   // names from outside the loop that the body reads
+    Stmt* body;
+} ParallelStmt;
+
+// 'for (var x in iterable) body' over the elements of an array or what a generator yields
+typedef struct {
+    Token* keyword;         // 'in'
+    Token* var;
+    Expr* iterable;
+    Stmt* body;
+} ForInStmt;
+
+typedef struct {
+    Token* keyword;
+    Expr* value;
+} YieldStmt;
+
 struct Stmt {
     StmtType type;
+    uint32_t line;      // where the statement starts, for --profile
     union {
         ExprStmt expr;
         PrintStmt print;
@@ -141,6 +331,9 @@ struct Stmt {
         VarDeclStmt var;
         IfStmt if_stmt;
         WhileStmt while_stmt;
+        ParallelStmt parallel;
+        ForInStmt for_in;
+        YieldStmt yield;
     } as;
 };
 
@@ -149,14 +342,37 @@ typedef struct {
     
     Tokenizer* tokenizer;
     size_t current_token;
+    bool in_generator;      // where 'yield' is allowed
+    size_t depth;           // statements and expressions being parsed by recursion
 } Parser;
 
 Parser* create_parser(Tokenizer* tokenizer);
 void free_parser(Parser* parser);
+void reset_parser(Parser* parser);
+
+StmtList* init_stmt_list();
+void add_statement(StmtList* list, Stmt stmt);
+void free_stmt_list(StmtList* list);
+void free_stmt(Stmt stmt);
+
+ExprList* init_expr_list();
+void add_expr(ExprList* list, Expr* expr);
+void free_expr(Expr* expr);
 
+// with ctx->stack_parse expressions are parsed without recursion, nested up to ctx->max_depth
 void parse(Parser* parser);
+// parses one top-level declaration onto stmt_list, false at the end of the tokens
+bool parse_declaration(Parser* parser);
 void print_statements(Parser* parser);
+void statement_printer(Parser* parser, Stmt stmt);
+// short name of a statement kind ("while", "print", ...) for --profile and --trace
+const char* stmt_kind_name(StmtType type);
 
-int get_column(Token* tok);
+// deepest expression nesting in list, found without recursing on expressions; passes
+// that do recurse (optimize, infer_types, the .plangc writer, --emit-c) skip or refuse programs
+// deeper than MAX_RECURSIVE_DEPTH
+size_t ast_depth(StmtList* list);
+// the same for a single statement
+size_t stmt_depth(Stmt* stmt);
 
 #endif //_PARSER_H
\ No newline at end of file
@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include "plang.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "infer.h"
+#include "optimize.h"
+#include "builtins.h"
+
+struct PlangProgram {
+    char* source;
+    Context ctx;
+    Tokenizer* tokenizer;
+    Parser* parser;
+};
+
+typedef struct {
+    PlangWriteFn fn;
+    void* user;
+} Sink;
+
+typedef struct {
+    Builtin builtin;    // calls hand this back to call_host
+    PlangFunction fn;
+    void* user;
+    char name[];
+} HostFunction;
+
+struct PlangEnv {
+    Context ctx;
+    Env* env;
+    Sink output;
+    Sink errors;
+    char** strings;     // values given to plang_set_string
+    size_t string_index;
+    size_t string_size;
+    HostFunction** functions;
+    size_t function_index;
+    size_t function_size;
+};
+
+#pragma region Streams
+
+static ssize_t sink_write(void* cookie, const char* buf, size_t size){
+    Sink* sink = (Sink*)cookie;
+    sink->fn(buf, size, sink->user);
+    return (ssize_t)size;
+}
+
+// a FILE that forwards everything written to it to the callback, so the interpreter
+// keeps writing through its Context streams
+static FILE* open_sink(Sink* sink){
+    FILE* f = fopencookie(sink, "w", (cookie_io_functions_t){ .write = sink_write });
+    if (f == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't open output stream");
+        exit(1);
+    }
+    setvbuf(f, NULL, _IOLBF, 0);
+    return f;
+}
+
+#pragma endregion Streams
+
+#pragma region Program
+
+PlangProgram* plang_compile(const char* source, PlangWriteFn errors, void* user){
+    PlangProgram* program = (PlangProgram*)malloc(sizeof(PlangProgram));
+    size_t n = strlen(source);
+    char* text = (char*)mem_alloc(MEM_SOURCE, n + 1);
+    if (program == NULL || text == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for program");
+        exit(1);
+    }
+    memcpy(text, source, n + 1);
+    program->source = text;
+
+    Sink sink = { .fn = errors, .user = user };
+    FILE* err = errors != NULL ? open_sink(&sink) : stderr;
+    program->ctx = create_context(stdout, err);
+    program->tokenizer = create_tokenizer(&program->ctx, text);
+    tokenize(program->tokenizer);
+    program->parser = create_parser(program->tokenizer);
+    parse(program->parser);
+
+    bool failed = program->ctx.hadError;
+    // compile diagnostics are done, nothing else writes through this Context
+    if (errors != NULL) fclose(err);
+    program->ctx.err = stderr;
+    if (failed){
+        plang_free_program(program);
+        return NULL;
+    }
+    infer_types(program->parser->stmt_list);
+    optimize(program->parser->stmt_list);
+    return program;
+}
+
+void plang_free_program(PlangProgram* program){
+    if (program == NULL) return;
+    free_parser(program->parser);
+    free_tokenizer(program->tokenizer);
+    mem_free(MEM_SOURCE, program->source);
+    free(program);
+}
+
+#pragma endregion Program
+
+#pragma region Env
+
+PlangEnv* plang_env_new(void){
+    PlangEnv* env = (PlangEnv*)calloc(1, sizeof(PlangEnv));
+    if (env == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for environment");
+        exit(1);
+    }
+    env->ctx = create_context(stdout, stderr);
+    env->env = create_env(NULL);
+    return env;
+}
+
+void plang_env_free(PlangEnv* env){
+    if (env == NULL) return;
+    if (env->ctx.out != stdout) fclose(env->ctx.out);
+    if (env->ctx.err != stderr) fclose(env->ctx.err);
+    for (size_t i = 0; i < env->string_index; i++) mem_free(MEM_STRINGS, env->strings[i]);
+    free(env->strings);
+    for (size_t i = 0; i < env->function_index; i++) free(env->functions[i]);
+    free(env->functions);
+    free_env(env->env);
+    free(env);
+}
+
+void plang_env_set_output(PlangEnv* env, PlangWriteFn output, void* user){
+    if (env->ctx.out != stdout) fclose(env->ctx.out);
+    env->output = (Sink){ .fn = output, .user = user };
+    env->ctx.out = output != NULL ? open_sink(&env->output) : stdout;
+}
+
+void plang_env_set_errors(PlangEnv* env, PlangWriteFn errors, void* user){
+    if (env->ctx.err != stderr) fclose(env->ctx.err);
+    env->errors = (Sink){ .fn = errors, .user = user };
+    env->ctx.err = errors != NULL ? open_sink(&env->errors) : stderr;
+}
+
+void plang_env_set_jit(PlangEnv* env, bool enabled){
+    env->ctx.jit = enabled;
+}
+
+void plang_env_set_max_depth(PlangEnv* env, size_t depth){
+    env->ctx.max_depth = depth;
+}
+
+int plang_run(const PlangProgram* program, PlangEnv* env){
+    env->ctx.hadError = false;
+    interpret(&env->ctx, program->parser->stmt_list, env->env);
+    fflush(env->ctx.out);
+    fflush(env->ctx.err);
+    return env->ctx.hadError ? -1 : 0;
+}
+
+#pragma endregion Env
+
+#pragma region Globals
+
+static void set_global(PlangEnv* env, const char* name, LiteralExpr value){
+    define(env->env, name, strlen(name), value);
+}
+
+void plang_set_nil(PlangEnv* env, const char* name){
+    set_global(env, name, (LiteralExpr){ .type = NIL_T });
+}
+
+void plang_set_number(PlangEnv* env, const char* name, double value){
+    set_global(env, name, (LiteralExpr){ .type = NUM_T, .as.number = value });
+}
+
+void plang_set_bool(PlangEnv* env, const char* name, bool value){
+    set_global(env, name, (LiteralExpr){ .type = BOOL_T, .as.boolean = value });
+}
+
+// a NUL-terminated copy of n chars, freed with the environment
+static char* keep_string(PlangEnv* env, const char* chars, size_t n){
+    if (env->string_index == env->string_size){
+        env->string_size = env->string_size == 0 ? 8 : env->string_size * 2;
+        env->strings = realloc(env->strings, sizeof(char*) * env->string_size);
+        if (env->strings == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for global strings");
+            exit(1);
+        }
+    }
+    char* copy = (char*)mem_alloc(MEM_STRINGS, n + 1);
+    if (copy == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for global string");
+        exit(1);
+    }
+    memcpy(copy, chars, n);
+    copy[n] = '\0';
+    env->strings[env->string_index++] = copy;
+    return copy;
+}
+
+void plang_set_string(PlangEnv* env, const char* name, const char* value){
+    size_t n = strlen(value);
+    if (n <= SSO_MAX) set_global(env, name, small_string(value, n));
+    else set_global(env, name, (LiteralExpr){ .type = STR_T, .as.string = keep_string(env, value, n) });
+}
+
+// strings point into the value, which has to outlive the result. Slices aren't NUL-terminated
+// and are left to the callers.
+static PlangValue plang_value(const LiteralExpr* v){
+    switch (v->type){
+        case NUM_T: return (PlangValue){ .type = PLANG_NUMBER, .as.number = v->as.number };
+        case INT_T: return (PlangValue){ .type = PLANG_NUMBER, .as.number = (double)v->as.integer };
+        case STR_T: return (PlangValue){ .type = PLANG_STRING, .as.string = string_chars(v) };
+        case BOOL_T: return (PlangValue){ .type = PLANG_BOOL, .as.boolean = v->as.boolean };
+        default: return (PlangValue){ .type = PLANG_NIL };
+    }
+}
+
+bool plang_get(PlangEnv* env, const char* name, PlangValue* value){
+    // strings may be stored inline, so point into the environment's own copy of the value
+    LiteralExpr* v = lookup_value(env->env, name, strlen(name));
+    if (v == NULL) return false;
+    *value = plang_value(v);
+    if (v->sso == SSO_SLICE) value->as.string = keep_string(env, v->as.slice.chars, v->as.slice.length);
+    return true;
+}
+
+#pragma endregion Globals
+
+#pragma region Functions
+
+static LiteralExpr script_value(PlangValue value){
+    switch (value.type){
+        case PLANG_NUMBER: return (LiteralExpr){ .type = NUM_T, .as.number = value.as.number };
+        case PLANG_BOOL: return (LiteralExpr){ .type = BOOL_T, .as.boolean = value.as.boolean };
+        case PLANG_STRING: {
+            size_t n = strlen(value.as.string);
+            if (n <= SSO_MAX) return small_string(value.as.string, n);
+            // like every string a script makes, it lives as long as the process
+            char* copy = (char*)mem_alloc(MEM_STRINGS, n + 1);
+            if (copy == NULL){
+                plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for function result");
+                exit(1);
+            }
+            memcpy(copy, value.as.string, n + 1);
+            return (LiteralExpr){ .type = STR_T, .as.string = copy };
+        }
+        default: return (LiteralExpr){ .type = NIL_T };
+    }
+}
+
+static LiteralExpr call_host(const Builtin* self, Context* ctx, Token* paren, LiteralExpr* args){
+    const HostFunction* host = (const HostFunction*)self;
+    PlangValue values[MAX_BUILTIN_ARITY];
+    char* copies[MAX_BUILTIN_ARITY] = {0};
+    for (size_t i = 0; i < self->arity; i++){
+        values[i] = plang_value(&args[i]);
+        if (args[i].sso != SSO_SLICE) continue;
+        size_t n = args[i].as.slice.length;
+        copies[i] = (char*)malloc(n + 1);
+        if (copies[i] == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for function argument");
+            exit(1);
+        }
+        memcpy(copies[i], args[i].as.slice.chars, n);
+        copies[i][n] = '\0';
+        values[i].as.string = copies[i];
+    }
+    PlangValue result = { .type = PLANG_NIL };
+    bool ok = host->fn(values, self->arity, &result, host->user);
+    for (size_t i = 0; i < self->arity; i++) free(copies[i]);
+    if (!ok){
+        plerror(ctx, paren->line, get_column(paren), RUNTIME_ERR, "Function '%s' failed", self->name);
+        return (LiteralExpr){ .type = NIL_T };
+    }
+    return script_value(result);
+}
+
+bool plang_define_function(PlangEnv* env, const char* name, size_t arity, PlangFunction fn, void* user){
+    size_t n = strlen(name);
+    if (arity > MAX_BUILTIN_ARITY || find_builtin(name, n) != NULL) return false;
+    if (env->function_index == env->function_size){
+        env->function_size = env->function_size == 0 ? 8 : env->function_size * 2;
+        env->functions = realloc(env->functions, sizeof(HostFunction*) * env->function_size);
+        if (env->functions == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for functions");
+            exit(1);
+        }
+    }
+    HostFunction* host = (HostFunction*)malloc(sizeof(HostFunction) + n + 1);
+    if (host == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for function");
+        exit(1);
+    }
+    memcpy(host->name, name, n + 1);
+    host->builtin = (Builtin){ .name = host->name, .arity = arity, .host = call_host };
+    host->fn = fn;
+    host->user = user;
+    env->functions[env->function_index++] = host;
+    set_global(env, name, (LiteralExpr){ .type = FUNC_T, .as.function = &host->builtin });
+    return true;
+}
+
+#pragma endregion Functions
@@ -0,0 +1,81 @@
+#ifndef _PLANG_H
+#define _PLANG_H
+
+// Public embedding API of libplang.
+//
+// Compile a script once into an immutable program, then run it any number of times
+// against execution environments. A program may run concurrently against different
+// environments, an environment must only be used by one thread at a time.
+// Free environments before the programs that ran against them: values they hold
+// may point into a program's string literals.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PLANG_API __attribute__((visibility("default")))
+
+typedef struct PlangProgram PlangProgram;
+typedef struct PlangEnv PlangEnv;
+
+typedef enum {
+    PLANG_NIL,
+    PLANG_NUMBER,
+    PLANG_STRING,
+    PLANG_BOOL
+} PlangType;
+
+typedef struct {
+    PlangType type;
+    union {
+        double number;
+        const char* string;
+        bool boolean;
+    } as;
+} PlangValue;
+
+// receives program output or diagnostics, text is not NUL-terminated
+typedef void (*PlangWriteFn)(const char* text, size_t len, void* user);
+
+// NULL on tokenization or parse errors, which are reported through 'errors' (stderr when NULL)
+PLANG_API PlangProgram* plang_compile(const char* source, PlangWriteFn errors, void* user);
+PLANG_API void plang_free_program(PlangProgram* program);
+
+PLANG_API PlangEnv* plang_env_new(void);
+PLANG_API void plang_env_free(PlangEnv* env);
+// output and diagnostics default to stdout and stderr
+PLANG_API void plang_env_set_output(PlangEnv* env, PlangWriteFn output, void* user);
+PLANG_API void plang_env_set_errors(PlangEnv* env, PlangWriteFn errors, void* user);
+// hot numeric loops are compiled to native code on x86-64 Linux unless disabled
+PLANG_API void plang_env_set_jit(PlangEnv* env, bool enabled);
+// deepest expression nesting plang_run evaluates, the default is 1 << 20
+PLANG_API void plang_env_set_max_depth(PlangEnv* env, size_t depth);
+
+// 0 on success, -1 if a runtime error was reported
+PLANG_API int plang_run(const PlangProgram* program, PlangEnv* env);
+
+PLANG_API void plang_set_nil(PlangEnv* env, const char* name);
+PLANG_API void plang_set_number(PlangEnv* env, const char* name, double value);
+PLANG_API void plang_set_bool(PlangEnv* env, const char* name, bool value);
+// the string is copied and owned by the environment
+PLANG_API void plang_set_string(PlangEnv* env, const char* name, const char* value);
+// false if the global is not defined; strings stay valid until the env is changed or freed
+PLANG_API bool plang_get(PlangEnv* env, const char* name, PlangValue* value);
+
+// A C function scripts call by name, count is the arity it was defined with. Strings in
+// args are only valid during the call and a string result is copied. Returning false
+// reports a runtime error at the call. Scripts that spawn tasks may call it from several
+// threads at once.
+typedef bool (*PlangFunction)(const PlangValue* args, size_t count, PlangValue* result, void* user);
+// defines a global function of at most 4 arguments, false if the arity is larger or the
+// name is taken by a builtin
+PLANG_API bool plang_define_function(PlangEnv* env, const char* name, size_t arity, PlangFunction fn, void* user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PLANG_H
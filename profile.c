@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 200809L
+#include "profile.h"
+#include <stdio.h>
+#include <sys/time.h>
+#include "parser.h"
+#include "utils.h"
+
+// The handler can't allocate, every distinct stack and its frames are kept in
+// tables sized up front. Samples of stacks that no longer fit are only counted.
+#define PROFILE_STACKS 8192     // power of two, filled up to 3/4
+#define PROFILE_POOL (PROFILE_STACKS * 16)
+
+typedef struct {
+    uint64_t hash;
+    uint64_t samples;   // 0 for an empty slot
+    uint32_t start;     // first frame in the pool
+    uint32_t depth;
+} ProfileStack;
+
+typedef struct ProfileTable {
+    ProfileStack stacks[PROFILE_STACKS];
+    ProfileFrame pool[PROFILE_POOL];
+    uint32_t pool_used;
+    uint32_t stack_count;
+    uint64_t dropped;
+    const char* root;
+} ProfileTable;
+
+static Profiler* active = NULL;
+// SIGPROF goes to whichever thread is running, tokenizer workers included
+static char sampling = 0;
+
+static bool same_frames(const ProfileFrame* a, const ProfileFrame* b, uint32_t depth){
+    for (uint32_t i = 0; i < depth; i++){
+        if (a[i].kind != b[i].kind || a[i].line != b[i].line) return false;
+    }
+    return true;
+}
+
+static void sample(int sig){
+    (void)sig;
+    Profiler* profiler = active;
+    if (profiler == NULL || __atomic_test_and_set(&sampling, __ATOMIC_ACQUIRE)) return;
+    sig_atomic_t depth = profiler->depth;
+    uint32_t count = depth < PROFILE_MAX_DEPTH ? (uint32_t)depth : PROFILE_MAX_DEPTH;
+    const ProfileFrame* frames = profiler->frames;
+
+    uint64_t hash = 14695981039346656037ULL ^ count;
+    for (uint32_t i = 0; i < count; i++){
+        hash = (hash ^ ((uint64_t)frames[i].line << 8 | frames[i].kind)) * 1099511628211ULL;
+    }
+
+    ProfileTable* table = profiler->table;
+    size_t mask = PROFILE_STACKS - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask){
+        ProfileStack* stack = &table->stacks[i];
+        if (stack->samples == 0){
+            if (table->stack_count >= PROFILE_STACKS / 4 * 3 || table->pool_used + count > PROFILE_POOL){
+                table->dropped++;
+                break;
+            }
+            for (uint32_t f = 0; f < count; f++) table->pool[table->pool_used + f] = frames[f];
+            *stack = (ProfileStack){ .hash = hash, .samples = 1, .start = table->pool_used, .depth = count };
+            table->pool_used += count;
+            table->stack_count++;
+            break;
+        }
+        if (stack->hash == hash && stack->depth == count && same_frames(&table->pool[stack->start], frames, count)){
+            stack->samples++;
+            break;
+        }
+    }
+    __atomic_clear(&sampling, __ATOMIC_RELEASE);
+}
+
+Profiler* profiler_start(const char* root, int hz){
+    Profiler* profiler = (Profiler*)mem_calloc(MEM_PROFILE, 1, sizeof(Profiler));
+    ProfileTable* table = (ProfileTable*)mem_calloc(MEM_PROFILE, 1, sizeof(ProfileTable));
+    if (profiler == NULL || table == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for the profiler");
+        exit(1);
+    }
+    table->root = root;
+    profiler->table = table;
+    active = profiler;
+
+    long interval = hz > 0 && hz < 1000000 ? 1000000 / hz : 1;
+    struct itimerval timer = { .it_interval = { interval / 1000000, interval % 1000000 } };
+    timer.it_value = timer.it_interval;
+    struct sigaction action = { .sa_handler = sample, .sa_flags = SA_RESTART };
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) != 0 || setitimer(ITIMER_PROF, &timer, NULL) != 0){
+        active = NULL;
+        mem_free(MEM_PROFILE, table);
+        mem_free(MEM_PROFILE, profiler);
+        return NULL;
+    }
+    return profiler;
+}
+
+static void write_stack(FILE* file, const char* root, const ProfileFrame* frames, uint32_t depth, uint64_t samples){
+    fputs(root, file);
+    for (uint32_t i = 0; i < depth; i++){
+        fprintf(file, ";%s:%u", stmt_kind_name((StmtType)frames[i].kind), frames[i].line);
+    }
+    fprintf(file, " %llu\n", (unsigned long long)samples);
+}
+
+bool profiler_stop(Profiler* profiler, const char* path){
+    struct itimerval off = {0};
+    setitimer(ITIMER_PROF, &off, NULL);
+    signal(SIGPROF, SIG_IGN);
+    active = NULL;
+
+    ProfileTable* table = profiler->table;
+    FILE* file = fopen(path, "w");
+    if (file != NULL){
+        for (size_t i = 0; i < PROFILE_STACKS; i++){
+            ProfileStack* stack = &table->stacks[i];
+            if (stack->samples > 0) write_stack(file, table->root, &table->pool[stack->start], stack->depth, stack->samples);
+        }
+        if (table->dropped > 0) fprintf(file, "%s;[stacks dropped] %llu\n", table->root, (unsigned long long)table->dropped);
+    }
+    bool written = file != NULL && fclose(file) == 0;
+    mem_free(MEM_PROFILE, table);
+    mem_free(MEM_PROFILE, profiler);
+    return written;
+}
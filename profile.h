@@ -0,0 +1,43 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// statements nested deeper than this are counted in the deepest frame
+#define PROFILE_MAX_DEPTH 128
+#define DEFAULT_PROFILE_HZ 997
+
+typedef struct {
+    uint32_t kind;  // a StmtType
+    uint32_t line;
+} ProfileFrame;
+
+// Shadow stack of the statements execute() is in, sampled on SIGPROF. Only one
+// profiler runs at a time since the interval timer belongs to the process.
+typedef struct Profiler {
+    ProfileFrame frames[PROFILE_MAX_DEPTH];
+    volatile sig_atomic_t depth;   // may exceed PROFILE_MAX_DEPTH
+    struct ProfileTable* table;
+} Profiler;
+
+// samples hz times per second of CPU time until profiler_stop, NULL if the timer couldn't be set
+Profiler* profiler_start(const char* root, int hz);
+// stops sampling and writes one folded stack per line ("root;while:3;print:4 17") to path,
+// which flamegraph.pl and speedscope read. false if the file couldn't be written.
+bool profiler_stop(Profiler* profiler, const char* path);
+
+static inline void profile_enter(Profiler* profiler, uint32_t kind, uint32_t line){
+    sig_atomic_t depth = profiler->depth;
+    if (depth < PROFILE_MAX_DEPTH) profiler->frames[depth] = (ProfileFrame){ kind, line };
+    // the handler only reads frames below depth, which must be written by then
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    profiler->depth = depth + 1;
+}
+
+static inline void profile_leave(Profiler* profiler){
+    profiler->depth = profiler->depth - 1;
+}
+
+#endif // _PROFILE_H
@@ -0,0 +1,300 @@
+#include "runtime.h"
+#include "builtins.h"
+#include "io.h"
+
+static const char* valueTypes[] = { "nil", "number", "string", "boolean", "array", "map", "integer", "task", "generator", "function", "file" };
+
+int isTruthy(LiteralExpr obj){
+    if (obj.type == NIL_T) return false;
+    if (obj.type == BOOL_T) return obj.as.boolean;
+    return true;
+}
+
+static bool is_number(LiteralExpr obj){
+    return obj.type == NUM_T || obj.type == INT_T;
+}
+
+bool values_equal(LiteralExpr left, LiteralExpr right){
+    if (is_number(left) && is_number(right)){
+        if (left.type == INT_T && right.type == INT_T) return left.as.integer == right.as.integer;
+        return as_double(left) == as_double(right);
+    }
+    if (left.type != right.type) return false;
+    switch (left.type){
+        case NIL_T: return true;
+        case BOOL_T: return left.as.boolean == right.as.boolean;
+        case STR_T: {
+            size_t n = string_length(&left);
+            return n == string_length(&right) && memcmp(string_chars(&left), string_chars(&right), n) == 0;
+        }
+        case ARR_T: return left.as.array == right.as.array;
+        case MAP_T: return left.as.map == right.as.map;
+        case TASK_T: return left.as.task == right.as.task;
+        case GEN_T: return left.as.generator == right.as.generator;
+        case FUNC_T: return left.as.function == right.as.function;
+        case FILE_T: return left.as.file == right.as.file;
+        default: return false;
+    }
+}
+
+#pragma region Operators
+LiteralExpr concat_strings(LiteralExpr left, LiteralExpr right){
+    size_t len_left = string_length(&left);
+    size_t len_right = string_length(&right);
+    const char* chars_left = string_chars(&left);
+    const char* chars_right = string_chars(&right);
+    if (len_left + len_right <= SSO_MAX){
+        LiteralExpr res = { .type = STR_T, .sso = (uint8_t)(len_left + len_right + 1) };
+        memcpy(res.as.small, chars_left, len_left);
+        memcpy(res.as.small + len_left, chars_right, len_right);
+        res.as.small[len_left + len_right] = '\0';
+        return res;
+    }
+    char* res = mem_alloc(MEM_STRINGS, len_left + len_right + 1);
+    if (res == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for string");
+        exit(1);
+    }
+    memcpy(res, chars_left, len_left);
+    memcpy(res + len_left, chars_right, len_right);
+    res[len_left + len_right] = '\0';
+    return string_obj(res);
+}
+
+LiteralExpr binary_op(Context* ctx, Token* op, LiteralExpr left, LiteralExpr right){
+    switch (op->type)
+    {
+    case EQUAL_EQUAL: return bool_obj(values_equal(left, right));
+    case BANG_EQUAL: return bool_obj(!values_equal(left, right));
+    case GREATER: {
+        if (!is_number(left) || !is_number(right)) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'greater than' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        if (left.type == INT_T && right.type == INT_T) return bool_obj(left.as.integer > right.as.integer);
+        return bool_obj(as_double(left) > as_double(right));
+    }
+    case GREATER_EQUAL: {
+        if (!is_number(left) || !is_number(right)) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'greater than or equal to' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        if (left.type == INT_T && right.type == INT_T) return bool_obj(left.as.integer >= right.as.integer);
+        return bool_obj(as_double(left) >= as_double(right));
+    }
+    case LESS: {
+        if (!is_number(left) || !is_number(right)) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'less than' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        if (left.type == INT_T && right.type == INT_T) return bool_obj(left.as.integer < right.as.integer);
+        return bool_obj(as_double(left) < as_double(right));
+    }
+    case LESS_EQUAL: {
+        if (!is_number(left) || !is_number(right)) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'less than or equal to' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        if (left.type == INT_T && right.type == INT_T) return bool_obj(left.as.integer <= right.as.integer);
+        return bool_obj(as_double(left) <= as_double(right));
+    }
+    case STAR: {
+        if (!is_number(left) || !is_number(right)) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'times' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        int64_t res;
+        if (left.type == INT_T && right.type == INT_T && !__builtin_mul_overflow(left.as.integer, right.as.integer, &res)){
+            return int_obj(res);
+        }
+        return num_obj(as_double(left) * as_double(right));
+    }
+    case SLASH: {
+        if (!is_number(left) || !is_number(right)) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'division' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        if (as_double(right) == 0) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Division by zero error");
+            return nil_obj();
+        }
+        // integer division stays integral only when it is exact
+        if (left.type == INT_T && right.type == INT_T && !(left.as.integer == INT64_MIN && right.as.integer == -1)
+            && left.as.integer % right.as.integer == 0){
+            return int_obj(left.as.integer / right.as.integer);
+        }
+        return num_obj(as_double(left) / as_double(right));
+    }
+    case PERCENT: {
+        if (left.type != INT_T || right.type != INT_T) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'modulo' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        if (right.as.integer == 0) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Modulo by zero error");
+            return nil_obj();
+        }
+        if (right.as.integer == -1) return int_obj(0);
+        return int_obj(left.as.integer % right.as.integer);
+    }
+    case MINUS: {
+        if (!is_number(left) || !is_number(right)) {
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'minus' operator is not defined for %s and %s", 
+                valueTypes[left.type], valueTypes[right.type]);
+            return nil_obj();
+        }
+        int64_t res;
+        if (left.type == INT_T && right.type == INT_T && !__builtin_sub_overflow(left.as.integer, right.as.integer, &res)){
+            return int_obj(res);
+        }
+        return num_obj(as_double(left) - as_double(right));
+    }
+    case PLUS: {
+        if (is_number(left) && is_number(right)){
+            int64_t res;
+            if (left.type == INT_T && right.type == INT_T && !__builtin_add_overflow(left.as.integer, right.as.integer, &res)){
+                return int_obj(res);
+            }
+            return num_obj(as_double(left) + as_double(right));
+        }
+        if (left.type == STR_T && right.type == STR_T) return concat_strings(left, right);
+        plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Type mismatch, binary 'plus' operation is not defined for %s and %s", 
+            valueTypes[left.type], valueTypes[right.type]);
+        return nil_obj();
+    }
+    default:
+        plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Unreachable binary operator");
+        return nil_obj();
+    }
+}
+
+LiteralExpr unary_op(Context* ctx, Token* op, LiteralExpr right){
+    switch(op->type){
+        case MINUS: {
+            if (!is_number(right)) {
+                plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Expected type '%s', but got '%s'", valueTypes[NUM_T], valueTypes[right.type]);
+                return nil_obj();
+            }
+            if (right.type == INT_T){
+                if (right.as.integer == INT64_MIN) return num_obj(-(double)right.as.integer);
+                return int_obj(-right.as.integer);
+            }
+            right.as.number = -right.as.number;
+            return right;
+        };
+        case BANG: return bool_obj(!isTruthy(right));
+        default: 
+            plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Unreachable state");
+            return nil_obj();
+    }
+}
+#pragma endregion Operators
+
+#pragma region Containers
+bool index_target(Context* ctx, Token* bracket, LiteralExpr object, LiteralExpr* index){
+    if (object.type == MAP_T){
+        if (!valid_map_key(*index)){
+            plerror(ctx, bracket->line, get_column(bracket), RUNTIME_ERR, "Map key must be a string or number, but got %s", valueTypes[index->type]);
+            return false;
+        }
+        return true;
+    }
+    if (object.type != ARR_T){
+        plerror(ctx, bracket->line, get_column(bracket), RUNTIME_ERR, "Type mismatch, indexing is not defined for %s", valueTypes[object.type]);
+        return false;
+    }
+    int64_t whole;
+    if (index->type == NUM_T && integral_value(index->as.number, &whole)) *index = int_obj(whole);
+    if (index->type != INT_T){
+        plerror(ctx, bracket->line, get_column(bracket), RUNTIME_ERR, "Array index must be an integer");
+        return false;
+    }
+    Array* array = object.as.array;
+    if (index->as.integer < 0 || (uint64_t)index->as.integer >= array->count){
+        plerror(ctx, bracket->line, get_column(bracket), RUNTIME_ERR, "Array index %lld out of bounds for length %zu", (long long)index->as.integer, array->count);
+        return false;
+    }
+    return true;
+}
+
+LiteralExpr index_get(Context* ctx, Token* bracket, LiteralExpr object, LiteralExpr index){
+    if (!index_target(ctx, bracket, object, &index)) return nil_obj();
+    if (object.type == MAP_T){
+        LiteralExpr value;
+        return map_get(object.as.map, index, &value) ? value : nil_obj();
+    }
+    return array_get(object.as.array, (size_t)index.as.integer);
+}
+
+void index_set(LiteralExpr object, LiteralExpr index, LiteralExpr value){
+    if (object.type == MAP_T) map_set(object.as.map, keep_value(index), keep_value(value));
+    else array_set(object.as.array, (size_t)index.as.integer, keep_value(value));
+}
+
+void map_literal_set(Context* ctx, Token* brace, Map* map, LiteralExpr key, LiteralExpr value){
+    if (!valid_map_key(key)){
+        plerror(ctx, brace->line, get_column(brace), RUNTIME_ERR, "Map key must be a string or number, but got %s", valueTypes[key.type]);
+        return;
+    }
+    map_set(map, keep_value(key), keep_value(value));
+}
+#pragma endregion Containers
+
+// Nested containers are printed up to a fixed depth so self-referencing ones terminate
+#define MAX_PRINT_DEPTH 8
+
+void print_value(FILE* out, LiteralExpr val, int depth){
+    switch (val.type)
+    {
+    case NUM_T:  fprintf(out, "%f", val.as.number); break;
+    case INT_T:  fprintf(out, "%lld", (long long)val.as.integer); break;
+    case NIL_T:  fprintf(out, "nil"); break;
+    case BOOL_T: fprintf(out, val.as.boolean ? "true" : "false"); break;
+    case STR_T:  fwrite(string_chars(&val), 1, string_length(&val), out); break;
+    case ARR_T: {
+        if (depth >= MAX_PRINT_DEPTH){
+            fprintf(out, "[...]");
+            break;
+        }
+        fprintf(out, "[");
+        for (size_t i = 0; i < val.as.array->count; i++){
+            if (i > 0) fprintf(out, ", ");
+            print_value(out, array_get(val.as.array, i), depth + 1);
+        }
+        fprintf(out, "]");
+    } break;
+    case MAP_T: {
+        if (depth >= MAX_PRINT_DEPTH){
+            fprintf(out, "{...}");
+            break;
+        }
+        fprintf(out, "{");
+        size_t it = 0;
+        MapEntry* entry;
+        for (bool first = true; map_next(val.as.map, &it, &entry); first = false){
+            if (!first) fprintf(out, ", ");
+            print_value(out, entry->key, depth + 1);
+            fprintf(out, ": ");
+            print_value(out, entry->value, depth + 1);
+        }
+        fprintf(out, "}");
+    } break;
+    case TASK_T: fprintf(out, "<task>"); break;
+    case GEN_T: fprintf(out, "<generator>"); break;
+    case FUNC_T: fprintf(out, "<function %s>", val.as.function->name); break;
+    case FILE_T: fprintf(out, "<file>"); break;
+    default: break;
+    }
+}
+
+LiteralExpr runtime_error(Context* ctx, Token* token, const char* message){
+    plerror(ctx, token->line, get_column(token), RUNTIME_ERR, "%s", message);
+    return nil_obj();
+}
@@ -0,0 +1,100 @@
+#ifndef _RUNTIME_H
+#define _RUNTIME_H
+
+#include "parser.h"
+#include "array.h"
+#include "map.h"
+#include "builtins.h"
+
+// Value semantics shared by the interpreter and by C emitted with --emit-c. Together
+// with utils.c, array.c, map.c and builtins.c this is everything a compiled script
+// links against (make runtime builds them into libplangrt.a). Operations report type
+// errors at the token they belong to and return nil.
+
+static inline LiteralExpr nil_obj(void){
+    return (LiteralExpr){ .type = NIL_T };
+}
+
+static inline LiteralExpr num_obj(double num){
+    return (LiteralExpr){ .type = NUM_T, .as.number = num };
+}
+
+static inline LiteralExpr int_obj(int64_t num){
+    return (LiteralExpr){ .type = INT_T, .as.integer = num };
+}
+
+static inline LiteralExpr string_obj(char* string){
+    return (LiteralExpr){ .type = STR_T, .as.string = string };
+}
+
+static inline LiteralExpr bool_obj(bool b){
+    return (LiteralExpr){ .type = BOOL_T, .as.boolean = b };
+}
+
+static inline LiteralExpr array_obj(Array* array){
+    return (LiteralExpr){ .type = ARR_T, .as.array = array };
+}
+
+static inline LiteralExpr map_obj(Map* map){
+    return (LiteralExpr){ .type = MAP_T, .as.map = map };
+}
+
+static inline double as_double(LiteralExpr obj){
+    return obj.type == INT_T ? (double)obj.as.integer : obj.as.number;
+}
+
+int isTruthy(LiteralExpr obj);
+bool values_equal(LiteralExpr left, LiteralExpr right);
+
+// everything but 'and' and 'or', which only evaluate their right side when needed
+LiteralExpr binary_op(Context* ctx, Token* op, LiteralExpr left, LiteralExpr right);
+LiteralExpr unary_op(Context* ctx, Token* op, LiteralExpr right);
+// '+' of two strings
+LiteralExpr concat_strings(LiteralExpr left, LiteralExpr right);
+
+// binary_op for operands infer_types() proved to be numbers, without checking them again.
+// Only what can still fail, division by zero, goes through binary_op for its message.
+static inline LiteralExpr numeric_op(Context* ctx, Token* op, LiteralExpr left, LiteralExpr right){
+    bool ints = left.type == INT_T && right.type == INT_T;
+    int64_t res;
+    switch (op->type)
+    {
+    case PLUS:
+        if (ints && !__builtin_add_overflow(left.as.integer, right.as.integer, &res)) return int_obj(res);
+        return num_obj(as_double(left) + as_double(right));
+    case MINUS:
+        if (ints && !__builtin_sub_overflow(left.as.integer, right.as.integer, &res)) return int_obj(res);
+        return num_obj(as_double(left) - as_double(right));
+    case STAR:
+        if (ints && !__builtin_mul_overflow(left.as.integer, right.as.integer, &res)) return int_obj(res);
+        return num_obj(as_double(left) * as_double(right));
+    case SLASH:
+        if (as_double(right) == 0) break;
+        if (ints && !(left.as.integer == INT64_MIN && right.as.integer == -1) && left.as.integer % right.as.integer == 0){
+            return int_obj(left.as.integer / right.as.integer);
+        }
+        return num_obj(as_double(left) / as_double(right));
+    case GREATER: return bool_obj(ints ? left.as.integer > right.as.integer : as_double(left) > as_double(right));
+    case GREATER_EQUAL: return bool_obj(ints ? left.as.integer >= right.as.integer : as_double(left) >= as_double(right));
+    case LESS: return bool_obj(ints ? left.as.integer < right.as.integer : as_double(left) < as_double(right));
+    case LESS_EQUAL: return bool_obj(ints ? left.as.integer <= right.as.integer : as_double(left) <= as_double(right));
+    default: break;
+    }
+    return binary_op(ctx, op, left, right);
+}
+
+// Checks that object can be indexed with index before the value of an index assignment
+// is evaluated, array indices are turned into integers
+bool index_target(Context* ctx, Token* bracket, LiteralExpr object, LiteralExpr* index);
+LiteralExpr index_get(Context* ctx, Token* bracket, LiteralExpr object, LiteralExpr index);
+// object and index must have passed index_target
+void index_set(LiteralExpr object, LiteralExpr index, LiteralExpr value);
+
+// one entry of a map literal, invalid keys are reported and skipped
+void map_literal_set(Context* ctx, Token* brace, Map* map, LiteralExpr key, LiteralExpr value);
+
+void print_value(FILE* out, LiteralExpr val, int depth);
+// reports message at token and returns nil, for errors the C emitter already knows about
+LiteralExpr runtime_error(Context* ctx, Token* token, const char* message);
+
+#endif // _RUNTIME_H
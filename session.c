@@ -0,0 +1,89 @@
+#include "session.h"
+
+Session* create_session(Context* ctx){
+    Session* session = (Session*)malloc(sizeof(Session));
+    if (session == NULL){
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for session");
+        exit(1);
+    }
+    session->units = (SessionUnit*)malloc(sizeof(SessionUnit) * INITIAL_UNIT_LIST_SIZE);
+    if (session->units == NULL){
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for session units");
+        exit(1);
+    }
+    session->ctx = ctx;
+    session->unit_index = 0;
+    session->unit_size = INITIAL_UNIT_LIST_SIZE;
+
+    // the keyword table is built once here, every line only resets the token list
+    session->tokenizer = create_tokenizer(ctx, "");
+    session->parser = create_parser(session->tokenizer);
+    session->env = create_env(NULL);
+
+    // lines bring their own token and statement lists, see session_run
+    free_token_list(session->tokenizer->tokens, session->tokenizer->list_index);
+    session->tokenizer->tokens = NULL;
+    free_stmt_list(session->parser->stmt_list);
+    session->parser->stmt_list = NULL;
+    return session;
+}
+
+void free_session(Session* session){
+    for (size_t i = 0; i < session->unit_index; i++){
+        SessionUnit* unit = &session->units[i];
+        free_stmt_list(unit->stmt_list);
+        free_token_list(unit->tokens, unit->token_count);
+        mem_free(MEM_SOURCE, unit->source);
+    }
+    free(session->units);
+    session->units = NULL;
+
+    // the last line's token and statement lists are owned by its unit
+    session->tokenizer->tokens = NULL;
+    session->parser->stmt_list = NULL;
+    free_parser(session->parser);
+    free_tokenizer(session->tokenizer);
+    free_env(session->env);
+    free(session);
+}
+
+static void add_unit(Session* session, SessionUnit unit){
+    if (session->unit_index == session->unit_size){
+        session->unit_size *= 2;
+        session->units = realloc(session->units, sizeof(SessionUnit) * session->unit_size);
+        if (session->units == NULL){
+            plerror(session->ctx, -1, -1, MEMORY_ERR, "Couldn't reallocate memory for session units");
+            exit(1);
+        }
+    }
+    session->units[session->unit_index++] = unit;
+}
+
+void session_run(Session* session, const char* line){
+    size_t n = strlen(line);
+    char* source = (char*)mem_alloc(MEM_SOURCE, n + 1);
+    if (source == NULL){
+        plerror(session->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for session source");
+        exit(1);
+    }
+    memcpy(source, line, n + 1);
+
+    Tokenizer* tokenizer = session->tokenizer;
+    Parser* parser = session->parser;
+    reset_tokenizer(tokenizer, source);
+    reset_parser(parser);
+
+    tokenize(tokenizer);
+    parse(parser);
+    if (!session->ctx->hadError) print_statements(parser);
+    if (!session->ctx->hadError) infer_types(parser->stmt_list);
+    if (!session->ctx->hadError) optimize(parser->stmt_list);
+    if (!session->ctx->hadError) interpret(session->ctx, parser->stmt_list, session->env);
+
+    add_unit(session, (SessionUnit){
+        .source = source,
+        .tokens = tokenizer->tokens,
+        .token_count = tokenizer->list_index,
+        .stmt_list = parser->stmt_list
+    });
+}
@@ -0,0 +1,39 @@
+#ifndef _SESSION_H
+#define _SESSION_H
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "infer.h"
+#include "optimize.h"
+#include "interpreter.h"
+
+// A session keeps the front end and everything the global Env may point into
+// (source text, tokens, string literals, AST) alive across REPL lines.
+// Every line only pays for its own tokens and statements.
+
+#define INITIAL_UNIT_LIST_SIZE 16
+
+typedef struct {
+    char* source;
+    Token* tokens;
+    size_t token_count;
+    StmtList* stmt_list;
+} SessionUnit;
+
+typedef struct {
+    Context* ctx;
+    Tokenizer* tokenizer;
+    Parser* parser;
+    Env* env;
+
+    SessionUnit* units;
+    size_t unit_index;
+    size_t unit_size;
+} Session;
+
+Session* create_session(Context* ctx);
+void free_session(Session* session);
+
+void session_run(Session* session, const char* line);
+
+#endif // _SESSION_H
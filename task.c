@@ -0,0 +1,615 @@
+#define _POSIX_C_SOURCE 200809L
+#include "task.h"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "runtime.h"
+
+struct Task {
+    Stmt* body;
+    Env* env;           // the copied captures, freed once the task ran
+    Context ctx;
+    LiteralExpr result;
+    size_t unfinished;  // 1 until result is set
+
+    // a chunk of parallel_chunks instead, when run is set
+    void (*run)(void* arg, size_t chunk);
+    void* arg;
+    size_t chunk;
+    size_t* remaining;
+};
+
+typedef struct TaskGroup {
+    size_t pending;     // spawned and not finished yet
+    bool failed;
+} TaskGroup;
+
+#pragma region Copies
+// Arrays and maps reachable from a value are copied once each, keyed by the address of
+// the original, so structure that is shared or cyclic comes out the same
+typedef struct {
+    Map* copies;
+    LiteralExpr* pending;   // copies whose elements are still the originals'
+    size_t count, size;
+} Copier;
+
+static LiteralExpr copy_container(Copier* c, LiteralExpr value){
+    if (value.type != ARR_T && value.type != MAP_T) return value;
+    void* original = value.type == ARR_T ? (void*)value.as.array : (void*)value.as.map;
+    LiteralExpr key = { .type = INT_T, .as.integer = (int64_t)(uintptr_t)original };
+    LiteralExpr copy;
+    if (c->copies == NULL) c->copies = create_map(INITIAL_MAP_SIZE);
+    else if (map_get(c->copies, key, &copy)) return copy;
+
+    if (value.type == ARR_T) copy = array_obj(copy_array(value.as.array));
+    else copy = map_obj(copy_map(value.as.map));
+    map_set(c->copies, key, copy);
+    // unboxed arrays hold nothing to copy
+    if (copy.type == ARR_T && !copy.as.array->boxed) return copy;
+    if (c->count == c->size){
+        c->size = c->size == 0 ? INITIAL_ARRAY_SIZE : c->size * 2;
+        c->pending = (LiteralExpr*)realloc(c->pending, sizeof(LiteralExpr) * c->size);
+        if (c->pending == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for copying a value");
+            exit(1);
+        }
+    }
+    c->pending[c->count++] = copy;
+    return copy;
+}
+
+// a deep copy for another thread, strings are never changed and stay shared
+static LiteralExpr copy_value(LiteralExpr value){
+    Copier c = {0};
+    LiteralExpr copy = copy_container(&c, value);
+    while (c.count > 0){
+        LiteralExpr next = c.pending[--c.count];
+        if (next.type == ARR_T){
+            Array* array = next.as.array;
+            for (size_t i = 0; i < array->count; i++) array->as.values[i] = copy_container(&c, array->as.values[i]);
+        } else {
+            size_t it = 0;
+            MapEntry* entry;
+            while (map_next(next.as.map, &it, &entry)) entry->value = copy_container(&c, entry->value);
+        }
+    }
+    if (c.copies != NULL) free_map(c.copies);
+    free(c.pending);
+    return copy;
+}
+
+void settle_value(LiteralExpr value){
+    if (value.type != ARR_T && value.type != MAP_T) return;
+    if (value.type == ARR_T && array_unbox(value.as.array)) return;
+    Map* seen = create_map(INITIAL_MAP_SIZE);
+    LiteralExpr* pending = NULL;
+    size_t count = 0, size = 0;
+    LiteralExpr next = value;
+    for (;;){
+        LiteralExpr key = { .type = INT_T, .as.integer = next.type == ARR_T ? (int64_t)(uintptr_t)next.as.array : (int64_t)(uintptr_t)next.as.map };
+        LiteralExpr found;
+        // only boxed arrays and maps can hold more containers
+        if (!map_get(seen, key, &found) && !(next.type == ARR_T && array_unbox(next.as.array))){
+            map_set(seen, key, nil_obj());
+            size_t it = 0, i = 0;
+            MapEntry* entry;
+            for (;;){
+                LiteralExpr element;
+                if (next.type == ARR_T){
+                    if (i == next.as.array->count) break;
+                    element = next.as.array->as.values[i++];
+                } else {
+                    if (!map_next(next.as.map, &it, &entry)) break;
+                    element = entry->value;
+                }
+                if (element.type != ARR_T && element.type != MAP_T) continue;
+                if (count == size){
+                    size = size == 0 ? INITIAL_ARRAY_SIZE : size * 2;
+                    pending = (LiteralExpr*)realloc(pending, sizeof(LiteralExpr) * size);
+                    if (pending == NULL){
+                        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for settling a value");
+                        exit(1);
+                    }
+                }
+                pending[count++] = element;
+            }
+        }
+        if (count == 0) break;
+        next = pending[--count];
+    }
+    free_map(seen);
+    free(pending);
+}
+#pragma endregion Copies
+
+#pragma region Captures
+typedef struct {
+    Token** names;
+    size_t count, size;
+} NameList;
+
+static void add_capture(NameList* list, Token* name){
+    size_t length = name->count - name->start;
+    for (size_t i = 0; i < list->count; i++){
+        Token* other = list->names[i];
+        if (other->count - other->start == length &&
+            memcmp(other->source + other->start, name->source + name->start, length) == 0) return;
+    }
+    if (list->count == list->size){
+        list->size = list->size == 0 ? INITIAL_EXPRLIST_SIZE : list->size * 2;
+        list->names = (Token**)realloc(list->names, sizeof(Token*) * list->size);
+        if (list->names == NULL){
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for task captures");
+            exit(1);
+        }
+    }
+    list->names[list->count++] = name;
+}
+
+static void capture_stmt(NameList* list, Stmt* stmt);
+
+// expressions wait on an explicit stack, like in free_expr
+static void capture_expr(NameList* list, Expr* expr){
+    if (expr == NULL) return;
+    ExprList* pending = init_expr_list();
+    add_expr(pending, expr);
+    while (pending->index > 0){
+        Expr* e = pending->exprs[--pending->index];
+        if (e == NULL) continue;
+        switch (e->type)
+        {
+        case BINARY:
+            add_expr(pending, e->as.binary.left);
+            add_expr(pending, e->as.binary.right);
+            break;
+        case TERNARY:
+            add_expr(pending, e->as.ternary.cond);
+            add_expr(pending, e->as.ternary.trueBranch);
+            add_expr(pending, e->as.ternary.falseBranch);
+            break;
+        case UNARY: add_expr(pending, e->as.unary.right); break;
+        case GROUPING: add_expr(pending, e->as.group.expression); break;
+        case VAREXPR: add_capture(list, e->as.var.name); break;
+        case ASSIGN:
+            add_capture(list, e->as.assign.name);
+            add_expr(pending, e->as.assign.value);
+            break;
+        case CALL:
+            // functions an embedder defined are globals like any other
+            add_expr(pending, e->as.call.callee);
+            for (size_t i = 0; i < e->as.call.args->index; i++) add_expr(pending, e->as.call.args->exprs[i]);
+            break;
+        case ARRAY:
+            for (size_t i = 0; i < e->as.array.elements->index; i++) add_expr(pending, e->as.array.elements->exprs[i]);
+            break;
+        case MAP:
+            for (size_t i = 0; i < e->as.map.entries->index; i++) add_expr(pending, e->as.map.entries->exprs[i]);
+            break;
+        case INDEX:
+            add_expr(pending, e->as.index.object);
+            add_expr(pending, e->as.index.index);
+            break;
+        case SET_INDEX:
+            add_expr(pending, e->as.set_index.object);
+            add_expr(pending, e->as.set_index.index);
+            add_expr(pending, e->as.set_index.value);
+            break;
+        case INVARIANT: add_expr(pending, e->as.invariant.expr); break;
+        // a nested spawn or generator copies from this task's scope, which needs its names too
+        case SPAWN_EXPR: capture_stmt(list, e->as.spawn.body); break;
+        case GENERATOR_EXPR: capture_stmt(list, e->as.generator.body); break;
+        default: break;
+        }
+    }
+    mem_free(MEM_EXPR, pending->exprs);
+    mem_free(MEM_EXPR, pending);
+}
+
+static void capture_stmt(NameList* list, Stmt* stmt){
+    if (stmt == NULL) return;
+    switch (stmt->type)
+    {
+    case EXPR_STMT: capture_expr(list, stmt->as.expr.expression); break;
+    case PRINT_STMT: capture_expr(list, stmt->as.print.expression); break;
+    case VAR_DECL_STMT: capture_expr(list, stmt->as.var.initializer); break;
+    case BLOCK_STMT:
+        for (size_t i = 0; i < stmt->as.block.list->index; i++) capture_stmt(list, &stmt->as.block.list->statements[i]);
+        break;
+    case IF_STMT:
+        capture_expr(list, stmt->as.if_stmt.cond);
+        capture_stmt(list, stmt->as.if_stmt.trueBranch);
+        capture_stmt(list, stmt->as.if_stmt.falseBranch);
+        break;
+    case WHILE_STMT:
+        capture_expr(list, stmt->as.while_stmt.cond);
+        capture_stmt(list, stmt->as.while_stmt.body);
+        break;
+    case PARALLEL_STMT:
+        capture_expr(list, stmt->as.parallel.start);
+        capture_expr(list, stmt->as.parallel.end);
+        for (size_t i = 0; i < stmt->as.parallel.reduction_count; i++) add_capture(list, stmt->as.parallel.reductions[i].name);
+        capture_stmt(list, stmt->as.parallel.body);
+        break;
+    case FOR_IN_STMT:
+        capture_expr(list, stmt->as.for_in.iterable);
+        capture_stmt(list, stmt->as.for_in.body);
+        break;
+    case YIELD_STMT: capture_expr(list, stmt->as.yield.value); break;
+    default: break;
+    }
+}
+
+// collected by whichever thread comes first, the others use its list
+SpawnCaptures* body_captures(Stmt* body, SpawnCaptures** cached){
+    SpawnCaptures* captures = __atomic_load_n(cached, __ATOMIC_ACQUIRE);
+    if (captures != NULL) return captures;
+    NameList list = {0};
+    capture_stmt(&list, body);
+    captures = (SpawnCaptures*)mem_alloc(MEM_EXPR, sizeof(SpawnCaptures) + sizeof(Token*) * list.count);
+    if (captures == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for task captures");
+        exit(1);
+    }
+    captures->count = list.count;
+    if (list.count > 0) memcpy(captures->names, list.names, sizeof(Token*) * list.count);
+    free(list.names);
+    SpawnCaptures* expected = NULL;
+    if (!__atomic_compare_exchange_n(cached, &expected, captures, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        mem_free(MEM_EXPR, captures);
+        captures = expected;
+    }
+    return captures;
+}
+#pragma endregion Captures
+
+#pragma region Deques
+// Chase-Lev work-stealing deque (with the memory orders of Le et al., PPoPP 2013). Only
+// the owner pushes and pops at the bottom, thieves take the top with a CAS.
+typedef struct DequeArray {
+    size_t size;                    // power of two
+    struct DequeArray* retired;     // the array this one replaced, thieves may still read it
+    Task* slots[];
+} DequeArray;
+
+typedef struct {
+    int64_t top;
+    char top_line[64 - sizeof(int64_t)];
+    int64_t bottom;
+    DequeArray* array;
+    bool used;                      // claimed by a running thread
+    char bottom_line[64 - sizeof(int64_t) - sizeof(DequeArray*) - sizeof(bool)];
+} Deque;
+
+typedef enum {
+    STEAL_EMPTY,
+    STEAL_LOST,     // another thread took the task first, there may be more
+    STEAL_TAKEN
+} StealResult;
+
+static DequeArray* create_deque_array(size_t size){
+    DequeArray* array = (DequeArray*)mem_calloc(MEM_TASKS, 1, sizeof(DequeArray) + sizeof(Task*) * size);
+    if (array == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for task deque");
+        exit(1);
+    }
+    array->size = size;
+    return array;
+}
+
+static void push(Deque* d, Task* task){
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    DequeArray* array = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    if (bottom - top > (int64_t)array->size - 1){
+        DequeArray* grown = create_deque_array(array->size * 2);
+        for (int64_t i = top; i < bottom; i++){
+            grown->slots[i & (grown->size - 1)] = __atomic_load_n(&array->slots[i & (array->size - 1)], __ATOMIC_RELAXED);
+        }
+        grown->retired = array;
+        __atomic_store_n(&d->array, grown, __ATOMIC_RELEASE);
+        array = grown;
+    }
+    __atomic_store_n(&array->slots[bottom & (array->size - 1)], task, __ATOMIC_RELAXED);
+    // a release store rather than the paper's fence, the task's fields go with it
+    __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+static Task* pop(Deque* d){
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    DequeArray* array = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    Task* task = NULL;
+    if (top <= bottom){
+        task = __atomic_load_n(&array->slots[bottom & (array->size - 1)], __ATOMIC_RELAXED);
+        if (top != bottom) return task;
+        // the last task, thieves may be after it too
+        if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) task = NULL;
+    }
+    __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return task;
+}
+
+static StealResult steal(Deque* d, Task** task){
+    int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) return STEAL_EMPTY;
+    DequeArray* array = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+    *task = __atomic_load_n(&array->slots[top & (array->size - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return STEAL_LOST;
+    return STEAL_TAKEN;
+}
+#pragma endregion Deques
+
+#pragma region Scheduler
+// Threads that find no work sleep on wake. epoch changes, under lock, when a task is
+// pushed while some thread sleeps and when a task finishes while a join or a run waits;
+// a thread counts itself in sleepers before it looks for work a last time, so a push
+// either sees it sleeping or it sees the push.
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint64_t epoch;
+    int sleepers;
+    int joiners;            // sleepers waiting for tasks to finish
+    int workers;
+    int deque_count;        // deques handed out so far, they are reused once their thread ends
+    Deque deques[TASK_MAX_THREADS];
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static pthread_once_t pool_started = PTHREAD_ONCE_INIT;
+static pthread_key_t deque_owner;
+static __thread Deque* own = NULL;
+static __thread uint32_t victim_seed = 0;
+
+void task_workers(int count){
+    pool.workers = count;
+}
+
+static void release_deque(void* deque){
+    pthread_mutex_lock(&pool.lock);
+    ((Deque*)deque)->used = false;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// the calling thread's deque, NULL if all TASK_MAX_THREADS are in use
+static Deque* own_deque(void){
+    if (own != NULL) return own;
+    pthread_mutex_lock(&pool.lock);
+    Deque* d = NULL;
+    for (int i = 0; i < pool.deque_count && d == NULL; i++){
+        if (!pool.deques[i].used) d = &pool.deques[i];
+    }
+    if (d == NULL && pool.deque_count < TASK_MAX_THREADS){
+        d = &pool.deques[pool.deque_count];
+        d->array = create_deque_array(TASK_DEQUE_SIZE);
+        __atomic_store_n(&pool.deque_count, pool.deque_count + 1, __ATOMIC_RELEASE);
+    }
+    if (d != NULL) d->used = true;
+    pthread_mutex_unlock(&pool.lock);
+    if (d != NULL){
+        own = d;
+        victim_seed = (uint32_t)(d - pool.deques) * 2654435761u + 1;
+        pthread_setspecific(deque_owner, d);
+    }
+    return d;
+}
+
+// xorshift, so thieves start their search at different deques
+static uint32_t next_victim(void){
+    if (victim_seed == 0) victim_seed = 2463534242u;
+    victim_seed ^= victim_seed << 13;
+    victim_seed ^= victim_seed >> 17;
+    victim_seed ^= victim_seed << 5;
+    return victim_seed;
+}
+
+static Task* find_task(void){
+    Task* task = own != NULL ? pop(own) : NULL;
+    if (task != NULL) return task;
+    int count = __atomic_load_n(&pool.deque_count, __ATOMIC_ACQUIRE);
+    if (count == 0) return NULL;
+    bool lost = true;
+    while (lost){
+        lost = false;
+        int start = (int)(next_victim() % (uint32_t)count);
+        for (int i = 0; i < count; i++){
+            Deque* victim = &pool.deques[(start + i) % count];
+            if (victim == own) continue;
+            StealResult result = steal(victim, &task);
+            if (result == STEAL_TAKEN) return task;
+            if (result == STEAL_LOST) lost = true;
+        }
+    }
+    return NULL;
+}
+
+// one sleeping thread for a pushed task, all of them when a task finished and joins wait
+static void wake(bool finished){
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int waiting = __atomic_load_n(finished ? &pool.joiners : &pool.sleepers, __ATOMIC_RELAXED);
+    if (waiting == 0) return;
+    pthread_mutex_lock(&pool.lock);
+    __atomic_store_n(&pool.epoch, pool.epoch + 1, __ATOMIC_RELAXED);
+    if (finished) pthread_cond_broadcast(&pool.wake);
+    else pthread_cond_signal(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void run_task(Task* task){
+    if (task->run != NULL){
+        // the chunks are freed once remaining reaches 0
+        size_t* remaining = task->remaining;
+        task->run(task->arg, task->chunk);
+        __atomic_sub_fetch(remaining, 1, __ATOMIC_ACQ_REL);
+        wake(true);
+        return;
+    }
+    Context* ctx = &task->ctx;
+    Stmt* body = task->body;
+    if (body->type == EXPR_STMT) task->result = evaluate(ctx, body->as.expr.expression, task->env);
+    else if (body->type == BLOCK_STMT){
+        // the block's declarations go into the task's own scope, next to the captures
+        StmtList* list = body->as.block.list;
+        for (size_t i = 0; i < list->index; i++){
+            Stmt* stmt = &list->statements[i];
+            if (i + 1 == list->index && stmt->type == EXPR_STMT) task->result = evaluate(ctx, stmt->as.expr.expression, task->env);
+            else execute(ctx, stmt, task->env);
+        }
+    } else execute(ctx, body, task->env);
+    free_env(task->env);
+    task->env = NULL;
+
+    TaskGroup* group = ctx->tasks;
+    if (ctx->hadError) __atomic_store_n(&group->failed, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&task->unfinished, 0, __ATOMIC_RELEASE);
+    // the group is freed once this reaches 0
+    __atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+    wake(true);
+}
+
+// Runs one task if there is any, or spins and then sleeps until there may be one.
+// counter is what a join waits for, it also ends the wait; NULL for an idle worker.
+static void idle(size_t* counter){
+    for (int i = 0; i < TASK_SPINS; i++){
+        Task* task = find_task();
+        if (task != NULL){
+            run_task(task);
+            return;
+        }
+        if (counter != NULL && __atomic_load_n(counter, __ATOMIC_ACQUIRE) == 0) return;
+        sched_yield();
+    }
+    __atomic_add_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+    if (counter != NULL) __atomic_add_fetch(&pool.joiners, 1, __ATOMIC_SEQ_CST);
+    uint64_t seen = __atomic_load_n(&pool.epoch, __ATOMIC_SEQ_CST);
+    Task* task = find_task();
+    if (task == NULL && (counter == NULL || __atomic_load_n(counter, __ATOMIC_SEQ_CST) != 0)){
+        pthread_mutex_lock(&pool.lock);
+        while (__atomic_load_n(&pool.epoch, __ATOMIC_RELAXED) == seen) pthread_cond_wait(&pool.wake, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    if (counter != NULL) __atomic_sub_fetch(&pool.joiners, 1, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+    if (task != NULL) run_task(task);
+}
+
+static void help_until_done(size_t* counter){
+    while (__atomic_load_n(counter, __ATOMIC_ACQUIRE) != 0) idle(counter);
+}
+
+static void* worker(void* arg){
+    (void)arg;
+    own_deque();
+    for (;;) idle(NULL);
+    return NULL;
+}
+
+// workers that can't be started are left out, joins run the tasks then
+static void start_pool(void){
+    pthread_key_create(&deque_owner, release_deque);
+    if (pool.workers <= 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        pool.workers = cores > 0 ? (int)cores : 1;
+    }
+    if (pool.workers > TASK_MAX_THREADS / 2) pool.workers = TASK_MAX_THREADS / 2;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, TASK_STACK_SIZE);
+    for (int i = 0; i < pool.workers; i++){
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, worker, NULL) != 0) break;
+    }
+    pthread_attr_destroy(&attr);
+}
+#pragma endregion Scheduler
+
+#pragma region Tasks
+static void start_group(Context* ctx){
+    if (ctx->tasks != NULL) return;
+    ctx->tasks = (TaskGroup*)mem_calloc(MEM_TASKS, 1, sizeof(TaskGroup));
+    if (ctx->tasks == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for task group");
+        exit(1);
+    }
+}
+
+LiteralExpr spawn_task(Context* ctx, SpawnExpr* spawn, Env* env){
+    pthread_once(&pool_started, start_pool);
+    start_group(ctx);
+    Task* task = (Task*)mem_alloc(MEM_TASKS, sizeof(Task));
+    if (task == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for task");
+        exit(1);
+    }
+    *task = (Task){ .body = spawn->body, .env = create_env(NULL), .ctx = *ctx, .result = nil_obj(), .unfinished = 1 };
+    task->ctx.hadError = false;
+    // the profiler and the trace only follow the thread of the run
+    task->ctx.profiler = NULL;
+    task->ctx.trace = NULL;
+
+    SpawnCaptures* captures = body_captures(spawn->body, &spawn->captures);
+    for (size_t i = 0; i < captures->count; i++){
+        Token* name = captures->names[i];
+        const char* key = name->source + name->start;
+        size_t length = name->count - name->start;
+        LiteralExpr* value = lookup_value(env, key, length);
+        if (value != NULL) define(task->env, key, length, copy_value(*value));
+    }
+
+    __atomic_add_fetch(&ctx->tasks->pending, 1, __ATOMIC_RELAXED);
+    Deque* d = own_deque();
+    if (d == NULL) run_task(task);
+    else {
+        push(d, task);
+        wake(false);
+    }
+    return (LiteralExpr){ .type = TASK_T, .as.task = task };
+}
+
+LiteralExpr join_task(Context* ctx, Token* op, LiteralExpr value){
+    if (value.type != TASK_T){
+        plerror(ctx, op->line, get_column(op), RUNTIME_ERR, "Can only join tasks");
+        return nil_obj();
+    }
+    Task* task = value.as.task;
+    help_until_done(&task->unfinished);
+    if (task->ctx.hadError) ctx->hadError = true;
+    return copy_value(task->result);
+}
+
+void parallel_chunks(Context* ctx, size_t count, void (*run)(void* arg, size_t chunk), void* arg){
+    pthread_once(&pool_started, start_pool);
+    start_group(ctx);
+    Deque* d = count > 1 ? own_deque() : NULL;
+    if (d == NULL){
+        for (size_t i = 0; i < count; i++) run(arg, i);
+        return;
+    }
+    Task* chunks = (Task*)mem_alloc(MEM_TASKS, sizeof(Task) * count);
+    if (chunks == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for loop chunks");
+        exit(1);
+    }
+    size_t remaining = count;
+    for (size_t i = 0; i < count; i++){
+        chunks[i] = (Task){ .run = run, .arg = arg, .chunk = i, .remaining = &remaining };
+        push(d, &chunks[i]);
+        wake(false);
+    }
+    help_until_done(&remaining);
+    mem_free(MEM_TASKS, chunks);
+}
+
+void wait_tasks(Context* ctx){
+    TaskGroup* group = ctx->tasks;
+    if (group == NULL) return;
+    help_until_done(&group->pending);
+    if (__atomic_load_n(&group->failed, __ATOMIC_ACQUIRE)) ctx->hadError = true;
+    mem_free(MEM_TASKS, group);
+    ctx->tasks = NULL;
+}
+#pragma endregion Tasks
@@ -0,0 +1,41 @@
+#ifndef _TASK_H
+#define _TASK_H
+
+#include "interpreter.h"
+
+// 'spawn' runs a block or expression as a task on a fixed pool of worker threads and
+// yields a handle, 'join t' waits for it and yields its result: the value of the
+// expression, or of a block's last statement when that is an expression statement.
+//
+// Every thread that spawns has its own Chase-Lev deque. It pushes and pops tasks at
+// the bottom, threads without work steal from the top of the others. A thread waiting
+// in join, or for its run's tasks at the end of interpret, runs tasks meanwhile.
+//
+// Tasks don't share scopes. The variables a task's code names are deep copied from the
+// spawning scope into an Env of its own when it is spawned, and its result is copied
+// again for every join, so an array or map is only ever reachable from one thread.
+// Assigning a captured variable in a task only changes the task's copy.
+
+#define TASK_DEQUE_SIZE 64          // initial slots of a deque, it doubles when full
+#define TASK_MAX_THREADS 256        // workers and other threads that spawn, beyond that spawn runs the task itself
+#define TASK_SPINS 64               // rounds of looking for work before an idle thread sleeps
+#define TASK_STACK_SIZE (16 << 20)  // joins run other tasks on top of the joining one
+
+// size of the pool, only before the first spawn (default: all cores)
+void task_workers(int count);
+
+LiteralExpr spawn_task(Context* ctx, SpawnExpr* spawn, Env* env);
+LiteralExpr join_task(Context* ctx, Token* op, LiteralExpr task);
+// waits for every task of the run, joined or not, and sets hadError if one failed
+void wait_tasks(Context* ctx);
+// the names body reads or assigns, collected once into *cached
+SpawnCaptures* body_captures(Stmt* body, SpawnCaptures** cached);
+
+// Runs run(arg, i) for every i below count on the pool and returns once all have; the
+// calling thread runs chunks too. Tasks spawned by the chunks belong to ctx's run.
+void parallel_chunks(Context* ctx, size_t count, void (*run)(void* arg, size_t chunk), void* arg);
+// unboxes the arrays reachable from value that only hold numbers, so that threads can
+// hand them to the numeric builtins together without any of them changing the storage
+void settle_value(LiteralExpr value);
+
+#endif // _TASK_H
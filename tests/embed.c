@@ -0,0 +1,116 @@
+// Runs scripts through the embedding API, make test compares what it prints with embed.out.
+#include <stdio.h>
+#include <string.h>
+#include "../plang.h"
+
+static void write_tagged(const char* text, size_t len, void* user){
+    printf("%s%.*s", (const char*)user, (int)len, text);
+}
+
+static void print_global(PlangEnv* env, const char* name){
+    PlangValue value;
+    if (!plang_get(env, name, &value)){
+        printf("%s undefined\n", name);
+        return;
+    }
+    switch (value.type){
+        case PLANG_NIL: printf("%s = nil\n", name); break;
+        case PLANG_NUMBER: printf("%s = %g\n", name, value.as.number); break;
+        case PLANG_STRING: printf("%s = \"%s\"\n", name, value.as.string); break;
+        case PLANG_BOOL: printf("%s = %s\n", name, value.as.boolean ? "true" : "false"); break;
+    }
+}
+
+static bool add(const PlangValue* args, size_t count, PlangValue* result, void* user){
+    (void)count;
+    (void)user;
+    if (args[0].type != PLANG_NUMBER || args[1].type != PLANG_NUMBER) return false;
+    result->type = PLANG_NUMBER;
+    result->as.number = args[0].as.number + args[1].as.number;
+    return true;
+}
+
+static bool shout(const PlangValue* args, size_t count, PlangValue* result, void* user){
+    (void)count;
+    (void)user;
+    static char buffer[64];
+    if (args[0].type != PLANG_STRING) return false;
+    snprintf(buffer, sizeof(buffer), "%s!", args[0].as.string);
+    result->type = PLANG_STRING;
+    result->as.string = buffer;
+    return true;
+}
+
+// changes a global behind the script's back, loops calling it must not hoist reads of it
+static bool bump(const PlangValue* args, size_t count, PlangValue* result, void* user){
+    (void)count;
+    plang_set_number((PlangEnv*)user, "g", args[0].as.number + 1);
+    result->type = PLANG_NIL;
+    return true;
+}
+
+static void run(const char* source, PlangEnv* env){
+    PlangProgram* program = plang_compile(source, write_tagged, "compile: ");
+    if (program == NULL){
+        printf("not compiled\n");
+        return;
+    }
+    printf("run %d\n", plang_run(program, env));
+    plang_free_program(program);
+}
+
+int main(void){
+    PlangEnv* env = plang_env_new();
+    plang_env_set_output(env, write_tagged, "out: ");
+    plang_env_set_errors(env, write_tagged, "err: ");
+
+    // globals go both ways and stay between runs
+    plang_set_number(env, "n", 4);
+    plang_set_string(env, "name", "plang");
+    plang_set_bool(env, "flag", true);
+    plang_set_nil(env, "none");
+    run("var twice = n * 2; var greeting = \"hi \" + name; print flag; print none;", env);
+    print_global(env, "twice");
+    print_global(env, "greeting");
+    print_global(env, "missing");
+    run("twice = twice + 1;", env);
+    print_global(env, "twice");
+
+    // host functions
+    printf("define plus %d\n", plang_define_function(env, "plus", 2, add, NULL));
+    printf("define shout %d\n", plang_define_function(env, "shout", 1, shout, NULL));
+    printf("define bump %d\n", plang_define_function(env, "bump", 1, bump, env));
+    printf("define len %d\n", plang_define_function(env, "len", 1, add, NULL));
+    printf("define wide %d\n", plang_define_function(env, "wide", 5, add, NULL));
+    run("print plus(1, 2.5); print shout(\"hey\"); print plus(\"a\", 1);", env);
+    run("var g = 1; var i = 0; while (i < 3) { print g * 10; bump(g); i = i + 1; }", env);
+    print_global(env, "g");
+
+    // the same program runs against several environments, with and without the JIT
+    PlangProgram* program = plang_compile("var s = 0; var i = 0; while (i < k) { s = s + i; i = i + 1; }", NULL, NULL);
+    for (int jit = 0; jit < 2; jit++){
+        PlangEnv* other = plang_env_new();
+        plang_env_set_jit(other, jit == 1);
+        plang_set_number(other, "k", 1000);
+        printf("run %d\n", plang_run(program, other));
+        print_global(other, "s");
+        plang_env_free(other);
+    }
+    plang_free_program(program);
+
+    // errors
+    run("print (1;", env);
+    run("print nothing;", env);
+    // nesting beyond the budget is reported instead of overflowing a stack
+    char deep[256] = "print ";
+    for (int i = 0; i < 50; i++) strcat(deep, "-(");
+    strcat(deep, "1");
+    for (int i = 0; i < 50; i++) strcat(deep, ")");
+    strcat(deep, ";");
+    run(deep, env);
+    plang_env_set_max_depth(env, 8);
+    run(deep, env);
+
+    plang_env_free(env);
+    return 0;
+}
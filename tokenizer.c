@@ -1,19 +1,21 @@
+#define _DEFAULT_SOURCE
 #include "tokenizer.h"
-#define UTILS_IMPLEMENT
-#include "utils.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
 
-char* read_source_file(const char* file_path){
+char* read_source_file(Context* ctx, const char* file_path){
     FILE* source_file = fopen(file_path, "r");
     if (source_file == NULL) {
-        plerror(-1, -1, MEMORY_ERR, "Couldn't read source file: %s", file_path);
-        exit(1);
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't read source file: %s", file_path);
+        return NULL;
     }
     fseek(source_file, 0L, SEEK_END);
     long size = ftell(source_file);
     fseek(source_file, 0L, SEEK_SET);
-    char* source = (char*)malloc(sizeof(char) * size + 1);
+    char* source = (char*)mem_alloc(MEM_SOURCE, sizeof(char) * size + 1);
     if (source == NULL) {
-        plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for source file");
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for source file");
         exit(1);
     }
     fread(source, size, 1, source_file);
@@ -44,14 +46,14 @@ void put(Node* hashtable[HASHTABLE_SIZE], char* key, TokenType val){
 
     Node* h_list;
     if ((h_list = lookup(hashtable, key)) == NULL){
-        h_list = (Node*)malloc(sizeof(Node));
+        h_list = (Node*)mem_alloc(MEM_KEYWORDS, sizeof(Node));
         if (h_list == NULL) {
-            plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for hashtable node: %s", key);
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for hashtable node: %s", key);
             exit(1);
         }
-        h_list->key = malloc(sizeof(char) * strlen(key) + 1);
+        h_list->key = mem_alloc(MEM_KEYWORDS, sizeof(char) * strlen(key) + 1);
         if (h_list->key == NULL) {
-            plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for hashtable node key");
+            plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for hashtable node key");
             exit(1);
         } 
         strcpy(h_list->key, key);
@@ -62,19 +64,20 @@ void put(Node* hashtable[HASHTABLE_SIZE], char* key, TokenType val){
     h_list->value = val;
 }
 
-Tokenizer* create_tokenizer(char* text){
-    Tokenizer* tokenizer = (Tokenizer*)malloc(sizeof(*tokenizer));
+Tokenizer* create_tokenizer(Context* ctx, char* text){
+    Tokenizer* tokenizer = (Tokenizer*)mem_alloc(MEM_TOKENS, sizeof(*tokenizer));
     if (tokenizer == NULL) {
-        plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for tokenization");
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for tokenization");
         exit(1);
     }
+    tokenizer->ctx = ctx;
     tokenizer->source = text;
     tokenizer->source_len = strlen(text);
     
-    tokenizer->tokens = (Token*)malloc(sizeof(Token) * INITIAL_TOKENLIST_SIZE);
+    tokenizer->tokens = (Token*)mem_alloc(MEM_TOKENS, sizeof(Token) * INITIAL_TOKENLIST_SIZE);
     if (tokenizer->tokens == NULL){
-        free(tokenizer);
-        plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for token list");
+        mem_free(MEM_TOKENS, tokenizer);
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for token list");
         exit(1);
     }
     tokenizer->list_index = 0;
@@ -83,6 +86,8 @@ Tokenizer* create_tokenizer(char* text){
     tokenizer->current_line = 1;
     tokenizer->start_char = 0;
     tokenizer->current_char = 0;
+    tokenizer->speculative = false;
+    tokenizer->failed = false;
     
     memset(tokenizer->hashtable, 0, sizeof(Node*) * HASHTABLE_SIZE);
     put(tokenizer->hashtable, "and",    AND);
@@ -101,18 +106,50 @@ Tokenizer* create_tokenizer(char* text){
     put(tokenizer->hashtable, "super",  SUPER);
     put(tokenizer->hashtable, "this",   THIS);
     put(tokenizer->hashtable, "var",    VAR);
+    put(tokenizer->hashtable, "spawn",  SPAWN);
+    put(tokenizer->hashtable, "join",   JOIN);
+    put(tokenizer->hashtable, "parallel", PARALLEL);
+    put(tokenizer->hashtable, "reduce", REDUCE);
+    put(tokenizer->hashtable, "generator", GENERATOR);
+    put(tokenizer->hashtable, "yield", YIELD);
+    put(tokenizer->hashtable, "in", IN);
 
     return tokenizer;
 }
 
-void free_tokenizer(Tokenizer* tokenizer){
-    for (size_t i = 0; i < tokenizer->list_index; i++){
-        // printf("%s\n", tokenizer->tokens[i].lit.string);
-        if (tokenizer->tokens[i].type == STRING){
-            free(tokenizer->tokens[i].lit.string);
+void reset_tokenizer(Tokenizer* tokenizer, char* text){
+    tokenizer->source = text;
+    tokenizer->source_len = strlen(text);
+
+    // the previous token list now belongs to the caller, size the new one after the input
+    size_t size = tokenizer->source_len / 2 + 2;
+    if (size > INITIAL_TOKENLIST_SIZE) size = INITIAL_TOKENLIST_SIZE;
+    tokenizer->tokens = (Token*)mem_alloc(MEM_TOKENS, sizeof(Token) * size);
+    if (tokenizer->tokens == NULL){
+        plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for token list");
+        exit(1);
+    }
+    tokenizer->list_index = 0;
+    tokenizer->max_size = size;
+
+    tokenizer->current_line = 1;
+    tokenizer->start_char = 0;
+    tokenizer->current_char = 0;
+    tokenizer->speculative = false;
+    tokenizer->failed = false;
+}
+
+void free_token_list(Token* tokens, size_t count){
+    for (size_t i = 0; i < count; i++){
+        if (tokens[i].type == STRING){
+            mem_free(MEM_LITERALS, tokens[i].lit.string);
         }
     }
-    free(tokenizer->tokens);
+    mem_free(MEM_TOKENS, tokens);
+}
+
+void free_tokenizer(Tokenizer* tokenizer){
+    if (tokenizer->tokens != NULL) free_token_list(tokenizer->tokens, tokenizer->list_index);
     tokenizer->tokens = NULL;
 
     for (int i = 0; i < HASHTABLE_SIZE; i++){
@@ -121,19 +158,17 @@ void free_tokenizer(Tokenizer* tokenizer){
         while(h != NULL){
             tmp = h;
             h = h->next;
-            free(tmp->key);
-            free(tmp);
+            mem_free(MEM_KEYWORDS, tmp->key);
+            mem_free(MEM_KEYWORDS, tmp);
         }
     }
-    free(tokenizer);
+    mem_free(MEM_TOKENS, tokenizer);
     tokenizer = NULL;
 }
 
-int get_column(Token* tok){
-    int col;
-    size_t cur = tok->start;
-    for (col = 0; cur-col > 0 && tok->source[cur-col] != '\n'; col++);
-    return col;
+static int scan_column(Tokenizer* tokenizer){
+    Token tok = { .start = tokenizer->start_char, .source = tokenizer->source };
+    return get_column(&tok);
 }
 
 static bool match(Tokenizer* tokenizer, char expected){
@@ -160,9 +195,9 @@ static char peek_next(Tokenizer* tokenizer){
 void addToken(Tokenizer* tokenizer, TokenType type) {
     if (tokenizer->list_index == tokenizer->max_size){
         tokenizer->max_size *= 2;
-        tokenizer->tokens = realloc(tokenizer->tokens, sizeof(Token) * tokenizer->max_size);
+        tokenizer->tokens = mem_realloc(MEM_TOKENS, tokenizer->tokens, sizeof(Token) * tokenizer->max_size);
         if (tokenizer->tokens == NULL){
-            plerror(-1, -1, MEMORY_ERR, "Reallocation of token list failed, couldn't allocate memory");
+            plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Reallocation of token list failed, couldn't allocate memory");
             exit(1);
         }
     }
@@ -176,23 +211,36 @@ void addToken(Tokenizer* tokenizer, TokenType type) {
     };
 
     char* literal = NULL;
-    if (type == NUMBER){
+    if (type == NUMBER || type == INTEGER){
         size_t n = tokenizer->current_char - tokenizer->start_char;
-        literal = malloc(n + 1);
+        literal = mem_alloc(MEM_LITERALS, n + 1);
         if (literal == NULL) {
-            plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for number literal");
+            plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for number literal");
             exit(1);
         }
         for (size_t i = 0; i < n; i++) 
             literal[i] = tokenizer->source[tokenizer->start_char+i];
         literal[n] = '\0';
-        tokenizer->tokens[tokenizer->list_index].lit.number = atof(literal);
-        free(literal);
+        Token* tok = &tokenizer->tokens[tokenizer->list_index];
+        if (type == INTEGER){
+            // literals that do not fit in 64 bits fall back to a double
+            errno = 0;
+            tok->lit.integer = strtoll(literal, NULL, 10);
+            if (errno == ERANGE) tok->type = NUMBER;
+        }
+        if (tok->type == NUMBER) tok->lit.number = atof(literal);
+        mem_free(MEM_LITERALS, literal);
     } else if (type == STRING){
         size_t n = tokenizer->current_char - tokenizer->start_char - 2;
-        literal = malloc(n + 1); // -2 for quotes and +1 for '\0'
+        tokenizer->tokens[tokenizer->list_index].lit.string = NULL;
+        if (n <= SSO_MAX){
+            // the parser copies short strings straight into the value
+            tokenizer->list_index++;
+            return;
+        }
+        literal = mem_alloc(MEM_LITERALS, n + 1); // -2 for quotes and +1 for '\0'
         if (literal == NULL) {
-            plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for string literal");
+            plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for string literal");
             exit(1);
         }
         for (size_t i = 0; i < n; i++) 
@@ -206,14 +254,16 @@ void addToken(Tokenizer* tokenizer, TokenType type) {
 void addString(Tokenizer* tokenizer){
     while(peek(tokenizer) != '"' && tokenizer->current_char < tokenizer->source_len){
         if (peek(tokenizer) == '\n') {
-            plerror(tokenizer->current_line, get_column(&tokenizer->tokens[tokenizer->list_index]), TOKEN_ERR, "Unterminated string literal");
+            if (tokenizer->speculative) tokenizer->failed = true;
+            else plerror(tokenizer->ctx, tokenizer->current_line, scan_column(tokenizer), TOKEN_ERR, "Unterminated string literal");
             return;
         }
         advance(tokenizer);
     }
 
     if (tokenizer->current_char >= tokenizer->source_len) {
-        plerror(tokenizer->current_line, get_column(&tokenizer->tokens[tokenizer->list_index]), TOKEN_ERR, "Unterminated string literal");
+        if (tokenizer->speculative) tokenizer->failed = true;
+        else plerror(tokenizer->ctx, tokenizer->current_line, scan_column(tokenizer), TOKEN_ERR, "Unterminated string literal");
         return;
     }
 
@@ -227,22 +277,24 @@ void addNumber(Tokenizer* tokenizer){
     if (peek(tokenizer) == '.' && isdigit(peek_next(tokenizer))){
         advance(tokenizer); // consume dot '.'
         while (isdigit(peek(tokenizer))) advance(tokenizer);
+        addToken(tokenizer, NUMBER);
+        return;
     }
-    addToken(tokenizer, NUMBER);
+    addToken(tokenizer, INTEGER);
 }
 
 void addIdentifier(Tokenizer* tokenizer){
     while(isalnum(peek(tokenizer))) advance(tokenizer);
     size_t n = tokenizer->current_char - tokenizer->start_char;
-    char* buf = (char*)malloc(n*sizeof(char)+1);
+    char* buf = (char*)mem_alloc(MEM_KEYWORDS, n*sizeof(char)+1);
     if (buf == NULL) {
-        plerror(-1, -1, MEMORY_ERR, "Couldn't allocate memory for string literal\n");
+        plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for string literal\n");
         exit(1);
     }
     strncpy(buf, tokenizer->source + tokenizer->start_char, n);
     buf[n] = '\0';
     Node* type = lookup(tokenizer->hashtable, buf);
-    free(buf);
+    mem_free(MEM_KEYWORDS, buf);
     if (type == NULL) {
         addToken(tokenizer, IDENTIFIER);
     } else {
@@ -250,9 +302,10 @@ void addIdentifier(Tokenizer* tokenizer){
     }
 }
 
-void tokenize(Tokenizer* tokenizer){
+// scans tokens starting before 'end', the last one may run past it (multiline comments)
+static void tokenize_range(Tokenizer* tokenizer, size_t end){
 
-    while(tokenizer->current_char < tokenizer->source_len){
+    while(tokenizer->current_char < end){
         tokenizer->start_char = tokenizer->current_char;
         char c = advance(tokenizer);
         switch (c){
@@ -260,6 +313,8 @@ void tokenize(Tokenizer* tokenizer){
             case ')': addToken(tokenizer, RIGHT_PAREN); break;
             case '{': addToken(tokenizer, LEFT_BRACE); break;
             case '}': addToken(tokenizer, RIGHT_BRACE); break;
+            case '[': addToken(tokenizer, LEFT_BRACKET); break;
+            case ']': addToken(tokenizer, RIGHT_BRACKET); break;
             case ',': addToken(tokenizer, COMMA); break;
             case '.': addToken(tokenizer, DOT); break;
             case '-': addToken(tokenizer, MINUS); break;
@@ -268,6 +323,7 @@ void tokenize(Tokenizer* tokenizer){
             case '?': addToken(tokenizer, QMARK); break;
             case ':': addToken(tokenizer, COLON); break;
             case '*': addToken(tokenizer, STAR); break;
+            case '%': addToken(tokenizer, PERCENT); break;
             case '!': addToken(tokenizer, match(tokenizer, '=') ? BANG_EQUAL : BANG); break;
             case '=': addToken(tokenizer, match(tokenizer, '=') ? EQUAL_EQUAL : EQUAL); break;
             case '<': addToken(tokenizer, match(tokenizer, '=') ? LESS_EQUAL : LESS); break;
@@ -281,8 +337,8 @@ void tokenize(Tokenizer* tokenizer){
                     // this is a multiline comment lexeme
                     for (; peek(tokenizer) != '*' && peek_next(tokenizer) != '/' && 
                             tokenizer->current_char < tokenizer->source_len; advance(tokenizer));
-                    advance(tokenizer);
-                    advance(tokenizer);
+                    // an unterminated comment ends with the source
+                    for (int i = 0; i < 2 && tokenizer->current_char < tokenizer->source_len; i++) advance(tokenizer);
                 } else addToken(tokenizer, SLASH);
             }; break;
             
@@ -300,19 +356,153 @@ void tokenize(Tokenizer* tokenizer){
                     addNumber(tokenizer);
                 } else if (isalpha(c)) {
                     addIdentifier(tokenizer);
+                } else if (tokenizer->speculative) {
+                    tokenizer->failed = true;
                 } else {
-                    plerror(tokenizer->current_line, get_column(&tokenizer->tokens[tokenizer->list_index]), TOKEN_ERR, "Unexpected character '%c'", c);
+                    plerror(tokenizer->ctx, tokenizer->current_line, scan_column(tokenizer), TOKEN_ERR, "Unexpected character '%c'", c);
                 }
             } break;
         }
     }
+}
+
+#pragma region Parallel
+
+// A chunk is tokenized speculatively, assuming scanning is in its normal state at the
+// chunk start. Chunks begin right after a newline, and only multiline comments can span
+// a newline, so the guess holds unless the previous chunk ended inside such a comment.
+typedef struct {
+    Tokenizer tokenizer;
+    size_t start;
+    size_t end;
+} Chunk;
+
+typedef struct {
+    Chunk* chunks;
+    size_t chunk_count;
+    size_t next;
+} ChunkQueue;
+
+static void* tokenize_chunks(void* arg){
+    ChunkQueue* queue = (ChunkQueue*)arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->chunk_count){
+        Chunk* chunk = &queue->chunks[i];
+        tokenize_range(&chunk->tokenizer, chunk->end);
+    }
+    return NULL;
+}
+
+static void append_tokens(Tokenizer* tokenizer, Token* tokens, size_t count, size_t line_offset){
+    if (tokenizer->list_index + count > tokenizer->max_size){
+        while (tokenizer->list_index + count > tokenizer->max_size) tokenizer->max_size *= 2;
+        tokenizer->tokens = mem_realloc(MEM_TOKENS, tokenizer->tokens, sizeof(Token) * tokenizer->max_size);
+        if (tokenizer->tokens == NULL){
+            plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Reallocation of token list failed, couldn't allocate memory");
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < count; i++){
+        tokens[i].line += line_offset;
+        tokenizer->tokens[tokenizer->list_index++] = tokens[i];
+    }
+}
+
+void tokenize_parallel(Tokenizer* tokenizer, int threads){
+    size_t chunk_count = (size_t)threads * 4;
+    size_t chunk_len = tokenizer->source_len / chunk_count + 1;
+    if (chunk_len < MIN_CHUNK_SIZE) chunk_len = MIN_CHUNK_SIZE;
+
+    Chunk* chunks = (Chunk*)mem_alloc(MEM_TOKENS, sizeof(Chunk) * chunk_count);
+    if (chunks == NULL){
+        plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for tokenizer chunks");
+        exit(1);
+    }
+
+    // split right after newlines so every chunk starts at the beginning of a line
+    size_t n = 0;
+    for (size_t start = 0; start < tokenizer->source_len && n < chunk_count; n++){
+        size_t end = start + chunk_len;
+        if (n == chunk_count - 1 || end >= tokenizer->source_len) end = tokenizer->source_len;
+        else {
+            char* nl = memchr(tokenizer->source + end, '\n', tokenizer->source_len - end);
+            end = nl == NULL ? tokenizer->source_len : (size_t)(nl - tokenizer->source) + 1;
+        }
+        Chunk* chunk = &chunks[n];
+        chunk->tokenizer = *tokenizer; // shares the read-only keyword table
+        chunk->tokenizer.max_size = (end - start) / 4 + 16;
+        chunk->tokenizer.tokens = (Token*)mem_alloc(MEM_TOKENS, sizeof(Token) * chunk->tokenizer.max_size);
+        if (chunk->tokenizer.tokens == NULL){
+            plerror(tokenizer->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for token list");
+            exit(1);
+        }
+        chunk->tokenizer.list_index = 0;
+        chunk->tokenizer.current_line = 1;
+        chunk->tokenizer.start_char = start;
+        chunk->tokenizer.current_char = start;
+        chunk->tokenizer.speculative = true;
+        chunk->tokenizer.failed = false;
+        chunk->start = start;
+        chunk->end = end;
+        start = end;
+    }
+
+    ChunkQueue queue = { .chunks = chunks, .chunk_count = n, .next = 0 };
+    pthread_t* workers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    for (; workers != NULL && started < threads - 1; started++){
+        if (pthread_create(&workers[started], NULL, tokenize_chunks, &queue) != 0) break;
+    }
+    tokenize_chunks(&queue);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+
+    // stitch in order, rescanning wherever the speculation was wrong or hit an error,
+    // so tokens, line numbers and error messages match a sequential run
+    for (size_t i = 0; i < n; i++){
+        Chunk* chunk = &chunks[i];
+        if (tokenizer->current_char == chunk->start && !chunk->tokenizer.failed){
+            append_tokens(tokenizer, chunk->tokenizer.tokens, chunk->tokenizer.list_index, tokenizer->current_line - 1);
+            tokenizer->current_line += chunk->tokenizer.current_line - 1;
+            tokenizer->current_char = chunk->tokenizer.current_char;
+            mem_free(MEM_TOKENS, chunk->tokenizer.tokens);
+        } else {
+            free_token_list(chunk->tokenizer.tokens, chunk->tokenizer.list_index);
+            if (tokenizer->current_char < chunk->end) tokenize_range(tokenizer, chunk->end);
+        }
+    }
+    mem_free(MEM_TOKENS, chunks);
+}
+
+#pragma endregion Parallel
+
+void tokenize(Tokenizer* tokenizer){
+    if (tokenizer->source_len >= PARALLEL_TOKENIZE_SIZE){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cores > 1){
+            tokenize_parallel(tokenizer, cores > MAX_TOKENIZE_THREADS ? MAX_TOKENIZE_THREADS : (int)cores);
+            addToken(tokenizer, ENDFILE);
+            return;
+        }
+    }
+    tokenize_range(tokenizer, tokenizer->source_len);
+    addToken(tokenizer, ENDFILE);
+}
+
+bool tokenize_span(Tokenizer* tokenizer, size_t start, size_t end, size_t line){
+    tokenizer->start_char = start;
+    tokenizer->current_char = start;
+    tokenizer->current_line = line;
+    tokenize_range(tokenizer, end);
+    bool exact = tokenizer->current_char == end;
     addToken(tokenizer, ENDFILE);
+    return exact;
 }
 
 const char* token_strings[] = {   
-    "LEFT_PAREN", "RIGHT_PAREN", "LEFT_BRACE", "RIGHT_BRACE", "COMMA", "DOT", "MINUS", "PLUS", "SEMICOLON", "SLASH", "STAR", "QMARK", "COLON",
-    "BANG", "BANG_EQUAL", "EQUAL", "EQUAL_EQUAL", "GREATER", "GREATER_EQUAL", "LESS", "LESS_EQUAL", "IDENTIFIER", "STRING", "NUMBER",
-    "AND", "OR", "PRINT", "IF", "ELSE", "TRUE", "FALSE", "NIL", "FOR", "WHILE", "FUN", "RETURN", "CLASS", "SUPER", "THIS", "VAR", "ENDFILE"
+    "LEFT_PAREN", "RIGHT_PAREN", "LEFT_BRACE", "RIGHT_BRACE", "LEFT_BRACKET", "RIGHT_BRACKET", "COMMA", "DOT", "MINUS", "PLUS", "SEMICOLON", "SLASH", "STAR", "PERCENT", "QMARK", "COLON",
+    "BANG", "BANG_EQUAL", "EQUAL", "EQUAL_EQUAL", "GREATER", "GREATER_EQUAL", "LESS", "LESS_EQUAL", "IDENTIFIER", "STRING", "NUMBER", "INTEGER",
+    "AND", "OR", "PRINT", "IF", "ELSE", "TRUE", "FALSE", "NIL", "FOR", "WHILE", "FUN", "RETURN", "CLASS", "SUPER", "THIS", "VAR", "SPAWN", "JOIN", "PARALLEL", "REDUCE", "GENERATOR", "YIELD", "IN", "ENDFILE"
 };
 
 void print_tokens(Tokenizer* tokenizer){
@@ -321,7 +511,7 @@ void print_tokens(Tokenizer* tokenizer){
     for (size_t i = 0; i < tokenizer->list_index; i++){
         TokenType t = tokenizer->tokens[i].type;
 
-        printf("[Line %d] %11s: ", 
+        printf("[Line %zu] %11s: ", 
             tokenizer->tokens[i].line, 
             token_strings[t]);
         
@@ -329,8 +519,9 @@ void print_tokens(Tokenizer* tokenizer){
             printf("%c", tokenizer->source[j]);
         }
 
-        t == NUMBER ? 
-            printf(" | literal: %f\n", tokenizer->tokens[i].lit.number) : 
-            printf(" | literal: %s\n", tokenizer->tokens[i].lit.string);
+        if (t == NUMBER) printf(" | literal: %f\n", tokenizer->tokens[i].lit.number);
+        else if (t == INTEGER) printf(" | literal: %lld\n", (long long)tokenizer->tokens[i].lit.integer);
+        else if (t == STRING && tokenizer->tokens[i].lit.string == NULL) printf(" | literal: (inline)\n");
+        else printf(" | literal: %s\n", tokenizer->tokens[i].lit.string);
     }
 }
\ No newline at end of file
@@ -6,13 +6,16 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <stdint.h>
+#include "utils.h"
 
 typedef enum {
     // single-character tokens
     LEFT_PAREN, RIGHT_PAREN,
     LEFT_BRACE, RIGHT_BRACE,
+    LEFT_BRACKET, RIGHT_BRACKET,
     COMMA, DOT, MINUS, PLUS,
-    SEMICOLON, SLASH, STAR,
+    SEMICOLON, SLASH, STAR, PERCENT,
     QMARK, COLON,
     
     // one or two character tokens
@@ -20,17 +23,28 @@ typedef enum {
     GREATER, GREATER_EQUAL, LESS, LESS_EQUAL,
 
     // literals
-    IDENTIFIER, STRING, NUMBER,
+    IDENTIFIER, STRING, NUMBER, INTEGER,
 
     // keywords
     AND, OR, PRINT, IF, ELSE, TRUE, FALSE, NIL,
     FOR, WHILE, FUN, RETURN, CLASS, SUPER, THIS, VAR,
+    SPAWN, JOIN, PARALLEL, REDUCE, GENERATOR, YIELD, IN,
 
     ENDFILE,
 } TokenType;
 
 #define INITIAL_TOKENLIST_SIZE 100
 
+// sources at least this large are split at newlines and tokenized on several threads
+#define PARALLEL_TOKENIZE_SIZE (4 << 20)
+#define MIN_CHUNK_SIZE (64 << 10)
+#define MAX_TOKENIZE_THREADS 16
+
+// strings shorter than this are stored inline in runtime values, including their '\0'
+#define SSO_CAPACITY 16
+#define SSO_MAX (SSO_CAPACITY - 1)
+#define SSO_SLICE 0xFF    // LiteralExpr.sso of a string that points into memory it doesn't own
+
 typedef struct {
     TokenType type;
     size_t line;
@@ -38,8 +52,9 @@ typedef struct {
     size_t count;
     char* source;
     union {
-        char* string;
+        char* string;       // NULL for strings short enough to be stored inline, read them from source
         double number;
+        int64_t integer;
     } lit;
 } Token;
 
@@ -52,6 +67,7 @@ struct node_t {
 };
 
 typedef struct {
+    Context* ctx;
     Token* tokens;
     size_t list_index;
     size_t max_size;
@@ -60,17 +76,31 @@ typedef struct {
     size_t current_char;
     char* source;
     size_t source_len;
+    bool speculative;   // record errors in 'failed' instead of reporting them
+    bool failed;
 
     Node* hashtable[HASHTABLE_SIZE];
 } Tokenizer;
 
-char* read_source_file(const char* file_path);
-Tokenizer* create_tokenizer(char* text);
+char* read_source_file(Context* ctx, const char* file_path);
+Tokenizer* create_tokenizer(Context* ctx, char* text);
+void reset_tokenizer(Tokenizer* tokenizer, char* text);
 void free_tokenizer(Tokenizer* tokenizer);
+void free_token_list(Token* tokens, size_t count);
 
-int get_colum(Token* tok);
+// inline so that compiled scripts can report error columns without the tokenizer
+static inline int get_column(Token* tok){
+    int col;
+    size_t cur = tok->start;
+    for (col = 0; cur-col > 0 && tok->source[cur-col] != '\n'; col++);
+    return col;
+}
 
 void tokenize(Tokenizer* tokenizer);
+// tokenizes source[start, end) with line numbers from line on and adds ENDFILE. False if
+// the last token ran past end (a string, comment or name continuing after it).
+bool tokenize_span(Tokenizer* tokenizer, size_t start, size_t end, size_t line);
+void tokenize_parallel(Tokenizer* tokenizer, int threads);
 void print_tokens(Tokenizer* tokenizer);
 
 #endif //_TOKENIZER_H
@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "utils.h"
+
+struct Trace {
+    FILE* file;
+    pthread_mutex_t lock;
+    struct timespec start;
+    long pid;
+    bool first;
+};
+
+Trace* trace_open(const char* path){
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return NULL;
+    Trace* trace = (Trace*)malloc(sizeof(Trace));
+    if (trace == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't allocate memory for the trace");
+        exit(1);
+    }
+    *trace = (Trace){ .file = file, .pid = (long)getpid(), .first = true };
+    pthread_mutex_init(&trace->lock, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &trace->start);
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    return trace;
+}
+
+bool trace_close(Trace* trace){
+    fputs("\n]}\n", trace->file);
+    bool written = !ferror(trace->file);
+    written = fclose(trace->file) == 0 && written;
+    pthread_mutex_destroy(&trace->lock);
+    free(trace);
+    return written;
+}
+
+static void put_string(FILE* file, const char* text){
+    fputc('"', file);
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++){
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if (*c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// called with the lock held
+static void put_header(Trace* trace, char phase, int tid, const char* name){
+    fputs(trace->first ? "\n" : ",\n", trace->file);
+    trace->first = false;
+    fprintf(trace->file, "{\"ph\":\"%c\",\"pid\":%ld,\"tid\":%d,\"name\":", phase, trace->pid, tid);
+    put_string(trace->file, name);
+}
+
+void trace_event(Trace* trace, char phase, int tid, const char* category, const char* name, const char* args){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double us = (now.tv_sec - trace->start.tv_sec) * 1e6 + (now.tv_nsec - trace->start.tv_nsec) / 1e3;
+    pthread_mutex_lock(&trace->lock);
+    put_header(trace, phase, tid, name);
+    fprintf(trace->file, ",\"cat\":\"%s\",\"ts\":%.3f", category, us);
+    if (args != NULL) fprintf(trace->file, ",\"args\":%s", args);
+    fputc('}', trace->file);
+    pthread_mutex_unlock(&trace->lock);
+}
+
+void trace_thread_name(Trace* trace, int tid, const char* name){
+    pthread_mutex_lock(&trace->lock);
+    put_header(trace, 'M', tid, "thread_name");
+    fputs(",\"args\":{\"name\":", trace->file);
+    put_string(trace->file, name);
+    fputs("}}", trace->file);
+    pthread_mutex_unlock(&trace->lock);
+}
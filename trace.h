@@ -0,0 +1,21 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdbool.h>
+
+// A Chrome/Perfetto trace-event JSON file, open in chrome://tracing or ui.perfetto.dev.
+// Every run of a batch writes to the same trace under its own tid.
+typedef struct Trace Trace;
+
+// NULL if path can't be opened for writing
+Trace* trace_open(const char* path);
+// ends the JSON document, false if it couldn't be written completely
+bool trace_close(Trace* trace);
+
+// phase is 'B' (begin), 'E' (end) or 'C' (counter). args is a JSON object or NULL,
+// name is escaped. The timestamp is taken here, in microseconds since trace_open.
+void trace_event(Trace* trace, char phase, int tid, const char* category, const char* name, const char* args);
+// labels the events of tid, with a script path in plang
+void trace_thread_name(Trace* trace, int tid, const char* name);
+
+#endif // _TRACE_H
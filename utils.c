@@ -0,0 +1,50 @@
+#define _POSIX_C_SOURCE 200809L
+#include "utils.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+static const char* errtypes[] = {"Tokenization Error", "Parse Error", "Runtime Error", "Memory Error"};
+
+Context create_context(FILE* out, FILE* err){
+    return (Context){
+        .hadError = false,
+        .jit = true,
+        .quiet = false,
+        .stack_parse = false,
+        .max_depth = DEFAULT_MAX_DEPTH,
+        .profiler = NULL,
+        .trace = NULL,
+        .trace_tid = 0,
+        .tasks = NULL,
+        .out = out,
+        .err = err
+    };
+}
+
+void plerror(Context* ctx, int line, int col, ErrorType type, const char* message, ...){
+    if (ctx != NULL && ctx->quiet){
+        ctx->hadError = true;
+        return;
+    }
+    FILE* err = ctx != NULL ? ctx->err : stderr;
+    // one message per lock, tasks report errors concurrently
+    flockfile(err);
+    if (line != -1 && col != -1) fprintf(err, "%s [line %d:%d]: ", errtypes[type], line, col);
+    else fprintf(err, "%s : ", errtypes[type]);
+    va_list args;
+    va_start(args, message);
+    vfprintf(err, message, args);
+    va_end(args);
+    fprintf(err, "\n");
+    funlockfile(err);
+    if (ctx != NULL) ctx->hadError = true;
+}
+
+bool integral_value(double d, int64_t* out){
+    // 2^63 is exact as a double, so the range check is exact as well
+    if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0)) return false;
+    int64_t i = (int64_t)d;
+    if ((double)i != d) return false;
+    *out = i;
+    return true;
+}
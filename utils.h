@@ -2,6 +2,9 @@
 #define _UTILS_H
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "memory.h"
 
 typedef enum {
     TOKEN_ERR,
@@ -10,27 +13,31 @@ typedef enum {
     MEMORY_ERR
 } ErrorType;
 
-// static void plerror(int line, enum ErrorType type, const char* message, ...);
-extern bool hadError;
+// nesting budget for --stack-parse and for evaluating expressions
+#define DEFAULT_MAX_DEPTH (1 << 20)
+
+// Per-run state that used to be global: where output and diagnostics go and whether
+// an error occurred. Every program that runs concurrently has its own Context.
+typedef struct {
+    bool hadError;
+    bool jit;           // hot while loops may be compiled to native code
+    bool quiet;         // errors only set hadError, for evaluating speculatively
+    bool stack_parse;   // parse expressions with heap stacks instead of recursion
+    size_t max_depth;   // deepest expression nesting the stack parser and evaluate accept
+    struct Profiler* profiler;  // NULL unless --profile samples this run
+    struct Trace* trace;        // NULL unless --trace records this run
+    int trace_tid;              // which row of the trace the run's events go to
+    struct TaskGroup* tasks;    // tasks spawned by the run, NULL until its first spawn
+    FILE* out;
+    FILE* err;
+} Context;
+
+Context create_context(FILE* out, FILE* err);
+
+// ctx may be NULL for failures outside of any run (allocation failures that exit right after)
+void plerror(Context* ctx, int line, int col, ErrorType type, const char* message, ...);
+
+// true if d is a whole number that fits in an int64_t, which is stored in out
+bool integral_value(double d, int64_t* out);
 
 #endif  //_UTILS_H
-
-#ifdef UTILS_IMPLEMENT
-
-#include <stdarg.h>
-#include <stdlib.h>
-#include <stdio.h>
-
-static char* errtypes[] = {"Tokenization Error", "Parse Error", "Runtime Error", "Memory Error"};
-
-static void plerror(int line, int col, ErrorType type, const char* message, ...){
-    if (line != -1 && col != -1) fprintf(stderr, "%s [line %d:%d]: ", errtypes[type], line, col);
-    else fprintf(stderr, "%s : ", errtypes[type]);
-    va_list args;
-    va_start(args, message);
-    vfprintf(stderr, message, args);
-    va_end(args);
-    fprintf(stderr, "\n");
-    hadError = true;
-}
-#endif
\ No newline at end of file
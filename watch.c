@@ -0,0 +1,288 @@
+#define _POSIX_C_SOURCE 200809L
+#include "watch.h"
+#include "task.h"
+
+Watch* create_watch(Context* ctx){
+    Watch* watch = (Watch*)malloc(sizeof(Watch));
+    if (watch == NULL){
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for watch");
+        exit(1);
+    }
+    *watch = (Watch){ .ctx = ctx };
+    // the keyword table is built once here, every span brings its own token and statement lists
+    watch->tokenizer = create_tokenizer(ctx, "");
+    watch->parser = create_parser(watch->tokenizer);
+    free_token_list(watch->tokenizer->tokens, watch->tokenizer->list_index);
+    watch->tokenizer->tokens = NULL;
+    free_stmt_list(watch->parser->stmt_list);
+    watch->parser->stmt_list = NULL;
+    return watch;
+}
+
+static void release_block(WatchBlock* block){
+    if (--block->users > 0) return;
+    free_token_list(block->tokens, block->token_count);
+    mem_free(MEM_SOURCE, block->text);
+    free(block->printed);
+    mem_free(MEM_TOKENS, block);
+}
+
+static void release_units(WatchUnit* units, size_t count){
+    for (size_t i = 0; i < count; i++){
+        free_stmt(units[i].stmt);
+        release_block(units[i].block);
+    }
+}
+
+void free_watch(Watch* watch){
+    release_units(watch->units, watch->unit_count);
+    free(watch->units);
+    mem_free(MEM_SOURCE, watch->source);
+    free_parser(watch->parser);
+    free_tokenizer(watch->tokenizer);
+    free(watch);
+}
+
+static void reserve_units(WatchUnit** units, size_t* size, size_t count){
+    if (count <= *size) return;
+    size_t grown = *size > 0 ? *size : INITIAL_WATCH_UNITS;
+    while (grown < count) grown *= 2;
+    *units = (WatchUnit*)realloc(*units, sizeof(WatchUnit) * grown);
+    if (*units == NULL){
+        plerror(NULL, -1, -1, MEMORY_ERR, "Couldn't reallocate memory for watch units");
+        exit(1);
+    }
+    *size = grown;
+}
+
+// line number at the start of unit i, where the last token of the unit before it ends
+static size_t line_before(Watch* watch, size_t i){
+    if (i == 0) return 1;
+    WatchUnit* unit = &watch->units[i - 1];
+    return unit->block->tokens[unit->first_token + unit->token_count - 1].line;
+}
+
+static void shift_stmt_lines(Stmt* stmt, long delta){
+    stmt->line += delta;
+    switch (stmt->type)
+    {
+    case IF_STMT:
+        shift_stmt_lines(stmt->as.if_stmt.trueBranch, delta);
+        if (stmt->as.if_stmt.falseBranch != NULL) shift_stmt_lines(stmt->as.if_stmt.falseBranch, delta);
+        break;
+    case WHILE_STMT: shift_stmt_lines(stmt->as.while_stmt.body, delta); break;
+    case PARALLEL_STMT: shift_stmt_lines(stmt->as.parallel.body, delta); break;
+    case FOR_IN_STMT: shift_stmt_lines(stmt->as.for_in.body, delta); break;
+    case BLOCK_STMT:
+        for (size_t i = 0; i < stmt->as.block.list->index; i++) shift_stmt_lines(&stmt->as.block.list->statements[i], delta);
+        break;
+    default: break;
+    }
+}
+
+// Tokenizes and parses source[start, end) into units. Fails, keeping nothing, if there
+// were errors or the last token ran on past end.
+static bool parse_span(Watch* watch, char* source, size_t start, size_t end, size_t line,
+    WatchUnit** units, size_t* count){
+    Context* ctx = watch->ctx;
+    Tokenizer* tokenizer = watch->tokenizer;
+    Parser* parser = watch->parser;
+    reset_tokenizer(tokenizer, source);
+    bool exact = tokenize_span(tokenizer, start, end, line);
+    reset_parser(parser);
+
+    size_t size = 0, n = 0, before = 0;
+    *units = NULL;
+    while (parse_declaration(parser)){
+        reserve_units(units, &size, n + 1);
+        (*units)[n++] = (WatchUnit){ .first_token = before, .token_count = parser->current_token - before };
+        before = parser->current_token;
+    }
+    StmtList* list = parser->stmt_list;
+    parser->stmt_list = NULL;
+    if (ctx->hadError || !exact){
+        free_stmt_list(list);
+        free_token_list(tokenizer->tokens, tokenizer->list_index);
+        tokenizer->tokens = NULL;
+        free(*units);
+        return false;
+    }
+
+    // the AST is printed as it was parsed, a normal run prints it before optimize
+    WatchBlock* block = (WatchBlock*)mem_calloc(MEM_TOKENS, 1, sizeof(WatchBlock));
+    size_t printed_len = 0;
+    FILE* printed = block != NULL ? open_memstream(&block->printed, &printed_len) : NULL;
+    if (printed == NULL){
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for watch block");
+        exit(1);
+    }
+    FILE* out = ctx->out;
+    ctx->out = printed;
+    for (size_t i = 0; i < n; i++){
+        (*units)[i].printed = (size_t)ftell(printed);
+        statement_printer(parser, list->statements[i]);
+        (*units)[i].printed_len = (size_t)ftell(printed) - (*units)[i].printed;
+    }
+    ctx->out = out;
+    fclose(printed);
+    optimize(list);
+
+    // from the newline before the span's first line, get_column counts from there
+    size_t base = start;
+    while (base > 0 && source[base - 1] != '\n') base--;
+    if (base > 0) base--;
+    block->text = (char*)mem_alloc(MEM_SOURCE, end - base + 1);
+    if (block->text == NULL){
+        plerror(ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for watch block");
+        exit(1);
+    }
+    memcpy(block->text, source + base, end - base);
+    block->text[end - base] = '\0';
+
+    size_t previous_end = start;
+    for (size_t i = 0; i < n; i++){
+        WatchUnit* unit = &(*units)[i];
+        unit->block = block;
+        unit->stmt = list->statements[i];
+        unit->start = previous_end;
+        unit->end = tokenizer->tokens[unit->first_token + unit->token_count - 1].count;
+        previous_end = unit->end;
+    }
+    for (size_t i = 0; i < tokenizer->list_index; i++){
+        Token* token = &tokenizer->tokens[i];
+        token->source = block->text;
+        token->start -= base;
+        token->count -= base;
+    }
+    block->tokens = tokenizer->tokens;
+    block->token_count = tokenizer->list_index;
+    tokenizer->tokens = NULL;
+    // the statements now belong to the units
+    mem_free(MEM_STMT, list->statements);
+    mem_free(MEM_STMT, list);
+
+    block->users = n > 0 ? n : 1;
+    if (n == 0) release_block(block);
+    *count = n;
+    return true;
+}
+
+// what a unit's operations work on depends on the units before it, so the whole program
+// is inferred again whenever some of it was replaced
+static void infer_units(Watch* watch){
+    size_t n = watch->unit_count;
+    StmtList list = { .index = n, .size = n, .statements = (Stmt*)malloc(sizeof(Stmt) * (n + 1)) };
+    if (list.statements == NULL){
+        plerror(watch->ctx, -1, -1, MEMORY_ERR, "Couldn't allocate memory for watch units");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) list.statements[i] = watch->units[i].stmt;
+    infer_types(&list);
+    free(list.statements);
+}
+
+void watch_update(Watch* watch, char* source){
+    Context* ctx = watch->ctx;
+    size_t len = strlen(source);
+    size_t n = watch->unit_count;
+    // units [first, last) are replaced by what source[start, end) parses to
+    size_t first = 0, last = n, start = 0, end = len;
+    if (watch->clean){
+        char* old = watch->source;
+        size_t old_len = watch->source_len;
+        size_t limit = old_len < len ? old_len : len;
+        // blocks at a time with memcmp, then bytes
+        size_t prefix = 0, suffix = 0;
+        while (prefix + WATCH_COMPARE_BLOCK <= limit && memcmp(old + prefix, source + prefix, WATCH_COMPARE_BLOCK) == 0)
+            prefix += WATCH_COMPARE_BLOCK;
+        while (prefix < limit && old[prefix] == source[prefix]) prefix++;
+        while (suffix + WATCH_COMPARE_BLOCK <= limit - prefix &&
+            memcmp(old + old_len - suffix - WATCH_COMPARE_BLOCK, source + len - suffix - WATCH_COMPARE_BLOCK, WATCH_COMPARE_BLOCK) == 0)
+            suffix += WATCH_COMPARE_BLOCK;
+        while (suffix < limit - prefix && old[old_len - 1 - suffix] == source[len - 1 - suffix]) suffix++;
+        if (prefix == old_len && prefix == len){
+            mem_free(MEM_SOURCE, source);
+            watch->reparsed = 0;
+            return;
+        }
+        // statements end in ';' or '}', which nothing typed after them can extend
+        while (first < n && watch->units[first].end <= prefix) first++;
+        for (last = first; last < n && watch->units[last].start < old_len - suffix; last++);
+        start = first < n ? watch->units[first].start : (n > 0 ? watch->units[n - 1].end : 0);
+        end = last < n ? watch->units[last].start + len - old_len : len;
+    }
+    size_t line = line_before(watch, first);
+
+    WatchUnit* fresh = NULL;
+    size_t fresh_count = 0;
+    bool parsed = false;
+    if (last < n){
+        // a span that doesn't parse on its own may only be the first part of a statement
+        // running on into the units after it, those are parsed again too then
+        bool quiet = ctx->quiet;
+        ctx->quiet = true;
+        parsed = parse_span(watch, source, start, end, line, &fresh, &fresh_count);
+        ctx->quiet = quiet;
+        ctx->hadError = false;
+        if (!parsed){
+            last = n;
+            end = len;
+        }
+    }
+    if (!parsed && !parse_span(watch, source, start, end, line, &fresh, &fresh_count)){
+        release_units(watch->units, n);
+        watch->unit_count = 0;
+        mem_free(MEM_SOURCE, watch->source);
+        watch->source = source;
+        watch->source_len = len;
+        watch->clean = false;
+        watch->reparsed = 0;
+        return;
+    }
+
+    // units after the span only move, their token and statement lines shift with inserted lines
+    long line_delta = (long)watch->tokenizer->current_line - (long)line_before(watch, last);
+    for (size_t i = last; i < n; i++){
+        WatchUnit* unit = &watch->units[i];
+        unit->start = unit->start + len - watch->source_len;
+        unit->end = unit->end + len - watch->source_len;
+        if (line_delta == 0) continue;
+        for (size_t t = unit->first_token; t < unit->first_token + unit->token_count; t++) unit->block->tokens[t].line += line_delta;
+        shift_stmt_lines(&unit->stmt, line_delta);
+    }
+    release_units(watch->units + first, last - first);
+
+    size_t count = first + fresh_count + (n - last);
+    reserve_units(&watch->units, &watch->unit_size, count);
+    memmove(watch->units + first + fresh_count, watch->units + last, sizeof(WatchUnit) * (n - last));
+    if (fresh_count > 0) memcpy(watch->units + first, fresh, sizeof(WatchUnit) * fresh_count);
+    free(fresh);
+    size_t joint = first + fresh_count;
+    if (joint < count) watch->units[joint].start = joint > 0 ? watch->units[joint - 1].end : 0;
+
+    watch->unit_count = count;
+    mem_free(MEM_SOURCE, watch->source);
+    watch->source = source;
+    watch->source_len = len;
+    watch->clean = true;
+    watch->reparsed = fresh_count;
+    infer_units(watch);
+}
+
+void watch_run(Watch* watch){
+    Context* ctx = watch->ctx;
+    if (!watch->clean) return;
+    for (size_t i = 0; i < watch->unit_count; i++){
+        WatchUnit* unit = &watch->units[i];
+        fwrite(unit->block->printed + unit->printed, 1, unit->printed_len, ctx->out);
+    }
+    fprintf(ctx->out, "\n");
+
+    Env* env = create_env(NULL);
+    for (size_t i = 0; i < watch->unit_count; i++){
+        execute(ctx, &watch->units[i].stmt, env);
+    }
+    wait_tasks(ctx);
+    free_env(env);
+    fflush(ctx->out);
+}
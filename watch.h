@@ -0,0 +1,61 @@
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "infer.h"
+#include "optimize.h"
+#include "interpreter.h"
+
+// --watch keeps a script loaded as one unit per top-level statement. A new version is
+// compared with the last one and only the span between their common prefix and suffix
+// is tokenized and parsed again; the statements around it keep their tokens and AST.
+
+#define INITIAL_WATCH_UNITS 64
+#define WATCH_COMPARE_BLOCK 256
+
+// The tokens of one tokenized span and the text they point into, shared by the
+// statements parsed from it and freed with the last of them
+typedef struct {
+    char* text;         // begins at a line break, so error columns stay right
+    Token* tokens;
+    size_t token_count;
+    char* printed;      // the AST print of its statements, taken before optimize
+    size_t users;
+} WatchBlock;
+
+typedef struct {
+    WatchBlock* block;
+    size_t first_token;
+    size_t token_count;
+    size_t printed;     // where its AST print starts in block->printed
+    size_t printed_len;
+    size_t start;       // its bytes in the source, from the end of the previous unit
+    size_t end;         // to the end of its last token
+    Stmt stmt;
+} WatchUnit;
+
+typedef struct {
+    Context* ctx;
+    Tokenizer* tokenizer;
+    Parser* parser;
+
+    char* source;       // the version the units were made from
+    size_t source_len;
+    bool clean;         // it tokenized and parsed without errors
+    size_t reparsed;    // statements parsed by the last update
+
+    WatchUnit* units;
+    size_t unit_count;
+    size_t unit_size;
+} Watch;
+
+Watch* create_watch(Context* ctx);
+void free_watch(Watch* watch);
+
+// takes over source, tokenize and parse errors are reported on the Context
+void watch_update(Watch* watch, char* source);
+// prints the AST and interprets the current version in a fresh global Env, like a normal run
+void watch_run(Watch* watch);
+
+#endif // _WATCH_H